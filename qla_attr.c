@@ -1625,9 +1625,22 @@ qla2x00_thermal_temp_show(struct device *dev,
 	struct device_attribute *attr, char *buf)
 {
 	scsi_qla_host_t *vha = shost_priv(class_to_shost(dev));
+	struct scsi_qla_host *base_vha = pci_get_drvdata(vha->hw->pdev);
+	struct qla_stats_cache *sc = &base_vha->stats_cache;
 	uint16_t temp = 0;
 	int rc;
 
+	/* Served from the firmware statistics cache while it is fresh. */
+	mutex_lock(&sc->lock);
+	if (ql2xstats_interval && sc->temp_valid &&
+	    time_before(jiffies, sc->temp_stamp + ql2xstats_interval * HZ)) {
+		temp = sc->temp;
+		sc->hits++;
+		mutex_unlock(&sc->lock);
+		return scnprintf(buf, PAGE_SIZE, "%d\n", temp);
+	}
+	mutex_unlock(&sc->lock);
+
 	mutex_lock(&vha->hw->optrom_mutex);
 	if (qla2x00_chip_is_down(vha)) {
 		mutex_unlock(&vha->hw->optrom_mutex);
@@ -1643,8 +1656,14 @@ qla2x00_thermal_temp_show(struct device *dev,
 
 	rc = qla2x00_get_thermal_temp(vha, &temp);
 	mutex_unlock(&vha->hw->optrom_mutex);
-	if (rc == QLA_SUCCESS)
+	if (rc == QLA_SUCCESS) {
+		mutex_lock(&sc->lock);
+		sc->temp = temp;
+		sc->temp_stamp = jiffies;
+		sc->temp_valid = 1;
+		mutex_unlock(&sc->lock);
 		return scnprintf(buf, PAGE_SIZE, "%d\n", temp);
+	}
 
 done:
 	return scnprintf(buf, PAGE_SIZE, "\n");
@@ -3207,15 +3226,179 @@ qla2x00_issue_lip(struct Scsi_Host *shost)
 	return 0;
 }
 
+/*
+ * Firmware statistics cache.
+ *
+ * Monitoring agents poll fc_host statistics and the private stats BSG every
+ * few seconds on every port.  Rather than issuing GET_LINK_PRIV_STATS (or
+ * GET_LINK_STATUS) for every read, keep one DMA snapshot per physical port
+ * and refresh it at most once per ql2xstats_interval.  While readers keep
+ * polling, a delayed work refreshes the snapshot ahead of them so reads are
+ * served without waiting on the mailbox.  The work stops re-arming once no
+ * reader has shown up for two intervals.
+ */
+static int
+qla2x00_stats_cache_refresh(scsi_qla_host_t *vha)
+{
+	struct qla_stats_cache *sc = &vha->stats_cache;
+	struct qla_hw_data *ha = vha->hw;
+	int rval = QLA_FUNCTION_FAILED;
+
+	lockdep_assert_held(&sc->lock);
+
+	if (test_bit(UNLOADING, &vha->dpc_flags) ||
+	    unlikely(pci_channel_offline(ha->pdev)) ||
+	    qla2x00_chip_is_down(vha))
+		return rval;
+
+	if (!sc->stats) {
+		sc->stats = dma_alloc_coherent(&ha->pdev->dev,
+		    sizeof(*sc->stats), &sc->stats_dma, GFP_KERNEL);
+		if (!sc->stats) {
+			ql_log(ql_log_warn, vha, 0x707d,
+			    "Failed to allocate memory for stats.\n");
+			return rval;
+		}
+	}
+
+	if (IS_FWI2_CAPABLE(ha)) {
+		rval = qla24xx_get_isp_stats(vha, sc->stats, sc->stats_dma, 0);
+	} else if (atomic_read(&vha->loop_state) == LOOP_READY &&
+	    !ha->dpc_active) {
+		/* Must be in a 'READY' state for statistics retrieval. */
+		rval = qla2x00_get_link_status(vha, vha->loop_id,
+		    sc->stats, sc->stats_dma);
+	} else {
+		return rval;
+	}
+
+	sc->fw_calls++;
+	if (rval != QLA_SUCCESS)
+		return rval;
+
+	memcpy(&sc->snap, sc->stats, sizeof(sc->snap));
+	sc->stamp = jiffies;
+	sc->gen++;
+	sc->valid = 1;
+
+	return rval;
+}
+
+static void
+qla2x00_stats_cache_work(struct work_struct *work)
+{
+	struct qla_stats_cache *sc = container_of(to_delayed_work(work),
+	    struct qla_stats_cache, work);
+	scsi_qla_host_t *vha = container_of(sc, scsi_qla_host_t, stats_cache);
+	unsigned long interval = ql2xstats_interval * HZ;
+
+	if (!interval || test_bit(UNLOADING, &vha->dpc_flags))
+		return;
+
+	mutex_lock(&sc->lock);
+	/* A reader may have just refreshed on its own. */
+	if (!sc->valid || time_after_eq(jiffies, sc->stamp + interval / 2))
+		qla2x00_stats_cache_refresh(vha);
+	mutex_unlock(&sc->lock);
+
+	if (time_before(jiffies, READ_ONCE(sc->last_read) + 2 * interval))
+		schedule_delayed_work(&sc->work, interval);
+}
+
+void
+qla2x00_stats_cache_init(scsi_qla_host_t *vha)
+{
+	struct qla_stats_cache *sc = &vha->stats_cache;
+
+	mutex_init(&sc->lock);
+	INIT_DELAYED_WORK(&sc->work, qla2x00_stats_cache_work);
+}
+
+void
+qla2x00_stats_cache_free(scsi_qla_host_t *vha)
+{
+	struct qla_stats_cache *sc = &vha->stats_cache;
+
+	cancel_delayed_work_sync(&sc->work);
+
+	if (sc->stats) {
+		dma_free_coherent(&vha->hw->pdev->dev, sizeof(*sc->stats),
+		    sc->stats, sc->stats_dma);
+		sc->stats = NULL;
+	}
+	sc->valid = 0;
+}
+
+/*
+ * Drop the snapshot after the firmware counters changed underneath it (stats
+ * reset, direct query with options) so the next reader sees fresh values.
+ */
+void
+qla2x00_stats_cache_invalidate(scsi_qla_host_t *vha)
+{
+	struct scsi_qla_host *base_vha = pci_get_drvdata(vha->hw->pdev);
+	struct qla_stats_cache *sc = &base_vha->stats_cache;
+
+	mutex_lock(&sc->lock);
+	sc->valid = 0;
+	sc->temp_valid = 0;
+	mutex_unlock(&sc->lock);
+}
+
+/**
+ * qla2x00_get_cached_stats() - Return the port's firmware link statistics
+ * @vha: HA context (any vha of the port)
+ * @stats: copy of the snapshot, raw firmware layout
+ * @gen: optional, generation of the returned snapshot
+ * @stamp: optional, jiffies at which the snapshot was taken
+ * @force: query the firmware even if the snapshot is still fresh
+ *
+ * Returns QLA_SUCCESS if @stats was filled in.
+ */
+int
+qla2x00_get_cached_stats(scsi_qla_host_t *vha, struct link_statistics *stats,
+	uint64_t *gen, unsigned long *stamp, bool force)
+{
+	struct scsi_qla_host *base_vha = pci_get_drvdata(vha->hw->pdev);
+	struct qla_stats_cache *sc = &base_vha->stats_cache;
+	unsigned long interval = ql2xstats_interval * HZ;
+	int rval = QLA_SUCCESS;
+
+	mutex_lock(&sc->lock);
+	WRITE_ONCE(sc->last_read, jiffies);
+
+	if (force || !interval || !sc->valid ||
+	    time_after_eq(jiffies, sc->stamp + interval))
+		rval = qla2x00_stats_cache_refresh(base_vha);
+	else
+		sc->hits++;
+
+	if (rval == QLA_SUCCESS) {
+		memcpy(stats, &sc->snap, sizeof(*stats));
+		if (gen)
+			*gen = sc->gen;
+		if (stamp)
+			*stamp = sc->stamp;
+	}
+	ql_dbg(ql_dbg_user + ql_dbg_verbose, vha, 0x7102,
+	    "Stats %s: gen %llu rval %x.\n",
+	    force ? "forced" : "cached", sc->gen, rval);
+	mutex_unlock(&sc->lock);
+
+	if (interval && !test_bit(UNLOADING, &base_vha->dpc_flags) &&
+	    !delayed_work_pending(&sc->work))
+		schedule_delayed_work(&sc->work, interval);
+
+	return rval;
+}
+
 static struct fc_host_statistics *
 qla2x00_get_fc_host_stats(struct Scsi_Host *shost)
 {
 	scsi_qla_host_t *vha = shost_priv(shost);
 	struct qla_hw_data *ha = vha->hw;
-	struct scsi_qla_host *base_vha = pci_get_drvdata(ha->pdev);
 	int rval;
 	struct link_statistics *stats;
-	dma_addr_t stats_dma;
 	struct fc_host_statistics *p = &vha->fc_host_stat;
 	struct qla_qpair *qpair;
 	int i;
@@ -3235,24 +3418,14 @@ qla2x00_get_fc_host_stats(struct Scsi_Host *shost)
 	if (qla2x00_chip_is_down(vha))
 		goto done;
 
-	stats = dma_alloc_coherent(&ha->pdev->dev, sizeof(*stats), &stats_dma,
-				   GFP_KERNEL);
+	stats = kmalloc(sizeof(*stats), GFP_KERNEL);
 	if (!stats) {
-		ql_log(ql_log_warn, vha, 0x707d,
+		ql_log(ql_log_warn, vha, 0x7103,
 		    "Failed to allocate memory for stats.\n");
 		goto done;
 	}
 
-	rval = QLA_FUNCTION_FAILED;
-	if (IS_FWI2_CAPABLE(ha)) {
-		rval = qla24xx_get_isp_stats(base_vha, stats, stats_dma, 0);
-	} else if (atomic_read(&base_vha->loop_state) == LOOP_READY &&
-	    !ha->dpc_active) {
-		/* Must be in a 'READY' state for statistics retrieval. */
-		rval = qla2x00_get_link_status(base_vha, base_vha->loop_id,
-						stats, stats_dma);
-	}
-
+	rval = qla2x00_get_cached_stats(vha, stats, NULL, NULL, false);
 	if (rval != QLA_SUCCESS)
 		goto done_free;
 
@@ -3311,8 +3484,7 @@ qla2x00_get_fc_host_stats(struct Scsi_Host *shost)
 	do_div(p->seconds_since_last_reset, HZ);
 
 done_free:
-	dma_free_coherent(&ha->pdev->dev, sizeof(struct link_statistics),
-	    stats, stats_dma);
+	kfree(stats);
 done:
 	return p;
 }
@@ -3354,6 +3526,8 @@ qla2x00_reset_host_stats(struct Scsi_Host *shost)
 
 		dma_free_coherent(&ha->pdev->dev, sizeof(*stats),
 		    stats, stats_dma);
+
+		qla2x00_stats_cache_invalidate(vha);
 	}
 }
 
@@ -3555,6 +3729,9 @@ vport_queue:
 vport_create_failed_2:
 	qla24xx_disable_vp(vha);
 	qla24xx_deallocate_vp_id(vha);
+	qla2x00_free_work_pool(vha);
+	qla2x00_free_disc_cache(vha);
+	qla24xx_free_purex_pool(vha);
 	scsi_host_put(vha->host);
 	return FC_VPORT_FAILED;
 }
@@ -3572,6 +3749,9 @@ qla24xx_vport_delete(struct fc_vport *fc_vport)
 	    test_bit(FCPORT_UPDATE_NEEDED, &vha->dpc_flags))
 		msleep(1000);
 
+	/* nvmet-fc aborts outstanding commands, the vport must still be up */
+	qla_nvmet_delete(vha);
+
 	qla24xx_disable_vp(vha);
 
 	qla_nvme_delete(vha);
@@ -3595,6 +3775,7 @@ qla24xx_vport_delete(struct fc_vport *fc_vport)
 		ql_dbg(ql_dbg_user, vha, 0x7086,
 		    "Timer for the VP[%d] has stopped\n", vha->vp_idx);
 	}
+	qla_tmo_wheel_stop(vha);
 
 	qla2x00_free_fcports(vha);
 
@@ -3607,6 +3788,7 @@ qla24xx_vport_delete(struct fc_vport *fc_vport)
 	    vha->gnl.ldma);
 
 	vha->gnl.l = NULL;
+	qla24xx_free_gnl_index(vha);
 
 	vfree(vha->scan.l);
 
@@ -3617,6 +3799,9 @@ qla24xx_vport_delete(struct fc_vport *fc_vport)
 	}
 
 	ql_log(ql_log_info, vha, 0x7088, "VP[%d] deleted.\n", id);
+	qla2x00_free_work_pool(vha);
+	qla2x00_free_disc_cache(vha);
+	qla24xx_free_purex_pool(vha);
 	scsi_host_put(vha->host);
 	return 0;
 }
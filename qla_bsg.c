@@ -2365,7 +2365,17 @@ qla2x00_get_priv_stats(bsg_job_t *bsg_job)
 		return -ENOMEM;
 	}
 
-	rval = qla24xx_get_isp_stats(base_vha, stats, stats_dma, options);
+	/*
+	 * Plain reads are served from the statistics cache; any option bits
+	 * (e.g. reset) go to the firmware and invalidate the snapshot.
+	 */
+	if (options) {
+		rval = qla24xx_get_isp_stats(base_vha, stats, stats_dma,
+		    options);
+		qla2x00_stats_cache_invalidate(vha);
+	} else {
+		rval = qla2x00_get_cached_stats(vha, stats, NULL, NULL, false);
+	}
 
 	if (rval == QLA_SUCCESS) {
 		ql_dump_buffer(ql_dbg_user + ql_dbg_verbose, vha, 0x70e5,
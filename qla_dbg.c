@@ -11,7 +11,7 @@
  * ----------------------------------------------------------------------
  * |             Level            |   Last Value Used  |     Holes	|
  * ----------------------------------------------------------------------
- * | Module Init and Probe        |       0x0199       |                |
+ * | Module Init and Probe        |       0x019a       |                |
  * | Mailbox commands             |       0x1206       | 0x11a5-0x11ff	|
  * | Device Discovery             |       0x2134       | 0x210e-0x2115  |
  * |                              |                    | 0x211c-0x2128  |
@@ -66,6 +66,10 @@
 #include "qla_def.h"
 
 #include <linux/delay.h>
+#include <linux/seq_file.h>
+#include <linux/vmalloc.h>
+#include <linux/log2.h>
+#include <asm/local.h>
 
 static uint32_t ql_dbg_offset = 0x800;
 
@@ -2881,3 +2885,160 @@ ql_dbg_qp(uint32_t level, struct qla_qpair *qpair, int32_t id,
 	va_end(va);
 
 }
+
+/*
+ * Per-CPU binary trace ring, see ql_trc() in qla_dbg.h.
+ */
+struct ql_trc_ring {
+	local_t head;
+	u32 mask;
+	struct ql_trc_rec *rec;
+};
+
+static struct ql_trc_ring __percpu *ql_trc_rings;
+
+void
+__ql_trc(uint level, scsi_qla_host_t *vha, uint id, u32 handle,
+    u64 a0, u64 a1, u64 a2)
+{
+	struct ql_trc_ring *ring;
+	struct ql_trc_rec *rec;
+	unsigned long idx;
+
+	/* No ring: say it the slow way rather than lose the message. */
+	if (!ql_trc_rings) {
+		ql_dbg(level, vha, id, "trc hdl=%x %llx %llx %llx\n",
+		    handle, a0, a1, a2);
+		return;
+	}
+
+	ring = get_cpu_ptr(ql_trc_rings);
+	/*
+	 * An interrupt on this CPU may nest a record in between; claiming
+	 * the slot with a local increment keeps both records intact.
+	 */
+	idx = local_inc_return(&ring->head) - 1;
+	rec = &ring->rec[idx & ring->mask];
+
+	WRITE_ONCE(rec->seq, 0);
+	/* pairs with the second smp_rmb() in qla2x00_trc_show() */
+	smp_wmb();
+	rec->ts = local_clock();
+	rec->args[0] = a0;
+	rec->args[1] = a1;
+	rec->args[2] = a2;
+	rec->handle = handle;
+	rec->id = id + ql_dbg_offset;
+	rec->host_no = vha ? vha->host_no : 0xffff;
+	smp_wmb();
+	WRITE_ONCE(rec->seq, (u64)idx + 1);
+
+	put_cpu_ptr(ql_trc_rings);
+}
+
+/**
+ * qla2x00_trc_init() - Allocate the per-CPU trace rings.
+ *
+ * Ring size comes from ql2xtrace_entries, rounded up to a power of two.
+ * A value of zero leaves the ring out; enabled ql_trc() sites then fall
+ * back to a plain ql_dbg() line.
+ */
+int
+qla2x00_trc_init(void)
+{
+	struct ql_trc_ring *ring;
+	unsigned int entries;
+	int cpu;
+
+	if (ql2xtrace_entries <= 0)
+		return 0;
+
+	entries = roundup_pow_of_two(min(ql2xtrace_entries, 1 << 16));
+
+	ql_trc_rings = alloc_percpu(struct ql_trc_ring);
+	if (!ql_trc_rings)
+		goto fail;
+
+	for_each_possible_cpu(cpu) {
+		ring = per_cpu_ptr(ql_trc_rings, cpu);
+		local_set(&ring->head, 0);
+		ring->mask = entries - 1;
+		ring->rec = vzalloc_node(entries * sizeof(struct ql_trc_rec),
+		    cpu_to_node(cpu));
+		if (!ring->rec)
+			goto fail;
+	}
+
+	return 0;
+fail:
+	qla2x00_trc_free();
+	ql_log(ql_log_warn, NULL, 0x019a,
+	    "Unable to allocate trace ring of %u entries, tracing disabled.\n",
+	    entries);
+	return -ENOMEM;
+}
+
+void
+qla2x00_trc_free(void)
+{
+	struct ql_trc_ring __percpu *rings = ql_trc_rings;
+	int cpu;
+
+	if (!rings)
+		return;
+
+	ql_trc_rings = NULL;
+	synchronize_rcu();
+
+	for_each_possible_cpu(cpu)
+		vfree(per_cpu_ptr(rings, cpu)->rec);
+	free_percpu(rings);
+}
+
+/**
+ * qla2x00_trc_show() - Decode trace records of one host into a seq_file.
+ * @s: seq_file of the debugfs node
+ * @vha: host whose records are shown
+ *
+ * One line per record: cpu, sequence, timestamp, message id, handle and
+ * arguments.  Records still being written are skipped.  Sort on the
+ * timestamp column to interleave CPUs.
+ */
+void
+qla2x00_trc_show(struct seq_file *s, scsi_qla_host_t *vha)
+{
+	struct ql_trc_ring *ring;
+	struct ql_trc_rec rec, *slot;
+	unsigned long head, idx, first;
+	int cpu;
+
+	if (!ql_trc_rings) {
+		seq_puts(s, "trace ring disabled, records go to the kernel log\n");
+		return;
+	}
+
+	seq_puts(s, "cpu seq ts_ns id handle arg0 arg1 arg2\n");
+	for_each_possible_cpu(cpu) {
+		ring = per_cpu_ptr(ql_trc_rings, cpu);
+		head = local_read(&ring->head);
+		first = head > ring->mask ? head - ring->mask - 1 : 0;
+
+		for (idx = first; idx != head; idx++) {
+			slot = &ring->rec[idx & ring->mask];
+			if (READ_ONCE(slot->seq) != (u64)idx + 1)
+				continue;
+			smp_rmb();
+			memcpy(&rec, slot, sizeof(rec));
+			smp_rmb();
+			/* rewritten while we copied it: torn, skip */
+			if (READ_ONCE(slot->seq) != (u64)idx + 1)
+				continue;
+			rec.seq = (u64)idx + 1;
+			if (rec.host_no != (u16)vha->host_no)
+				continue;
+			seq_printf(s, "%d %llu %llu %04x %x %llx %llx %llx\n",
+			    cpu, rec.seq, rec.ts, rec.id, rec.handle,
+			    rec.args[0], rec.args[1], rec.args[2]);
+		}
+	}
+}
@@ -413,3 +413,33 @@ ql_mask_match(uint level)
 
 	return (level & ql2xextended_error_logging) == level;
 }
+
+/*
+ * Binary trace ring.
+ *
+ * Hot-path (I/O submit, completion, abort, target CTIO) sites use ql_trc()
+ * instead of ql_dbg().  The level check is done inline at the call site so
+ * the arguments are never evaluated when the level is off, and when it is
+ * on a fixed-size record is written to a per-CPU ring without a lock and
+ * without formatting.  Records are read back through the per-host "trace"
+ * debugfs node.  The message id space is shared with ql_dbg().
+ */
+#define QL_TRC_NARGS	3
+
+struct ql_trc_rec {
+	u64	seq;		/* 0 while the record is being written */
+	u64	ts;		/* local_clock() in ns */
+	u64	args[QL_TRC_NARGS];
+	u32	handle;
+	u16	id;
+	u16	host_no;
+};
+
+extern void __ql_trc(uint, scsi_qla_host_t *, uint, u32, u64, u64, u64);
+
+#define ql_trc(_level, _vha, _id, _handle, _a0, _a1, _a2)		\
+do {									\
+	if (unlikely(ql_mask_match(_level)))				\
+		__ql_trc(_level, _vha, _id, _handle, (u64)(_a0),	\
+		    (u64)(_a1), (u64)(_a2));				\
+} while (0)
@@ -26,6 +26,8 @@
 #include <linux/aer.h>
 #include <linux/mutex.h>
 #include <linux/btree.h>
+#include <linux/llist.h>
+#include <linux/hashtable.h>
 
 #include <scsi/scsi.h>
 #include <scsi/scsi_host.h>
@@ -312,12 +314,38 @@ typedef struct auth_els_header_t auth_els_header_t;
 #define MAX_CMDSZ	16		/* SCSI maximum CDB size. */
 #include "qla_fw.h"
 
+/*
+ * Per-completion index over name_list_extended.l[], rebuilt on every GNL
+ * completion.  Hash chains hold entry indices in ascending order.
+ */
+#define QLA_GNL_NONE	0xffff
+struct qla_gnl_index {
+	u16			entries;	/* capacity of l[] */
+	u8			bits;
+	u16			*wwpn_head;	/* 1 << bits */
+	u16			*pid_head;	/* 1 << bits */
+	u16			*wwpn_next;	/* entries */
+	u16			*pid_next;	/* entries */
+	unsigned long		*lid_map;	/* raw nport handles present */
+	unsigned long		*seen;		/* entries matched to an fcport */
+};
+
+struct qla_gnl_stats {
+	u64			count;
+	u64			entries;	/* total entries processed */
+	u64			last_ns;
+	u64			max_ns;
+	u64			total_ns;
+};
+
 struct name_list_extended {
 	struct get_name_list_extended *l;
 	dma_addr_t		ldma;
 	struct list_head	fcports;
 	u32			size;
 	u8			sent;
+	struct qla_gnl_index	*idx;
+	struct qla_gnl_stats	stats;
 };
 
 
@@ -381,6 +409,8 @@ struct srb_cmd {
 #define SRB_WAKEUP_ON_COMP		BIT_6
 #define SRB_DIF_BUNDL_DMA_VALID		BIT_7   /* DIF: DMA list valid */
 #define SRB_EDIF_CLEANUP_DELETE		BIT_9
+#define SRB_LOGIN_SLOT			BIT_10	/* holds a login window slot */
+#define SRB_FCP2_CMD			BIT_11	/* counted in fcp2_active_cmds */
 
 
 /* To identify if a srb is of T10-CRC type. @sp => srb_t pointer */
@@ -650,6 +680,7 @@ struct srb_iocb {
 			__le16 comp_status;
 			__le16 req_que_no;
 			struct completion comp;
+			u64 start_ns;	/* direct NVMe abort only */
 		} abt;
 		struct ct_arg ctarg;
 #define MAX_IOCB_MB_REG 28
@@ -688,6 +719,12 @@ struct srb_iocb {
 		struct {
 			struct edif_sa_ctl	*sa_ctl;
 			struct qla_sa_update_frame sa_frame;
+			/* kept clear of sp->u.bsg_job, see qla24xx_sadb_update */
+			struct qla_sa_batch	*batch;
+			u32			batch_idx;
+			u16			comp_sts;
+			u8			status;	/* QL_VND_SA_STAT_* */
+			ktime_t			start;
 		} sa_update;
 		struct {
 			struct {
@@ -708,7 +745,8 @@ struct srb_iocb {
 		} drv_els;
 	} u;
 
-	struct timer_list timer;
+	struct list_head tmo_node;	/* qla_tmo_wheel slot */
+	unsigned long tmo_expires;	/* absolute, in jiffies */
 	void (*timeout)(void *);
 };
 
@@ -741,6 +779,8 @@ struct srb_iocb {
 #define SRB_SA_REPLACE	27
 #define SRB_ELS_RDF	28
 #define SRB_ELS_EDC	29
+#define SRB_NVMET_LS	30
+#define SRB_NVMET_FCP	31
 
 enum {
 	TYPE_SRB,
@@ -1186,6 +1226,50 @@ struct mbx_cmd_32 {
 
 #define	MBX_TOV_SECONDS	30
 
+/*
+ * Mailbox latency accounting, kept per opcode by qla2x00_mailbox_command().
+ * Histogram bucket 0 counts commands under 1ms, bucket n counts
+ * [2^(n-1), 2^n) ms and the last bucket everything slower.
+ */
+#define QLA_MBX_LAT_BUCKETS	16
+#define QLA_MBX_LAT_OPCODES	0x80	/* higher opcodes share one slot */
+
+struct qla_mbx_lat {
+	u64	count;
+	u64	iocb_count;		/* issued through MBX_IOCB_TYPE */
+	u64	total_us;
+	u32	max_us;
+	u32	hist[QLA_MBX_LAT_BUCKETS];
+};
+
+struct qla_mbx_stats {
+	spinlock_t		lock;
+	struct qla_mbx_lat	op[QLA_MBX_LAT_OPCODES + 1];
+};
+
+/*
+ * NVMe abort accounting.  Latency runs from the transport's abort
+ * callback to the ABTS completion and is bucketed as for mailboxes;
+ * only aborts sent on the direct path are timed.
+ */
+struct qla_nvme_abt_cnt {
+	u64	direct;			/* sent from the transport callback */
+	u64	deferred;		/* handed to abort_work */
+	u64	not_found;		/* command already gone */
+	u64	ring_full;		/* requeued to abort_work */
+	u64	doorbells;
+	u64	max_batch;
+	u64	count;			/* completed direct aborts */
+	u64	total_us;
+	u32	max_us;
+	u32	hist[QLA_MBX_LAT_BUCKETS];
+};
+
+struct qla_nvme_abt_stats {
+	spinlock_t		lock;
+	struct qla_nvme_abt_cnt	cnt;
+};
+
 /*
  *  ISP product identification definitions in mailboxes after reset.
  */
@@ -2843,6 +2927,7 @@ typedef struct fc_port {
 #define NVME_PRLI_SP_FIRST_BURST	BIT_0
 
 	uint32_t nvme_first_burst_size;
+#define NVME_FLAG_NVMET_HOST 8	/* has sent an LS to our NVMe target */
 #define NVME_FLAG_REGISTERED 4
 #define NVME_FLAG_DELETING 2
 #define NVME_FLAG_RESETTING 1
@@ -2872,10 +2957,30 @@ typedef struct fc_port {
 	uint8_t fabric_port_name[WWN_SIZE];
 	uint16_t fp_speed;
 
+	/*
+	 * Name-server attributes (GPSC speed) kept across logouts.  Valid
+	 * while rscn_gen and d_id match the stamp below.  FC-4 types need no
+	 * stamp: a non-zero fc4_type is what skips GFF_ID, so QLA_ATTR_FC4
+	 * only marks discovery cache entries.
+	 */
+	uint8_t attr_valid;
+#define QLA_ATTR_SPEED		BIT_0
+#define QLA_ATTR_FC4		BIT_1
+	uint8_t iidma_pending;
+	u32 attr_gen;
+	port_id_t attr_d_id;
+
 	fc_port_type_t port_type;
 
 	atomic_t state;
 	uint32_t flags;
+	atomic_t active_cmds;		/* outstanding SCSI commands */
+	unsigned long work_pend;	/* BIT(qla_work_type) queued */
+
+	/* Session as it was before the last ISP abort, see qla_warm_resume */
+	port_id_t warm_d_id;
+	uint16_t warm_loop_id;
+	uint8_t warm_resume;
 
 	int login_retry;
 
@@ -2892,6 +2997,10 @@ typedef struct fc_port {
 	uint16_t port_id;
 
 	struct nvme_fc_remote_port *nvme_remote_port;
+	/* ABTS SRBs waiting for qla_nvme_abort_flush() */
+	spinlock_t nvme_abt_lock;
+	struct list_head nvme_abt_list;
+	bool nvme_abt_busy;
 
 	unsigned long retry_delay_timestamp;
 	struct qla_tgt_sess *tgt_session;
@@ -2972,8 +3081,8 @@ typedef struct fc_port {
 		// delayed rx delete data structure list
 		uint64_t	tx_bytes;
 		uint64_t	rx_bytes;
-		struct list_head edif_indx_list;
-		spinlock_t  indx_list_lock;  // protects the edif index list
+		spinlock_t  indx_list_lock;  // protects delete_sa_index claims
+		atomic_t	rx_del_pending;	/* armed delayed rx deletes */
 
 		struct list_head tx_sa_list;
 		struct list_head rx_sa_list;
@@ -3578,6 +3687,20 @@ struct fab_scan {
 #define MAX_SCAN_RETRIES 5
 	enum scan_flags_t scan_flags;
 	struct delayed_work scan_work;
+
+	/*
+	 * RSCNs gathered until scan_work runs, protected by vha->work_lock.
+	 * Port-scoped ones are resolved with GPN_ID; anything wider, or an
+	 * overflow of rscn_pid[], falls back to a full fabric scan.
+	 */
+#define QLA_RSCN_COALESCE_MAX 16
+	u32 rscn_pid[QLA_RSCN_COALESCE_MAX];
+	u8 rscn_cnt;
+	u8 rscn_full;
+	u64 rscn_rcvd;
+	u64 rscn_coalesced;
+	u64 full_scans;
+	u64 scans_avoided;
 };
 
 /*
@@ -3808,9 +3931,11 @@ enum qla_work_type {
 
 struct qla_work_evt {
 	struct list_head	list;
+	struct llist_node	lnode;		/* vha->work_q */
 	enum qla_work_type	type;
 	u32			flags;
 #define QLA_EVT_FLAG_FREE	0x1
+#define QLA_EVT_FLAG_POOL	0x2
 
 	union {
 		struct {
@@ -3869,6 +3994,20 @@ struct qla_work_evt {
 	 } u;
 };
 
+/*
+ * Pre-allocated qla_work_evt pool.  A slot is claimed by atomically setting
+ * its bit in 'map', so posting from interrupt context needs neither a lock
+ * nor an allocation; kzalloc(GFP_ATOMIC) is only the overflow path.
+ */
+struct qla_work_pool {
+	struct qla_work_evt	*evt;
+	unsigned long		*map;
+	u32			size;
+	atomic64_t		posted;
+	atomic64_t		deduped;
+	atomic64_t		overflow;
+};
+
 struct qla_chip_state_84xx {
 	struct list_head list;
 	struct kref kref;
@@ -3915,6 +4054,145 @@ struct bidi_statistics {
 	unsigned long long transfer_bytes;
 };
 
+/*
+ * Firmware link statistics cache.  Lives in the base vha (the statistics
+ * are per physical port) and is refreshed by a delayed work while readers
+ * keep polling, so sysfs/BSG readers are served without a mailbox
+ * round-trip.  'gen' bumps on every successful refresh.
+ */
+struct qla_stats_cache {
+	struct mutex		lock;		/* serializes refresh and copies */
+	struct delayed_work	work;
+	struct link_statistics	*stats;		/* DMA target, lazily allocated */
+	dma_addr_t		stats_dma;
+	struct link_statistics	snap;		/* last good snapshot */
+	uint64_t		gen;
+	unsigned long		stamp;		/* jiffies of last good refresh */
+	unsigned long		last_read;	/* jiffies of last reader */
+	uint64_t		fw_calls;
+	uint64_t		hits;
+	uint16_t		temp;
+	unsigned long		temp_stamp;
+	uint8_t			valid;
+	uint8_t			temp_valid;
+};
+
+/*
+ * Fabric login scheduler.  GNL/PLOGI/PRLI/GPDB exchanges hold a slot in
+ * the per-host window (ql2xlogin_window) from issue until their srb is
+ * freed.  Ports that find the window full are held back and restarted
+ * by the next slot release instead of waiting for the DPC relogin tick.
+ */
+enum qla_login_stage {
+	QLA_LOGIN_STAGE_GNL,
+	QLA_LOGIN_STAGE_PLOGI,
+	QLA_LOGIN_STAGE_PRLI,
+	QLA_LOGIN_STAGE_GPDB,
+	QLA_LOGIN_STAGE_MAX
+};
+
+struct qla_login_stage_stats {
+	uint64_t	count;
+	uint64_t	total_ms;
+	uint32_t	max_ms;
+};
+
+struct qla_login_sched {
+	spinlock_t		lock;		/* protects the counters below */
+	atomic_t		inflight;
+	unsigned long		deferred;	/* bit 0: a port was held back */
+	uint32_t		peak;
+	uint64_t		deferrals;
+	unsigned long		linkup_jif;
+	unsigned long		last_online_jif;
+	struct qla_login_stage_stats stage[QLA_LOGIN_STAGE_MAX];
+};
+
+/*
+ * Async srb timeouts.  Every vha keeps one wheel of QLA_TMO_SLOTS buckets
+ * driven by a single timer that ticks every QLA_TMO_TICK jiffies while
+ * anything is queued.  Entries hash by expiry tick, so a bucket can hold
+ * srbs from later revolutions; those are skipped until they are due.
+ */
+#define QLA_TMO_SLOTS	256
+#define QLA_TMO_TICK	(HZ / 10 ? HZ / 10 : 1)
+
+struct qla_tmo_wheel {
+	spinlock_t		lock;		/* innermost; protects all below */
+	struct timer_list	timer;
+	unsigned long		base;		/* jiffy at which slot cur is due */
+	uint32_t		cur;
+	uint32_t		count;
+	uint8_t			armed;
+	uint8_t			dead;
+	uint64_t		added;
+	uint64_t		expired;
+	uint64_t		cancelled;
+	struct list_head	firing;		/* due, handler not yet run */
+	struct list_head	slot[QLA_TMO_SLOTS];
+};
+
+/*
+ * Warm session resumption across ISP abort.  Logged-in fabric sessions are
+ * snapshotted before the chip reset; when the fabric login that follows
+ * the restart hands us back the same N_Port ID, those ports are logged in
+ * again with their old handle at once rather than after GPN_FT and GNL.
+ */
+struct qla_warm_resume {
+	port_id_t	d_id;		/* our N_Port ID at snapshot */
+	uint8_t		pending;
+	uint32_t	snapped;	/* sessions in the last snapshot */
+	uint64_t	resets;		/* snapshots taken */
+	uint64_t	resumed;
+	uint64_t	missed;		/* snapshotted but not resumed */
+};
+
+/* Name-server attribute reuse and iIDMA batching, per vha. */
+struct qla_attr_stats {
+	uint64_t	gpsc_hits;
+	uint64_t	gpsc_misses;
+	uint64_t	invalidated;
+	uint64_t	iidma_batches;
+	uint64_t	iidma_ports;
+};
+
+/*
+ * Name-server attributes of remote ports, keyed by WWPN, that outlive the
+ * fc_port they were learned on.  Only valid while the fabric name is the
+ * one they were learned under.
+ */
+#define QLA_DISC_CACHE_BITS	6
+
+struct qla_disc_ent {
+	struct hlist_node	hnode;
+	struct list_head	lru;
+	uint64_t		wwpn;
+	port_id_t		d_id;
+	uint16_t		fp_speed;
+	uint8_t			fc4_type;
+	uint8_t			fc4_features;
+	uint8_t			valid;		/* QLA_ATTR_* */
+};
+
+struct qla_disc_cache {
+	spinlock_t		lock;
+	struct qla_disc_ent	*ent;
+	uint32_t		size;
+	struct list_head	lru;		/* least recently saved first */
+	DECLARE_HASHTABLE(hash, QLA_DISC_CACHE_BITS);
+	uint64_t		fabric_wwn;
+	port_id_t		reg_d_id;	/* our id at last RFT_ID */
+	uint8_t			reg_valid;
+	uint8_t			reg_nvme;
+
+	uint64_t		hits;
+	uint64_t		misses;
+	uint64_t		saved;
+	uint64_t		flushes;
+	uint64_t		regs_skipped;
+	uint64_t		regs_lost;	/* name server dropped them */
+};
+
 struct qla_tc_param {
 	struct scsi_qla_host *vha;
 	uint32_t blk_sz;
@@ -3923,6 +4201,7 @@ struct qla_tc_param {
 	struct scatterlist *prot_sg;
 	struct crc_context *ctx;
 	uint8_t *ctx_dsd_alloced;
+	struct qla_qpair *qpair;	/* source of DSD lists */
 };
 
 /* Multi queue support */
@@ -4053,11 +4332,25 @@ struct qla_latency_counter {
 };
 #endif
 
+/*
+ * Qpairs split into a SCSI and an NVMe pool (ql2xnvme_qpairs) each get
+ * their share of the firmware IOCBs and exchanges; iocbs_limit and
+ * exch_limit are the pool's, not the HBA's.
+ */
+#define QLA_QP_POOL_SCSI	0
+#define QLA_QP_POOL_NVME	1
+#define QLA_QP_POOLS		2
+
 struct qla_fw_resources {
 	u16 iocbs_total;
 	u16 iocbs_limit;
 	u16 iocbs_qp_limit;
 	u16 iocbs_used;
+	u16 exch_limit;		/* 0 - not enforced */
+	u16 exch_qp_limit;
+	u16 exch_used;
+	u8 pool;		/* QLA_QP_POOL_* */
+	u32 busy;		/* commands refused for lack of budget */
 };
 #define QLA_IOCB_PCT_LIMIT 95
 
@@ -4206,6 +4499,35 @@ struct qla_qpair {
 	struct qla_fw_resources fwres ____cacheline_aligned;
 	u32	cmd_cnt;
 	u32	cmd_completion_cnt;
+
+	/*
+	 * Pre-mapped continuation DSD lists (dl_dma_pool chunks).  Taken
+	 * under qp_lock_ptr on the submit side, returned lock-free from
+	 * completion.  dsd_cache_cnt never exceeds the entries on the list.
+	 */
+	struct llist_head dsd_cache ____cacheline_aligned;
+	atomic_t dsd_cache_cnt;
+	atomic_t dsd_inuse;
+	u32	dsd_cache_miss;
+
+	/* Pre-mapped CRC_2 contexts (dl_dma_pool chunks), same rules. */
+	struct llist_head crc_ctx_cache;
+	atomic_t crc_ctx_cache_cnt;
+	u32	crc_ctx_cache_miss;
+
+	/*
+	 * Command Type 6 contexts with their FCP_CMND buffer attached, for
+	 * the eDIF and P3P submit paths.  Same rules as dsd_cache.
+	 */
+	struct llist_head ct6_cache;
+	atomic_t ct6_cache_cnt;
+	u32	ct6_cache_miss;
+
+	/* qla2x00_abort_all_cmds() drains each qpair on its own CPU */
+	struct work_struct drain_work;
+	u32	drain_last_us;
+	u32	drain_max_us;
+	u64	drains;
 };
 
 /* Place holder for FW buffer parameters */
@@ -4545,6 +4867,9 @@ struct qla_hw_data {
 	uint8_t		max_qpairs;
 	uint8_t		num_qpairs;
 	uint16_t	slow_queue_id;
+	uint16_t	nvme_hwqs;	/* qpairs behind NVMe hw queues */
+	uint16_t	nvme_qpairs;	/* NVMe-only qpairs, 0 - shared */
+	uint16_t	nvme_qpair_base; /* queue_pair_map index of the first */
 	struct qla_qpair *base_qpair;
 	struct qla_npiv_entry *npiv_info;
 	uint16_t	nvram_npiv_size;
@@ -4791,6 +5116,11 @@ struct qla_hw_data {
 	atomic_t	num_pend_mbx_stage1;
 	atomic_t	num_pend_mbx_stage2;
 	atomic_t	num_pend_mbx_stage3;
+	atomic_t	num_pend_mbx_hipri;	/* recovery-critical waiters */
+	wait_queue_head_t mbx_hipri_wq;
+	atomic_t	fcp2_active_cmds;	/* SCSI cmds to FCP2 devices */
+	struct qla_mbx_stats *mbx_stats;
+	struct qla_nvme_abt_stats *nvme_abt_stats;
 	uint16_t	frame_payload_size;
 
 	uint32_t	login_retry_count;
@@ -4891,6 +5221,14 @@ struct qla_hw_data {
 	struct mutex vport_lock;        /* Virtual port synchronization */
 	spinlock_t vport_slock; /* order is hardware_lock, then vport_slock */
 	struct mutex mq_lock;        /* multi-queue synchronization */
+
+	/* parallel qpair drain, serialized by drain_mutex */
+	struct mutex drain_mutex;
+	struct completion drain_done;
+	atomic_t drain_pending;
+	int drain_res;
+	u32 drain_last_us;
+	u32 drain_max_us;
 	struct completion mbx_cmd_comp; /* Serialize mbx access */
 	struct completion mbx_intr_comp;  /* Used for completion notification */
 	struct completion dcbx_comp;	/* For set port config notification */
@@ -4989,6 +5327,16 @@ struct qla_hw_data {
 	struct dentry *dfs_fce;
 	struct dentry *dfs_tgt_counters;
 	struct dentry *dfs_fw_resource_cnt;
+	struct dentry *dfs_trace;
+	struct dentry *dfs_mbx_lat;
+	struct dentry *dfs_nvme_abt;
+	struct dentry *dfs_stats_cache;
+	struct dentry *dfs_disc_stats;
+	struct dentry *dfs_login_sched;
+	struct dentry *dfs_srb_timeouts;
+	struct dentry *dfs_qpair_drain;
+	struct dentry *dfs_nvme_qmap;
+	struct dentry *dfs_edif_sa_stats;
 
 	dma_addr_t	fce_dma;
 	void		*fce;
@@ -5005,6 +5353,7 @@ struct qla_hw_data {
 	uint8_t		model_number[16+1];
 	char		model_desc[80];
 	uint8_t		adapter_id[16+1];
+	uint8_t		boot_port_name[WWN_SIZE];	/* from NVRAM */
 
 	/* Option ROM information. */
 	char		*optrom_buffer;
@@ -5120,9 +5469,6 @@ struct qla_hw_data {
 	struct fw_blob	*hablob;
 	struct qla82xx_legacy_intr_set nx_legacy_intr;
 
-	uint16_t	gbl_dsd_inuse;
-	uint16_t	gbl_dsd_avail;
-	struct list_head gbl_dsd_list;
 #define NUM_DSD_CHAIN 4096
 
 	uint8_t fw_type;
@@ -5199,9 +5545,16 @@ struct qla_hw_data {
 	void *edif_tx_sa_id_map;
 	spinlock_t sadb_fp_lock;
 
-	struct list_head sadb_tx_index_list;
-	struct list_head sadb_rx_index_list;
-	spinlock_t	sadb_lock;       /* protects list */
+	/*
+	 * sadb entries and delayed rx delete entries, indexed by nport
+	 * handle.  Slots are written under sadb_lock; rx delete entries are
+	 * freed through RCU so the completion path can look them up unlocked.
+	 */
+#define EDIF_NPH_TBL_SIZE	MAX_FIBRE_DEVICES_MAX
+	struct edif_sa_index_entry **sadb_tx_tbl;
+	struct edif_sa_index_entry **sadb_rx_tbl;
+	struct edif_list_entry **edif_indx_tbl;
+	spinlock_t	sadb_lock;       /* protects tables */
 	struct els_reject elsrej;
 	u8	edif_post_stop_cnt_down;
 
@@ -5239,10 +5592,14 @@ struct active_regions {
 #define QLA_SET_DATA_RATE_LR	2 /* Set speed and initiate LR */
 
 #define QLA_DEFAULT_PAYLOAD_SIZE	64
+/* payload room of a pooled purex item, one full FC frame */
+#define QLA_PUREX_POOL_PAYLOAD		2112
 /*
  * This item might be allocated with a size > sizeof(struct purex_item).
  * The "size" variable gives the size of the payload (which
  * is variable) starting at "iocb".
+ * "in_use" is the reference count; the last qla24xx_free_purex_item()
+ * hands the item back to wherever it came from.
  */
 struct purex_item {
 	struct list_head list;
@@ -5251,6 +5608,9 @@ struct purex_item {
 			     struct purex_item *pkt);
 	atomic_t in_use;
 	uint16_t size;
+	uint8_t flags;
+#define PUREX_ITEM_POOLED	BIT_0
+#define PUREX_ITEM_FPIN		BIT_1	/* batched by qla27xx_process_fpin_list */
 	struct {
 		uint8_t iocb[64];
 	} iocb;
@@ -5263,7 +5623,10 @@ struct purex_item {
 typedef struct scsi_qla_host {
 	struct list_head list;
 	struct list_head vp_fcports;	/* list of fcports */
-	struct list_head work_list;
+	struct list_head work_list;	/* deferred by do_work (EAGAIN) */
+	struct llist_head work_q;	/* posted, not yet picked up */
+	struct qla_work_pool work_pool;
+	unsigned long work_pend;	/* BIT(qla_work_type) queued */
 	spinlock_t work_lock;
 	struct work_struct iocb_work;
 
@@ -5391,6 +5754,12 @@ typedef struct scsi_qla_host {
 	struct		nvme_fc_local_port *nvme_local_port;
 	struct completion nvme_del_done;
 
+	/* FC-NVMe target, see qla_nvmet.c */
+	struct nvmet_fc_target_port *nvmet_tgtport;
+	struct completion nvmet_del_done;
+	spinlock_t	nvmet_cmd_lock;
+	struct list_head nvmet_cmd_list;
+
 	uint16_t	fcoe_vlan_id;
 	uint16_t	fcoe_fcf_idx;
 	uint8_t		fcoe_vn_port_mac[6];
@@ -5447,6 +5816,12 @@ typedef struct scsi_qla_host {
 	struct fc_host_statistics fc_host_stat;
 	struct qla_statistics qla_stats;
 	struct bidi_statistics bidi_stats;
+	struct qla_stats_cache stats_cache;
+	struct qla_login_sched login_sched;
+	struct qla_tmo_wheel tmo_wheel;
+	struct qla_warm_resume warm;
+	struct qla_attr_stats attr_stats;
+	struct qla_disc_cache disc_cache;
 	atomic_t	vref_count;
 	struct qla8044_reset_template reset_tmplt;
 	uint16_t	bbcr;
@@ -5464,6 +5839,12 @@ typedef struct scsi_qla_host {
 		spinlock_t lock;
 	} purex_list;
 	struct purex_item default_item;
+	/* preallocated purex items, ql2xpurex_pool of them */
+	struct purex_pool {
+		struct list_head free;
+		spinlock_t lock;
+		u32 size;
+	} purex_pool;
 
 	struct name_list_extended gnl;
 	/* Count of active session/fcport */
@@ -5488,6 +5869,8 @@ typedef struct scsi_qla_host {
 	uint64_t short_link_down_cnt;
 
 	struct edif_dbell e_dbell;
+	spinlock_t sa_stats_lock;	/* protects sa_stats */
+	struct qla_edif_sa_stats sa_stats;
 	struct pur_core pur_cinfo;
 
 #ifdef QLA2XXX_LATENCY_MEASURE
@@ -5713,12 +6096,12 @@ typedef struct edif_list_entry {
 	uint16_t handle;			// nport_handle
 	uint32_t update_sa_index;
 	uint32_t delete_sa_index;
-	uint32_t count;				// counter for filtering sa_index
+	atomic_t count;				// counter for filtering sa_index
 #define EDIF_ENTRY_FLAGS_CLEANUP	0x01	// this index is being cleaned up
 	uint32_t flags;				// used by sadb cleanup code
 	fc_port_t *fcport;			// needed by rx delay timer function
 	struct timer_list timer;		// rx delay timer
-	struct list_head next;
+	struct rcu_head rcu;
 } edif_list_entry_t;
 
 #define EDIF_TX_INDX_BASE 512
@@ -5743,7 +6126,6 @@ typedef struct edif_sa_index_entry {
 	sa_index_pair_t sa_pair[2];
 	fc_port_t *fcport;
 	uint16_t handle;
-	struct list_head next;
 } edif_sa_index_entry_t;
 
 
@@ -5939,6 +6321,7 @@ struct ql_vnd_tgt_stats_resp {
 #define is_debug(_bit)		unlikely((ql2xdebug & (_bit)))
 
 #include "qla_target.h"
+#include "qla_nvmet.h"
 #include "qla_gbl.h"
 #include "qla_dbg.h"
 #include "qla_inline.h"
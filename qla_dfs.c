@@ -264,6 +264,35 @@ static const struct file_operations dfs_tgt_port_database_ops = {
 	.release	= single_release,
 };
 
+/* Per-protocol budget when NVMe has queue pairs of its own. */
+static void
+qla_dfs_fw_pools(struct seq_file *s, struct qla_hw_data *ha)
+{
+	static const char * const name[QLA_QP_POOLS] = { "SCSI", "NVMe" };
+	u32 iocbs[QLA_QP_POOLS] = {}, exch[QLA_QP_POOLS] = {};
+	u32 busy[QLA_QP_POOLS] = {}, ilimit[QLA_QP_POOLS] = {};
+	u32 xlimit[QLA_QP_POOLS] = {};
+	struct qla_qpair *qp;
+	u16 i;
+	u8 p;
+
+	for (i = 0; i <= ha->max_qpairs; i++) {
+		qp = i ? ha->queue_pair_map[i - 1] : ha->base_qpair;
+		if (!qp)
+			continue;
+		p = qp->fwres.pool;
+		iocbs[p] += qp->fwres.iocbs_used;
+		exch[p] += qp->fwres.exch_used;
+		busy[p] += qp->fwres.busy;
+		ilimit[p] = qp->fwres.iocbs_limit;
+		xlimit[p] = qp->fwres.exch_limit;
+	}
+
+	for (p = 0; p < QLA_QP_POOLS; p++)
+		seq_printf(s, "Driver: %s pool iocb used[%u/%u] exch used[%u/%u] busy[%u]\n",
+		    name[p], iocbs[p], ilimit[p], exch[p], xlimit[p], busy[p]);
+}
+
 static int
 qla_dfs_fw_resource_cnt_show(struct seq_file *s, void *unused)
 {
@@ -307,6 +336,8 @@ qla_dfs_fw_resource_cnt_show(struct seq_file *s, void *unused)
 
 		seq_printf(s, "Driver: estimate iocb used[%d] high water limit [%d] \n",
 		    iocbs_used, ha->base_qpair->fwres.iocbs_limit);
+		if (ha->nvme_qpairs)
+			qla_dfs_fw_pools(s, ha);
 	}
 
 	return 0;
@@ -705,6 +736,579 @@ static const struct file_operations dfs_fce_ops = {
 	.release	= qla2x00_dfs_fce_release,
 };
 
+static int
+qla2x00_dfs_trace_show(struct seq_file *s, void *unused)
+{
+	scsi_qla_host_t *vha = s->private;
+
+	qla2x00_trc_show(s, vha);
+	return 0;
+}
+
+static int
+qla2x00_dfs_trace_open(struct inode *inode, struct file *file)
+{
+	scsi_qla_host_t *vha = inode->i_private;
+
+	return single_open(file, qla2x00_dfs_trace_show, vha);
+}
+
+static const struct file_operations dfs_trace_ops = {
+	.open		= qla2x00_dfs_trace_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int
+qla_dfs_mbx_lat_show(struct seq_file *s, void *unused)
+{
+	struct scsi_qla_host *vha = s->private;
+	struct qla_mbx_stats *st = vha->hw->mbx_stats;
+	struct qla_mbx_lat lat;
+	unsigned long flags;
+	int i, b;
+
+	if (!st)
+		return 0;
+
+	seq_puts(s, "Mailbox latency (bucket n: < 2^n ms, last: slower)\n");
+	seq_printf(s, "Pending: stage1 %d, recovery-critical %d\n\n",
+	    atomic_read(&vha->hw->num_pend_mbx_stage1),
+	    atomic_read(&vha->hw->num_pend_mbx_hipri));
+	seq_puts(s, "cmd    count      iocb       avg_us     max_us     histogram\n");
+
+	for (i = 0; i <= QLA_MBX_LAT_OPCODES; i++) {
+		spin_lock_irqsave(&st->lock, flags);
+		lat = st->op[i];
+		spin_unlock_irqrestore(&st->lock, flags);
+
+		if (!lat.count)
+			continue;
+
+		if (i == QLA_MBX_LAT_OPCODES)
+			seq_puts(s, "other ");
+		else
+			seq_printf(s, "0x%02x  ", i);
+		seq_printf(s, "%-10llu %-10llu %-10llu %-10u",
+		    lat.count, lat.iocb_count,
+		    div64_u64(lat.total_us, lat.count), lat.max_us);
+		for (b = 0; b < QLA_MBX_LAT_BUCKETS; b++)
+			seq_printf(s, " %u", lat.hist[b]);
+		seq_putc(s, '\n');
+	}
+
+	return 0;
+}
+
+static int
+qla_dfs_mbx_lat_open(struct inode *inode, struct file *file)
+{
+	struct scsi_qla_host *vha = inode->i_private;
+
+	return single_open(file, qla_dfs_mbx_lat_show, vha);
+}
+
+static ssize_t
+qla_dfs_mbx_lat_write(struct file *file, const char __user *buffer,
+    size_t count, loff_t *pos)
+{
+	struct seq_file *s = file->private_data;
+	struct scsi_qla_host *vha = s->private;
+	struct qla_mbx_stats *st = vha->hw->mbx_stats;
+	unsigned long flags;
+
+	/* Any write clears the histograms. */
+	if (st) {
+		spin_lock_irqsave(&st->lock, flags);
+		memset(st->op, 0, sizeof(st->op));
+		spin_unlock_irqrestore(&st->lock, flags);
+	}
+
+	return count;
+}
+
+static const struct file_operations dfs_mbx_lat_ops = {
+	.open		= qla_dfs_mbx_lat_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+	.write		= qla_dfs_mbx_lat_write,
+};
+
+static int
+qla_dfs_nvme_abt_show(struct seq_file *s, void *unused)
+{
+	struct scsi_qla_host *vha = s->private;
+	struct qla_nvme_abt_stats *st = vha->hw->nvme_abt_stats;
+	struct qla_nvme_abt_cnt c;
+	unsigned long flags;
+	int b;
+
+	if (!st)
+		return 0;
+
+	spin_lock_irqsave(&st->lock, flags);
+	c = st->cnt;
+	spin_unlock_irqrestore(&st->lock, flags);
+
+	seq_printf(s, "direct: %llu\n", c.direct);
+	seq_printf(s, "deferred: %llu\n", c.deferred);
+	seq_printf(s, "not found: %llu\n", c.not_found);
+	seq_printf(s, "ring full: %llu\n", c.ring_full);
+	seq_printf(s, "doorbells: %llu\n", c.doorbells);
+	seq_printf(s, "max batch: %llu\n", c.max_batch);
+	seq_printf(s, "completed: %llu\n", c.count);
+	if (c.count)
+		seq_printf(s, "avg_us: %llu\n", div64_u64(c.total_us, c.count));
+	seq_printf(s, "max_us: %u\n", c.max_us);
+	seq_puts(s, "histogram (bucket n: < 2^n ms, last: slower):\n");
+	for (b = 0; b < QLA_MBX_LAT_BUCKETS; b++)
+		seq_printf(s, " %u", c.hist[b]);
+	seq_putc(s, '\n');
+
+	return 0;
+}
+
+static int
+qla_dfs_nvme_abt_open(struct inode *inode, struct file *file)
+{
+	struct scsi_qla_host *vha = inode->i_private;
+
+	return single_open(file, qla_dfs_nvme_abt_show, vha);
+}
+
+static ssize_t
+qla_dfs_nvme_abt_write(struct file *file, const char __user *buffer,
+    size_t count, loff_t *pos)
+{
+	struct seq_file *s = file->private_data;
+	struct scsi_qla_host *vha = s->private;
+	struct qla_nvme_abt_stats *st = vha->hw->nvme_abt_stats;
+	unsigned long flags;
+
+	/* Any write clears the counters. */
+	if (st) {
+		spin_lock_irqsave(&st->lock, flags);
+		memset(&st->cnt, 0, sizeof(st->cnt));
+		spin_unlock_irqrestore(&st->lock, flags);
+	}
+
+	return count;
+}
+
+static const struct file_operations dfs_nvme_abt_ops = {
+	.open		= qla_dfs_nvme_abt_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+	.write		= qla_dfs_nvme_abt_write,
+};
+
+static int
+qla_dfs_stats_cache_show(struct seq_file *s, void *unused)
+{
+	struct scsi_qla_host *vha = s->private;
+	struct qla_stats_cache *sc = &vha->stats_cache;
+
+	mutex_lock(&sc->lock);
+	seq_printf(s, "interval: %d s\n", ql2xstats_interval);
+	seq_printf(s, "valid: %u\n", sc->valid);
+	seq_printf(s, "generation: %llu\n", sc->gen);
+	if (sc->valid)
+		seq_printf(s, "age: %u ms\n",
+		    jiffies_to_msecs(jiffies - sc->stamp));
+	seq_printf(s, "firmware queries: %llu\n", sc->fw_calls);
+	seq_printf(s, "cache hits: %llu\n", sc->hits);
+	mutex_unlock(&sc->lock);
+
+	return 0;
+}
+
+static int
+qla_dfs_stats_cache_open(struct inode *inode, struct file *file)
+{
+	struct scsi_qla_host *vha = inode->i_private;
+
+	return single_open(file, qla_dfs_stats_cache_show, vha);
+}
+
+static ssize_t
+qla_dfs_stats_cache_write(struct file *file, const char __user *buffer,
+    size_t count, loff_t *pos)
+{
+	struct seq_file *s = file->private_data;
+	struct scsi_qla_host *vha = s->private;
+	struct link_statistics *stats;
+	int rval;
+
+	/* Any write forces a firmware refresh of the snapshot. */
+	stats = kmalloc(sizeof(*stats), GFP_KERNEL);
+	if (!stats)
+		return -ENOMEM;
+
+	rval = qla2x00_get_cached_stats(vha, stats, NULL, NULL, true);
+	kfree(stats);
+
+	return rval == QLA_SUCCESS ? count : -EIO;
+}
+
+static const struct file_operations dfs_stats_cache_ops = {
+	.open		= qla_dfs_stats_cache_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+	.write		= qla_dfs_stats_cache_write,
+};
+
+static int
+qla_dfs_disc_stats_show(struct seq_file *s, void *unused)
+{
+	struct scsi_qla_host *vha = s->private;
+	struct fab_scan *scan = &vha->scan;
+	u64 rcvd, coalesced, full, avoided;
+	struct qla_gnl_stats gs;
+	unsigned long flags;
+
+	spin_lock_irqsave(&vha->hw->tgt.sess_lock, flags);
+	gs = vha->gnl.stats;
+	spin_unlock_irqrestore(&vha->hw->tgt.sess_lock, flags);
+
+	spin_lock_irqsave(&vha->work_lock, flags);
+	rcvd = scan->rscn_rcvd;
+	coalesced = scan->rscn_coalesced;
+	full = scan->full_scans;
+	avoided = scan->scans_avoided;
+	spin_unlock_irqrestore(&vha->work_lock, flags);
+
+	seq_printf(s, "rscn received: %llu\n", rcvd);
+	seq_printf(s, "rscn coalesced: %llu\n", coalesced);
+	seq_printf(s, "full fabric scans: %llu\n", full);
+	seq_printf(s, "full scans avoided: %llu\n", avoided);
+
+	seq_printf(s, "work events posted: %llu\n",
+	    (u64)atomic64_read(&vha->work_pool.posted));
+	seq_printf(s, "work events deduplicated: %llu\n",
+	    (u64)atomic64_read(&vha->work_pool.deduped));
+	seq_printf(s, "work events beyond pool: %llu\n",
+	    (u64)atomic64_read(&vha->work_pool.overflow));
+
+	seq_printf(s, "warm resume snapshots: %llu\n", vha->warm.resets);
+	seq_printf(s, "warm resume last snapshot: %u\n", vha->warm.snapped);
+	seq_printf(s, "warm resumed sessions: %llu\n", vha->warm.resumed);
+	seq_printf(s, "warm resume misses: %llu\n", vha->warm.missed);
+
+	seq_printf(s, "gpsc cache hits: %llu\n", vha->attr_stats.gpsc_hits);
+	seq_printf(s, "gpsc cache misses: %llu\n", vha->attr_stats.gpsc_misses);
+	seq_printf(s, "attr cache invalidated: %llu\n",
+	    vha->attr_stats.invalidated);
+	seq_printf(s, "iidma batches: %llu ports: %llu\n",
+	    vha->attr_stats.iidma_batches, vha->attr_stats.iidma_ports);
+
+	seq_printf(s, "disc cache hits: %llu misses: %llu saved: %llu\n",
+	    vha->disc_cache.hits, vha->disc_cache.misses,
+	    vha->disc_cache.saved);
+	seq_printf(s, "disc cache fabric flushes: %llu\n",
+	    vha->disc_cache.flushes);
+	seq_printf(s, "fc4 registrations skipped: %llu lost: %llu\n",
+	    vha->disc_cache.regs_skipped, vha->disc_cache.regs_lost);
+
+	seq_printf(s, "gnl completions: %llu\n", gs.count);
+	seq_printf(s, "gnl entries: %llu\n", gs.entries);
+	seq_printf(s, "last: %llu us\n", div_u64(gs.last_ns, NSEC_PER_USEC));
+	seq_printf(s, "avg: %llu us\n", gs.count ?
+	    div64_u64(gs.total_ns, gs.count * NSEC_PER_USEC) : 0);
+	seq_printf(s, "max: %llu us\n", div_u64(gs.max_ns, NSEC_PER_USEC));
+
+	return 0;
+}
+
+static int
+qla_dfs_disc_stats_open(struct inode *inode, struct file *file)
+{
+	struct scsi_qla_host *vha = inode->i_private;
+
+	return single_open(file, qla_dfs_disc_stats_show, vha);
+}
+
+static const struct file_operations dfs_disc_stats_ops = {
+	.open		= qla_dfs_disc_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int
+qla_dfs_login_sched_show(struct seq_file *s, void *unused)
+{
+	static const char * const stage_name[QLA_LOGIN_STAGE_MAX] = {
+		[QLA_LOGIN_STAGE_GNL]	= "gnl",
+		[QLA_LOGIN_STAGE_PLOGI]	= "plogi",
+		[QLA_LOGIN_STAGE_PRLI]	= "prli",
+		[QLA_LOGIN_STAGE_GPDB]	= "gpdb",
+	};
+	struct scsi_qla_host *vha = s->private;
+	struct qla_login_sched *ls = &vha->login_sched;
+	struct qla_login_stage_stats st[QLA_LOGIN_STAGE_MAX];
+	unsigned long flags;
+	u64 deferrals;
+	int i;
+
+	spin_lock_irqsave(&ls->lock, flags);
+	memcpy(st, ls->stage, sizeof(st));
+	deferrals = ls->deferrals;
+	spin_unlock_irqrestore(&ls->lock, flags);
+
+	seq_printf(s, "window: %d\n", ql2xlogin_window);
+	seq_printf(s, "inflight: %d\n", atomic_read(&ls->inflight));
+	seq_printf(s, "peak: %u\n", READ_ONCE(ls->peak));
+	seq_printf(s, "deferrals: %llu\n", deferrals);
+	if (ls->linkup_jif && time_after_eq(ls->last_online_jif, ls->linkup_jif))
+		seq_printf(s, "linkup to last online: %u ms\n",
+		    jiffies_to_msecs(ls->last_online_jif - ls->linkup_jif));
+
+	seq_puts(s, "\nstage      count     avg(ms)   max(ms)\n");
+	for (i = 0; i < QLA_LOGIN_STAGE_MAX; i++)
+		seq_printf(s, "%-6s %9llu %11llu %9u\n", stage_name[i],
+		    st[i].count,
+		    st[i].count ? div64_u64(st[i].total_ms, st[i].count) : 0,
+		    st[i].max_ms);
+
+	return 0;
+}
+
+static int
+qla_dfs_login_sched_open(struct inode *inode, struct file *file)
+{
+	struct scsi_qla_host *vha = inode->i_private;
+
+	return single_open(file, qla_dfs_login_sched_show, vha);
+}
+
+static const struct file_operations dfs_login_sched_ops = {
+	.open		= qla_dfs_login_sched_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+#define QLA_TMO_TYPES	32
+
+static void
+qla_dfs_srb_timeouts_vha(struct seq_file *s, struct scsi_qla_host *vha)
+{
+	struct qla_tmo_wheel *w = &vha->tmo_wheel;
+	const char *name[QLA_TMO_TYPES] = { NULL };
+	u32 pending[QLA_TMO_TYPES] = { 0 };
+	u64 added, expired, cancelled;
+	unsigned long flags, next = 0;
+	struct srb_iocb *iocb;
+	bool have_next = false;
+	u32 count;
+	srb_t *sp;
+	int i;
+
+	spin_lock_irqsave(&w->lock, flags);
+	for (i = 0; i <= QLA_TMO_SLOTS; i++) {
+		struct list_head *head = i < QLA_TMO_SLOTS ?
+		    &w->slot[i] : &w->firing;
+
+		list_for_each_entry(iocb, head, tmo_node) {
+			sp = container_of(iocb, srb_t, u.iocb_cmd);
+			if (sp->type < QLA_TMO_TYPES) {
+				pending[sp->type]++;
+				name[sp->type] = sp->name;
+			}
+			if (!have_next || time_before(iocb->tmo_expires, next)) {
+				next = iocb->tmo_expires;
+				have_next = true;
+			}
+		}
+	}
+	count = w->count;
+	added = w->added;
+	expired = w->expired;
+	cancelled = w->cancelled;
+	spin_unlock_irqrestore(&w->lock, flags);
+
+	seq_printf(s, "vp %d: pending %u added %llu expired %llu cancelled %llu\n",
+	    vha->vp_idx, count, added, expired, cancelled);
+	if (have_next)
+		seq_printf(s, "  next expiry in %u ms\n",
+		    time_after(next, jiffies) ?
+		    jiffies_to_msecs(next - jiffies) : 0);
+	for (i = 0; i < QLA_TMO_TYPES; i++)
+		if (pending[i])
+			seq_printf(s, "  type %2d %-12s %u\n", i,
+			    name[i] ? name[i] : "-", pending[i]);
+}
+
+static int
+qla_dfs_srb_timeouts_show(struct seq_file *s, void *unused)
+{
+	struct scsi_qla_host *vha = s->private;
+	struct qla_hw_data *ha = vha->hw;
+	struct scsi_qla_host *vp;
+	unsigned long flags;
+
+	spin_lock_irqsave(&ha->vport_slock, flags);
+	list_for_each_entry(vp, &ha->vp_list, list)
+		qla_dfs_srb_timeouts_vha(s, vp);
+	spin_unlock_irqrestore(&ha->vport_slock, flags);
+
+	return 0;
+}
+
+static int
+qla_dfs_srb_timeouts_open(struct inode *inode, struct file *file)
+{
+	struct scsi_qla_host *vha = inode->i_private;
+
+	return single_open(file, qla_dfs_srb_timeouts_show, vha);
+}
+
+static const struct file_operations dfs_srb_timeouts_ops = {
+	.open		= qla_dfs_srb_timeouts_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int
+qla_dfs_qpair_drain_show(struct seq_file *s, void *unused)
+{
+	struct scsi_qla_host *vha = s->private;
+	struct qla_hw_data *ha = vha->hw;
+	struct qla_qpair *qp;
+	int i;
+
+	seq_printf(s, "last: %u us\n", READ_ONCE(ha->drain_last_us));
+	seq_printf(s, "max: %u us\n", READ_ONCE(ha->drain_max_us));
+
+	seq_puts(s, "\nqpair  cpu     drains   last(us)    max(us)\n");
+	mutex_lock(&ha->mq_lock);
+	for (i = -1; i < (int)ha->max_qpairs; i++) {
+		qp = i < 0 ? ha->base_qpair :
+		    ha->queue_pair_map ? ha->queue_pair_map[i] : NULL;
+		if (!qp)
+			continue;
+		seq_printf(s, "%5u %4u %10llu %10u %10u\n", qp->id, qp->cpuid,
+		    qp->drains, qp->drain_last_us, qp->drain_max_us);
+	}
+	mutex_unlock(&ha->mq_lock);
+
+	return 0;
+}
+
+static int
+qla_dfs_qpair_drain_open(struct inode *inode, struct file *file)
+{
+	struct scsi_qla_host *vha = inode->i_private;
+
+	return single_open(file, qla_dfs_qpair_drain_show, vha);
+}
+
+static const struct file_operations dfs_qpair_drain_ops = {
+	.open		= qla_dfs_qpair_drain_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int
+qla_dfs_nvme_qmap_show(struct seq_file *s, void *unused)
+{
+	struct scsi_qla_host *vha = s->private;
+	struct qla_hw_data *ha = vha->hw;
+	const struct cpumask *mask;
+	struct qla_qpair *qp;
+	unsigned int i;
+
+	seq_printf(s, "nvme hw queues: %u\n", ha->nvme_hwqs);
+	seq_printf(s, "nvme-only qpairs: %u\n", ha->nvme_qpairs);
+
+	if (!ha->max_qpairs || !ha->queue_pair_map)
+		return 0;
+
+	seq_puts(s, "\nhwq qpair vector cpu affinity\n");
+	mutex_lock(&ha->mq_lock);
+	for (i = 0; i < ha->nvme_hwqs; i++) {
+		qp = ha->queue_pair_map[(ha->nvme_qpairs ?
+		    ha->nvme_qpair_base : 0) + i];
+		if (!qp || !qp->msix) {
+			seq_printf(s, "%3u     -\n", i + 1);
+			continue;
+		}
+		mask = pci_irq_get_affinity(ha->pdev, qp->msix->entry);
+		if (mask)
+			seq_printf(s, "%3u %5u %6u %3u %*pbl\n", i + 1, qp->id,
+			    qp->msix->vector, qp->cpuid, cpumask_pr_args(mask));
+		else
+			seq_printf(s, "%3u %5u %6u %3u -\n", i + 1, qp->id,
+			    qp->msix->vector, qp->cpuid);
+	}
+	mutex_unlock(&ha->mq_lock);
+
+	return 0;
+}
+
+static int
+qla_dfs_nvme_qmap_open(struct inode *inode, struct file *file)
+{
+	struct scsi_qla_host *vha = inode->i_private;
+
+	return single_open(file, qla_dfs_nvme_qmap_show, vha);
+}
+
+static const struct file_operations dfs_nvme_qmap_ops = {
+	.open		= qla_dfs_nvme_qmap_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int
+qla_dfs_edif_sa_stats_show(struct seq_file *s, void *unused)
+{
+	struct scsi_qla_host *vha = s->private;
+	struct qla_edif_sa_stats snap;
+	unsigned long flags;
+
+	spin_lock_irqsave(&vha->sa_stats_lock, flags);
+	snap = vha->sa_stats;
+	spin_unlock_irqrestore(&vha->sa_stats_lock, flags);
+
+	seq_printf(s, "sa updates: %llu failed: %llu\n", snap.updates,
+	    snap.failed);
+	seq_printf(s, "last: %llu us\n", div_u64(snap.last_ns, NSEC_PER_USEC));
+	seq_printf(s, "avg: %llu us\n", snap.updates ?
+	    div64_u64(snap.total_ns, snap.updates * NSEC_PER_USEC) : 0);
+	seq_printf(s, "max: %llu us\n", div_u64(snap.max_ns, NSEC_PER_USEC));
+	seq_printf(s, "batches: %llu entries: %llu\n", snap.batches,
+	    snap.batch_entries);
+	seq_printf(s, "last batch: %u entries in %llu us (%llu/s)\n",
+	    snap.last_batch_cnt, div_u64(snap.last_batch_ns, NSEC_PER_USEC),
+	    snap.last_batch_ns ? div64_u64((u64)snap.last_batch_cnt *
+		NSEC_PER_SEC, snap.last_batch_ns) : 0);
+
+	return 0;
+}
+
+static int
+qla_dfs_edif_sa_stats_open(struct inode *inode, struct file *file)
+{
+	struct scsi_qla_host *vha = inode->i_private;
+
+	return single_open(file, qla_dfs_edif_sa_stats_show, vha);
+}
+
+static const struct file_operations dfs_edif_sa_stats_ops = {
+	.open		= qla_dfs_edif_sa_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
 static int
 qla_dfs_naqp_show(struct seq_file *s, void *unused)
 {
@@ -822,6 +1426,36 @@ create_nodes:
 	ha->tgt.dfs_tgt_sess = debugfs_create_file("tgt_sess",
 		S_IRUSR, ha->dfs_dir, vha, &dfs_tgt_sess_ops);
 
+	ha->dfs_trace = debugfs_create_file("trace", S_IRUSR, ha->dfs_dir,
+	    vha, &dfs_trace_ops);
+
+	ha->dfs_mbx_lat = debugfs_create_file("mbx_latency", 0600,
+	    ha->dfs_dir, vha, &dfs_mbx_lat_ops);
+
+	ha->dfs_nvme_abt = debugfs_create_file("nvme_abort", 0600,
+	    ha->dfs_dir, vha, &dfs_nvme_abt_ops);
+
+	ha->dfs_stats_cache = debugfs_create_file("stats_cache", 0600,
+	    ha->dfs_dir, vha, &dfs_stats_cache_ops);
+
+	ha->dfs_disc_stats = debugfs_create_file("disc_stats", 0400,
+	    ha->dfs_dir, vha, &dfs_disc_stats_ops);
+
+	ha->dfs_login_sched = debugfs_create_file("login_sched", 0400,
+	    ha->dfs_dir, vha, &dfs_login_sched_ops);
+
+	ha->dfs_srb_timeouts = debugfs_create_file("srb_timeouts", 0400,
+	    ha->dfs_dir, vha, &dfs_srb_timeouts_ops);
+
+	ha->dfs_qpair_drain = debugfs_create_file("qpair_drain", 0400,
+	    ha->dfs_dir, vha, &dfs_qpair_drain_ops);
+
+	ha->dfs_nvme_qmap = debugfs_create_file("nvme_queue_map", 0400,
+	    ha->dfs_dir, vha, &dfs_nvme_qmap_ops);
+
+	ha->dfs_edif_sa_stats = debugfs_create_file("edif_sa_stats", 0400,
+	    ha->dfs_dir, vha, &dfs_edif_sa_stats_ops);
+
 #ifdef QLA2XXX_LATENCY_MEASURE
 	vha->dfs_latency_counters = debugfs_create_file("latency_counters", 0400,
 	    ha->dfs_dir, vha, &dfs_latency_counters_ops);
@@ -881,6 +1515,56 @@ qla2x00_dfs_remove(scsi_qla_host_t *vha)
 		ha->dfs_fce = NULL;
 	}
 
+	if (ha->dfs_trace) {
+		debugfs_remove(ha->dfs_trace);
+		ha->dfs_trace = NULL;
+	}
+
+	if (ha->dfs_mbx_lat) {
+		debugfs_remove(ha->dfs_mbx_lat);
+		ha->dfs_mbx_lat = NULL;
+	}
+
+	if (ha->dfs_nvme_abt) {
+		debugfs_remove(ha->dfs_nvme_abt);
+		ha->dfs_nvme_abt = NULL;
+	}
+
+	if (ha->dfs_stats_cache) {
+		debugfs_remove(ha->dfs_stats_cache);
+		ha->dfs_stats_cache = NULL;
+	}
+
+	if (ha->dfs_disc_stats) {
+		debugfs_remove(ha->dfs_disc_stats);
+		ha->dfs_disc_stats = NULL;
+	}
+
+	if (ha->dfs_login_sched) {
+		debugfs_remove(ha->dfs_login_sched);
+		ha->dfs_login_sched = NULL;
+	}
+
+	if (ha->dfs_srb_timeouts) {
+		debugfs_remove(ha->dfs_srb_timeouts);
+		ha->dfs_srb_timeouts = NULL;
+	}
+
+	if (ha->dfs_qpair_drain) {
+		debugfs_remove(ha->dfs_qpair_drain);
+		ha->dfs_qpair_drain = NULL;
+	}
+
+	if (ha->dfs_nvme_qmap) {
+		debugfs_remove(ha->dfs_nvme_qmap);
+		ha->dfs_nvme_qmap = NULL;
+	}
+
+	if (ha->dfs_edif_sa_stats) {
+		debugfs_remove(ha->dfs_edif_sa_stats);
+		ha->dfs_edif_sa_stats = NULL;
+	}
+
 	if (vha->dfs_rport_root) {
 		debugfs_remove_recursive(vha->dfs_rport_root);
 		vha->dfs_rport_root = NULL;
@@ -12,8 +12,8 @@
 #include <scsi/scsi_tcq.h>
 
 
-static edif_sa_index_entry_t *qla_edif_sadb_find_sa_index_entry(uint16_t nport_handle,
-    struct list_head *sa_list);
+static edif_sa_index_entry_t *qla_edif_sadb_find_sa_index_entry(
+    struct qla_hw_data *ha, uint16_t nport_handle, int dir);
 static uint16_t qla_edif_sadb_get_sa_index(fc_port_t *fcport,
     struct qla_sa_update_frame *sa_frame);
 int qla_edif_sadb_delete_sa_index(fc_port_t *fcport, uint16_t nport_handle,
@@ -24,6 +24,7 @@ extern void qla24xx_process_purex_auth_rjt_iocb(struct scsi_qla_host *, void *);
 
 typedef struct edb_node {
 	struct  list_head	list;
+	struct hlist_node	hnode;		/* e_dbell.pend */
 	uint32_t		ntype;
 	uint32_t		lstate;
 	union {
@@ -58,20 +59,42 @@ const char *sc_to_str(uint16_t cmd)
 //
 // find an edif list entry for an nport_handle
 //
+// The slot is read without a lock; callers outside the rx delete owners
+// must hold rcu_read_lock() across their use of the entry.
+//
 edif_list_entry_t *qla_edif_list_find_sa_index(fc_port_t *fcport,
     uint16_t handle)
 {
-
+	struct qla_hw_data *ha = fcport->vha->hw;
 	edif_list_entry_t *entry;
-	edif_list_entry_t *tentry;
-	struct list_head *indx_list = &fcport->edif.edif_indx_list;
 
-	list_for_each_entry_safe(entry, tentry, indx_list, next) {
-		if (entry->handle == handle) {
-			return entry;
-		}
+	if (!ha->edif_indx_tbl || handle >= EDIF_NPH_TBL_SIZE)
+		return NULL;
+
+	entry = READ_ONCE(ha->edif_indx_tbl[handle]);
+	if (entry && entry->fcport != fcport)
+		return NULL;
+
+	return entry;
+}
+
+//
+// release an edif list entry that is no longer in the table
+//
+static void qla_edif_list_free_entry(fc_port_t *fcport,
+    edif_list_entry_t *entry)
+{
+	unsigned long flags = 0;
+
+	spin_lock_irqsave(&fcport->edif.indx_list_lock, flags);
+	if (entry->delete_sa_index != INVALID_EDIF_SA_INDEX) {
+		entry->delete_sa_index = INVALID_EDIF_SA_INDEX;
+		atomic_dec(&fcport->edif.rx_del_pending);
 	}
-	return NULL;
+	spin_unlock_irqrestore(&fcport->edif.indx_list_lock, flags);
+
+	del_timer(&entry->timer);
+	kfree_rcu(entry, rcu);
 }
 
 
@@ -109,6 +132,7 @@ void qla2x00_sa_replace_iocb_timeout(qla_timer_arg_t t)
 
 		uint16_t delete_sa_index = edif_entry->delete_sa_index;
 		edif_entry->delete_sa_index = INVALID_EDIF_SA_INDEX;
+		atomic_dec(&fcport->edif.rx_del_pending);
 		nport_handle = edif_entry->handle;
 		spin_unlock_irqrestore(&fcport->edif.indx_list_lock, flags);
 
@@ -146,7 +170,8 @@ void qla2x00_sa_replace_iocb_timeout(qla_timer_arg_t t)
 static int qla_edif_list_add_sa_update_index(fc_port_t *fcport,
     uint16_t sa_index, uint16_t handle)
 {
-	edif_list_entry_t *entry;
+	struct qla_hw_data *ha = fcport->vha->hw;
+	edif_list_entry_t *entry, *stale;
 	unsigned long flags = 0;
 
 	//
@@ -155,10 +180,13 @@ static int qla_edif_list_add_sa_update_index(fc_port_t *fcport,
 	entry = qla_edif_list_find_sa_index(fcport,handle);
 	if (entry) {
 		entry->update_sa_index = sa_index;
-		entry->count = 0;
+		atomic_set(&entry->count, 0);
 		return 0;
 	}
 
+	if (!ha->edif_indx_tbl || handle >= EDIF_NPH_TBL_SIZE)
+		return -1;
+
 	//
 	// This is the normal path - there should be no existing entry
 	// when update is called.  The exception is at startup
@@ -170,30 +198,41 @@ static int qla_edif_list_add_sa_update_index(fc_port_t *fcport,
 		return -1;
 	}
 
-	INIT_LIST_HEAD(&entry->next);
 	entry->handle = handle;
 	entry->update_sa_index = sa_index;
 	entry->delete_sa_index = INVALID_EDIF_SA_INDEX;
-	entry->count = 0;
+	atomic_set(&entry->count, 0);
 	entry->flags = 0;
+	entry->fcport = fcport;
 	qla_timer_setup(&entry->timer, qla2x00_sa_replace_iocb_timeout,
 	    			0, entry);
-	spin_lock_irqsave(&fcport->edif.indx_list_lock, flags);
-	list_add_tail(&entry->next, &fcport->edif.edif_indx_list);
-	spin_unlock_irqrestore(&fcport->edif.indx_list_lock, flags);
+
+	//
+	// a slot still held by another session is left over from before the
+	// handle was reassigned
+	//
+	spin_lock_irqsave(&ha->sadb_lock, flags);
+	stale = ha->edif_indx_tbl[handle];
+	smp_store_release(&ha->edif_indx_tbl[handle], entry);
+	spin_unlock_irqrestore(&ha->sadb_lock, flags);
+
+	if (stale)
+		qla_edif_list_free_entry(stale->fcport, stale);
 	return 0;
 }
 
 //
-// remove an entry from the list
+// remove an entry from the table
 //
 static void qla_edif_list_delete_sa_index(fc_port_t *fcport, edif_list_entry_t *entry)
 {
+	struct qla_hw_data *ha = fcport->vha->hw;
 	unsigned long flags = 0;
 
-	spin_lock_irqsave(&fcport->edif.indx_list_lock, flags);
-	list_del(&entry->next);
-	spin_unlock_irqrestore(&fcport->edif.indx_list_lock, flags);
+	spin_lock_irqsave(&ha->sadb_lock, flags);
+	if (ha->edif_indx_tbl[entry->handle] == entry)
+		WRITE_ONCE(ha->edif_indx_tbl[entry->handle], NULL);
+	spin_unlock_irqrestore(&ha->sadb_lock, flags);
 }
 
 
@@ -435,159 +474,174 @@ static void qla_edif_add_sa_index_to_freepool(fc_port_t *fcport, int dir,
 	    "%s: index %d added to free pool\n", __func__, sa_index);
 }
 
+//
+// take the sadb entry owned by fcport out of the table.  It normally sits
+// at fcport->loop_id; fall back to a scan if the handle has moved.
+//
+static edif_sa_index_entry_t *
+qla_edif_sadb_unhook(struct qla_hw_data *ha, fc_port_t *fcport, int dir)
+{
+	edif_sa_index_entry_t **tbl = dir ? ha->sadb_tx_tbl : ha->sadb_rx_tbl;
+	edif_sa_index_entry_t *entry = NULL;
+	unsigned long flags;
+	int h;
+
+	if (!tbl)
+		return NULL;
+
+	spin_lock_irqsave(&ha->sadb_lock, flags);
+	h = fcport->loop_id;
+	if (h >= EDIF_NPH_TBL_SIZE || !tbl[h] || tbl[h]->fcport != fcport) {
+		for (h = 0; h < EDIF_NPH_TBL_SIZE; h++)
+			if (tbl[h] && tbl[h]->fcport == fcport)
+				break;
+	}
+	if (h < EDIF_NPH_TBL_SIZE) {
+		entry = tbl[h];
+		tbl[h] = NULL;
+	}
+	spin_unlock_irqrestore(&ha->sadb_lock, flags);
+
+	return entry;
+}
+
 //
 // find an release all outstanding sadb sa_indicies
 //
 void qla2x00_release_all_sadb(struct scsi_qla_host *vha, struct fc_port *fcport)
 {
-	edif_sa_index_entry_t *entry, *tmp;
+	edif_sa_index_entry_t *entry;
 	int rx_key_cnt = 0;
 	int tx_key_cnt = 0;
 	int i, dir;
 	struct qla_hw_data *ha = vha->hw;
 	edif_list_entry_t *edif_entry;
 	struct  edif_sa_ctl *sa_ctl;
-	unsigned long flags;
 
 	ql_dbg(ql_dbg_edif + ql_dbg_verbose, vha, 0x3063,
 	    "%s: Starting...\n", __func__);
 
-	spin_lock_irqsave(&ha->sadb_lock, flags);
-
-	list_for_each_entry_safe(entry, tmp, &ha->sadb_rx_index_list, next) {
-		if (entry->fcport == fcport) {
-			list_del(&entry->next);
-			spin_unlock_irqrestore(&ha->sadb_lock, flags);
-
-			for (i=0; i<2; i++) {
-				if (entry->sa_pair[i].sa_index != INVALID_EDIF_SA_INDEX) {
-					if(fcport->loop_id != entry->handle) {
-						ql_dbg(ql_dbg_edif, vha, 0x3063,
-						    "%s: ** WARNING %d** entry handle: 0x%x, "
-						    "fcport nport_handle: 0x%x, sa_index: %d\n",
-						    __func__, i, entry->handle,
-						    fcport->loop_id,
-						    entry->sa_pair[i].sa_index);
-					}
-
-					// release the sa_ctl
-					//
-					sa_ctl = qla_edif_find_sa_ctl_by_index(fcport,
-					    entry->sa_pair[i].sa_index , 0);
-					if ((sa_ctl != NULL) &&
-					    (qla_edif_find_sa_ctl_by_index(fcport, sa_ctl->index,
-						0) != NULL)) {
-						ql_dbg(ql_dbg_edif, vha, 0x3063,
-						    "%s: freeing sa_ctl for index %d\n",
-						    __func__, sa_ctl->index);
-						qla_edif_free_sa_ctl(fcport, sa_ctl, sa_ctl->index);
-					} else {
-						ql_dbg(ql_dbg_edif, vha, 0x3063,
-						    "%s: sa_ctl NOT freed, sa_ctl: %px\n",
-						    __func__, sa_ctl);
-
-					}
+	entry = qla_edif_sadb_unhook(ha, fcport, 0);
+	if (entry) {
+		for (i=0; i<2; i++) {
+			if (entry->sa_pair[i].sa_index != INVALID_EDIF_SA_INDEX) {
+				if(fcport->loop_id != entry->handle) {
+					ql_dbg(ql_dbg_edif, vha, 0x3063,
+					    "%s: ** WARNING %d** entry handle: 0x%x, "
+					    "fcport nport_handle: 0x%x, sa_index: %d\n",
+					    __func__, i, entry->handle,
+					    fcport->loop_id,
+					    entry->sa_pair[i].sa_index);
+				}
 
-					// Release the index
-					//
+				// release the sa_ctl
+				//
+				sa_ctl = qla_edif_find_sa_ctl_by_index(fcport,
+				    entry->sa_pair[i].sa_index , 0);
+				if ((sa_ctl != NULL) &&
+				    (qla_edif_find_sa_ctl_by_index(fcport, sa_ctl->index,
+					0) != NULL)) {
+					ql_dbg(ql_dbg_edif, vha, 0x3063,
+					    "%s: freeing sa_ctl for index %d\n",
+					    __func__, sa_ctl->index);
+					qla_edif_free_sa_ctl(fcport, sa_ctl, sa_ctl->index);
+				} else {
 					ql_dbg(ql_dbg_edif, vha, 0x3063,
-					    "%s: freeing sa_index %d, nph: 0x%x\n",
-					    __func__, entry->sa_pair[i].sa_index, entry->handle);
+					    "%s: sa_ctl NOT freed, sa_ctl: %px\n",
+					    __func__, sa_ctl);
 
-					dir = (entry->sa_pair[i].sa_index < EDIF_TX_SA_INDEX_BASE) ? 0 : 1;
-					qla_edif_add_sa_index_to_freepool(fcport, dir,
-					    entry->sa_pair[i].sa_index);
+				}
 
-					//Delete timer on RX
-
-					edif_entry = qla_edif_list_find_sa_index(fcport, entry->handle);
-					if (edif_entry) {
-						ql_dbg(ql_dbg_edif, vha, 0x5033,
-						    "%s: removing edif_entry %px, update_sa_index: 0x%x, delete_sa_index: 0x%x\n",
-						    __func__, edif_entry, edif_entry->update_sa_index  , edif_entry->delete_sa_index);
-						qla_edif_list_delete_sa_index(fcport, edif_entry);
-						// valid delete_sa_index indicates there is a rx delayed delete queued
-						if (edif_entry->delete_sa_index != INVALID_EDIF_SA_INDEX) {
-							del_timer(&edif_entry->timer);
-
-							// build and send the aen
-							fcport->edif.rx_sa_set = 1;
-							fcport->edif.rx_sa_pending = 0;
-							qla_edb_eventcreate(vha,
-							    VND_CMD_AUTH_STATE_SAUPDATE_COMPL,
-							    QL_VND_SA_STAT_SUCCESS,
-							    QL_VND_RX_SA_KEY, fcport);
-						}
-						ql_dbg(ql_dbg_edif, vha, 0x5033,
-						    "%s: releasing edif_entry %px, update_sa_index: 0x%x, delete_sa_index: 0x%x\n",
-						    __func__, edif_entry, edif_entry->update_sa_index  , edif_entry->delete_sa_index);
-
-						kfree(edif_entry);
+				// Release the index
+				//
+				ql_dbg(ql_dbg_edif, vha, 0x3063,
+				    "%s: freeing sa_index %d, nph: 0x%x\n",
+				    __func__, entry->sa_pair[i].sa_index, entry->handle);
+
+				dir = (entry->sa_pair[i].sa_index < EDIF_TX_SA_INDEX_BASE) ? 0 : 1;
+				qla_edif_add_sa_index_to_freepool(fcport, dir,
+				    entry->sa_pair[i].sa_index);
+
+				//Delete timer on RX
+
+				edif_entry = qla_edif_list_find_sa_index(fcport, entry->handle);
+				if (edif_entry) {
+					ql_dbg(ql_dbg_edif, vha, 0x5033,
+					    "%s: removing edif_entry %px, update_sa_index: 0x%x, delete_sa_index: 0x%x\n",
+					    __func__, edif_entry, edif_entry->update_sa_index  , edif_entry->delete_sa_index);
+					qla_edif_list_delete_sa_index(fcport, edif_entry);
+					// valid delete_sa_index indicates there is a rx delayed delete queued
+					if (edif_entry->delete_sa_index != INVALID_EDIF_SA_INDEX) {
+						del_timer(&edif_entry->timer);
+
+						// build and send the aen
+						fcport->edif.rx_sa_set = 1;
+						fcport->edif.rx_sa_pending = 0;
+						qla_edb_eventcreate(vha,
+						    VND_CMD_AUTH_STATE_SAUPDATE_COMPL,
+						    QL_VND_SA_STAT_SUCCESS,
+						    QL_VND_RX_SA_KEY, fcport);
 					}
+					ql_dbg(ql_dbg_edif, vha, 0x5033,
+					    "%s: releasing edif_entry %px, update_sa_index: 0x%x, delete_sa_index: 0x%x\n",
+					    __func__, edif_entry, edif_entry->update_sa_index  , edif_entry->delete_sa_index);
 
-					rx_key_cnt++;
+					qla_edif_list_free_entry(fcport, edif_entry);
 				}
+
+				rx_key_cnt++;
 			}
-			kfree(entry);
-			spin_lock_irqsave(&ha->sadb_lock, flags);
-			break;
 		}
+		kfree(entry);
 	}
 
-	list_for_each_entry_safe(entry, tmp, &ha->sadb_tx_index_list, next) {
-		if (entry->fcport == fcport) {
-			list_del(&entry->next);
-			spin_unlock_irqrestore(&ha->sadb_lock, flags);
-
-			for (i=0; i<2; i++) {
-				if (entry->sa_pair[i].sa_index != INVALID_EDIF_SA_INDEX) {
+	entry = qla_edif_sadb_unhook(ha, fcport, 1);
+	if (entry) {
+		for (i=0; i<2; i++) {
+			if (entry->sa_pair[i].sa_index != INVALID_EDIF_SA_INDEX) {
 
-					if(fcport->loop_id != entry->handle) {
-						ql_dbg(ql_dbg_edif, vha, 0x3063,
-						    "%s: ** WARNING %i** entry handle: 0x%x, "
-						    "fcport nport_handle: 0x%x, sa_index: %d\n",
-						    __func__,i+2, entry->handle,
-						    fcport->loop_id,
-						    entry->sa_pair[i].sa_index );
-					}
+				if(fcport->loop_id != entry->handle) {
+					ql_dbg(ql_dbg_edif, vha, 0x3063,
+					    "%s: ** WARNING %i** entry handle: 0x%x, "
+					    "fcport nport_handle: 0x%x, sa_index: %d\n",
+					    __func__,i+2, entry->handle,
+					    fcport->loop_id,
+					    entry->sa_pair[i].sa_index );
+				}
 
-					// release the sa_ctl
-					//
-					sa_ctl = qla_edif_find_sa_ctl_by_index(fcport,
-					    entry->sa_pair[i].sa_index , SAU_FLG_TX);
-					if ((sa_ctl != NULL) &&
-					    (qla_edif_find_sa_ctl_by_index(fcport, sa_ctl->index,
-						SAU_FLG_TX) != NULL)) {
-						ql_dbg(ql_dbg_edif, vha, 0x3063,
-						    "%s: freeing sa_ctl for index %d\n",
-						    __func__, sa_ctl->index);
-						qla_edif_free_sa_ctl(fcport, sa_ctl, sa_ctl->index);
-					} else {
-						ql_dbg(ql_dbg_edif, vha, 0x3063,
-						    "%s: sa_ctl NOT freed, sa_ctl: %px\n",
-						    __func__, sa_ctl);
+				// release the sa_ctl
+				//
+				sa_ctl = qla_edif_find_sa_ctl_by_index(fcport,
+				    entry->sa_pair[i].sa_index , SAU_FLG_TX);
+				if ((sa_ctl != NULL) &&
+				    (qla_edif_find_sa_ctl_by_index(fcport, sa_ctl->index,
+					SAU_FLG_TX) != NULL)) {
+					ql_dbg(ql_dbg_edif, vha, 0x3063,
+					    "%s: freeing sa_ctl for index %d\n",
+					    __func__, sa_ctl->index);
+					qla_edif_free_sa_ctl(fcport, sa_ctl, sa_ctl->index);
+				} else {
+					ql_dbg(ql_dbg_edif, vha, 0x3063,
+					    "%s: sa_ctl NOT freed, sa_ctl: %px\n",
+					    __func__, sa_ctl);
 
-					}
+				}
 
-					// release the index
-					//
-					ql_dbg(ql_dbg_edif, vha, 0x3063,
-					    "%s: freeing sa_index %d, nph: 0x%x\n",
-					    __func__, entry->sa_pair[i].sa_index, entry->handle);
+				// release the index
+				//
+				ql_dbg(ql_dbg_edif, vha, 0x3063,
+				    "%s: freeing sa_index %d, nph: 0x%x\n",
+				    __func__, entry->sa_pair[i].sa_index, entry->handle);
 
-					dir = (entry->sa_pair[i].sa_index < EDIF_TX_SA_INDEX_BASE) ? 0 : 1;
-					qla_edif_add_sa_index_to_freepool(fcport, dir,
-					    entry->sa_pair[i].sa_index);
+				dir = (entry->sa_pair[i].sa_index < EDIF_TX_SA_INDEX_BASE) ? 0 : 1;
+				qla_edif_add_sa_index_to_freepool(fcport, dir,
+				    entry->sa_pair[i].sa_index);
 
-					tx_key_cnt++;
-				}
+				tx_key_cnt++;
 			}
-			kfree(entry);
-			spin_lock_irqsave(&ha->sadb_lock, flags);
-			break;
 		}
+		kfree(entry);
 	}
-	spin_unlock_irqrestore(&ha->sadb_lock, flags);
 	ql_dbg(ql_dbg_edif, vha, 0x3063,
 	    "%s: %d rx_keys released, %d tx_keys released\n",
 	    __func__, rx_key_cnt, tx_key_cnt);
@@ -624,6 +678,12 @@ qla_edif_app_start(scsi_qla_host_t *vha, bsg_job_t *bsg_job)
 	    __func__, vha->edif_prli_timeout, vha->edif_kshred_timeout);
 
 	if (vha->e_dbell.db_flags != EDB_ACTIVE) {
+		// event nodes must exist before anyone can queue to them
+		if (qla_edb_pool_alloc(vha)) {
+			bsg_job->reply_len = sizeof(struct fc_bsg_reply);
+			SET_DID_STATUS(bsg_reply->result, DID_ERROR);
+			return -ENOMEM;
+		}
 		// mark doorbell as active since an app is now present
 		vha->e_dbell.db_flags = EDB_ACTIVE;
 	} else {
@@ -1291,6 +1351,10 @@ qla_edif_app_mgmt(bsg_job_t *bsg_job)
 		done = false;
 		rval = qla24xx_sadb_update(bsg_job);
 		break;
+	case QL_VND_SC_SA_UPDATE_BATCH:
+		done = false;
+		rval = qla24xx_sadb_update_batch(bsg_job);
+		break;
 	case QL_VND_SC_APP_START:
 		rval = qla_edif_app_start(vha, bsg_job);
 		break;
@@ -1493,105 +1557,85 @@ qla24xx_check_sadb_avail_slot(bsg_job_t *bsg_job, fc_port_t *fcport,
 #define QLA_SA_UPDATE_FLAGS_RX_KEY      0x0
 #define QLA_SA_UPDATE_FLAGS_TX_KEY      0x2
 
-int
-qla24xx_sadb_update(bsg_job_t *bsg_job)
+#define QLA_SA_NEED_IOCB	0
+#define QLA_SA_NO_IOCB		1
+
+/*
+ * Validate one SA update frame and do the sadb/sa_ctl bookkeeping ahead of
+ * its SA_UPDATE IOCB.  Returns QLA_SA_NEED_IOCB when an IOCB must be sent,
+ * QLA_SA_NO_IOCB when the request was fully handled here (rx delete with no
+ * sa_index, delayed rx delete queued), or -EINVAL with *did set to the DID
+ * status to report.
+ */
+static int
+qla_edif_sa_update_prep(scsi_qla_host_t *vha,
+    struct qla_sa_update_frame *sa_frame, fc_port_t **pfcport, int *did)
 {
-	struct	fc_bsg_reply	*bsg_reply = bsg_job->reply;
-	struct Scsi_Host *host = fc_bsg_to_shost(bsg_job);
-	scsi_qla_host_t *vha = shost_priv(host);
 	fc_port_t		*fcport = NULL;
-	srb_t			*sp = NULL;
 	edif_list_entry_t *edif_entry = NULL;
 	int			found = 0;
-	int			rval = 0;
 	int result = 0;
-	struct qla_sa_update_frame sa_frame;
-	struct srb_iocb *iocb_cmd;
-
-
-	ql_dbg(ql_dbg_edif + ql_dbg_verbose, vha, 0x911d,
-	    "%s entered, vha: 0x%px\n", __func__, vha);
-
-	sg_copy_to_buffer(bsg_job->request_payload.sg_list,
-	    bsg_job->request_payload.sg_cnt, &sa_frame,
-	    sizeof(struct qla_sa_update_frame));
-
-	/* Check if host is online */
-	if (!vha->flags.online) {
-		ql_log(ql_log_warn, vha, 0x70a1, "Host is not online\n");
-		rval = -EIO;
-		SET_DID_STATUS(bsg_reply->result, DID_ERROR);
-		goto done;
-	}
-
-	if (vha->e_dbell.db_flags != EDB_ACTIVE) {
-		ql_log(ql_log_warn, vha, 0x70a1, "App not started\n");
-		rval = -EIO;
-		SET_DID_STATUS(bsg_reply->result, DID_ERROR);
-		goto done;
-	}
+	unsigned long flags;
 
-	fcport = qla2x00_find_fcport_by_pid(vha, &sa_frame.port_id);
+	fcport = qla2x00_find_fcport_by_pid(vha, &sa_frame->port_id);
 	if (fcport) {
 		found = 1;
-		if (sa_frame.flags == QLA_SA_UPDATE_FLAGS_TX_KEY)
+		if (sa_frame->flags == QLA_SA_UPDATE_FLAGS_TX_KEY)
 			fcport->edif.tx_bytes = 0;
-		if (sa_frame.flags == QLA_SA_UPDATE_FLAGS_RX_KEY)
+		if (sa_frame->flags == QLA_SA_UPDATE_FLAGS_RX_KEY)
 			fcport->edif.rx_bytes = 0;
 	}
 
+	*pfcport = fcport;
+
 	if (!found) {
 		ql_dbg(ql_dbg_edif, vha, 0x70a3, "Failed to find port= %06x\n",
-		    sa_frame.port_id.b24);
-		rval = -EINVAL;
-		SET_DID_STATUS(bsg_reply->result, DID_TARGET_FAILURE);
-		goto done;
+		    sa_frame->port_id.b24);
+		*did = DID_TARGET_FAILURE;
+		return -EINVAL;
 	}
 
 	/* make sure the nport_handle is valid */
 	if (fcport->loop_id == FC_NO_LOOP_ID) {
 		ql_dbg(ql_dbg_edif, vha, 0x70e1,
 		    "%s: %8phNn lid=FC_NO_LOOP_ID, spi: 0x%x, DS %d, returning NO_CONNECT\n",
-		    __func__, fcport->port_name, sa_frame.spi,
+		    __func__, fcport->port_name, sa_frame->spi,
 		    fcport->disc_state);
-		rval = -EINVAL;
-		SET_DID_STATUS(bsg_reply->result, DID_NO_CONNECT);
-		goto done;
+		*did = DID_NO_CONNECT;
+		return -EINVAL;
 	}
 
 	/* allocate and queue an sa_ctl */
-	result = qla24xx_check_sadb_avail_slot(bsg_job, fcport, &sa_frame);
+	result = qla24xx_check_sadb_avail_slot(fcport, sa_frame);
 
 	// failure of bsg
 	if (result == INVALID_EDIF_SA_INDEX) {
 		ql_dbg(ql_dbg_edif, vha, 0x70e1,
 		    "%s: %8phNn, skipping update.\n",
 		    __func__, fcport->port_name);
-		rval = -EINVAL;
-		SET_DID_STATUS(bsg_reply->result, DID_ERROR);
-		goto done;
+		*did = DID_ERROR;
+		return -EINVAL;
 
 	// rx delete failure
 	} else if (result == RX_DELETE_NO_EDIF_SA_INDEX) {
 		ql_dbg(ql_dbg_edif, vha, 0x70e1,
 		    "%s: %8phNn, skipping rx delete.\n",
 		    __func__, fcport->port_name);
-		SET_DID_STATUS(bsg_reply->result, DID_OK);
-		goto done;
+		return QLA_SA_NO_IOCB;
 	}
 
 	ql_dbg(ql_dbg_edif, vha, 0x70e1,
 	    "%s: %8phNn, sa_index in sa_frame: %d flags %xh\n",
-	    __func__, fcport->port_name, sa_frame.fast_sa_index,
-	    sa_frame.flags);
+	    __func__, fcport->port_name, sa_frame->fast_sa_index,
+	    sa_frame->flags);
 
 	//
 	// looking for rx index and delete
 	//
-	if ( ((sa_frame.flags & SAU_FLG_TX) == 0) &&
-	    (sa_frame.flags & SAU_FLG_INV) ) {
+	if ( ((sa_frame->flags & SAU_FLG_TX) == 0) &&
+	    (sa_frame->flags & SAU_FLG_INV) ) {
 		uint16_t nport_handle = fcport->loop_id;
-		uint16_t sa_index = sa_frame.fast_sa_index;
+		uint16_t sa_index = sa_frame->fast_sa_index;
 
 		//
 		// make sure we have an existing rx key, otherwise just process
@@ -1605,22 +1649,22 @@ qla24xx_sadb_update(bsg_job_t *bsg_job)
 			    "%s: WARNING: no active sa_index for nport_handle 0x%x, "
 			    "forcing delete for sa_index 0x%x\n",
 			    __func__, fcport->loop_id, sa_index);
-			goto force_rx_delete;
+			return QLA_SA_NEED_IOCB;
 		}
 
 		//
 		// if we have a forced delete for rx, remove the sa_index from the edif list
 		// and proceed with normal delete.  The rx delay timer should not be running
 		//
-		if ( (sa_frame.flags & SAU_FLG_FORCE_DELETE) == SAU_FLG_FORCE_DELETE) {
+		if ( (sa_frame->flags & SAU_FLG_FORCE_DELETE) == SAU_FLG_FORCE_DELETE) {
 
 			qla_edif_list_delete_sa_index(fcport, edif_entry);
 			ql_dbg(ql_dbg_edif, vha, 0x911d,
 			    "%s: FORCE DELETE flag found for nport_handle 0x%x, "
 			    "sa_index 0x%x, forcing DELETE\n",
 			    __func__, fcport->loop_id, sa_index);
-			kfree(edif_entry);
-			goto force_rx_delete;
+			qla_edif_list_free_entry(fcport, edif_entry);
+			return QLA_SA_NEED_IOCB;
 		}
 
 		//
@@ -1641,7 +1685,7 @@ qla24xx_sadb_update(bsg_job_t *bsg_job)
 			// free up the sa_ctl that was allocated with the sa_index
 			//
 			sa_ctl = qla_edif_find_sa_ctl_by_index(fcport, sa_index,
-			    (sa_frame.flags & SAU_FLG_TX));
+			    (sa_frame->flags & SAU_FLG_TX));
 			if (sa_ctl != NULL) {
 				ql_dbg(ql_dbg_edif, vha, 0x3063,
 				    "%s: freeing sa_ctl for index %d\n",
@@ -1656,9 +1700,8 @@ qla24xx_sadb_update(bsg_job_t *bsg_job)
 			    __func__, sa_index, nport_handle);
 			qla_edif_sadb_delete_sa_index(fcport, nport_handle, sa_index);
 
-			rval = -EINVAL;
-			SET_DID_STATUS(bsg_reply->result, DID_ERROR);
-			goto done;
+			*did = DID_ERROR;
+			return -EINVAL;
 		}
 
 		/* clean up edif flags/state */
@@ -1694,30 +1737,30 @@ qla24xx_sadb_update(bsg_job_t *bsg_job)
 
 		ql_dbg(ql_dbg_edif, vha, 0x911d,
 		    "%s:  adding delete sa_index %d, vha: 0x%px, nport_handle 0x%x "
-		    "to edif_list. bsg done ptr %px\n",
-		    __func__, sa_index, vha, nport_handle, bsg_job);
+		    "to edif_list\n",
+		    __func__, sa_index, vha, nport_handle);
 
+		spin_lock_irqsave(&fcport->edif.indx_list_lock, flags);
 		edif_entry->delete_sa_index = sa_index;
-
-		bsg_job->reply_len = sizeof(struct fc_bsg_reply);
-		bsg_reply->result = DID_OK << 16;
+		atomic_inc(&fcport->edif.rx_del_pending);
+		spin_unlock_irqrestore(&fcport->edif.indx_list_lock, flags);
 
 		ql_dbg(ql_dbg_edif, vha, 0x911d,
 		    "%s:  SA_DELETE vha: 0x%px  nport_handle: 0x%x  sa_index: %d successfully queued \n",
 		    __func__, vha, fcport->loop_id, sa_index);
-		goto done;
+		return QLA_SA_NO_IOCB;
 
 	//
 	// rx index and update
 	//   add the index to the list and continue with normal update
 	//
-	} else if ( ((sa_frame.flags & SAU_FLG_TX) == 0) &&
-	    ((sa_frame.flags & SAU_FLG_INV) == 0 )) {
+	} else if ( ((sa_frame->flags & SAU_FLG_TX) == 0) &&
+	    ((sa_frame->flags & SAU_FLG_INV) == 0 )) {
 		//
 		// sa_update for rx key
 		//
 		uint32_t nport_handle = fcport->loop_id;
-		uint16_t sa_index = sa_frame.fast_sa_index;
+		uint16_t sa_index = sa_frame->fast_sa_index;
 		int result;
 
 		//
@@ -1738,12 +1781,69 @@ qla24xx_sadb_update(bsg_job_t *bsg_job)
 			    __func__, sa_index, nport_handle);
 		}
 	}
-	if (sa_frame.flags & SAU_FLG_GMAC_MODE)
+	if (sa_frame->flags & SAU_FLG_GMAC_MODE)
 		fcport->edif.aes_gmac = 1;
 	else
 		fcport->edif.aes_gmac = 0;
 
-force_rx_delete:
+	return QLA_SA_NEED_IOCB;
+}
+
+static void
+qla_edif_sa_update_sent(fc_port_t *fcport)
+{
+	/* clean up edif flags/state */
+	fcport->edif.new_sa = 0;			// NOT USED ???
+	fcport->edif.db_sent = 0;			// NOT USED ???
+	fcport->edif.rekey = fcport->edif.reload_value;
+	fcport->edif.rekey_cnt++;
+}
+
+int
+qla24xx_sadb_update(bsg_job_t *bsg_job)
+{
+	struct	fc_bsg_reply	*bsg_reply = bsg_job->reply;
+	struct Scsi_Host *host = fc_bsg_to_shost(bsg_job);
+	scsi_qla_host_t *vha = shost_priv(host);
+	fc_port_t		*fcport = NULL;
+	srb_t			*sp = NULL;
+	int			rval = 0;
+	int			did = DID_ERROR;
+	struct qla_sa_update_frame sa_frame;
+	struct srb_iocb *iocb_cmd;
+
+
+	ql_dbg(ql_dbg_edif + ql_dbg_verbose, vha, 0x911d,
+	    "%s entered, vha: 0x%px\n", __func__, vha);
+
+	sg_copy_to_buffer(bsg_job->request_payload.sg_list,
+	    bsg_job->request_payload.sg_cnt, &sa_frame,
+	    sizeof(struct qla_sa_update_frame));
+
+	/* Check if host is online */
+	if (!vha->flags.online) {
+		ql_log(ql_log_warn, vha, 0x70a1, "Host is not online\n");
+		rval = -EIO;
+		SET_DID_STATUS(bsg_reply->result, DID_ERROR);
+		goto done;
+	}
+
+	if (vha->e_dbell.db_flags != EDB_ACTIVE) {
+		ql_log(ql_log_warn, vha, 0x70a1, "App not started\n");
+		rval = -EIO;
+		SET_DID_STATUS(bsg_reply->result, DID_ERROR);
+		goto done;
+	}
+
+	rval = qla_edif_sa_update_prep(vha, &sa_frame, &fcport, &did);
+	if (rval == QLA_SA_NO_IOCB) {
+		SET_DID_STATUS(bsg_reply->result, DID_OK);
+		goto done;
+	} else if (rval) {
+		SET_DID_STATUS(bsg_reply->result, did);
+		goto done;
+	}
+
 	//
 	// sa_update for both rx and tx keys, sa_delete for tx key
 	// immediately process the request
@@ -1767,6 +1867,7 @@ force_rx_delete:
 	sp->done = qla2x00_bsg_job_done;
 	iocb_cmd = &sp->u.iocb_cmd;
 	iocb_cmd->u.sa_update.sa_frame  = sa_frame;
+	iocb_cmd->u.sa_update.start = ktime_get();
 
 	rval = qla2x00_start_sp(sp);
 	if (rval != QLA_SUCCESS) {
@@ -1780,16 +1881,11 @@ force_rx_delete:
 		goto done;
 	}
 
-	/* clean up edif flags/state */
-	fcport->edif.new_sa = 0;			// NOT USED ???
-	fcport->edif.db_sent = 0;			// NOT USED ???
-	fcport->edif.rekey = fcport->edif.reload_value;
-
 	ql_dbg(ql_dbg_edif, vha, 0x911d,
 	    "%s:  %s sent, hdl=%x, portid=%06x.\n",
 	    __func__, sp->name, sp->handle, fcport->d_id.b24);
 
-	fcport->edif.rekey_cnt++;
+	qla_edif_sa_update_sent(fcport);
 	bsg_job->reply_len = sizeof(struct fc_bsg_reply);
 	SET_DID_STATUS(bsg_reply->result, DID_OK);
 
@@ -1808,6 +1904,233 @@ done:
 	return 0;
 }
 
+static void
+qla_edif_sa_batch_put(struct qla_sa_batch *batch)
+{
+	bsg_job_t *bsg_job = batch->bsg_job;
+	struct fc_bsg_reply *bsg_reply = bsg_job->reply;
+	struct scsi_qla_host *vha = batch->vha;
+	struct qla_edif_sa_stats *st = &vha->sa_stats;
+	u64 elapsed;
+	unsigned long flags;
+	u32 i;
+
+	if (!atomic_dec_and_test(&batch->pending))
+		return;
+
+	for (i = 0; i < batch->rsp.count; i++) {
+		if (batch->rsp.status[i].status == QL_VND_SA_STAT_SUCCESS)
+			batch->rsp.done++;
+		else
+			batch->rsp.failed++;
+	}
+
+	elapsed = ktime_to_ns(ktime_sub(ktime_get(), batch->start));
+	batch->rsp.elapsed_us = div_u64(elapsed, NSEC_PER_USEC);
+
+	spin_lock_irqsave(&vha->sa_stats_lock, flags);
+	st->batches++;
+	st->batch_entries += batch->rsp.count;
+	st->last_batch_cnt = batch->rsp.count;
+	st->last_batch_ns = elapsed;
+	spin_unlock_irqrestore(&vha->sa_stats_lock, flags);
+
+	ql_dbg(ql_dbg_edif, vha, 0x911d,
+	    "%s: sa batch done, %u entries, %u ok, %u failed, %u us\n",
+	    __func__, batch->rsp.count, batch->rsp.done, batch->rsp.failed,
+	    batch->rsp.elapsed_us);
+
+	bsg_reply->reply_payload_rcv_len =
+	    sg_copy_from_buffer(bsg_job->reply_payload.sg_list,
+		bsg_job->reply_payload.sg_cnt, &batch->rsp, batch->rsp_len);
+	bsg_job->reply_len = sizeof(struct fc_bsg_reply);
+	SET_DID_STATUS(bsg_reply->result, DID_OK);
+	kfree(batch);
+
+	bsg_job_done(bsg_job, bsg_reply->result,
+	    bsg_reply->reply_payload_rcv_len);
+}
+
+static void
+qla_edif_sa_batch_fail(struct qla_sa_batch *batch, u32 idx, int did)
+{
+	batch->rsp.status[idx].status = QL_VND_SA_STAT_ERROR;
+	batch->rsp.status[idx].did = did;
+}
+
+/* runs from the response queue with the qpair lock held */
+static void
+qla_edif_sa_batch_sp_done(srb_t *sp, int res)
+{
+	struct qla_sa_batch *batch = sp->u.iocb_cmd.u.sa_update.batch;
+	u32 idx = sp->u.iocb_cmd.u.sa_update.batch_idx;
+	struct qla_sa_update_batch_status *ent = &batch->rsp.status[idx];
+
+	/* no firmware response (abort, chip reset): nothing was installed */
+	if (res != QLA_SUCCESS) {
+		qla_edif_sa_batch_fail(batch, idx, res);
+	} else {
+		ent->status = sp->u.iocb_cmd.u.sa_update.status;
+		ent->comp_sts = sp->u.iocb_cmd.u.sa_update.comp_sts;
+	}
+	ent->latency_us = ktime_us_delta(ktime_get(),
+	    sp->u.iocb_cmd.u.sa_update.start);
+
+	sp->free(sp);
+	qla_edif_sa_batch_put(batch);
+}
+
+/*
+ * QL_VND_SC_SA_UPDATE_BATCH: install or delete many SAs with one bsg call.
+ * Every frame goes through the same checks as QL_VND_SC_SA_UPDATE, then
+ * all SA_UPDATE IOCBs are written to the request ring under one lock hold.
+ * The bsg job completes once the last IOCB is back, with a status entry
+ * per frame.
+ */
+int
+qla24xx_sadb_update_batch(bsg_job_t *bsg_job)
+{
+	struct	fc_bsg_reply	*bsg_reply = bsg_job->reply;
+	struct Scsi_Host *host = fc_bsg_to_shost(bsg_job);
+	scsi_qla_host_t *vha = shost_priv(host);
+	struct qla_sa_update_batch hdr, *req = NULL;
+	struct qla_sa_update_batch_status *ent;
+	struct qla_sa_update_frame *sa_frame;
+	struct qla_sa_batch *batch;
+	fc_port_t *fcport, **fcports = NULL;
+	srb_t **sps = NULL;
+	u32 cnt, i, j, n = 0, req_len, rsp_len;
+	int rval, did, started;
+
+	sg_copy_to_buffer(bsg_job->request_payload.sg_list,
+	    bsg_job->request_payload.sg_cnt, &hdr, sizeof(hdr));
+
+	if (!vha->flags.online) {
+		ql_log(ql_log_warn, vha, 0x70a1, "Host is not online\n");
+		goto fail;
+	}
+
+	if (vha->e_dbell.db_flags != EDB_ACTIVE) {
+		ql_log(ql_log_warn, vha, 0x70a1, "App not started\n");
+		goto fail;
+	}
+
+	cnt = hdr.count;
+	req_len = sizeof(hdr) + cnt * sizeof(struct qla_sa_update_frame);
+	rsp_len = sizeof(struct qla_sa_update_batch_reply) +
+	    cnt * sizeof(struct qla_sa_update_batch_status);
+	if (!cnt || cnt > QL_VND_SA_BATCH_MAX ||
+	    bsg_job->request_payload.payload_len < req_len ||
+	    bsg_job->reply_payload.payload_len < rsp_len) {
+		ql_dbg(ql_dbg_edif, vha, 0x911d,
+		    "%s: bad sa batch, count %u req %u/%u rsp %u/%u\n",
+		    __func__, cnt, bsg_job->request_payload.payload_len,
+		    req_len, bsg_job->reply_payload.payload_len, rsp_len);
+		goto fail;
+	}
+
+	req = kmalloc(req_len, GFP_KERNEL);
+	sps = kcalloc(cnt, sizeof(*sps), GFP_KERNEL);
+	fcports = kcalloc(cnt, sizeof(*fcports), GFP_KERNEL);
+	batch = kzalloc(sizeof(*batch) +
+	    cnt * sizeof(struct qla_sa_update_batch_status), GFP_KERNEL);
+	if (!req || !sps || !fcports || !batch) {
+		kfree(batch);
+		goto fail;
+	}
+
+	sg_copy_to_buffer(bsg_job->request_payload.sg_list,
+	    bsg_job->request_payload.sg_cnt, req, req_len);
+
+	batch->bsg_job = bsg_job;
+	batch->vha = vha;
+	batch->rsp_len = rsp_len;
+	batch->rsp.count = cnt;
+	/* submitter reference, dropped once every IOCB is on the ring */
+	atomic_set(&batch->pending, 1);
+	batch->start = ktime_get();
+
+	for (i = 0; i < cnt; i++) {
+		sa_frame = &req->sa_frame[i];
+		ent = &batch->rsp.status[i];
+		ent->port_id = sa_frame->port_id;
+		ent->flags = sa_frame->flags;
+
+		did = DID_ERROR;
+		rval = qla_edif_sa_update_prep(vha, sa_frame, &fcport, &did);
+		ent->sa_index = sa_frame->fast_sa_index;
+		if (rval == QLA_SA_NO_IOCB) {
+			ent->status = QL_VND_SA_STAT_SUCCESS;
+			continue;
+		} else if (rval) {
+			qla_edif_sa_batch_fail(batch, i, did);
+			continue;
+		}
+
+		sps[n] = qla2x00_get_sp(vha, fcport, GFP_KERNEL);
+		if (!sps[n]) {
+			ql_log(ql_log_warn, vha, 0x70e1,
+			    "qla2x00_get_sp failed.\n");
+			qla_edif_sa_batch_fail(batch, i, DID_IMM_RETRY);
+			continue;
+		}
+
+		sps[n]->type = SRB_SA_UPDATE;
+		sps[n]->name = "bsg_sa_update_batch";
+		sps[n]->free = qla2x00_rel_sp;
+		sps[n]->done = qla_edif_sa_batch_sp_done;
+		sps[n]->u.iocb_cmd.u.sa_update.sa_frame = *sa_frame;
+		sps[n]->u.iocb_cmd.u.sa_update.batch = batch;
+		sps[n]->u.iocb_cmd.u.sa_update.batch_idx = i;
+		sps[n]->u.iocb_cmd.u.sa_update.start = batch->start;
+		/* the sp may be gone by the time its IOCB is known queued */
+		fcports[n] = fcport;
+		n++;
+	}
+
+	atomic_add(n, &batch->pending);
+
+	for (i = 0; i < n; i += started) {
+		started = qla2x00_start_sp_batch(&sps[i], n - i);
+		if (!started)
+			break;
+		/* same rekey accounting as the single-frame path */
+		for (j = i; j < i + started; j++)
+			qla_edif_sa_update_sent(fcports[j]);
+	}
+
+	if (i < n)
+		ql_log(ql_log_warn, vha, 0x70e3,
+		    "%s: %u of %u SA_UPDATE IOCBs not queued.\n",
+		    __func__, n - i, n);
+
+	for (; i < n; i++) {
+		qla_edif_sa_batch_fail(batch,
+		    sps[i]->u.iocb_cmd.u.sa_update.batch_idx, DID_IMM_RETRY);
+		qla2x00_rel_sp(sps[i]);
+		atomic_dec(&batch->pending);
+	}
+
+	ql_dbg(ql_dbg_edif, vha, 0x911d,
+	    "%s: %u sa frames, %u SA_UPDATE IOCBs queued\n",
+	    __func__, cnt, n);
+
+	kfree(fcports);
+	kfree(sps);
+	kfree(req);
+	qla_edif_sa_batch_put(batch);
+	return 0;
+
+fail:
+	kfree(fcports);
+	kfree(sps);
+	kfree(req);
+	bsg_job->reply_len = sizeof(struct fc_bsg_reply);
+	SET_DID_STATUS(bsg_reply->result, DID_ERROR);
+	bsg_job_done(bsg_job, bsg_reply->result,
+	    bsg_reply->reply_payload_rcv_len);
+	return 0;
+}
 
 static void
 qla_enode_free(scsi_qla_host_t *vha, enode_t *node)
@@ -2062,6 +2385,17 @@ qla_els_reject_iocb(scsi_qla_host_t *vha, struct qla_qpair *qp,
 	return 0;
 }
 
+static void
+qla_edb_notify_work(struct work_struct *work)
+{
+	struct edif_dbell *edb = container_of(work, struct edif_dbell,
+	    notify_work);
+	scsi_qla_host_t *vha = container_of(edb, scsi_qla_host_t, e_dbell);
+
+	/* wake poll()/select() sleepers on the doorbell attribute */
+	sysfs_notify(&vha->host->shost_dev.kobj, NULL, "edif_doorbell");
+}
+
 void
 qla_edb_init(scsi_qla_host_t *vha)
 {
@@ -2075,11 +2409,59 @@ qla_edb_init(scsi_qla_host_t *vha)
 	/* initialize lock which protects doorbell & init list */
 	spin_lock_init(&vha->e_dbell.db_lock);
 	INIT_LIST_HEAD(&vha->e_dbell.head);
+	INIT_LIST_HEAD(&vha->e_dbell.free);
+	hash_init(vha->e_dbell.pend);
+	INIT_WORK(&vha->e_dbell.notify_work, qla_edb_notify_work);
+	spin_lock_init(&vha->sa_stats_lock);
 
 	/* create and initialize doorbell */
 	init_completion(&vha->e_dbell.dbell);
 }
 
+/*
+ * Preallocate the event nodes before the doorbell goes active, so event
+ * creation from interrupt context never has to allocate.
+ */
+static int
+qla_edb_pool_alloc(scsi_qla_host_t *vha)
+{
+	struct edif_dbell *edb = &vha->e_dbell;
+	edb_node_t *pool;
+	unsigned long flags;
+	int i, depth = ql2xedif_db_depth;
+
+	if (edb->pool)
+		return 0;
+
+	if (depth < 16)
+		depth = 16;
+
+	pool = kcalloc(depth, sizeof(*pool), GFP_KERNEL);
+	if (!pool) {
+		ql_log(ql_log_warn, vha, 0x09103,
+		    "Unable to allocate %d edif doorbell nodes.\n", depth);
+		return -ENOMEM;
+	}
+
+	spin_lock_irqsave(&edb->db_lock, flags);
+	edb->pool = pool;
+	edb->pool_size = depth;
+	for (i = 0; i < depth; i++) {
+		pool[i].lstate = LSTATE_OFF;
+		list_add_tail(&pool[i].list, &edb->free);
+	}
+	spin_unlock_irqrestore(&edb->db_lock, flags);
+
+	return 0;
+}
+
+static bool
+qla_edb_node_in_pool(struct edif_dbell *edb, edb_node_t *node)
+{
+	return edb->pool && node >= edb->pool &&
+	    node < edb->pool + edb->pool_size;
+}
+
 static void
 qla_edb_node_free(scsi_qla_host_t *vha, edb_node_t *node)
 {
@@ -2103,6 +2485,21 @@ qla_edb_node_free(scsi_qla_host_t *vha, edb_node_t *node)
 	node->ntype = N_UNDEF;
 }
 
+/* return a consumed node to the pool; called with db_lock held */
+static void
+qla_edb_node_put(scsi_qla_host_t *vha, edb_node_t *node)
+{
+	struct edif_dbell *edb = &vha->e_dbell;
+
+	qla_edb_node_free(vha, node);
+	if (qla_edb_node_in_pool(edb, node)) {
+		node->lstate = LSTATE_OFF;
+		list_add(&node->list, &edb->free);
+	} else {
+		kfree(node);
+	}
+}
+
 // function called when app is stopping
 
 void
@@ -2110,12 +2507,13 @@ qla_edb_stop(scsi_qla_host_t *vha)
 {
 	unsigned long flags;
 	struct edb_node *node, *q;
+	edb_node_t *pool;
 
 	if (vha->e_dbell.db_flags != EDB_ACTIVE) {
 		/* doorbell list not enabled */
 		ql_dbg(ql_dbg_edif, vha, 0x09102,
 		    "%s doorbell not enabled\n", __func__);
-		return;
+		goto free_pool;
 	}
 
 	/* grab lock so list doesn't move */
@@ -2126,66 +2524,169 @@ qla_edb_stop(scsi_qla_host_t *vha)
 	list_for_each_entry_safe(node, q, &vha->e_dbell.head, list) {
 		ql_dbg(ql_dbg_edif, vha, 0x910f, "%s freeing edb_node type="
 		    "%x\n", __func__, node->ntype);
-		qla_edb_node_free(vha, node);
 		list_del(&node->list);
-
-		spin_unlock_irqrestore(&vha->e_dbell.db_lock, flags);
-		kfree(node);
-		spin_lock_irqsave(&vha->e_dbell.db_lock, flags);
+		if (!hlist_unhashed(&node->hnode))
+			hash_del(&node->hnode);
+		qla_edb_node_put(vha, node);
 	}
 	spin_unlock_irqrestore(&vha->e_dbell.db_lock, flags);
 
+	ql_dbg(ql_dbg_edif, vha, 0x09104,
+	    "%s doorbell stopped, %u events coalesced, %u pool misses\n",
+	    __func__, vha->e_dbell.coalesced, vha->e_dbell.pool_miss);
+
 	// wake up doorbell waiters - they'll be dismissed with error code
 	complete_all(&vha->e_dbell.dbell);
+
+free_pool:
+	// the notify work is only ever queued once the pool exists
+	if (!vha->e_dbell.pool)
+		return;
+	cancel_work_sync(&vha->e_dbell.notify_work);
+
+	spin_lock_irqsave(&vha->e_dbell.db_lock, flags);
+	pool = vha->e_dbell.pool;
+	vha->e_dbell.pool = NULL;
+	vha->e_dbell.pool_size = 0;
+	INIT_LIST_HEAD(&vha->e_dbell.free);
+	spin_unlock_irqrestore(&vha->e_dbell.db_lock, flags);
+	kfree(pool);
 }
 
+/* take a node from the pool; called with db_lock held */
 static edb_node_t *
 qla_edb_node_alloc(scsi_qla_host_t *vha, uint32_t ntype)
 {
+	struct edif_dbell *edb = &vha->e_dbell;
 	edb_node_t	*node;
 
-	if ((node = (edb_node_t *)
-	    kzalloc(sizeof(edb_node_t), GFP_ATOMIC)) == NULL) {
-		/* couldn't get space */
-		ql_dbg(ql_dbg_edif, vha, 0x9100,
-		    "edb node unable to be allocated\n");
-		return NULL;
+	if (!list_empty(&edb->free)) {
+		node = list_first_entry(&edb->free, edb_node_t, list);
+		list_del(&node->list);
+		memset(node, 0, sizeof(*node));
+	} else {
+		// pool exhausted, don't lose the event
+		edb->pool_miss++;
+		node = kzalloc(sizeof(edb_node_t), GFP_ATOMIC);
+		if (!node) {
+			/* couldn't get space */
+			ql_dbg(ql_dbg_edif, vha, 0x9100,
+			    "edb node unable to be allocated\n");
+			return NULL;
+		}
 	}
 
 	node->lstate = LSTATE_OFF;
 	node->ntype = ntype;
 	INIT_LIST_HEAD(&node->list);
+	INIT_HLIST_NODE(&node->hnode);
 	return node;
 }
 
-
-/* adds a already alllocated enode to the linked list */
+/* state events that only need to be seen once per session */
 static bool
-qla_edb_node_add(scsi_qla_host_t *vha, edb_node_t *ptr)
+qla_edb_coalescible(uint32_t ntype)
 {
-	unsigned long		flags;
+	return ntype == VND_CMD_AUTH_STATE_NEEDED ||
+	    ntype == VND_CMD_AUTH_STATE_SESSION_SHUTDOWN;
+}
 
+static u32
+qla_edb_pend_key(uint32_t ntype, port_id_t id)
+{
+	return (ntype << 24) ^ id.b24;
+}
 
-	if (ptr->lstate != LSTATE_OFF) {
-		ql_dbg(ql_dbg_edif, vha, 0x911a, "%s error, "
-		    "edb node(%px) state=%x\n", __func__, ptr, ptr->lstate);
-		return false;
+static u32
+qla_edb_node_port(edb_node_t *node)
+{
+	switch (node->ntype) {
+	case VND_CMD_AUTH_STATE_NEEDED:
+	case VND_CMD_AUTH_STATE_SESSION_SHUTDOWN:
+		return node->u.plogi_did.b24;
+	case VND_CMD_AUTH_STATE_ELS_RCVD:
+		return node->u.els_sid.b24;
+	case VND_CMD_AUTH_STATE_SAUPDATE_COMPL:
+		return node->u.sa_aen.port_id.b24;
+	default:
+		return U32_MAX;
 	}
+}
 
-	if (vha->e_dbell.db_flags != EDB_ACTIVE) {
+/* true if no later event for @node's port is queued behind it */
+static bool
+qla_edb_node_newest(struct edif_dbell *edb, edb_node_t *node)
+{
+	u32 port = qla_edb_node_port(node);
+	edb_node_t *n = node;
+
+	list_for_each_entry_continue(n, &edb->head, list)
+		if (qla_edb_node_port(n) == port)
+			return false;
+	return true;
+}
+
+/*
+ * Queue an event for the app.  The node is built from @ev under db_lock,
+ * so a concurrent qla_edb_stop() can never free it from under us.
+ */
+static bool
+qla_edb_node_add(scsi_qla_host_t *vha, edb_node_t *ev)
+{
+	struct edif_dbell *edb = &vha->e_dbell;
+	unsigned long		flags;
+	edb_node_t *node;
+	u32 key = 0;
+
+	spin_lock_irqsave(&edb->db_lock, flags);
+
+	if (edb->db_flags != EDB_ACTIVE) {
+		spin_unlock_irqrestore(&edb->db_lock, flags);
 		/* doorbell list not enabled */
 		ql_dbg(ql_dbg_edif, vha, 0x09102,
 		    "%s doorbell not enabled\n", __func__);
 		return false;
 	}
 
-	spin_lock_irqsave(&vha->e_dbell.db_lock, flags);
-	ptr->lstate = LSTATE_ON;
-	list_add_tail(&(ptr->list), &(vha->e_dbell.head));
-	spin_unlock_irqrestore(&vha->e_dbell.db_lock, flags);
+	if (qla_edb_coalescible(ev->ntype)) {
+		key = qla_edb_pend_key(ev->ntype, ev->u.plogi_did);
+		hash_for_each_possible(edb->pend, node, hnode, key) {
+			if (node->ntype == ev->ntype &&
+			    node->u.plogi_did.b24 == ev->u.plogi_did.b24) {
+				// app has not picked up the last one yet.
+				// If something newer for this port is queued
+				// (NEEDED, SHUTDOWN, NEEDED) the app must still
+				// see this event last, so move it to the tail.
+				if (!qla_edb_node_newest(edb, node)) {
+					list_move_tail(&node->list, &edb->head);
+					ql_dbg(ql_dbg_edif, vha, 0x09106,
+					    "%s: requeued event %x for %06x\n",
+					    __func__, node->ntype,
+					    node->u.plogi_did.b24);
+				}
+				WARN_ON_ONCE(!qla_edb_node_newest(edb, node));
+				edb->coalesced++;
+				spin_unlock_irqrestore(&edb->db_lock, flags);
+				return true;
+			}
+		}
+	}
+
+	node = qla_edb_node_alloc(vha, ev->ntype);
+	if (!node) {
+		spin_unlock_irqrestore(&edb->db_lock, flags);
+		return false;
+	}
+	node->u = ev->u;
+	node->lstate = LSTATE_ON;
+	list_add_tail(&node->list, &edb->head);
+	if (qla_edb_coalescible(node->ntype))
+		hash_add(edb->pend, &node->hnode, key);
+	spin_unlock_irqrestore(&edb->db_lock, flags);
 
 	// ring doorbell for waiters
-	complete(&vha->e_dbell.dbell);
+	complete(&edb->dbell);
+	schedule_work(&edb->notify_work);
 
 	return true;
 }
@@ -2195,7 +2696,7 @@ void
 qla_edb_eventcreate(scsi_qla_host_t *vha, uint32_t dbtype,
 	uint32_t data, uint32_t data2, fc_port_t	*sfcport)
 {
-	edb_node_t	*edbnode;
+	edb_node_t	ev;
 	fc_port_t *fcport = sfcport;
 	port_id_t id;
 
@@ -2214,12 +2715,6 @@ qla_edb_eventcreate(scsi_qla_host_t *vha, uint32_t dbtype,
 		return;
 	}
 
-	if ((edbnode = qla_edb_node_alloc(vha, dbtype)) == NULL) {
-		ql_dbg(ql_dbg_edif, vha, 0x09102,
-		    "%s unable to alloc db node\n", __func__);
-		return;
-	}
-
 	if (!fcport){
 		id.b.domain = (data >> 16)& 0xff;
 		id.b.area = (data >> 8)& 0xff;
@@ -2233,65 +2728,58 @@ qla_edb_eventcreate(scsi_qla_host_t *vha, uint32_t dbtype,
 			ql_dbg(ql_dbg_edif, vha, 0x09102,
 			    "%s can't find fcport for sid= 0x%x - ignoring\n",
 			__func__, id.b24);
-			kfree(edbnode);
 			return;
 		}
 	}
 
 	// populate the edb node
+	memset(&ev, 0, sizeof(ev));
+	ev.ntype = dbtype;
 	switch (dbtype) {
 	case VND_CMD_AUTH_STATE_NEEDED:
 	case VND_CMD_AUTH_STATE_SESSION_SHUTDOWN:
-	    edbnode->u.plogi_did.b24 = fcport->d_id.b24;
+	    ev.u.plogi_did.b24 = fcport->d_id.b24;
 	    break;
 	case VND_CMD_AUTH_STATE_ELS_RCVD:
-	    edbnode->u.els_sid.b24 = fcport->d_id.b24;
+	    ev.u.els_sid.b24 = fcport->d_id.b24;
 	    break;
 	case VND_CMD_AUTH_STATE_SAUPDATE_COMPL:
-	    edbnode->u.sa_aen.port_id = fcport->d_id;
-	    edbnode->u.sa_aen.status =  data;
-	    edbnode->u.sa_aen.key_type =  data2;
+	    ev.u.sa_aen.port_id = fcport->d_id;
+	    ev.u.sa_aen.status =  data;
+	    ev.u.sa_aen.key_type =  data2;
 	    break;
 	default:
 	    ql_dbg(ql_dbg_edif, vha, 0x09102,
 		"%s unknown type: %x\n", __func__, dbtype);
-	    qla_edb_node_free(vha, edbnode);
-	    kfree(edbnode);
-	    edbnode = NULL;
-	    break;
+	    return;
 	}
 
-	if (edbnode && (!qla_edb_node_add(vha, edbnode))) {
+	if (!qla_edb_node_add(vha, &ev)) {
 		ql_dbg(ql_dbg_edif, vha, 0x09102,
 		    "%s unable to add dbnode\n", __func__);
-		qla_edb_node_free(vha, edbnode);
-		kfree(edbnode);
 		return;
 	}
-	if (edbnode && fcport)
-		fcport->edif.auth_state = dbtype;
+	fcport->edif.auth_state = dbtype;
 	ql_dbg(ql_dbg_edif, vha, 0x09102,
-	    "%s Doorbell produced : type=%d %p\n", __func__, dbtype, edbnode);
+	    "%s Doorbell produced : type=%d\n", __func__, dbtype);
 }
 
+/* called with db_lock held */
 static edb_node_t *
 qla_edb_getnext(scsi_qla_host_t *vha)
 {
-	unsigned long	flags;
 	edb_node_t	*edbnode = NULL;
 
-	spin_lock_irqsave(&vha->e_dbell.db_lock, flags);
-
 	// db nodes are fifo - no qualifications done
 	if (!list_empty(&vha->e_dbell.head)) {
 		edbnode = list_first_entry(&vha->e_dbell.head,
 		    struct edb_node, list);
 		list_del(&edbnode->list);
+		if (!hlist_unhashed(&edbnode->hnode))
+			hash_del(&edbnode->hnode);
 		edbnode->lstate = LSTATE_OFF;
 	}
 
-	spin_unlock_irqrestore(&vha->e_dbell.db_lock, flags);
-
 	return edbnode;
 }
 
@@ -2322,8 +2810,10 @@ qla_edif_timer(scsi_qla_host_t *vha)
 
 
 /*
- * app uses seperate thread to read this. It'll wait until the doorbell
- * is rung by the driver or the max wait time has expired
+ * app uses seperate thread to read this.  Every event queued when the
+ * read starts is handed over in one batch, up to ql2xedif_db_batch bytes.
+ * The attribute supports poll()/select(): the app waits for POLLPRI,
+ * then seeks to 0 and reads again.
  */
 ssize_t
 qla2x00_edif_doorbellr(struct device *dev, struct device_attribute *attr,
@@ -2333,7 +2823,10 @@ qla2x00_edif_doorbellr(struct device *dev, struct device_attribute *attr,
 	edb_node_t		*dbnode = NULL;
 	struct edif_app_dbell	*ap = (struct edif_app_dbell *) buf;
 	uint32_t dat_siz, buf_size, sz;
-	sz = 256; // app currently hardcode to 256.
+	unsigned long flags;
+
+	// app used to hardcode 256; larger reads take bigger batches
+	sz = clamp_t(uint32_t, ql2xedif_db_batch, 256, PAGE_SIZE);
 
 	/* stop new threads from waiting if we're not init'd */
 	if (vha->e_dbell.db_flags != EDB_ACTIVE) {
@@ -2349,7 +2842,9 @@ qla2x00_edif_doorbellr(struct device *dev, struct device_attribute *attr,
 	}
 
 	buf_size = 0;
-	while ((sz - buf_size) >= sizeof(edb_node_t)) {
+	spin_lock_irqsave(&vha->e_dbell.db_lock, flags);
+	// the largest record is an SA update AEN
+	while ((sz - buf_size) >= 8 + sizeof(edif_sa_update_aen_t)) {
 		// remove the next item from the doorbell list
 		dat_siz = 0;
 		if ((dbnode = qla_edb_getnext(vha)) != NULL) {
@@ -2382,8 +2877,7 @@ qla2x00_edif_doorbellr(struct device *dev, struct device_attribute *attr,
 				"%s Doorbell consumed : type=%d %p\n",
 				__func__, dbnode->ntype, dbnode);
 			// we're done with the db node, so free it up
-			qla_edb_node_free(vha, dbnode);
-			kfree(dbnode);
+			qla_edb_node_put(vha, dbnode);
 		} else {
 			break;
 		}
@@ -2393,6 +2887,7 @@ qla2x00_edif_doorbellr(struct device *dev, struct device_attribute *attr,
 		buf_size += dat_siz + 8;
 		ap = (struct edif_app_dbell *)(buf + buf_size);
 	}
+	spin_unlock_irqrestore(&vha->e_dbell.db_lock, flags);
 	return buf_size;
 }
 
@@ -2785,19 +3280,15 @@ static uint16_t  qla_edif_get_sa_index_from_freepool(fc_port_t *fcport, int dir)
 // find an sadb entry for an nport_handle
 //
 static edif_sa_index_entry_t *
-qla_edif_sadb_find_sa_index_entry(uint16_t nport_handle,
-    struct list_head *sa_list)
+qla_edif_sadb_find_sa_index_entry(struct qla_hw_data *ha,
+    uint16_t nport_handle, int dir)
 {
-	edif_sa_index_entry_t *entry;
-	edif_sa_index_entry_t *tentry;
-	struct list_head *indx_list = sa_list;
+	edif_sa_index_entry_t **tbl = dir ? ha->sadb_tx_tbl : ha->sadb_rx_tbl;
 
-	list_for_each_entry_safe(entry, tentry, indx_list, next) {
-		if (entry->handle == nport_handle) {
-			return entry;
-		}
-	}
-	return NULL;
+	if (!tbl || nport_handle >= EDIF_NPH_TBL_SIZE)
+		return NULL;
+
+	return READ_ONCE(tbl[nport_handle]);
 }
 
 
@@ -2806,7 +3297,6 @@ int qla_edif_sadb_delete_sa_index(fc_port_t *fcport, uint16_t nport_handle,
     uint16_t sa_index)
 {
 	edif_sa_index_entry_t *entry;
-	struct list_head *sa_list;
 	int dir = (sa_index < EDIF_TX_SA_INDEX_BASE) ? 0 : 1;
 	int slot = 0;
 	int free_slot_count = 0;
@@ -2817,13 +3307,7 @@ int qla_edif_sadb_delete_sa_index(fc_port_t *fcport, uint16_t nport_handle,
 	ql_dbg(ql_dbg_edif, vha, 0x3063,
 	    "%s: entry\n", __func__);
 
-	if (dir) {
-		sa_list = &ha->sadb_tx_index_list;
-	} else {
-		sa_list = &ha->sadb_rx_index_list;
-	}
-
-	entry = qla_edif_sadb_find_sa_index_entry(nport_handle, sa_list);
+	entry = qla_edif_sadb_find_sa_index_entry(ha, nport_handle, dir);
 	if (!entry) {
 		ql_dbg(ql_dbg_edif, vha, 0x3063,
 		    "%s: no entry found for nport_handle 0x%x\n",
@@ -2844,7 +3328,10 @@ int qla_edif_sadb_delete_sa_index(fc_port_t *fcport, uint16_t nport_handle,
 	}
 
 	if (free_slot_count == 2) {
-		list_del(&entry->next);
+		if (dir)
+			WRITE_ONCE(ha->sadb_tx_tbl[nport_handle], NULL);
+		else
+			WRITE_ONCE(ha->sadb_rx_tbl[nport_handle], NULL);
 		kfree(entry);
 	}
 	spin_unlock_irqrestore(&ha->sadb_lock, flags);
@@ -2856,6 +3343,24 @@ int qla_edif_sadb_delete_sa_index(fc_port_t *fcport, uint16_t nport_handle,
 	return 0;
 }
 
+static void
+qla_edif_sa_stats_update(scsi_qla_host_t *vha, ktime_t start, u8 sa_status)
+{
+	struct qla_edif_sa_stats *st = &vha->sa_stats;
+	u64 ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	unsigned long flags;
+
+	spin_lock_irqsave(&vha->sa_stats_lock, flags);
+	st->updates++;
+	if (sa_status != QL_VND_SA_STAT_SUCCESS)
+		st->failed++;
+	st->last_ns = ns;
+	st->total_ns += ns;
+	if (ns > st->max_ns)
+		st->max_ns = ns;
+	spin_unlock_irqrestore(&vha->sa_stats_lock, flags);
+}
+
 void
 qla28xx_sa_update_iocb_entry(scsi_qla_host_t *v, struct req_que *req,
     struct sa_update_28xx *pkt)
@@ -2864,6 +3369,7 @@ qla28xx_sa_update_iocb_entry(scsi_qla_host_t *v, struct req_que *req,
 	srb_t *sp;
 	struct 	edif_sa_ctl *sa_ctl;
 	int old_sa_deleted = 1;
+	u8 sa_status = QL_VND_SA_STAT_SUCCESS;
 	uint16_t nport_handle;
 	struct scsi_qla_host *vha;
 
@@ -2928,13 +3434,12 @@ qla28xx_sa_update_iocb_entry(scsi_qla_host_t *v, struct req_que *req,
 			    "%s: removing edif_entry %px, new sa_index: 0x%x\n",
 			    __func__, edif_entry, pkt->sa_index);
 			qla_edif_list_delete_sa_index(sp->fcport, edif_entry);
-			del_timer(&edif_entry->timer);
 
 			ql_dbg(ql_dbg_edif, vha, 0x5033,
 			    "%s: releasing edif_entry %px, new sa_index: 0x%x\n",
 			    __func__, edif_entry, pkt->sa_index);
 
-			kfree(edif_entry);
+			qla_edif_list_free_entry(sp->fcport, edif_entry);
 		}
 	}
 
@@ -2983,6 +3488,7 @@ qla28xx_sa_update_iocb_entry(scsi_qla_host_t *v, struct req_que *req,
 				QL_VND_RX_SA_KEY, sp->fcport);
 		}
 	} else {
+		sa_status = QL_VND_SA_STAT_FAILED;
 
 		ql_dbg(ql_dbg_edif, vha, 0x3063,
 		    "%s: %8phN SA update FAILED: sa_index: %d, new_sa_info %d, "
@@ -3051,14 +3557,24 @@ qla28xx_sa_update_iocb_entry(scsi_qla_host_t *v, struct req_que *req,
 		}
 	}
 
+	sp->u.iocb_cmd.u.sa_update.comp_sts = le16_to_cpu(pkt->u.comp_sts);
+	sp->u.iocb_cmd.u.sa_update.status = sa_status;
+	if (ktime_to_ns(sp->u.iocb_cmd.u.sa_update.start))
+		qla_edif_sa_stats_update(vha, sp->u.iocb_cmd.u.sa_update.start,
+		    sa_status);
+
 	sp->done(sp, 0);
 }
 
 /*
  * qla28xx_start_scsi_edif() - Send a SCSI type 6 command ot the ISP
  * @sp: command to send to the ISP
- * req/rsp queue to use for this request
- * lock to protect submission
+ *
+ * MQ submit path for FC-SP encrypted sessions.  It follows
+ * qla2xxx_start_scsi_mq(): everything is done under the qpair lock and
+ * the Command Type 6 context, with its FCP_CMND buffer, comes from the
+ * qpair cache.  Only CF_EN_EDIF separates it from plain I/O; the firmware
+ * picks the SA index from the session.
  *
  * Returns non-zero if a failure occurred, else zero.
  */
@@ -3069,22 +3585,24 @@ qla28xx_start_scsi_edif(srb_t *sp)
 	unsigned long   flags;
 	struct scsi_cmnd *cmd;
 	uint32_t        *clr_ptr;
-	uint32_t        index, i;
+	uint32_t        i;
 	uint32_t        handle;
 	uint16_t        cnt;
-	int16_t        req_cnt;
+	uint16_t        req_cnt;
 	uint16_t        tot_dsds;
 	__be32 *fcp_dl;
 	uint8_t additional_cdb_len;
-	struct ct6_dsd *ctx;
+	struct ct6_dsd *ctx = NULL;
 	struct scsi_qla_host *vha = sp->vha;
 	struct qla_hw_data *ha = vha->hw;
 	struct cmd_type_6 *cmd_pkt;
 	struct dsd64	*cur_dsd;
 	uint8_t		avail_dsds = 0;
 	struct 	scatterlist *sg;
-	struct req_que *req = sp->qpair->req;
-	spinlock_t *lock = sp->qpair->qp_lock_ptr;
+	struct qla_qpair *qpair = sp->qpair;
+	struct req_que *req = qpair->req;
+	struct rsp_que *rsp = qpair->rsp;
+	spinlock_t *lock = qpair->qp_lock_ptr;
 
 	/* Setup device pointers. */
 	cmd = GET_CMD_SP(sp);
@@ -3092,10 +3610,29 @@ qla28xx_start_scsi_edif(srb_t *sp)
 	/* So we know we haven't pci_map'ed anything yet */
 	tot_dsds = 0;
 
+	if (cmd->cmd_len > 16) {
+		if ((cmd->cmd_len % 4) != 0) {
+			/* SCSI command bigger than 16 bytes must be
+			 * multiple of 4
+			 */
+			ql_log(ql_log_warn, vha, 0x3012,
+			    "scsi cmd len %d not multiple of 4 "
+			    "for cmd=%px.\n", cmd->cmd_len, cmd);
+			return QLA_FUNCTION_FAILED;
+		}
+		additional_cdb_len = cmd->cmd_len - 16;
+	} else {
+		additional_cdb_len = 0;
+	}
+
+	/* Acquire qpair specific lock */
+	spin_lock_irqsave(lock, flags);
+
 	/* Send marker if required */
 	if (vha->marker_needed != 0) {
-		if (qla2x00_marker(vha, sp->qpair, 0, 0, MK_SYNC_ALL) !=
-			QLA_SUCCESS) {
+		if (__qla2x00_marker(vha, qpair, 0, 0, MK_SYNC_ALL) !=
+		    QLA_SUCCESS) {
+			spin_unlock_irqrestore(lock, flags);
 			ql_log(ql_log_warn, vha, 0x300c,
 			    "qla2x00_marker failed for cmd=%px.\n", cmd);
 			return QLA_FUNCTION_FAILED;
@@ -3103,19 +3640,8 @@ qla28xx_start_scsi_edif(srb_t *sp)
 		vha->marker_needed = 0;
 	}
 
-	/* Acquire ring specific lock */
-	spin_lock_irqsave(lock, flags);
-
-	/* Check for room in outstanding command list. */
-	handle = req->current_outstanding_cmd;
-	for (index = 1; index < req->num_outstanding_cmds; index++) {
-		handle++;
-		if (handle == req->num_outstanding_cmds)
-			handle = 1;
-		if (!req->outstanding_cmds[handle])
-		break;
-	}
-	if (index == req->num_outstanding_cmds)
+	handle = qla2xxx_get_next_handle(req);
+	if (handle == 0)
 		goto queuing_error;
 
 	/* Map the sg table so we have an accurate count of sg entries needed */
@@ -3129,9 +3655,21 @@ qla28xx_start_scsi_edif(srb_t *sp)
 
 	tot_dsds = nseg;
 	req_cnt = qla24xx_calc_iocbs(vha, tot_dsds);
+
+	sp->iores.res_type = RESOURCE_INI;
+	sp->iores.iocb_cnt = req_cnt;
+	if (qla_get_iocbs(qpair, &sp->iores))
+		goto queuing_error;
+
 	if (req->cnt < (req_cnt + 2)) {
-		cnt = IS_SHADOW_REG_CAPABLE(ha) ? *req->out_ptr :
-		RD_REG_DWORD_RELAXED(req->req_q_out);
+		if (IS_SHADOW_REG_CAPABLE(ha)) {
+			cnt = *req->out_ptr;
+		} else {
+			cnt = RD_REG_DWORD_RELAXED(req->req_q_out);
+			if (qla2x00_check_reg16_for_disconnect(vha, cnt))
+				goto queuing_error;
+		}
+
 		if (req->ring_index < cnt)
 			req->cnt = cnt - req->ring_index;
 		else
@@ -3141,43 +3679,13 @@ qla28xx_start_scsi_edif(srb_t *sp)
 			goto queuing_error;
 	}
 
-	ctx = sp->u.scmd.ct6_ctx =
-	    mempool_alloc(ha->ctx_mempool, GFP_ATOMIC);
+	ctx = sp->u.scmd.ct6_ctx = qla_ct6_ctx_get(qpair);
 	if (!ctx) {
 		ql_log(ql_log_fatal, vha, 0x3010,
 		    "Failed to allocate ctx for cmd=%px.\n", cmd);
 		goto queuing_error;
 	}
-
-	memset(ctx, 0, sizeof(struct ct6_dsd));
-	ctx->fcp_cmnd = dma_pool_zalloc(ha->fcp_cmnd_dma_pool,
-	    GFP_ATOMIC, &ctx->fcp_cmnd_dma);
-	if (!ctx->fcp_cmnd) {
-		ql_log(ql_log_fatal, vha, 0x3011,
-		    "Failed to allocate fcp_cmnd for cmd=%px.\n", cmd);
-		goto queuing_error;
-	}
-
-	/* Initialize the DSD list and dma handle */
-	INIT_LIST_HEAD(&ctx->dsd_list);
-	ctx->dsd_use_cnt = 0;
-
-	if (cmd->cmd_len > 16) {
-		additional_cdb_len = cmd->cmd_len - 16;
-		if ((cmd->cmd_len % 4) != 0) {
-			/* SCSI command bigger than 16 bytes must be
-			 * multiple of 4
-			 */
-			ql_log(ql_log_warn, vha, 0x3012,
-			    "scsi cmd len %d not multiple of 4 "
-			    "for cmd=%px.\n", cmd->cmd_len, cmd);
-			goto queuing_error_fcp_cmnd;
-		}
-			ctx->fcp_cmnd_len = 12 + cmd->cmd_len + 4;
-	} else {
-		additional_cdb_len = 0;
-		ctx->fcp_cmnd_len = 12 + 16 + 4;
-	}
+	ctx->fcp_cmnd_len = 12 + 16 + additional_cdb_len + 4;
 
 	cmd_pkt = (struct cmd_type_6 *)req->ring_ptr;
 	cmd_pkt->handle = MAKE_HANDLE(req->id, handle);
@@ -3247,9 +3755,6 @@ no_dsds:
 
 	cmd_pkt->entry_type = COMMAND_TYPE_6;
 
-	/* Set total data segment count. */
-	cmd_pkt->entry_count = (uint8_t)req_cnt;
-
 	int_to_scsilun(cmd->device->lun, &cmd_pkt->lun);
 	host_to_fcp_swap((uint8_t *)&cmd_pkt->lun, sizeof(cmd_pkt->lun));
 
@@ -3262,6 +3767,8 @@ no_dsds:
 	else if (cmd->sc_data_direction == DMA_FROM_DEVICE)
 		ctx->fcp_cmnd->additional_cdb_len |= 2;
 
+	ctx->fcp_cmnd->task_attribute = qla_scsi_get_task_attr(cmd);
+
 	/* Populate the FCP_PRIO. */
 	if (ha->flags.fcp_prio_enabled)
 		ctx->fcp_cmnd->task_attribute |=
@@ -3298,10 +3805,17 @@ no_dsds:
 	} else
 		req->ring_ptr++;
 
-	sp->qpair->cmd_cnt++;
+	qpair->cmd_cnt++;
+	sp->flags |= SRB_DMA_VALID;
+
 	/* Set chip new ring index. */
 	WRT_REG_DWORD(req->req_q_in, req->ring_index);
 
+	/* Manage unprocessed RIO/ZIO commands in response queue. */
+	if (vha->flags.process_response_queue &&
+	    rsp->ring_ptr->signature != RESPONSE_PROCESSED)
+		qla24xx_process_response_queue(vha, rsp);
+
 	spin_unlock_irqrestore(lock, flags);
 
 #ifdef QLA2XXX_LATENCY_MEASURE
@@ -3309,16 +3823,15 @@ no_dsds:
 #endif
 	return QLA_SUCCESS;
 
-queuing_error_fcp_cmnd:
-	dma_pool_free(ha->fcp_cmnd_dma_pool, ctx->fcp_cmnd, ctx->fcp_cmnd_dma);
 queuing_error:
 	if (tot_dsds)
 		scsi_dma_unmap(cmd);
 
-	if (sp->u.scmd.ct6_ctx) {
-		mempool_free(sp->u.scmd.ct6_ctx, ha->ctx_mempool);
+	if (ctx) {
+		qla_ct6_ctx_put(qpair, ctx);
 		sp->u.scmd.ct6_ctx = NULL;
 	}
+	qla_put_iocbs(qpair, &sp->iores);
 	spin_unlock_irqrestore(lock, flags);
 
 	return QLA_FUNCTION_FAILED;
@@ -3329,20 +3842,32 @@ queuing_error:
 // edif update/delete sa_index list functions
 
 //
-// clear the edif_indx_list for this port
+// clear the edif index entries for this port
 //
 void qla_edif_list_del(fc_port_t *fcport)
 {
+	struct qla_hw_data *ha = fcport->vha->hw;
 	edif_list_entry_t *indx_lst;
-	edif_list_entry_t *tindx_lst;
-	struct list_head *indx_list = &fcport->edif.edif_indx_list;
 	unsigned long flags = 0;
+	int h;
 
-	list_for_each_entry_safe(indx_lst, tindx_lst, indx_list, next) {
-		spin_lock_irqsave(&fcport->edif.indx_list_lock, flags);
-		list_del(&indx_lst->next);
-		spin_unlock_irqrestore(&fcport->edif.indx_list_lock, flags);
-		kfree(indx_lst);
+	if (!ha->edif_indx_tbl)
+		return;
+
+	for (h = 0; h < EDIF_NPH_TBL_SIZE; h++) {
+		indx_lst = READ_ONCE(ha->edif_indx_tbl[h]);
+		if (!indx_lst || indx_lst->fcport != fcport)
+			continue;
+
+		spin_lock_irqsave(&ha->sadb_lock, flags);
+		if (ha->edif_indx_tbl[h] == indx_lst)
+			WRITE_ONCE(ha->edif_indx_tbl[h], NULL);
+		else
+			indx_lst = NULL;
+		spin_unlock_irqrestore(&ha->sadb_lock, flags);
+
+		if (indx_lst)
+			qla_edif_list_free_entry(fcport, indx_lst);
 	}
 }
 
@@ -3360,7 +3885,7 @@ static uint16_t qla_edif_sadb_get_sa_index(fc_port_t *fcport,
 {
 
 	edif_sa_index_entry_t *entry;
-	struct list_head *sa_list;
+	edif_sa_index_entry_t **tbl;
 	uint16_t sa_index;
 	int dir = sa_frame->flags & SAU_FLG_TX;
 	int slot = 0;
@@ -3373,13 +3898,11 @@ static uint16_t qla_edif_sadb_get_sa_index(fc_port_t *fcport,
 	    "%s: entry  fc_port: %px, nport_handle: 0x%x\n",
 	    __func__, fcport, nport_handle);
 
-	if (dir) {
-		sa_list = &ha->sadb_tx_index_list;
-	} else {
-		sa_list = &ha->sadb_rx_index_list;
-	}
+	tbl = dir ? ha->sadb_tx_tbl : ha->sadb_rx_tbl;
+	if (!tbl || nport_handle >= EDIF_NPH_TBL_SIZE)
+		return INVALID_EDIF_SA_INDEX;
 
-	entry = qla_edif_sadb_find_sa_index_entry(nport_handle, sa_list);
+	entry = qla_edif_sadb_find_sa_index_entry(ha, nport_handle, dir);
 	if (!entry) {
 
 		if ( (sa_frame->flags & (SAU_FLG_TX | SAU_FLG_INV)) == SAU_FLG_INV ) {
@@ -3401,7 +3924,6 @@ static uint16_t qla_edif_sadb_get_sa_index(fc_port_t *fcport,
 			return INVALID_EDIF_SA_INDEX;
 		}
 
-		INIT_LIST_HEAD(&entry->next);
 		entry->handle = nport_handle;
 		entry->fcport = fcport;
 		entry->sa_pair[0].spi = sa_frame->spi;
@@ -3409,7 +3931,7 @@ static uint16_t qla_edif_sadb_get_sa_index(fc_port_t *fcport,
 		entry->sa_pair[1].spi = 0;
 		entry->sa_pair[1].sa_index = INVALID_EDIF_SA_INDEX;
 		spin_lock_irqsave(&ha->sadb_lock, flags);
-		list_add_tail(&entry->next, sa_list);
+		smp_store_release(&tbl[nport_handle], entry);
 		spin_unlock_irqrestore(&ha->sadb_lock, flags);
 		ql_dbg(ql_dbg_edif, vha, 0x3063,
 		    "%s: Created new sadb entry for nport_handle 0x%x, "
@@ -3490,21 +4012,27 @@ static uint16_t qla_edif_sadb_get_sa_index(fc_port_t *fcport,
 //
 void qla_edif_sadb_release(struct qla_hw_data *ha)
 {
-	struct list_head *pos;
-	struct list_head *tmp;
-	edif_sa_index_entry_t *entry;
-
-	list_for_each_safe(pos, tmp, &ha->sadb_rx_index_list) {
-		entry = list_entry(pos, edif_sa_index_entry_t, next);
-		list_del(&entry->next);
-		kfree(entry);
+	edif_list_entry_t *indx_lst;
+	int h;
+
+	for (h = 0; h < EDIF_NPH_TBL_SIZE; h++) {
+		if (ha->sadb_rx_tbl)
+			kfree(ha->sadb_rx_tbl[h]);
+		if (ha->sadb_tx_tbl)
+			kfree(ha->sadb_tx_tbl[h]);
+		if (ha->edif_indx_tbl && ha->edif_indx_tbl[h]) {
+			indx_lst = ha->edif_indx_tbl[h];
+			del_timer_sync(&indx_lst->timer);
+			kfree(indx_lst);
+		}
 	}
 
-	list_for_each_safe(pos, tmp, &ha->sadb_tx_index_list) {
-		entry = list_entry(pos, edif_sa_index_entry_t, next);
-		list_del(&entry->next);
-		kfree(entry);
-	}
+	kfree(ha->sadb_rx_tbl);
+	ha->sadb_rx_tbl = NULL;
+	kfree(ha->sadb_tx_tbl);
+	ha->sadb_tx_tbl = NULL;
+	kfree(ha->edif_indx_tbl);
+	ha->edif_indx_tbl = NULL;
 }
 
 // *****************************************
@@ -3534,6 +4062,20 @@ int qla_edif_sadb_build_free_pool(struct qla_hw_data *ha)
 		    "Unable to allocate memory for sadb rx.\n");
 		return ENOMEM;
 	}
+
+	ha->sadb_tx_tbl = kcalloc(EDIF_NPH_TBL_SIZE,
+	    sizeof(*ha->sadb_tx_tbl), GFP_KERNEL);
+	ha->sadb_rx_tbl = kcalloc(EDIF_NPH_TBL_SIZE,
+	    sizeof(*ha->sadb_rx_tbl), GFP_KERNEL);
+	ha->edif_indx_tbl = kcalloc(EDIF_NPH_TBL_SIZE,
+	    sizeof(*ha->edif_indx_tbl), GFP_KERNEL);
+	if (!ha->sadb_tx_tbl || !ha->sadb_rx_tbl || !ha->edif_indx_tbl) {
+		qla_edif_sadb_release(ha);
+		qla_edif_sadb_release_free_pool(ha);
+		ql_log_pci(ql_log_fatal, ha->pdev, 0x0009,
+		    "Unable to allocate memory for sadb tables.\n");
+		return ENOMEM;
+	}
 	return 0;
 }
 
@@ -3556,14 +4098,22 @@ static void __chk_edif_rx_sa_delete_pending(scsi_qla_host_t *vha,
 	edif_list_entry_t *edif_entry;
 	struct 	edif_sa_ctl * sa_ctl;
 	uint16_t delete_sa_index = INVALID_EDIF_SA_INDEX;
+	uint16_t update_sa_index;
 	unsigned long flags = 0;
 	uint16_t nport_handle = fcport->loop_id;
 	uint16_t cached_nport_handle;
 
-	spin_lock_irqsave(&fcport->edif.indx_list_lock, flags);
+	//
+	// no delayed rx delete armed for this session, which is the case for
+	// every I/O outside a rekey window
+	//
+	if (!atomic_read(&fcport->edif.rx_del_pending))
+		return;
+
+	rcu_read_lock();
 	edif_entry = qla_edif_list_find_sa_index(fcport, nport_handle);
 	if (!edif_entry) {
-		spin_unlock_irqrestore(&fcport->edif.indx_list_lock, flags);
+		rcu_read_unlock();
 		return;		// no pending delete for this handle
 	}
 
@@ -3571,9 +4121,10 @@ static void __chk_edif_rx_sa_delete_pending(scsi_qla_host_t *vha,
 	// check for no pending delete for this index or iocb does not
 	// match rx sa_index
 	//
-	if ((edif_entry->delete_sa_index == INVALID_EDIF_SA_INDEX) ||
-	    (edif_entry->update_sa_index != sa_index)) {
-		spin_unlock_irqrestore(&fcport->edif.indx_list_lock, flags);
+	update_sa_index = READ_ONCE(edif_entry->update_sa_index);
+	if ((READ_ONCE(edif_entry->delete_sa_index) == INVALID_EDIF_SA_INDEX) ||
+	    (update_sa_index != sa_index)) {
+		rcu_read_unlock();
 		return;
 	}
 
@@ -3581,21 +4132,31 @@ static void __chk_edif_rx_sa_delete_pending(scsi_qla_host_t *vha,
 	// wait until we have seen at least EDIF_DELAY_COUNT transfers before
 	// queueing RX delete
 	//
-	if (edif_entry->count++ < EDIF_RX_DELETE_FILTER_COUNT) {
+	if (atomic_inc_return(&edif_entry->count) <=
+	    EDIF_RX_DELETE_FILTER_COUNT) {
+		rcu_read_unlock();
+		return;
+	}
+
+	spin_lock_irqsave(&fcport->edif.indx_list_lock, flags);
+	delete_sa_index = edif_entry->delete_sa_index;
+	if (delete_sa_index == INVALID_EDIF_SA_INDEX) {
+		// claimed by the timer or another completion
 		spin_unlock_irqrestore(&fcport->edif.indx_list_lock, flags);
+		rcu_read_unlock();
 		return;
 	}
 
 	ql_dbg(ql_dbg_edif, vha, 0x5033,
 	    "%s: invalidating delete_sa_index,  update_sa_index: 0x%x "
 	    "sa_index: 0x%x, delete_sa_index: 0x%x\n",
-	    __func__, edif_entry->update_sa_index , sa_index,
-	    edif_entry->delete_sa_index);
+	    __func__, update_sa_index , sa_index, delete_sa_index);
 
-	delete_sa_index = edif_entry->delete_sa_index;
 	edif_entry->delete_sa_index = INVALID_EDIF_SA_INDEX;
+	atomic_dec(&fcport->edif.rx_del_pending);
 	cached_nport_handle = edif_entry->handle;
 	spin_unlock_irqrestore(&fcport->edif.indx_list_lock, flags);
+	rcu_read_unlock();
 
 	// sanity check on the nport handle
 	if (nport_handle != cached_nport_handle) {
@@ -3614,7 +4175,7 @@ static void __chk_edif_rx_sa_delete_pending(scsi_qla_host_t *vha,
 		    "%s: POST SA DELETE sa_ctl: %px, index recvd %d, delete "
 		    "index %d, update index: %d, nport handle: 0x%x, handle: 0x%x\n",
 		    __func__, sa_ctl, sa_index, delete_sa_index,
-		    edif_entry->update_sa_index, nport_handle, handle);
+		    update_sa_index, nport_handle, handle);
 
 		sa_ctl->flags = EDIF_SA_CTL_FLG_DEL;
 		set_bit(EDIF_SA_CTL_REPL, &sa_ctl->state);
@@ -46,11 +46,46 @@ enum db_flags_t {
 	EDB_ACTIVE = 0x1,
 };
 
+#define EDB_PEND_BITS	6
+
 struct edif_dbell {
 	enum db_flags_t		db_flags;
 	spinlock_t		db_lock;	/* protects list */
 	struct  list_head	head;
 	struct	completion	dbell;		/* doorbell ring */
+
+	/* event nodes preallocated at app start, ql2xedif_db_depth of them */
+	struct edb_node		*pool;
+	struct list_head	free;
+	u32			pool_size;
+	/* queued per-session state events, by type and port id */
+	DECLARE_HASHTABLE(pend, EDB_PEND_BITS);
+	struct work_struct	notify_work;	/* wakes poll() on edif_doorbell */
+	u32			coalesced;
+	u32			pool_miss;
+};
+
+/* SA_UPDATE completion accounting, single and batched requests */
+struct qla_edif_sa_stats {
+	u64		updates;	/* SA_UPDATE IOCBs completed */
+	u64		failed;
+	u64		last_ns;
+	u64		max_ns;
+	u64		total_ns;
+	u64		batches;	/* QL_VND_SC_SA_UPDATE_BATCH calls */
+	u64		batch_entries;
+	u32		last_batch_cnt;
+	u64		last_batch_ns;
+};
+
+/* one QL_VND_SC_SA_UPDATE_BATCH request in flight */
+struct qla_sa_batch {
+	bsg_job_t	*bsg_job;
+	struct scsi_qla_host *vha;
+	atomic_t	pending;	/* outstanding IOCBs + submitter ref */
+	ktime_t		start;
+	u32		rsp_len;
+	struct qla_sa_update_batch_reply rsp;	/* must be last */
 };
 
 
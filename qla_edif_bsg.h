@@ -196,6 +196,35 @@ struct qla_sa_update_frame {
 	port_id_t	port_id;
 } __attribute__ ((packed));
 
+// QL_VND_SC_SA_UPDATE_BATCH request: header followed by count sa frames
+#define	QL_VND_SA_BATCH_MAX	1024
+struct qla_sa_update_batch {
+	app_id_t	app_info;
+	uint32_t	count;		// # of entries in sa_frame[]
+	uint32_t	reserved[VND_CMD_APP_RESERVED_SIZE];
+	struct qla_sa_update_frame sa_frame[0];
+} __attribute__ ((packed));
+
+// per-entry result, same order as the request sa_frame[]
+struct qla_sa_update_batch_status {
+	port_id_t	port_id;
+	uint16_t	flags;		// sa_frame flags, echoed back
+	uint16_t	sa_index;	// sa_index assigned by the driver
+	uint32_t	status;		// QL_VND_SA_STAT_*
+	uint32_t	comp_sts;	// fw completion status
+	uint32_t	did;		// DID_*/driver code when fw did not answer
+	uint32_t	latency_us;	// bsg receipt to completion
+} __attribute__ ((packed));
+
+struct qla_sa_update_batch_reply {
+	uint32_t	count;		// # of entries in status[]
+	uint32_t	done;		// # completed with QL_VND_SA_STAT_SUCCESS
+	uint32_t	failed;
+	uint32_t	elapsed_us;	// first submit to last completion
+	uint32_t	reserved[VND_CMD_APP_RESERVED_SIZE];
+	struct qla_sa_update_batch_status status[0];
+} __attribute__ ((packed));
+
 // used for edif mgmt bsg interface
 #define	QL_VND_SC_UNDEF		0
 #define	QL_VND_SC_SA_UPDATE	1	// sa key info
@@ -206,6 +235,7 @@ struct qla_sa_update_frame {
 #define	QL_VND_SC_REKEY_CONFIG	6	// auth rekey set parms (time/data)
 #define	QL_VND_SC_GET_FCINFO	7	// get port info
 #define	QL_VND_SC_GET_STATS	8	// get edif stats
+#define	QL_VND_SC_SA_UPDATE_BATCH 9	// many sa key infos, one bsg call
 
 
 /* Application interface data structure for rtn data */
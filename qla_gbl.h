@@ -83,6 +83,7 @@ int qla2x00_post_work(struct scsi_qla_host *vha, struct qla_work_evt *e);
 extern void *qla2x00_alloc_iocbs_ready(struct qla_qpair *, srb_t *);
 extern int qla24xx_update_fcport_fcp_prio(scsi_qla_host_t *, fc_port_t *);
 extern int qla24xx_async_abort_cmd(srb_t *, bool);
+extern srb_t *qla24xx_prep_abort_sp(srb_t *, bool);
 
 extern void qla2x00_set_fcport_state(fc_port_t *fcport, int state);
 extern fc_port_t *
@@ -101,6 +102,10 @@ extern int qla2x00_init_rings(scsi_qla_host_t *);
 extern struct qla_qpair *qla2xxx_create_qpair(struct scsi_qla_host *,
 	int, int, bool);
 extern int qla2xxx_delete_qpair(struct scsi_qla_host *, struct qla_qpair *);
+extern void qla_dsd_cache_fill(struct qla_qpair *);
+extern int qla24xx_alloc_gnl_index(struct scsi_qla_host *);
+extern void qla24xx_free_gnl_index(struct scsi_qla_host *);
+extern void qla_dsd_cache_drain(struct qla_qpair *);
 void qla2x00_handle_rscn(scsi_qla_host_t *vha, struct event_arg *ea);
 void qla24xx_handle_plogi_done_event(struct scsi_qla_host *vha,
 				     struct event_arg *ea);
@@ -113,6 +118,7 @@ int qla24xx_async_notify_ack(scsi_qla_host_t *, fc_port_t *,
 int qla24xx_post_newsess_work(struct scsi_qla_host *, port_id_t *, u8 *, u8*,
     void *, u8);
 int qla24xx_fcport_handle_login(struct scsi_qla_host *, fc_port_t *);
+bool qla_login_priority(fc_port_t *);
 int qla24xx_post_gpdb_work(struct scsi_qla_host *, fc_port_t *, u8);
 
 extern void qla28xx_get_aux_images(struct scsi_qla_host *,
@@ -127,10 +133,13 @@ extern int qla2x00_post_async_prlo_work(struct scsi_qla_host *, fc_port_t *,
 extern int qla2x00_post_async_prlo_done_work(struct scsi_qla_host *,
     fc_port_t *, uint16_t *);
 int qla_post_iidma_work(struct scsi_qla_host *vha, fc_port_t *fcport);
-void qla_do_iidma_work(struct scsi_qla_host *vha, fc_port_t *fcport);
+void qla_do_iidma_work(struct scsi_qla_host *vha);
+void qla_disc_cache_seed(struct scsi_qla_host *vha, fc_port_t *fcport);
+void qla_disc_cache_save(fc_port_t *fcport);
 int qla2x00_reserve_mgmt_server_loop_id(scsi_qla_host_t *);
 void qla_rscn_replay(fc_port_t *fcport);
 void qla24xx_free_purex_item(struct purex_item *item);
+void qla27xx_process_fpin_list(struct scsi_qla_host *, struct list_head *);
 extern bool qla24xx_risc_firmware_invalid(uint32_t *);
 void qla_init_iocb_limit(scsi_qla_host_t *);
 #ifdef QLA2XXX_LATENCY_MEASURE
@@ -208,8 +217,12 @@ extern int ql2xexlogins;
 extern int ql2xdifbundlinginternalbuffers;
 extern int ql2xfulldump_on_mpifail;
 extern int ql2xsecenable;
+extern int ql2xedif_db_depth;
+extern int ql2xedif_db_batch;
 extern int ql2xenforce_iocb_limit;
 extern int ql2xabts_wait_nvme;
+extern int ql2xnvme_abt_direct;
+extern int ql2xnvmetenable;
 extern int ql2x_scmr_drop_pct;
 extern int ql2x_scmr_drop_pct_low_wm;
 extern int ql2x_scmr_up_pct;
@@ -219,6 +232,20 @@ extern int ql2x_scmr_throttle_mode;
 extern int ql2xrspq_follow_inptr;
 extern int ql2xrspq_follow_inptr_legacy;
 extern int ql2xcontrol_edc_rdf;
+extern int ql2xtrace_entries;
+extern int ql2xmbx_iocb;
+extern int ql2xstats_interval;
+extern int ql2xdsd_cache_depth;
+extern int ql2xlogin_window;
+extern int ql2xwork_pool;
+extern int ql2xwarm_resume;
+extern int ql2xdisc_cache;
+extern int ql2xpurex_pool;
+extern int ql2xnvme_queues;
+extern int ql2xnvme_qpairs;
+extern int ql2xnvme_qpair_weight;
+extern int ql2xparallel_drain;
+extern int ql2xrscn_coalesce_ms;
 extern u64 ql2xdebug;
 
 extern int qla2x00_loop_reset(scsi_qla_host_t *);
@@ -246,6 +273,12 @@ extern struct scsi_qla_host *qla2x00_create_host(struct scsi_host_template *,
 extern void qla2x00_free_host(struct scsi_qla_host *);
 extern void qla2x00_relogin(struct scsi_qla_host *);
 extern void qla2x00_do_work(struct scsi_qla_host *);
+extern int qla2x00_alloc_work_pool(struct scsi_qla_host *);
+extern void qla2x00_free_work_pool(struct scsi_qla_host *);
+extern int qla2x00_alloc_disc_cache(struct scsi_qla_host *);
+extern void qla2x00_free_disc_cache(struct scsi_qla_host *);
+extern int qla24xx_alloc_purex_pool(struct scsi_qla_host *);
+extern void qla24xx_free_purex_pool(struct scsi_qla_host *);
 extern void qla2x00_free_fcports(struct scsi_qla_host *);
 extern void qla2x00_free_fcport(fc_port_t *);
 
@@ -349,7 +382,12 @@ extern int qla2x00_start_scsi(srb_t *sp);
 extern int qla24xx_start_scsi(srb_t *sp);
 int qla2x00_marker(struct scsi_qla_host *, struct qla_qpair *,
     uint16_t, uint64_t, uint8_t);
+int __qla2x00_marker(struct scsi_qla_host *, struct qla_qpair *,
+    uint16_t, uint64_t, uint8_t);
 extern int qla2x00_start_sp(srb_t *);
+extern int qla2x00_start_sp_batch(srb_t **, int);
+extern int qla2x00_start_sp_batch_hook(srb_t **, int, bool (*)(srb_t *),
+    void (*)(srb_t *));
 extern int qla24xx_dif_start_scsi(srb_t *);
 extern int qla2x00_start_bidir(srb_t *, struct scsi_qla_host *, uint32_t);
 extern int qla2xxx_dif_start_scsi_mq(srb_t *);
@@ -729,6 +767,10 @@ extern void ql_dump_regs(uint, scsi_qla_host_t *, uint);
 extern void ql_dump_buffer(uint, scsi_qla_host_t *, uint, const void *, uint);
 extern void ql_scm_dump_buffer(uint level, scsi_qla_host_t *vha,
 	uint id, void *buf, uint size);
+struct seq_file;
+extern int qla2x00_trc_init(void);
+extern void qla2x00_trc_free(void);
+extern void qla2x00_trc_show(struct seq_file *, scsi_qla_host_t *);
 /*
  * Global Function Prototypes in qla_gs.c source file.
  */
@@ -739,6 +781,7 @@ extern int qla2x00_gid_pt(scsi_qla_host_t *, sw_info_t *);
 extern int qla2x00_gpn_id(scsi_qla_host_t *, sw_info_t *);
 extern int qla2x00_gnn_id(scsi_qla_host_t *, sw_info_t *);
 extern void qla2x00_gff_id(scsi_qla_host_t *, sw_info_t *);
+extern int qla2x00_gft_id(scsi_qla_host_t *, port_id_t *, uint8_t *);
 extern int qla2x00_rft_id(scsi_qla_host_t *);
 extern int qla2x00_rff_id(scsi_qla_host_t *, u8);
 extern int qla2x00_rnn_id(scsi_qla_host_t *);
@@ -799,6 +842,11 @@ extern int qla24xx_update_all_fcp_prio(scsi_qla_host_t *);
 extern int qla24xx_fcp_prio_cfg_valid(scsi_qla_host_t *,
 	struct qla_fcp_prio_cfg *, uint8_t);
 void qla_insert_tgt_attrs(void);
+extern void qla2x00_stats_cache_init(scsi_qla_host_t *);
+extern void qla2x00_stats_cache_free(scsi_qla_host_t *);
+extern void qla2x00_stats_cache_invalidate(scsi_qla_host_t *);
+extern int qla2x00_get_cached_stats(scsi_qla_host_t *,
+	struct link_statistics *, uint64_t *, unsigned long *, bool);
 /*
  * Global Function Prototypes in qla_dfs.c source file.
  */
@@ -891,7 +939,10 @@ extern int qla82xx_restart_isp(scsi_qla_host_t *);
 /* IOCB related functions */
 extern int qla82xx_start_scsi(srb_t *);
 extern void qla2x00_sp_free(srb_t *sp);
-extern void qla2x00_sp_timeout(qla_timer_arg_t timer_arg);
+extern void qla_tmo_wheel_init(struct scsi_qla_host *);
+extern void qla_tmo_wheel_stop(struct scsi_qla_host *);
+extern int qla_tmo_wheel_add(srb_t *);
+extern void qla_tmo_wheel_del(srb_t *);
 extern void qla2x00_bsg_job_done(srb_t *sp, int);
 extern void qla2x00_bsg_sp_free(srb_t *sp);
 extern void qla2x00_start_iocbs(struct scsi_qla_host *, struct req_que *);
@@ -949,6 +1000,7 @@ extern int qla2x00_issue_iocb_timeout(scsi_qla_host_t *, void *,
 extern int qla2x00_get_idma_speed(scsi_qla_host_t *, uint16_t,
 	uint16_t *, uint16_t *);
 extern int qla24xx_sadb_update(bsg_job_t *bsg_job);
+extern int qla24xx_sadb_update_batch(bsg_job_t *bsg_job);
 extern int qla_post_sa_replace_work(struct scsi_qla_host *vha,
 	 fc_port_t *fcport, uint16_t nport_handle, struct edif_sa_ctl *sa_ctl);
 
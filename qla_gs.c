@@ -530,7 +530,7 @@ static void qla2x00_async_sns_sp_done(srb_t *sp, int rc)
 		if (!e)
 			goto err2;
 
-		del_timer(&sp->u.iocb_cmd.timer);
+		qla_tmo_wheel_del(sp);
 		e->u.iosb.sp = sp;
 		qla2x00_post_work(vha, e);
 		return;
@@ -2746,10 +2746,75 @@ qla2x00_gff_id(scsi_qla_host_t *vha, sw_info_t *list)
 	}
 }
 
+/**
+ * qla2x00_gft_id() - SNS Get FC-4 TYPEs (GFT_ID) query.
+ * @vha: HA context
+ * @d_id: port to query
+ * @fc4_types: 32 byte FC-4 TYPEs bitmap to populate
+ *
+ * Returns 0 on success.
+ */
+int
+qla2x00_gft_id(scsi_qla_host_t *vha, port_id_t *d_id, uint8_t *fc4_types)
+{
+	int		rval;
+	struct qla_hw_data *ha = vha->hw;
+	ms_iocb_entry_t	*ms_pkt;
+	struct ct_sns_req	*ct_req;
+	struct ct_sns_rsp	*ct_rsp;
+	struct ct_arg arg;
+
+	if (!IS_FWI2_CAPABLE(ha))
+		return QLA_FUNCTION_FAILED;
+
+	arg.iocb = ha->ms_iocb;
+	arg.req_dma = ha->ct_sns_dma;
+	arg.rsp_dma = ha->ct_sns_dma;
+	arg.req_size = GFT_ID_REQ_SIZE;
+	arg.rsp_size = GFT_ID_RSP_SIZE;
+	arg.nport_handle = NPH_SNS;
+
+	/* Prepare common MS IOCB */
+	ms_pkt = ha->isp_ops->prep_ms_iocb(vha, &arg);
+
+	/* Prepare CT request */
+	ct_req = qla2x00_prep_ct_req(ha->ct_sns, GFT_ID_CMD, GFT_ID_RSP_SIZE);
+	ct_rsp = &ha->ct_sns->p.rsp;
+
+	/* Prepare CT arguments -- port_id */
+	ct_req->req.port_id.port_id = port_id_to_be_id(*d_id);
+
+	/* Execute MS IOCB */
+	rval = qla2x00_issue_iocb(vha, ha->ms_iocb, ha->ms_iocb_dma,
+	    sizeof(ms_iocb_entry_t));
+	if (rval != QLA_SUCCESS) {
+		ql_dbg(ql_dbg_disc, vha, 0x2125,
+		    "GFT_ID issue IOCB failed (%d).\n", rval);
+	} else if (qla2x00_chk_ms_status(vha, ms_pkt, ct_rsp, "GFT_ID") !=
+	    QLA_SUCCESS) {
+		rval = QLA_FUNCTION_FAILED;
+	} else {
+		memcpy(fc4_types, ct_rsp->rsp.gft_id.fc4_types,
+		    sizeof(ct_rsp->rsp.gft_id.fc4_types));
+	}
+
+	return rval;
+}
+
+/*
+ * A port's speed capability survives logouts; only RSCNs for it or a new
+ * N_Port ID make us ask the name server again.
+ */
 int qla24xx_post_gpsc_work(struct scsi_qla_host *vha, fc_port_t *fcport)
 {
 	struct qla_work_evt *e;
 
+	if (qla_fcport_attr_valid(fcport, QLA_ATTR_SPEED)) {
+		vha->attr_stats.gpsc_hits++;
+		return qla_post_iidma_work(vha, fcport);
+	}
+	vha->attr_stats.gpsc_misses++;
+
 	e = qla2x00_alloc_work(vha, QLA_EVT_GPSC);
 	if (!e)
 		return QLA_FUNCTION_FAILED;
@@ -2823,6 +2888,7 @@ static void qla24xx_async_gpsc_sp_done(srb_t *sp, int res)
 	} else {
 		fcport->fp_speed = qla2x00_port_speed_capability(
 		    be16_to_cpu(ct_rsp->rsp.gpsc.speed));
+		qla_fcport_attr_set(fcport, QLA_ATTR_SPEED, sp->gen1);
 
 		ql_dbg(ql_dbg_disc, vha, 0x2054,
 		    "Async-%s OUT WWPN %8phC speeds=%04x speed=%04x.\n",
@@ -2975,9 +3041,10 @@ void qla24xx_handle_gpnid_event(scsi_qla_host_t *vha, struct event_arg *ea)
 	if (ea->rc) {
 		/* cable is disconnected */
 		list_for_each_entry_safe(fcport, t, &vha->vp_fcports, list) {
-			if (fcport->d_id.b24 == ea->id.b24)
-				fcport->scan_state = QLA_FCPORT_SCAN;
+			if (fcport->d_id.b24 != ea->id.b24)
+				continue;
 
+			fcport->scan_state = QLA_FCPORT_SCAN;
 			qlt_schedule_sess_for_deletion(fcport);
 		}
 	} else {
@@ -2986,16 +3053,16 @@ void qla24xx_handle_gpnid_event(scsi_qla_host_t *vha, struct event_arg *ea)
 		if (fcport) {
 			list_for_each_entry_safe(conflict, t, &vha->vp_fcports,
 			    list) {
-				if ((conflict->d_id.b24 == ea->id.b24) &&
-				    (fcport != conflict))
-					/*
-					 * 2 fcports with conflict Nport ID or
-					 * an existing fcport is having nport ID
-					 * conflict with new fcport.
-					 */
-
-					conflict->scan_state = QLA_FCPORT_SCAN;
+				if (conflict->d_id.b24 != ea->id.b24 ||
+				    fcport == conflict)
+					continue;
 
+				/*
+				 * 2 fcports with conflict Nport ID or
+				 * an existing fcport is having nport ID
+				 * conflict with new fcport.
+				 */
+				conflict->scan_state = QLA_FCPORT_SCAN;
 				qlt_schedule_sess_for_deletion(conflict);
 			}
 
@@ -3216,9 +3283,9 @@ int qla24xx_async_gpnid(scsi_qla_host_t *vha, port_id_t *id)
 	return rval;
 
 done_free_sp:
-	spin_lock_irqsave(&vha->hw->vport_slock, flags);
+	spin_lock_irqsave(&vha->hw->tgt.sess_lock, flags);
 	list_del(&sp->elem);
-	spin_unlock_irqrestore(&vha->hw->vport_slock, flags);
+	spin_unlock_irqrestore(&vha->hw->tgt.sess_lock, flags);
 
 	if (sp->u.iocb_cmd.u.ctarg.req) {
 		dma_free_coherent(&vha->hw->pdev->dev,
@@ -3562,6 +3629,12 @@ out:
 	qla24xx_sp_unmap(vha, sp);
 	spin_lock_irqsave(&vha->work_lock, flags);
 	vha->scan.scan_flags &= ~SF_SCANNING;
+	/* RSCNs that arrived during the scan were held back */
+	if (vha->scan.scan_flags == 0 &&
+	    (vha->scan.rscn_cnt || vha->scan.rscn_full)) {
+		vha->scan.scan_flags |= SF_QUEUED;
+		schedule_delayed_work(&vha->scan.scan_work, 5);
+	}
 	spin_unlock_irqrestore(&vha->work_lock, flags);
 
 	if (recheck) {
@@ -3721,7 +3794,7 @@ static void qla2x00_async_gpnft_gnnft_sp_done(srb_t *sp, int res)
 	    "Async done-%s res %x FC4Type %x\n",
 	    sp->name, res, sp->gen2);
 
-	del_timer(&sp->u.iocb_cmd.timer);
+	qla_tmo_wheel_del(sp);
 	sp->rc = res;
 	if (res) {
 		unsigned long flags;
@@ -3897,6 +3970,7 @@ done_free_sp:
 
 	spin_lock_irqsave(&vha->work_lock, flags);
 	vha->scan.scan_flags &= ~SF_SCANNING;
+	vha->scan.rscn_full = 1;
 	if (vha->scan.scan_flags == 0) {
 		ql_dbg(ql_dbg_disc, vha, 0xffff,
 		    "%s: schedule\n", __func__);
@@ -4061,6 +4135,7 @@ done_free_sp:
 
 	spin_lock_irqsave(&vha->work_lock, flags);
 	vha->scan.scan_flags &= ~SF_SCANNING;
+	vha->scan.rscn_full = 1;
 	if (vha->scan.scan_flags == 0) {
 		ql_dbg(ql_dbg_disc + ql_dbg_verbose, vha, 0xffff,
 		    "%s: Scan scheduled.\n", __func__);
@@ -4079,16 +4154,45 @@ void qla_scan_work_fn(struct work_struct *work)
 	    struct fab_scan, scan_work);
 	struct scsi_qla_host *vha = container_of(s, struct scsi_qla_host,
 	    scan);
+	u32 pid[QLA_RSCN_COALESCE_MAX];
 	unsigned long flags;
+	port_id_t id;
+	int i, n;
+	bool full;
 
-	ql_dbg(ql_dbg_disc, vha, 0xffff,
-	    "%s: schedule loop resync\n", __func__);
-	set_bit(LOCAL_LOOP_UPDATE, &vha->dpc_flags);
-	set_bit(LOOP_RESYNC_NEEDED, &vha->dpc_flags);
-	qla2xxx_wake_dpc(vha);
 	spin_lock_irqsave(&vha->work_lock, flags);
-	vha->scan.scan_flags &= ~SF_QUEUED;
+	/* nothing gathered means a caller asked for a plain rescan */
+	full = s->rscn_full || !s->rscn_cnt;
+	n = s->rscn_cnt;
+	memcpy(pid, s->rscn_pid, n * sizeof(pid[0]));
+	s->rscn_cnt = 0;
+	s->rscn_full = 0;
+	/*
+	 * Clear in the same section as the snapshot so that an RSCN landing
+	 * after it schedules a fresh scan instead of being left stranded.
+	 */
+	s->scan_flags &= ~SF_QUEUED;
+	if (full)
+		s->full_scans++;
+	else
+		s->scans_avoided++;
 	spin_unlock_irqrestore(&vha->work_lock, flags);
+
+	if (full) {
+		ql_dbg(ql_dbg_disc, vha, 0xffff,
+		    "%s: schedule loop resync\n", __func__);
+		set_bit(LOCAL_LOOP_UPDATE, &vha->dpc_flags);
+		set_bit(LOOP_RESYNC_NEEDED, &vha->dpc_flags);
+		qla2xxx_wake_dpc(vha);
+	} else {
+		for (i = 0; i < n; i++) {
+			id.b24 = pid[i];
+			id.b.rsvd_1 = 0;
+			ql_dbg(ql_dbg_disc, vha, 0xffff,
+			    "%s: post gpnid %06x\n", __func__, id.b24);
+			qla24xx_post_gpnid_work(vha, &id);
+		}
+	}
 }
 
 /* GNN_ID */
@@ -10,6 +10,8 @@
 #include <linux/delay.h>
 #include <linux/slab.h>
 #include <linux/vmalloc.h>
+#include <linux/hash.h>
+#include <linux/log2.h>
 
 #include "qla_devtbl.h"
 
@@ -43,22 +45,274 @@ static void __qla24xx_handle_gpdb_event(scsi_qla_host_t *, struct event_arg *);
 
 /* SRB Extensions ---------------------------------------------------------- */
 
-void
-qla2x00_sp_timeout(qla_timer_arg_t t)
+/*
+ * Async srb timeout wheel.  w->base is the jiffy at which slot w->cur
+ * falls due; an srb lands in the slot for the first tick at or after its
+ * expiry, and the tick timer only runs while the wheel is non-empty.
+ */
+
+/*
+ * Run the handlers on w->firing one at a time with the lock dropped.  An
+ * srb completed meanwhile is unlinked from w->firing by
+ * qla_tmo_wheel_del(), exactly as del_timer() would have won.
+ */
+static void
+qla_tmo_wheel_run(struct qla_tmo_wheel *w, unsigned long *flags)
 {
-	srb_t *sp = qla_from_timer(sp, t, u.iocb_cmd.timer);
 	struct srb_iocb *iocb;
+	srb_t *sp;
+
+	while (!list_empty(&w->firing)) {
+		iocb = list_first_entry(&w->firing, struct srb_iocb, tmo_node);
+		list_del_init(&iocb->tmo_node);
+		w->count--;
+		w->expired++;
+		spin_unlock_irqrestore(&w->lock, *flags);
 
-	WARN_ON(irqs_disabled());
-	iocb = &sp->u.iocb_cmd;
-	iocb->timeout(sp);
+		sp = container_of(iocb, srb_t, u.iocb_cmd);
+		WARN_ON(irqs_disabled());
+		iocb->timeout(sp);
+
+		spin_lock_irqsave(&w->lock, *flags);
+	}
 }
 
-void qla2x00_sp_free(srb_t *sp)
+static void
+qla_tmo_wheel_fn(qla_timer_arg_t t)
+{
+	struct qla_tmo_wheel *w = qla_from_timer(w, t, timer);
+	struct list_head *head;
+	struct srb_iocb *iocb, *tmp;
+	unsigned long flags, lag;
+	int n;
+
+	spin_lock_irqsave(&w->lock, flags);
+	for (n = 0; n < QLA_TMO_SLOTS && time_after_eq(jiffies, w->base);
+	    n++) {
+		head = &w->slot[w->cur];
+		list_for_each_entry_safe(iocb, tmp, head, tmo_node) {
+			if (time_before(jiffies, iocb->tmo_expires))
+				continue;
+			list_move_tail(&iocb->tmo_node, &w->firing);
+		}
+		w->cur = (w->cur + 1) % QLA_TMO_SLOTS;
+		w->base += QLA_TMO_TICK;
+	}
+	/*
+	 * Stalled for a whole revolution: every slot has been checked.  Skip
+	 * the missed ticks by moving base and cur together, so each slot
+	 * keeps its place in the schedule.  Moving base alone would leave
+	 * a pending srb up to a full revolution late.
+	 */
+	if (time_after_eq(jiffies, w->base)) {
+		lag = (jiffies - w->base) / QLA_TMO_TICK + 1;
+		w->base += lag * QLA_TMO_TICK;
+		w->cur = (w->cur + lag) % QLA_TMO_SLOTS;
+	}
+
+	qla_tmo_wheel_run(w, &flags);
+
+	if (w->count && !w->dead)
+		mod_timer(&w->timer, w->base);
+	else
+		w->armed = 0;
+	spin_unlock_irqrestore(&w->lock, flags);
+}
+
+void qla_tmo_wheel_init(struct scsi_qla_host *vha)
+{
+	struct qla_tmo_wheel *w = &vha->tmo_wheel;
+	int i;
+
+	spin_lock_init(&w->lock);
+	qla_timer_setup(&w->timer, qla_tmo_wheel_fn, 0, w);
+	INIT_LIST_HEAD(&w->firing);
+	for (i = 0; i < QLA_TMO_SLOTS; i++)
+		INIT_LIST_HEAD(&w->slot[i]);
+	w->base = jiffies;
+}
+
+/*
+ * Teardown.  Stop the tick, then expire every srb still on the wheel
+ * through its ->timeout handler.  None may stay linked here, because a
+ * later qla_tmo_wheel_del() would touch a vha that is about to be freed.
+ */
+void qla_tmo_wheel_stop(struct scsi_qla_host *vha)
+{
+	struct qla_tmo_wheel *w = &vha->tmo_wheel;
+	unsigned long flags;
+	int i;
+
+	spin_lock_irqsave(&w->lock, flags);
+	w->dead = 1;
+	spin_unlock_irqrestore(&w->lock, flags);
+	del_timer_sync(&w->timer);
+
+	spin_lock_irqsave(&w->lock, flags);
+	/* a handler may queue a follow-up srb; keep going until empty */
+	while (w->count) {
+		for (i = 0; i < QLA_TMO_SLOTS; i++)
+			list_splice_tail_init(&w->slot[i], &w->firing);
+		if (list_empty(&w->firing))
+			break;
+		qla_tmo_wheel_run(w, &flags);
+	}
+	spin_unlock_irqrestore(&w->lock, flags);
+}
+
+/*
+ * Called from qla2x00_start_sp() with the qpair lock held, before the
+ * IOCB is built.  Fails once qla_tmo_wheel_stop() has run: nothing would
+ * ever time the srb out, so it must not be started.
+ */
+int qla_tmo_wheel_add(srb_t *sp)
+{
+	struct qla_tmo_wheel *w = &sp->vha->tmo_wheel;
+	struct srb_iocb *iocb = &sp->u.iocb_cmd;
+	unsigned long flags, delta = 0;
+
+	spin_lock_irqsave(&w->lock, flags);
+	if (w->dead) {
+		spin_unlock_irqrestore(&w->lock, flags);
+		return QLA_FUNCTION_FAILED;
+	}
+	if (!w->armed) {
+		w->base = jiffies;
+		w->armed = 1;
+		mod_timer(&w->timer, w->base);
+	}
+	if (time_after(iocb->tmo_expires, w->base))
+		delta = DIV_ROUND_UP(iocb->tmo_expires - w->base,
+		    QLA_TMO_TICK);
+	list_add_tail(&iocb->tmo_node,
+	    &w->slot[(w->cur + delta) % QLA_TMO_SLOTS]);
+	w->count++;
+	w->added++;
+	spin_unlock_irqrestore(&w->lock, flags);
+
+	return QLA_SUCCESS;
+}
+
+void qla_tmo_wheel_del(srb_t *sp)
 {
+	struct qla_tmo_wheel *w = &sp->vha->tmo_wheel;
 	struct srb_iocb *iocb = &sp->u.iocb_cmd;
+	unsigned long flags;
+
+	if (!sp->start_timer)
+		return;
+
+	spin_lock_irqsave(&w->lock, flags);
+	if (!list_empty(&iocb->tmo_node)) {
+		list_del_init(&iocb->tmo_node);
+		w->count--;
+		w->cancelled++;
+	}
+	spin_unlock_irqrestore(&w->lock, flags);
+}
+
+static int qla_login_stage(srb_t *sp)
+{
+	switch (sp->type) {
+	case SRB_LOGIN_CMD:
+		return QLA_LOGIN_STAGE_PLOGI;
+	case SRB_PRLI_CMD:
+		return QLA_LOGIN_STAGE_PRLI;
+	default:
+		if (sp->u.iocb_cmd.u.mbx.out_mb[0] == MBC_PORT_NODE_NAME_LIST)
+			return QLA_LOGIN_STAGE_GNL;
+		return QLA_LOGIN_STAGE_GPDB;
+	}
+}
+
+/* Called before qla2x00_start_sp() so a fast completion can't underflow. */
+static void qla_login_slot_get(srb_t *sp)
+{
+	struct qla_login_sched *ls = &sp->vha->login_sched;
+	u32 n;
+
+	sp->flags |= SRB_LOGIN_SLOT;
+	n = atomic_inc_return(&ls->inflight);
+	if (n > READ_ONCE(ls->peak))
+		WRITE_ONCE(ls->peak, n);
+}
+
+/* Undo qla_login_slot_get() when the exchange was never started. */
+static void qla_login_slot_cancel(srb_t *sp)
+{
+	if (sp->flags & SRB_LOGIN_SLOT) {
+		sp->flags &= ~SRB_LOGIN_SLOT;
+		atomic_dec(&sp->vha->login_sched.inflight);
+	}
+}
+
+static void qla_login_slot_put(srb_t *sp)
+{
+	struct scsi_qla_host *vha = sp->vha;
+	struct qla_login_sched *ls = &vha->login_sched;
+	struct qla_login_stage_stats *st = &ls->stage[qla_login_stage(sp)];
+	u32 ms = jiffies_to_msecs(jiffies - sp->start_jiffies);
+	unsigned long flags;
+
+	sp->flags &= ~SRB_LOGIN_SLOT;
+	atomic_dec(&ls->inflight);
+
+	spin_lock_irqsave(&ls->lock, flags);
+	st->count++;
+	st->total_ms += ms;
+	if (ms > st->max_ms)
+		st->max_ms = ms;
+	spin_unlock_irqrestore(&ls->lock, flags);
+
+	/* restart held-back ports now rather than on the next relogin tick */
+	if (test_and_clear_bit(0, &ls->deferred) &&
+	    !test_bit(UNLOADING, &vha->dpc_flags))
+		qla24xx_post_relogin_work(vha);
+}
+
+/*
+ * A registered rport has I/O blocked behind it and the boot target gates
+ * the whole host, so both get ahead of ports nobody is waiting on.
+ */
+bool qla_login_priority(fc_port_t *fcport)
+{
+	struct qla_hw_data *ha = fcport->vha->hw;
+
+	if (fcport->rport)
+		return true;
+
+	return wwn_to_u64(ha->boot_port_name) &&
+	    !memcmp(fcport->port_name, ha->boot_port_name, WWN_SIZE);
+}
+
+static bool qla_login_window_open(struct scsi_qla_host *vha,
+    fc_port_t *fcport)
+{
+	struct qla_login_sched *ls = &vha->login_sched;
+	int limit = ql2xlogin_window;
+	unsigned long flags;
+
+	if (limit <= 0)
+		return true;
+
+	if (!qla_login_priority(fcport))
+		limit -= limit / 4;
+
+	if (atomic_read(&ls->inflight) < limit)
+		return true;
 
-	del_timer(&iocb->timer);
+	set_bit(0, &ls->deferred);
+	spin_lock_irqsave(&ls->lock, flags);
+	ls->deferrals++;
+	spin_unlock_irqrestore(&ls->lock, flags);
+	return false;
+}
+
+void qla2x00_sp_free(srb_t *sp)
+{
+	qla_tmo_wheel_del(sp);
+	if (sp->flags & SRB_LOGIN_SLOT)
+		qla_login_slot_put(sp);
 	qla2x00_rel_sp(sp);
 }
 
@@ -131,24 +385,26 @@ static void qla24xx_abort_sp_done(srb_t *sp, int res)
 	if (orig_sp)
 		qla_wait_nvme_release_cmd_kref(orig_sp);
 
-	del_timer(&sp->u.iocb_cmd.timer);
+	qla_tmo_wheel_del(sp);
 	if (sp->flags & SRB_WAKEUP_ON_COMP)
 		complete(&abt->u.abt.comp);
 	else
 		sp->free(sp);
 }
 
-int qla24xx_async_abort_cmd(srb_t *cmd_sp, bool wait)
+/*
+ * Build, but do not start, an abort SRB for @cmd_sp on the command's own
+ * qpair.  Callers that batch aborts may override ->done.
+ */
+srb_t *qla24xx_prep_abort_sp(srb_t *cmd_sp, bool wait)
 {
-	scsi_qla_host_t *vha = cmd_sp->vha;
 	struct srb_iocb *abt_iocb;
 	srb_t *sp;
-	int rval = QLA_FUNCTION_FAILED;
 
 	sp = qla2xxx_get_qpair_sp(cmd_sp->vha, cmd_sp->qpair, cmd_sp->fcport,
 				  GFP_ATOMIC);
 	if (!sp)
-		return QLA_MEMORY_ALLOC_FAILED;
+		return NULL;
 
 	abt_iocb = &sp->u.iocb_cmd;
 	sp->type = SRB_ABT_CMD;
@@ -169,6 +425,21 @@ int qla24xx_async_abort_cmd(srb_t *cmd_sp, bool wait)
 
 	sp->done = qla24xx_abort_sp_done;
 
+	return sp;
+}
+
+int qla24xx_async_abort_cmd(srb_t *cmd_sp, bool wait)
+{
+	scsi_qla_host_t *vha = cmd_sp->vha;
+	struct srb_iocb *abt_iocb;
+	srb_t *sp;
+	int rval = QLA_FUNCTION_FAILED;
+
+	sp = qla24xx_prep_abort_sp(cmd_sp, wait);
+	if (!sp)
+		return QLA_MEMORY_ALLOC_FAILED;
+	abt_iocb = &sp->u.iocb_cmd;
+
 	ql_dbg(ql_dbg_async, vha, 0x507c,
 	       "Abort command issued - hdl=%x, type=%x\n", cmd_sp->handle,
 	       cmd_sp->type);
@@ -352,6 +623,7 @@ qla2x00_async_login(struct scsi_qla_host *vha, fc_port_t *fcport,
 	    fcport->d_id.b.domain, fcport->d_id.b.area, fcport->d_id.b.al_pa,
 	    fcport->login_retry, lio->u.logio.flags);
 
+	qla_login_slot_get(sp);
 	rval = qla2x00_start_sp(sp);
 	if (rval != QLA_SUCCESS) {
 		fcport->flags |= FCF_LOGIN_NEEDED;
@@ -362,6 +634,7 @@ qla2x00_async_login(struct scsi_qla_host *vha, fc_port_t *fcport,
 	return rval;
 
 done_free_sp:
+	qla_login_slot_cancel(sp);
 	sp->free(sp);
 	fcport->flags &= ~FCF_ASYNC_SENT;
 done:
@@ -679,14 +952,111 @@ void qla2x00_clear_loop_id(fc_port_t *fcport)
 	fcport->loop_id = FC_NO_LOOP_ID;
 }
 
+int qla24xx_alloc_gnl_index(struct scsi_qla_host *vha)
+{
+	struct qla_gnl_index *gi;
+	u16 entries = vha->hw->max_loop_id + 1;
+	u8 bits = ilog2(roundup_pow_of_two(entries));
+	size_t heads = sizeof(u16) << bits;
+	size_t maps = BITS_TO_LONGS(entries) * sizeof(unsigned long);
+	void *p;
+
+	gi = kzalloc(sizeof(*gi) + 2 * maps + 2 * heads +
+	    2 * entries * sizeof(u16), GFP_KERNEL);
+	if (!gi)
+		return -ENOMEM;
+
+	/* carve the arrays out of one block, longs first for alignment */
+	p = gi + 1;
+	gi->lid_map = p;
+	p += maps;
+	gi->seen = p;
+	p += maps;
+	gi->wwpn_head = p;
+	p += heads;
+	gi->pid_head = p;
+	p += heads;
+	gi->wwpn_next = p;
+	p += entries * sizeof(u16);
+	gi->pid_next = p;
+
+	gi->entries = entries;
+	gi->bits = bits;
+	vha->gnl.idx = gi;
+
+	return 0;
+}
+
+void qla24xx_free_gnl_index(struct scsi_qla_host *vha)
+{
+	kfree(vha->gnl.idx);
+	vha->gnl.idx = NULL;
+}
+
+static inline u32 qla24xx_gnl_pid(struct get_name_list_extended *e)
+{
+	return e->port_id[2] << 16 | e->port_id[1] << 8 | e->port_id[0];
+}
+
+/*
+ * GNL port names compare against fc_port::port_name through the memory
+ * image of wwn_to_u64(), so key both sides the same way.
+ */
+static inline u64 qla24xx_gnl_fcport_key(fc_port_t *fcport)
+{
+	u64 key;
+
+	memcpy(&key, fcport->port_name, WWN_SIZE);
+	return key;
+}
+
+static void qla24xx_gnl_build_index(struct scsi_qla_host *vha, u16 n)
+{
+	struct qla_gnl_index *gi = vha->gnl.idx;
+	struct get_name_list_extended *e;
+	u32 h;
+	u16 i, lid;
+
+	memset(gi->wwpn_head, 0xff, sizeof(u16) << gi->bits);
+	memset(gi->pid_head, 0xff, sizeof(u16) << gi->bits);
+	bitmap_zero(gi->lid_map, gi->entries);
+	bitmap_zero(gi->seen, gi->entries);
+
+	/* insert backwards so each chain walks in ascending entry order */
+	for (i = n; i-- > 0; ) {
+		e = &vha->gnl.l[i];
+
+		h = hash_64(wwn_to_u64(e->port_name), gi->bits);
+		gi->wwpn_next[i] = gi->wwpn_head[h];
+		gi->wwpn_head[h] = i;
+
+		h = hash_32(qla24xx_gnl_pid(e), gi->bits);
+		gi->pid_next[i] = gi->pid_head[h];
+		gi->pid_head[h] = i;
+
+		lid = le16_to_cpu(e->nport_handle);
+		if (lid < gi->entries)
+			set_bit(lid, gi->lid_map);
+	}
+}
+
+#define for_each_gnl_wwpn(gi, i, key)					\
+	for (i = (gi)->wwpn_head[hash_64(key, (gi)->bits)];		\
+	     i != QLA_GNL_NONE; i = (gi)->wwpn_next[i])
+
+#define for_each_gnl_pid(gi, i, pid)					\
+	for (i = (gi)->pid_head[hash_32(pid, (gi)->bits)];		\
+	     i != QLA_GNL_NONE; i = (gi)->pid_next[i])
+
 static void qla24xx_handle_gnl_done_event(scsi_qla_host_t *vha,
 	struct event_arg *ea)
 {
 	fc_port_t *fcport, *conflict_fcport;
 	struct get_name_list_extended *e;
+	struct qla_gnl_index *gi = vha->gnl.idx;
 	u16 i, n, found = 0, loop_id;
 	port_id_t id;
-	u64 wwn;
+	u64 wwn, key;
 	u16 data[2];
 	u8 current_login_state, nvme_cls;
 
@@ -730,17 +1100,17 @@ static void qla24xx_handle_gnl_done_event(scsi_qla_host_t *vha,
 	    fcport->d_id.b.domain, fcport->d_id.b.area,
 	    fcport->d_id.b.al_pa, fcport->loop_id);
 
-	for (i = 0; i < n; i++) {
+	key = qla24xx_gnl_fcport_key(fcport);
+	for_each_gnl_wwpn(gi, i, key) {
 		e = &vha->gnl.l[i];
-		wwn = wwn_to_u64(e->port_name);
+		if (wwn_to_u64(e->port_name) != key)
+			continue;
+
 		id.b.domain = e->port_id[2];
 		id.b.area = e->port_id[1];
 		id.b.al_pa = e->port_id[0];
 		id.b.rsvd_1 = 0;
 
-		if (memcmp((u8 *)&wwn, fcport->port_name, WWN_SIZE))
-			continue;
-
 		if (IS_SW_RESV_ADDR(id))
 			continue;
 
@@ -904,35 +1274,31 @@ static void qla24xx_handle_gnl_done_event(scsi_qla_host_t *vha,
 		switch (vha->hw->current_topology) {
 		case ISP_CFG_F:
 		case ISP_CFG_FL:
-			for (i = 0; i < n; i++) {
+			for_each_gnl_pid(gi, i, fcport->d_id.b24) {
 				e = &vha->gnl.l[i];
-				id.b.domain = e->port_id[0];
-				id.b.area = e->port_id[1];
-				id.b.al_pa = e->port_id[2];
-				id.b.rsvd_1 = 0;
-				loop_id = le16_to_cpu(e->nport_handle);
-
-				if (fcport->d_id.b24 == id.b24) {
-					conflict_fcport =
-					    qla2x00_find_fcport_by_wwpn(vha,
-						e->port_name, 0);
-					if (conflict_fcport) {
-						ql_dbg(ql_dbg_disc + ql_dbg_verbose,
-						    vha, 0x20e5,
-						    "%s %d %8phC post del sess\n",
-						    __func__, __LINE__,
-						    conflict_fcport->port_name);
-						qlt_schedule_sess_for_deletion
-							(conflict_fcport);
-					}
+				if (qla24xx_gnl_pid(e) != fcport->d_id.b24)
+					continue;
+
+				conflict_fcport =
+				    qla2x00_find_fcport_by_wwpn(vha,
+					e->port_name, 0);
+				if (conflict_fcport) {
+					ql_dbg(ql_dbg_disc + ql_dbg_verbose,
+					    vha, 0x20e5,
+					    "%s %d %8phC post del sess\n",
+					    __func__, __LINE__,
+					    conflict_fcport->port_name);
+					qlt_schedule_sess_for_deletion
+						(conflict_fcport);
 				}
-				/*
-				 * FW already picked this loop id for
-				 * another fcport
-				 */
-				if (fcport->loop_id == loop_id)
-					fcport->loop_id = FC_NO_LOOP_ID;
 			}
+			/*
+			 * FW already picked this loop id for
+			 * another fcport
+			 */
+			if (fcport->loop_id < gi->entries &&
+			    test_bit(fcport->loop_id, gi->lid_map))
+				fcport->loop_id = FC_NO_LOOP_ID;
 			qla24xx_fcport_handle_login(vha, fcport);
 			break;
 		case ISP_CFG_N:
@@ -984,9 +1350,10 @@ static void qla24xx_async_gnl_sp_done(srb_t *sp, int res)
 	u16 i, n = 0, loop_id;
 	struct event_arg ea;
 	struct get_name_list_extended *e;
-	u64 wwn;
+	struct qla_gnl_index *gi = vha->gnl.idx;
+	struct qla_gnl_stats *gs = &vha->gnl.stats;
+	u64 wwn, key, start, delta;
 	struct list_head h;
-	bool found = false;
 
 	ql_dbg(ql_dbg_disc, vha, 0x20e7,
 	    "Async done-%s res %x mb[1]=%x mb[2]=%x \n",
@@ -996,6 +1363,7 @@ static void qla24xx_async_gnl_sp_done(srb_t *sp, int res)
 	if (res == QLA_FUNCTION_TIMEOUT)
 		return;
 
+	start = ktime_get_ns();
 	sp->fcport->flags &= ~(FCF_ASYNC_SENT|FCF_ASYNC_ACTIVE);
 	memset(&ea, 0, sizeof(ea));
 	ea.sp = sp;
@@ -1005,8 +1373,10 @@ static void qla24xx_async_gnl_sp_done(srb_t *sp, int res)
 	    sizeof(struct get_name_list_extended)) {
 		n = sp->u.iocb_cmd.u.mbx.in_mb[1] /
 		    sizeof(struct get_name_list_extended);
+		n = min_t(u16, n, gi->entries);
 		ea.data[0] = sp->u.iocb_cmd.u.mbx.in_mb[1]; /* amnt xfered */
 	}
+	qla24xx_gnl_build_index(vha, n);
 
 	for (i = 0; i < n; i++) {
 		e = &vha->gnl.l[i];
@@ -1041,29 +1411,32 @@ static void qla24xx_async_gnl_sp_done(srb_t *sp, int res)
 		qla24xx_handle_gnl_done_event(vha, &ea);
 	}
 
+	/* mark every entry some fcport already owns */
+	list_for_each_entry(fcport, &vha->vp_fcports, list) {
+		key = qla24xx_gnl_fcport_key(fcport);
+		for_each_gnl_wwpn(gi, i, key) {
+			if (wwn_to_u64(vha->gnl.l[i].port_name) == key)
+				set_bit(i, gi->seen);
+		}
+	}
+
 	/* create new fcport if fw has knowledge of new sessions */
 	for (i = 0; i < n; i++) {
 		port_id_t id;
 		u64 wwnn;
 
+		if (test_bit(i, gi->seen))
+			continue;
+
 		e = &vha->gnl.l[i];
 		wwn = wwn_to_u64(e->port_name);
 
-		found = false;
-		list_for_each_entry_safe(fcport, tf, &vha->vp_fcports, list) {
-			if (!memcmp((u8 *)&wwn, fcport->port_name,
-			    WWN_SIZE)) {
-				found = true;
-				break;
-			}
-		}
-
 		id.b.domain = e->port_id[2];
 		id.b.area = e->port_id[1];
 		id.b.al_pa = e->port_id[0];
 		id.b.rsvd_1 = 0;
 
-		if (!found && wwn && !IS_SW_RESV_ADDR(id)) {
+		if (wwn && !IS_SW_RESV_ADDR(id)) {
 			ql_dbg(ql_dbg_disc, vha, 0x2065,
 			    "%s %d %8phC %06x post new sess\n",
 			    __func__, __LINE__, (u8 *)&wwn, id.b24);
@@ -1073,7 +1446,18 @@ static void qla24xx_async_gnl_sp_done(srb_t *sp, int res)
 		}
 	}
 
+	delta = ktime_get_ns() - start;
+	ql_dbg(ql_dbg_disc, vha, 0x2120,
+	    "%s processed %d entries in %llu us\n",
+	    __func__, n, div_u64(delta, NSEC_PER_USEC));
+
 	spin_lock_irqsave(&vha->hw->tgt.sess_lock, flags);
+	gs->count++;
+	gs->entries += n;
+	gs->last_ns = delta;
+	gs->total_ns += delta;
+	if (delta > gs->max_ns)
+		gs->max_ns = delta;
 	vha->gnl.sent = 0;
 	if (!list_empty(&vha->gnl.fcports)) {
 		/* retrigger gnl */
@@ -1147,6 +1531,7 @@ int qla24xx_async_gnl(struct scsi_qla_host *vha, fc_port_t *fcport)
 	    "Async-%s - OUT WWPN %8phC hndl %x\n",
 	    sp->name, fcport->port_name, sp->handle);
 
+	qla_login_slot_get(sp);
 	rval = qla2x00_start_sp(sp);
 	if (rval != QLA_SUCCESS)
 		goto done_free_sp;
@@ -1154,6 +1539,7 @@ int qla24xx_async_gnl(struct scsi_qla_host *vha, fc_port_t *fcport)
 	return rval;
 
 done_free_sp:
+	qla_login_slot_cancel(sp);
 	sp->free(sp);
 done:
 	fcport->flags &= ~(FCF_ASYNC_ACTIVE | FCF_ASYNC_SENT);
@@ -1296,6 +1682,7 @@ qla24xx_async_prli(struct scsi_qla_host *vha, fc_port_t *fcport)
 	    fcport->login_retry, fcport->fc4_type, vha->hw->fc4_type_priority,
 	    NVME_TARGET(vha->hw, fcport) ? "nvme" : "fcp");
 
+	qla_login_slot_get(sp);
 	rval = qla2x00_start_sp(sp);
 	if (rval != QLA_SUCCESS) {
 		fcport->flags |= FCF_LOGIN_NEEDED;
@@ -1306,6 +1693,7 @@ qla24xx_async_prli(struct scsi_qla_host *vha, fc_port_t *fcport)
 	return rval;
 
 done_free_sp:
+	qla_login_slot_cancel(sp);
 	sp->free(sp);
 	fcport->flags &= ~FCF_ASYNC_SENT;
 	return rval;
@@ -1385,6 +1773,7 @@ int qla24xx_async_gpdb(struct scsi_qla_host *vha, fc_port_t *fcport, u8 opt)
 	    "Async-%s %8phC hndl %x opt %x\n",
 	    sp->name, fcport->port_name, sp->handle, opt);
 
+	qla_login_slot_get(sp);
 	rval = qla2x00_start_sp(sp);
 	if (rval != QLA_SUCCESS)
 		goto done_free_sp;
@@ -1394,6 +1783,7 @@ done_free_sp:
 	if (pd)
 		dma_pool_free(ha->s_dma_pool, pd, pd_dma);
 
+	qla_login_slot_cancel(sp);
 	sp->free(sp);
 	fcport->flags &= ~FCF_ASYNC_SENT;
 done:
@@ -1675,6 +2065,17 @@ int qla24xx_fcport_handle_login(struct scsi_qla_host *vha, fc_port_t *fcport)
 		return 0;
 	}
 
+	/* only new login sequences wait for the window */
+	if (fcport->disc_state == DSC_DELETED &&
+	    !qla_login_window_open(vha, fcport)) {
+		set_bit(RELOGIN_NEEDED, &vha->dpc_flags);
+		ql_dbg(ql_dbg_disc, vha, 0x20d8,
+		    "%s %d %8phC login window full\n",
+		    __func__, __LINE__,
+		    fcport->port_name);
+		return 0;
+	}
+
 	switch (fcport->disc_state) {
 	case DSC_DELETED:
 		wwn = wwn_to_u64(fcport->node_name);
@@ -1813,10 +2214,176 @@ int qla24xx_post_newsess_work(struct scsi_qla_host *vha, port_id_t *id,
 	return qla2x00_post_work(vha, e);
 }
 
+/* Bits of an N_Port ID an RSCN of this format is about. */
+static u32 qla_rscn_mask(port_id_t *id)
+{
+	switch (id->b.rsvd_1) {
+	case RSCN_PORT_ADDR:
+		return 0xffffff;
+	case RSCN_AREA_ADDR:
+		return 0xffff00;
+	case RSCN_DOM_ADDR:
+		return 0xff0000;
+	default:
+		return 0;
+	}
+}
+
+/*
+ * An area, domain or fabric RSCN may stand for ports whose attributes
+ * changed without a port-scoped RSCN; forget what we cached for them.
+ */
+static void qla_fcport_attr_invalidate(scsi_qla_host_t *vha, port_id_t *id)
+{
+	fc_port_t *fcport;
+	u32 mask = qla_rscn_mask(id);
+
+	list_for_each_entry(fcport, &vha->vp_fcports, list) {
+		if (!fcport->attr_valid ||
+		    (fcport->d_id.b24 & mask) != (id->b24 & mask))
+			continue;
+		fcport->attr_valid = 0;
+		vha->attr_stats.invalidated++;
+	}
+}
+
+static void qla_disc_cache_drop(struct qla_disc_cache *dc,
+	struct qla_disc_ent *ent)
+{
+	hash_del(&ent->hnode);
+	ent->valid = 0;
+	list_move(&ent->lru, &dc->lru);
+}
+
+/* Forget cached attributes of every port the RSCN covers. */
+static void qla_disc_cache_invalidate(scsi_qla_host_t *vha, port_id_t *id)
+{
+	struct qla_disc_cache *dc = &vha->disc_cache;
+	struct qla_disc_ent *ent;
+	struct hlist_node *tmp;
+	unsigned long flags;
+	u32 mask = qla_rscn_mask(id);
+	int bkt;
+
+	spin_lock_irqsave(&dc->lock, flags);
+	hash_for_each_safe(dc->hash, bkt, tmp, ent, hnode) {
+		if ((ent->d_id.b24 & mask) == (id->b24 & mask))
+			qla_disc_cache_drop(dc, ent);
+	}
+	spin_unlock_irqrestore(&dc->lock, flags);
+}
+
+static struct qla_disc_ent *
+qla_disc_cache_find(struct qla_disc_cache *dc, u64 wwpn)
+{
+	struct qla_disc_ent *ent;
+
+	hash_for_each_possible(dc->hash, ent, hnode, wwpn)
+		if (ent->wwpn == wwpn)
+			return ent;
+
+	return NULL;
+}
+
+/*
+ * Remember what the name server told us about @fcport before it is freed,
+ * so a session to the same WWPN at the same N_Port ID can start without
+ * GFF_ID and GPSC.
+ */
+void qla_disc_cache_save(fc_port_t *fcport)
+{
+	struct qla_disc_cache *dc = &fcport->vha->disc_cache;
+	struct qla_disc_ent *ent;
+	unsigned long flags;
+	u64 wwpn = wwn_to_u64(fcport->port_name);
+	u8 valid = 0;
+
+	if (!dc->size || !wwpn || fcport->n2n_flag ||
+	    !(fcport->flags & FCF_FABRIC_DEVICE))
+		return;
+
+	if (fcport->fc4_type)
+		valid |= QLA_ATTR_FC4;
+	if (qla_fcport_attr_valid(fcport, QLA_ATTR_SPEED))
+		valid |= QLA_ATTR_SPEED;
+	if (!valid)
+		return;
+
+	spin_lock_irqsave(&dc->lock, flags);
+	if (!dc->size)
+		goto out;
+
+	ent = qla_disc_cache_find(dc, wwpn);
+	if (!ent) {
+		ent = list_first_entry(&dc->lru, struct qla_disc_ent, lru);
+		if (!hlist_unhashed(&ent->hnode))
+			hash_del(&ent->hnode);
+		ent->wwpn = wwpn;
+		hash_add(dc->hash, &ent->hnode, wwpn);
+	}
+	ent->d_id = fcport->d_id;
+	ent->fc4_type = fcport->fc4_type;
+	ent->fc4_features = fcport->fc4_features;
+	ent->fp_speed = fcport->fp_speed;
+	ent->valid = valid;
+	list_move_tail(&ent->lru, &dc->lru);
+	dc->saved++;
+out:
+	spin_unlock_irqrestore(&dc->lock, flags);
+}
+
+/* Hand a new fabric session whatever we still know about its WWPN. */
+void qla_disc_cache_seed(scsi_qla_host_t *vha, fc_port_t *fcport)
+{
+	struct qla_disc_cache *dc = &vha->disc_cache;
+	struct qla_disc_ent *ent;
+	unsigned long flags;
+	u8 valid = 0, fc4_type = 0, fc4_features = 0;
+	u16 fp_speed = 0;
+
+	if (!dc->size)
+		return;
+
+	spin_lock_irqsave(&dc->lock, flags);
+	ent = qla_disc_cache_find(dc, wwn_to_u64(fcport->port_name));
+	if (ent) {
+		if (ent->d_id.b24 == fcport->d_id.b24) {
+			valid = ent->valid;
+			fc4_type = ent->fc4_type;
+			fc4_features = ent->fc4_features;
+			fp_speed = ent->fp_speed;
+		}
+		/* The fc_port owns these from now on. */
+		qla_disc_cache_drop(dc, ent);
+	}
+	if (valid)
+		dc->hits++;
+	else
+		dc->misses++;
+	spin_unlock_irqrestore(&dc->lock, flags);
+
+	if ((valid & QLA_ATTR_FC4) && !fcport->fc4_type) {
+		fcport->fc4_type = fc4_type;
+		fcport->fc4_features = fc4_features;
+	}
+	if (valid & QLA_ATTR_SPEED) {
+		fcport->fp_speed = fp_speed;
+		qla_fcport_attr_set(fcport, QLA_ATTR_SPEED, fcport->rscn_gen);
+	}
+
+	if (valid)
+		ql_dbg(ql_dbg_disc, vha, 0x2126,
+		    "%8phC seeded from discovery cache fc4_type %x speed %x.\n",
+		    fcport->port_name, fcport->fc4_type, fcport->fp_speed);
+}
+
 void qla2x00_handle_rscn(scsi_qla_host_t *vha, struct event_arg *ea)
 {
+	struct fab_scan *scan = &vha->scan;
 	fc_port_t *fcport;
 	unsigned long flags;
+	bool targeted;
+	int i;
 
 	fcport = qla2x00_find_fcport_by_nportid(vha, &ea->id, 1);
 	if (fcport) {
@@ -1830,11 +2397,36 @@ void qla2x00_handle_rscn(scsi_qla_host_t *vha, struct event_arg *ea)
 		fcport->rscn_gen++;
 	}
 
+	if (ea->id.b.rsvd_1 != RSCN_PORT_ADDR)
+		qla_fcport_attr_invalidate(vha, &ea->id);
+	qla_disc_cache_invalidate(vha, &ea->id);
+
+	targeted = ql2xrscn_coalesce_ms > 0 &&
+	    ea->id.b.rsvd_1 == RSCN_PORT_ADDR &&
+	    (vha->hw->current_topology == ISP_CFG_F ||
+	     vha->hw->current_topology == ISP_CFG_FL);
+
 	spin_lock_irqsave(&vha->work_lock, flags);
-	if (vha->scan.scan_flags == 0) {
+	scan->rscn_rcvd++;
+	if (scan->rscn_full) {
+		scan->rscn_coalesced++;
+	} else if (!targeted || scan->rscn_cnt == QLA_RSCN_COALESCE_MAX) {
+		scan->rscn_full = 1;
+	} else {
+		for (i = 0; i < scan->rscn_cnt; i++)
+			if (scan->rscn_pid[i] == ea->id.b24)
+				break;
+		if (i < scan->rscn_cnt)
+			scan->rscn_coalesced++;
+		else
+			scan->rscn_pid[scan->rscn_cnt++] = ea->id.b24;
+	}
+
+	if (scan->scan_flags == 0) {
 		ql_dbg(ql_dbg_disc, vha, 0xffff, "%s: schedule\n", __func__);
-		vha->scan.scan_flags |= SF_QUEUED;
-		schedule_delayed_work(&vha->scan.scan_work, 5);
+		scan->scan_flags |= SF_QUEUED;
+		schedule_delayed_work(&scan->scan_work, ql2xrscn_coalesce_ms ?
+		    msecs_to_jiffies(ql2xrscn_coalesce_ms) : 5);
 	}
 	spin_unlock_irqrestore(&vha->work_lock, flags);
 }
@@ -3909,28 +4501,63 @@ out:
 	return ha->flags.lr_detected;
 }
 
+static u8 qla_qpair_pool(struct qla_hw_data *ha, struct qla_qpair *qp)
+{
+	if (ha->nvme_qpairs && qp != ha->base_qpair &&
+	    qp->id >= ha->nvme_qpair_base &&
+	    qp->id < ha->nvme_qpair_base + ha->nvme_qpairs)
+		return QLA_QP_POOL_NVME;
+
+	return QLA_QP_POOL_SCSI;
+}
+
 void qla_init_iocb_limit(scsi_qla_host_t *vha)
 {
-	u16 i, num_qps;
-	u32 limit;
+	u16 i, num_qps, qps[QLA_QP_POOLS] = { 1, 0 };
+	u32 limit, xlimit, pct;
+	u32 plimit[QLA_QP_POOLS], pxlimit[QLA_QP_POOLS];
 	struct qla_hw_data *ha = vha->hw;
+	struct qla_qpair *qp;
+	u8 pool;
 
 	num_qps = ha->num_qpairs + 1;
 	limit = (ha->orig_fw_iocb_count * QLA_IOCB_PCT_LIMIT) / 100;
+	xlimit = (ha->orig_fw_xcb_count * QLA_IOCB_PCT_LIMIT) / 100;
 
-	ha->base_qpair->fwres.iocbs_total = ha->orig_fw_iocb_count;
-	ha->base_qpair->fwres.iocbs_limit = limit;
-	ha->base_qpair->fwres.iocbs_qp_limit = limit/num_qps;
-	ha->base_qpair->fwres.iocbs_used = 0;
-	for (i=0; i < ha->max_qpairs; i++) {
-		if (ha->queue_pair_map[i])  {
-			ha->queue_pair_map[i]->fwres.iocbs_total =
-				ha->orig_fw_iocb_count;
-			ha->queue_pair_map[i]->fwres.iocbs_limit = limit;
-			ha->queue_pair_map[i]->fwres.iocbs_qp_limit =
-				limit/num_qps;
-			ha->queue_pair_map[i]->fwres.iocbs_used = 0;
-		}
+	for (i = 0; i < ha->max_qpairs; i++) {
+		if (ha->queue_pair_map[i])
+			qps[qla_qpair_pool(ha, ha->queue_pair_map[i])]++;
+	}
+
+	if (qps[QLA_QP_POOL_NVME]) {
+		/* Weighted split, or by qpair count; neither pool starves. */
+		pct = ql2xnvme_qpair_weight > 0 ? ql2xnvme_qpair_weight :
+		    (qps[QLA_QP_POOL_NVME] * 100) / num_qps;
+		pct = clamp_t(u32, pct, 5, 95);
+		plimit[QLA_QP_POOL_NVME] = (limit * pct) / 100;
+		pxlimit[QLA_QP_POOL_NVME] = (xlimit * pct) / 100;
+	} else {
+		/* One shared pool; exchanges are left to the firmware. */
+		plimit[QLA_QP_POOL_NVME] = 0;
+		pxlimit[QLA_QP_POOL_NVME] = 0;
+		xlimit = 0;
+	}
+	plimit[QLA_QP_POOL_SCSI] = limit - plimit[QLA_QP_POOL_NVME];
+	pxlimit[QLA_QP_POOL_SCSI] = xlimit - pxlimit[QLA_QP_POOL_NVME];
+
+	for (i = 0; i <= ha->max_qpairs; i++) {
+		qp = i ? ha->queue_pair_map[i - 1] : ha->base_qpair;
+		if (!qp)
+			continue;
+		pool = qla_qpair_pool(ha, qp);
+		qp->fwres.pool = pool;
+		qp->fwres.iocbs_total = ha->orig_fw_iocb_count;
+		qp->fwres.iocbs_limit = plimit[pool];
+		qp->fwres.iocbs_qp_limit = plimit[pool] / qps[pool];
+		qp->fwres.iocbs_used = 0;
+		qp->fwres.exch_limit = pxlimit[pool];
+		qp->fwres.exch_qp_limit = pxlimit[pool] / qps[pool];
+		qp->fwres.exch_used = 0;
 	}
 }
 
@@ -5213,10 +5840,12 @@ void qla2x00_set_fcport_state(fc_port_t *fcport, int state)
 
 	old_state = atomic_read(&fcport->state);
 
-	if (state == FCS_ONLINE)
+	if (state == FCS_ONLINE) {
 		fcport->online_time = jiffies;
-	else if (old_state == FCS_ONLINE)
+		fcport->vha->login_sched.last_online_jif = jiffies;
+	} else if (old_state == FCS_ONLINE) {
 		fcport->offline_time = jiffies;
+	}
 
 	atomic_set(&fcport->state, state);
 
@@ -5294,7 +5923,10 @@ qla2x00_alloc_fcport(scsi_qla_host_t *vha, gfp_t flags)
 
 	// edif rx delete data structure
 	spin_lock_init(&fcport->edif.indx_list_lock);
-	INIT_LIST_HEAD(&fcport->edif.edif_indx_list);
+	atomic_set(&fcport->edif.rx_del_pending, 0);
+
+	spin_lock_init(&fcport->nvme_abt_lock);
+	INIT_LIST_HEAD(&fcport->nvme_abt_list);
 
 	return fcport;
 }
@@ -5310,6 +5942,7 @@ qla2x00_free_fcport(fc_port_t *fcport)
 		fcport->ct_desc.ct_sns = NULL;
 	}
 
+	qla_disc_cache_save(fcport);
 	qla_edif_flush_sa_ctl_lists(fcport);
 	list_del(&fcport->list);
 	qla2x00_clear_loop_id(fcport);
@@ -5450,6 +6083,8 @@ qla2x00_configure_loop(scsi_qla_host_t *vha)
 				qla2x00_post_aen_work(vha, FCH_EVT_PORT_ONLINE,0);
 			}
 
+			qla_nvmet_register(vha);
+
 			/*
 			 * Process any ATIO queue entries that came in
 			 * while we weren't online.
@@ -5757,21 +6392,36 @@ qla2x00_iidma_fcport(scsi_qla_host_t *vha, fc_port_t *fcport)
 	}
 }
 
-void qla_do_iidma_work(struct scsi_qla_host *vha, fc_port_t *fcport)
+/* Apply iIDMA to every port marked by qla_post_iidma_work() in one pass. */
+void qla_do_iidma_work(struct scsi_qla_host *vha)
 {
-	qla2x00_iidma_fcport(vha, fcport);
-	qla24xx_update_fcport_fcp_prio(vha, fcport);
+	fc_port_t *fcport;
+	u32 n = 0;
+
+	list_for_each_entry(fcport, &vha->vp_fcports, list) {
+		if (!fcport->iidma_pending)
+			continue;
+		fcport->iidma_pending = 0;
+		qla2x00_iidma_fcport(vha, fcport);
+		qla24xx_update_fcport_fcp_prio(vha, fcport);
+		n++;
+	}
+
+	if (n) {
+		vha->attr_stats.iidma_batches++;
+		vha->attr_stats.iidma_ports += n;
+	}
 }
 
 int qla_post_iidma_work(struct scsi_qla_host *vha, fc_port_t *fcport)
 {
 	struct qla_work_evt *e;
 
+	fcport->iidma_pending = 1;
 	e = qla2x00_alloc_work(vha, QLA_EVT_IIDMA);
 	if (!e)
 		return QLA_FUNCTION_FAILED;
 
-	e->u.fcport.fcport = fcport;
 	return qla2x00_post_work(vha, e);
 }
 
@@ -5910,7 +6560,11 @@ qla2x00_update_fcport(scsi_qla_host_t *vha, fc_port_t *fcport)
 	qla2x00_set_fcport_state(fcport, FCS_ONLINE);
 
 	if (IS_IIDMA_CAPABLE(vha->hw) && vha->hw->flags.gpsc_supported) {
-		if (fcport->id_changed) {
+		if (qla_fcport_attr_valid(fcport, QLA_ATTR_SPEED)) {
+			/* cached speed was applied by iidma_fcport above */
+			fcport->id_changed = 0;
+			vha->attr_stats.gpsc_hits++;
+		} else if (fcport->id_changed) {
 			fcport->id_changed = 0;
 			ql_dbg(ql_dbg_disc, vha, 0x20d7,
 			    "%s %d %8phC post gfpnid fcp_cnt %d\n",
@@ -5957,6 +6611,170 @@ void qla_register_fcport_fn(struct work_struct *work)
 	}
 }
 
+/*
+ * Record the logged-in fabric sessions of @vha before an ISP abort tears
+ * them down, together with our own N_Port ID.
+ */
+static void qla_warm_snapshot(scsi_qla_host_t *vha)
+{
+	struct qla_warm_resume *wr = &vha->warm;
+	struct qla_hw_data *ha = vha->hw;
+	fc_port_t *fcport;
+	u32 n = 0;
+
+	wr->pending = 0;
+	if (!ql2xwarm_resume ||
+	    !(ha->prev_topology & (ISP_CFG_F | ISP_CFG_FL)))
+		return;
+
+	list_for_each_entry(fcport, &vha->vp_fcports, list) {
+		fcport->warm_resume = 0;
+		if (fcport->disc_state != DSC_LOGIN_COMPLETE ||
+		    IS_SW_RESV_ADDR(fcport->d_id) ||
+		    fcport->loop_id == FC_NO_LOOP_ID)
+			continue;
+		fcport->warm_d_id = fcport->d_id;
+		fcport->warm_loop_id = fcport->loop_id;
+		fcport->warm_resume = 1;
+		n++;
+	}
+
+	wr->d_id = vha->d_id;
+	wr->snapped = n;
+	wr->resets++;
+	wr->pending = n != 0;
+
+	ql_dbg(ql_dbg_disc, vha, 0x2123,
+	    "Warm resume snapshot: %u sessions, port id %06x.\n",
+	    n, vha->d_id.b24);
+}
+
+/*
+ * Called once the fabric login after an ISP abort is done.  Firmware lost
+ * every login in the reset, so ADISC is not an option; but a port that is
+ * still at its old N_Port ID can be sent PLOGI with its old handle right
+ * away, skipping the GPN_FT/GNN_FT round and GNL.  The scan that follows
+ * still runs and deletes whatever has really gone.
+ */
+static void qla_warm_resume(scsi_qla_host_t *vha)
+{
+	struct qla_warm_resume *wr = &vha->warm;
+	struct qla_hw_data *ha = vha->hw;
+	unsigned long flags;
+	fc_port_t *fcport;
+	u32 resumed = 0, missed = 0;
+	bool same_id;
+
+	if (!wr->pending)
+		return;
+	wr->pending = 0;
+
+	same_id = wr->d_id.b24 == vha->d_id.b24;
+
+	list_for_each_entry(fcport, &vha->vp_fcports, list) {
+		if (!fcport->warm_resume)
+			continue;
+		fcport->warm_resume = 0;
+
+		if (!same_id || fcport->disc_state != DSC_DELETED ||
+		    fcport->loop_id != FC_NO_LOOP_ID ||
+		    fcport->d_id.b24 != fcport->warm_d_id.b24) {
+			missed++;
+			continue;
+		}
+
+		spin_lock_irqsave(&ha->vport_slock, flags);
+		if (!qla2x00_is_reserved_id(vha, fcport->warm_loop_id) &&
+		    !test_and_set_bit(fcport->warm_loop_id, ha->loop_id_map))
+			fcport->loop_id = fcport->warm_loop_id;
+		spin_unlock_irqrestore(&ha->vport_slock, flags);
+
+		if (!fcport->login_retry)
+			fcport->login_retry = ha->login_retry_count;
+		fcport->scan_state = QLA_FCPORT_FOUND;
+		qla24xx_fcport_handle_login(vha, fcport);
+		resumed++;
+	}
+
+	wr->resumed += resumed;
+	wr->missed += missed;
+
+	ql_dbg(ql_dbg_disc, vha, 0x2124,
+	    "Warm resume: %u resumed, %u left to discovery (port id %06x -> %06x).\n",
+	    resumed, missed, wr->d_id.b24, vha->d_id.b24);
+}
+
+/*
+ * Cached port attributes were learned from one fabric's name server; drop
+ * them when we find ourselves attached to a different fabric.
+ */
+static void qla_disc_cache_fabric(scsi_qla_host_t *vha)
+{
+	struct qla_disc_cache *dc = &vha->disc_cache;
+	struct qla_disc_ent *ent;
+	struct hlist_node *tmp;
+	unsigned long flags;
+	u64 wwn = wwn_to_u64(vha->fabric_node_name);
+	int bkt;
+
+	if (dc->fabric_wwn == wwn)
+		return;
+
+	ql_dbg(ql_dbg_disc, vha, 0x2127,
+	    "Fabric name %016llx -> %016llx, discovery cache flushed.\n",
+	    dc->fabric_wwn, wwn);
+
+	spin_lock_irqsave(&dc->lock, flags);
+	hash_for_each_safe(dc->hash, bkt, tmp, ent, hnode)
+		qla_disc_cache_drop(dc, ent);
+	if (dc->fabric_wwn)
+		dc->flushes++;
+	dc->fabric_wwn = wwn;
+	dc->reg_valid = 0;
+	spin_unlock_irqrestore(&dc->lock, flags);
+}
+
+/*
+ * The name server deregisters a port on implicit logout, so a link bounce
+ * normally costs us our FC-4 registrations anyway.  When it did not (same
+ * fabric, same N_Port ID, e.g. a chip reset the switch never saw), one
+ * GFT_ID tells us and saves RFT_ID, RFF_ID and RNN_ID/RSNN_NN.
+ */
+static bool qla_disc_cache_regs_current(scsi_qla_host_t *vha)
+{
+	struct qla_disc_cache *dc = &vha->disc_cache;
+	uint8_t fc4_types[32];
+	bool nvme = vha->flags.nvme_enabled;
+
+	if (!dc->size || !dc->reg_valid ||
+	    dc->reg_d_id.b24 != vha->d_id.b24 || dc->reg_nvme != nvme)
+		return false;
+
+	dc->reg_valid = 0;
+	if (qla2x00_gft_id(vha, &vha->d_id, fc4_types) != QLA_SUCCESS ||
+	    !(fc4_types[2] & BIT_0) || (nvme && !(fc4_types[6] & BIT_0))) {
+		dc->regs_lost++;
+		return false;
+	}
+
+	dc->reg_valid = 1;
+	dc->regs_skipped++;
+	ql_dbg(ql_dbg_disc, vha, 0x2128,
+	    "FC-4 registration of %06x still in place, skipped.\n",
+	    vha->d_id.b24);
+
+	return true;
+}
+
+static void qla_disc_cache_regs_done(scsi_qla_host_t *vha)
+{
+	struct qla_disc_cache *dc = &vha->disc_cache;
+
+	dc->reg_d_id = vha->d_id;
+	dc->reg_nvme = vha->flags.nvme_enabled;
+	dc->reg_valid = 1;
+}
+
 /*
  * qla2x00_configure_fabric
  *      Setup SNS devices with loop ID's.
@@ -5993,6 +6811,7 @@ qla2x00_configure_fabric(scsi_qla_host_t *vha)
 		return (QLA_SUCCESS);
 	}
 	vha->device_flags |= SWITCH_FOUND;
+	qla_disc_cache_fabric(vha);
 
 	rval = qla2x00_get_port_name(vha, loop_id, vha->fabric_port_name, 0);
 	if (rval != QLA_SUCCESS)
@@ -6038,7 +6857,8 @@ qla2x00_configure_fabric(scsi_qla_host_t *vha)
 		    test_and_clear_bit(REGISTER_FDMI_NEEDED, &vha->dpc_flags))
 			qla2x00_fdmi_register(vha);
 
-		if (test_and_clear_bit(REGISTER_FC4_NEEDED, &vha->dpc_flags)) {
+		if (test_and_clear_bit(REGISTER_FC4_NEEDED, &vha->dpc_flags) &&
+		    !qla_disc_cache_regs_current(vha)) {
 			if (qla2x00_rft_id(vha)) {
 				/* EMPTY */
 				ql_dbg(ql_dbg_disc, vha, 0x20a2,
@@ -6075,6 +6895,7 @@ qla2x00_configure_fabric(scsi_qla_host_t *vha)
 				if (test_bit(LOOP_RESYNC_NEEDED, &vha->dpc_flags))
 					break;
 			}
+			qla_disc_cache_regs_done(vha);
 		}
 
 
@@ -6087,6 +6908,7 @@ qla2x00_configure_fabric(scsi_qla_host_t *vha)
 		qlt_do_generation_tick(vha, &discovery_gen);
 
 		if (USE_ASYNC_SCAN(ha)) {
+			qla_warm_resume(vha);
 			rval = qla24xx_async_gpnft(vha, FC4_TYPE_FCP_SCSI,
 			    NULL);
 			if (rval)
@@ -7175,6 +7997,7 @@ qla2x00_abort_isp_cleanup(scsi_qla_host_t *vha)
 	atomic_set(&vha->loop_down_timer, LOOP_DOWN_TIME);
 	if (atomic_read(&vha->loop_state) != LOOP_DOWN) {
 		atomic_set(&vha->loop_state, LOOP_DOWN);
+		qla_warm_snapshot(vha);
 		qla2x00_mark_all_devices_lost(vha);
 
 		spin_lock_irqsave(&ha->vport_slock, flags);
@@ -7182,6 +8005,8 @@ qla2x00_abort_isp_cleanup(scsi_qla_host_t *vha)
 			atomic_inc(&vp->vref_count);
 			spin_unlock_irqrestore(&ha->vport_slock, flags);
 
+			if (vp->vp_idx)
+				qla_warm_snapshot(vp);
 			qla2x00_mark_all_devices_lost(vp);
 
 			spin_lock_irqsave(&ha->vport_slock, flags);
@@ -7739,6 +8564,7 @@ qla24xx_nvram_config(scsi_qla_host_t *vha)
 		memcpy(icb->node_name, nv->alternate_node_name, WWN_SIZE);
 		memcpy(icb->port_name, nv->alternate_port_name, WWN_SIZE);
 	}
+	memcpy(ha->boot_port_name, nv->boot_port_name, WWN_SIZE);
 
 	/* Prepare nodename */
 	if ((icb->firmware_options_1 & cpu_to_le32(BIT_14)) == 0) {
@@ -8949,6 +9775,7 @@ qla81xx_nvram_config(scsi_qla_host_t *vha)
 		memcpy(icb->node_name, nv->alternate_node_name, WWN_SIZE);
 		memcpy(icb->port_name, nv->alternate_port_name, WWN_SIZE);
 	}
+	memcpy(ha->boot_port_name, nv->boot_port_name, WWN_SIZE);
 
 	/* Prepare nodename */
 	if ((icb->firmware_options_1 & cpu_to_le32(BIT_14)) == 0) {
@@ -9537,6 +10364,8 @@ struct qla_qpair *qla2xxx_create_qpair(struct scsi_qla_host *vha, int qos,
 			goto fail_mempool;
 		}
 
+		qla_dsd_cache_fill(qpair);
+
 		/* Mark as online */
 		qpair->online = 1;
 
@@ -9573,6 +10402,102 @@ fail_qid_map:
 	return NULL;
 }
 
+/*
+ * Pre-populate the qpair's continuation DSD list, CRC_2 and Command Type 6
+ * context caches so large SG, DIF and eDIF commands do not hit the DMA pool allocator in steady
+ * state.  A short fill
+ * is not fatal; qla_dsd_get() falls back to the pool.
+ */
+void qla_dsd_cache_fill(struct qla_qpair *qpair)
+{
+	struct qla_hw_data *ha = qpair->hw;
+	struct dsd_dma *dsd;
+	int i;
+
+	if (!ha->dl_dma_pool)
+		return;
+
+	for (i = atomic_read(&qpair->dsd_cache_cnt);
+	     i < ql2xdsd_cache_depth; i++) {
+		dsd = kzalloc(sizeof(*dsd), GFP_KERNEL);
+		if (!dsd)
+			break;
+		dsd->dsd_addr = dma_pool_alloc(ha->dl_dma_pool, GFP_KERNEL,
+		    &dsd->dsd_list_dma);
+		if (!dsd->dsd_addr) {
+			kfree(dsd);
+			break;
+		}
+		llist_add(&dsd->cache_node, &qpair->dsd_cache);
+		atomic_inc(&qpair->dsd_cache_cnt);
+	}
+
+	for (i = atomic_read(&qpair->crc_ctx_cache_cnt);
+	     i < ql2xdsd_cache_depth; i++) {
+		struct crc_context *ctx;
+		dma_addr_t dma;
+
+		ctx = dma_pool_zalloc(ha->dl_dma_pool, GFP_KERNEL, &dma);
+		if (!ctx)
+			break;
+		ctx->crc_ctx_dma = dma;
+		llist_add((struct llist_node *)ctx, &qpair->crc_ctx_cache);
+		atomic_inc(&qpair->crc_ctx_cache_cnt);
+	}
+
+	/* only eDIF and P3P build Command Type 6 IOCBs */
+	if (!ha->ctx_mempool || !ha->fcp_cmnd_dma_pool ||
+	    !(IS_P3P_TYPE(ha) || (IS_QLA28XX(ha) && ql2xsecenable)))
+		return;
+
+	for (i = atomic_read(&qpair->ct6_cache_cnt);
+	     i < ql2xdsd_cache_depth; i++) {
+		struct ct6_dsd *ctx;
+
+		ctx = mempool_alloc(ha->ctx_mempool, GFP_KERNEL);
+		if (!ctx)
+			break;
+		ctx->fcp_cmnd = dma_pool_zalloc(ha->fcp_cmnd_dma_pool,
+		    GFP_KERNEL, &ctx->fcp_cmnd_dma);
+		if (!ctx->fcp_cmnd) {
+			mempool_free(ctx, ha->ctx_mempool);
+			break;
+		}
+		llist_add(&ctx->cache_node, &qpair->ct6_cache);
+		atomic_inc(&qpair->ct6_cache_cnt);
+	}
+}
+
+void qla_dsd_cache_drain(struct qla_qpair *qpair)
+{
+	struct llist_node *node;
+	struct dsd_dma *dsd, *tmp;
+
+	node = llist_del_all(&qpair->dsd_cache);
+	llist_for_each_entry_safe(dsd, tmp, node, cache_node)
+		qla_dsd_release(qpair->hw, dsd);
+	atomic_set(&qpair->dsd_cache_cnt, 0);
+
+	node = llist_del_all(&qpair->crc_ctx_cache);
+	while (node) {
+		struct crc_context *ctx = (struct crc_context *)node;
+
+		node = node->next;
+		dma_pool_free(qpair->hw->dl_dma_pool, ctx, ctx->crc_ctx_dma);
+	}
+	atomic_set(&qpair->crc_ctx_cache_cnt, 0);
+
+	node = llist_del_all(&qpair->ct6_cache);
+	while (node) {
+		struct ct6_dsd *ctx = llist_entry(node, struct ct6_dsd,
+		    cache_node);
+
+		node = node->next;
+		qla_ct6_ctx_release(qpair->hw, ctx);
+	}
+	atomic_set(&qpair->ct6_cache_cnt, 0);
+}
+
 int qla2xxx_delete_qpair(struct scsi_qla_host *vha, struct qla_qpair *qpair)
 {
 	int ret = QLA_FUNCTION_FAILED;
@@ -9599,6 +10524,7 @@ int qla2xxx_delete_qpair(struct scsi_qla_host *vha, struct qla_qpair *qpair)
 		vha->flags.qpairs_rsp_created = 0;
 	}
 	mempool_destroy(qpair->srb_mempool);
+	qla_dsd_cache_drain(qpair);
 	kfree(qpair);
 	mutex_unlock(&ha->mq_lock);
 
@@ -110,19 +110,188 @@ host_to_adap(uint8_t *src, uint8_t *dst, uint32_t bsize)
 		*odest++ = cpu_to_le32(*isrc);
 }
 
+static inline struct dsd_dma *
+qla_dsd_alloc(struct qla_hw_data *ha)
+{
+	struct dsd_dma *dsd;
+
+	dsd = kzalloc(sizeof(*dsd), GFP_ATOMIC);
+	if (!dsd)
+		return NULL;
+
+	dsd->dsd_addr = dma_pool_alloc(ha->dl_dma_pool, GFP_ATOMIC,
+	    &dsd->dsd_list_dma);
+	if (!dsd->dsd_addr) {
+		kfree(dsd);
+		return NULL;
+	}
+
+	return dsd;
+}
+
+static inline void
+qla_dsd_release(struct qla_hw_data *ha, struct dsd_dma *dsd)
+{
+	dma_pool_free(ha->dl_dma_pool, dsd->dsd_addr, dsd->dsd_list_dma);
+	kfree(dsd);
+}
+
+/*
+ * Take a continuation DSD list from the qpair cache, falling back to the
+ * DMA pool on a miss.  Callers hold qpair->qp_lock_ptr, which makes them
+ * the single llist consumer.
+ */
+static inline struct dsd_dma *
+qla_dsd_get(struct qla_qpair *qpair)
+{
+	struct llist_node *node;
+	struct dsd_dma *dsd;
+
+	node = llist_del_first(&qpair->dsd_cache);
+	if (node) {
+		atomic_dec(&qpair->dsd_cache_cnt);
+		dsd = llist_entry(node, struct dsd_dma, cache_node);
+	} else {
+		qpair->dsd_cache_miss++;
+		dsd = qla_dsd_alloc(qpair->hw);
+		if (!dsd)
+			return NULL;
+	}
+	atomic_inc(&qpair->dsd_inuse);
+
+	return dsd;
+}
+
+/* Return a DSD list to the qpair cache, or to the DMA pool once it is full. */
 static inline void
-qla2x00_clean_dsd_pool(struct qla_hw_data *ha, struct crc_context *ctx)
+qla_dsd_put(struct qla_qpair *qpair, struct dsd_dma *dsd)
+{
+	atomic_dec(&qpair->dsd_inuse);
+
+	if (atomic_read(&qpair->dsd_cache_cnt) >= ql2xdsd_cache_depth) {
+		qla_dsd_release(qpair->hw, dsd);
+		return;
+	}
+
+	llist_add(&dsd->cache_node, &qpair->dsd_cache);
+	atomic_inc(&qpair->dsd_cache_cnt);
+}
+
+/*
+ * CRC_2 contexts share dl_dma_pool with the DSD lists.  While a context
+ * sits in the cache its first bytes hold the llist node; crc_ctx_dma is
+ * left intact so the chunk never needs re-mapping.
+ */
+static inline struct crc_context *
+qla_crc_ctx_get(struct qla_qpair *qpair)
+{
+	struct llist_node *node;
+	struct crc_context *ctx;
+	dma_addr_t dma;
+
+	node = llist_del_first(&qpair->crc_ctx_cache);
+	if (!node) {
+		qpair->crc_ctx_cache_miss++;
+		ctx = dma_pool_zalloc(qpair->hw->dl_dma_pool, GFP_ATOMIC, &dma);
+		if (!ctx)
+			return NULL;
+		ctx->crc_ctx_dma = dma;
+		return ctx;
+	}
+
+	atomic_dec(&qpair->crc_ctx_cache_cnt);
+	ctx = (struct crc_context *)node;
+	dma = ctx->crc_ctx_dma;
+	memset(ctx, 0, sizeof(*ctx));
+	ctx->crc_ctx_dma = dma;
+
+	return ctx;
+}
+
+static inline void
+qla_crc_ctx_put(struct qla_qpair *qpair, struct crc_context *ctx)
+{
+	if (atomic_read(&qpair->crc_ctx_cache_cnt) >= ql2xdsd_cache_depth) {
+		dma_pool_free(qpair->hw->dl_dma_pool, ctx, ctx->crc_ctx_dma);
+		return;
+	}
+
+	llist_add((struct llist_node *)ctx, &qpair->crc_ctx_cache);
+	atomic_inc(&qpair->crc_ctx_cache_cnt);
+}
+
+static inline void
+qla_ct6_ctx_release(struct qla_hw_data *ha, struct ct6_dsd *ctx)
+{
+	dma_pool_free(ha->fcp_cmnd_dma_pool, ctx->fcp_cmnd, ctx->fcp_cmnd_dma);
+	mempool_free(ctx, ha->ctx_mempool);
+}
+
+/*
+ * Take a Command Type 6 context from the qpair cache.  The FCP_CMND
+ * buffer stays attached to the context while it is cached, so a hit
+ * costs one llist pop and a memset.
+ */
+static inline struct ct6_dsd *
+qla_ct6_ctx_get(struct qla_qpair *qpair)
+{
+	struct qla_hw_data *ha = qpair->hw;
+	struct llist_node *node;
+	struct ct6_dsd *ctx;
+
+	node = llist_del_first(&qpair->ct6_cache);
+	if (node) {
+		atomic_dec(&qpair->ct6_cache_cnt);
+		ctx = llist_entry(node, struct ct6_dsd, cache_node);
+		memset(ctx->fcp_cmnd, 0, sizeof(*ctx->fcp_cmnd));
+	} else {
+		qpair->ct6_cache_miss++;
+		ctx = mempool_alloc(ha->ctx_mempool, GFP_ATOMIC);
+		if (!ctx)
+			return NULL;
+		ctx->fcp_cmnd = dma_pool_zalloc(ha->fcp_cmnd_dma_pool,
+		    GFP_ATOMIC, &ctx->fcp_cmnd_dma);
+		if (!ctx->fcp_cmnd) {
+			mempool_free(ctx, ha->ctx_mempool);
+			return NULL;
+		}
+	}
+	ctx->fcp_cmnd_len = 0;
+	ctx->dsd_use_cnt = 0;
+	INIT_LIST_HEAD(&ctx->dsd_list);
+
+	return ctx;
+}
+
+static inline void
+qla_ct6_ctx_put(struct qla_qpair *qpair, struct ct6_dsd *ctx)
+{
+	if (atomic_read(&qpair->ct6_cache_cnt) >= ql2xdsd_cache_depth) {
+		qla_ct6_ctx_release(qpair->hw, ctx);
+		return;
+	}
+
+	llist_add(&ctx->cache_node, &qpair->ct6_cache);
+	atomic_inc(&qpair->ct6_cache_cnt);
+}
+
+static inline void
+qla_dsd_put_list(struct qla_qpair *qpair, struct list_head *head)
 {
 	struct dsd_dma *dsd, *tdsd;
 
-	/* clean up allocated prev pool */
-	list_for_each_entry_safe(dsd, tdsd, &ctx->dsd_list, list) {
-		dma_pool_free(ha->dl_dma_pool, dsd->dsd_addr,
-		    dsd->dsd_list_dma);
+	list_for_each_entry_safe(dsd, tdsd, head, list) {
 		list_del(&dsd->list);
-		kfree(dsd);
+		qla_dsd_put(qpair, dsd);
 	}
-	INIT_LIST_HEAD(&ctx->dsd_list);
+	INIT_LIST_HEAD(head);
+}
+
+static inline void
+qla2x00_clean_dsd_pool(struct qla_qpair *qpair, struct crc_context *ctx)
+{
+	/* hand the lists back to the qpair cache */
+	qla_dsd_put_list(qpair, &ctx->dsd_list);
 }
 
 static inline void
@@ -260,6 +429,35 @@ done:
 	return sp;
 }
 
+/*
+ * Outstanding SCSI commands are counted per fc_port (and FCP2 commands
+ * per adapter) at submit and completion, so loop-down and EH paths can
+ * tell whether a port is idle without sweeping outstanding_cmds[].
+ */
+static inline void
+qla_fcport_cmd_start(srb_t *sp)
+{
+	fc_port_t *fcport = sp->fcport;
+
+	atomic_inc(&fcport->active_cmds);
+	if (fcport->flags & FCF_FCP2_DEVICE) {
+		sp->flags |= SRB_FCP2_CMD;
+		atomic_inc(&fcport->vha->hw->fcp2_active_cmds);
+	}
+}
+
+static inline void
+qla_fcport_cmd_done(srb_t *sp)
+{
+	fc_port_t *fcport = sp->fcport;
+
+	if (sp->flags & SRB_FCP2_CMD) {
+		sp->flags &= ~SRB_FCP2_CMD;
+		atomic_dec(&fcport->vha->hw->fcp2_active_cmds);
+	}
+	atomic_dec(&fcport->active_cmds);
+}
+
 static inline void
 qla2x00_rel_sp(srb_t *sp)
 {
@@ -374,30 +572,43 @@ enum {
 static inline int
 qla_get_iocbs(struct qla_qpair *qp, struct iocb_resource *iores)
 {
-	u16 iocbs_used, i;
+	u16 iocbs_used, exch_used, i;
 	struct qla_hw_data *ha = qp->vha->hw;
+	struct qla_fw_resources *res = &qp->fwres;
+	struct qla_qpair *q;
 
 	if (!ql2xenforce_iocb_limit) {
 		iores->res_type = RESOURCE_NONE;
 		return 0;
 	}
 
-	if ((iores->iocb_cnt + qp->fwres.iocbs_used) < qp->fwres.iocbs_qp_limit) {
-		qp->fwres.iocbs_used += iores->iocb_cnt;
+	if ((iores->iocb_cnt + res->iocbs_used) < res->iocbs_qp_limit &&
+	    (!res->exch_limit || res->exch_used < res->exch_qp_limit)) {
+		res->iocbs_used += iores->iocb_cnt;
+		res->exch_used++;
 		return 0;
 	} else {
-		/* no need to acquire qpair lock. It's just rough calculation */
-		iocbs_used = ha->base_qpair->fwres.iocbs_used;
-		for (i=0; i < ha->max_qpairs; i++) {
-			if (ha->queue_pair_map[i])  {
-				iocbs_used += ha->queue_pair_map[i]->fwres.iocbs_used;
+		/*
+		 * no need to acquire qpair lock. It's just rough calculation,
+		 * over the qpairs of this one's pool.
+		 */
+		iocbs_used = 0;
+		exch_used = 0;
+		for (i = 0; i <= ha->max_qpairs; i++) {
+			q = i ? ha->queue_pair_map[i - 1] : ha->base_qpair;
+			if (q && q->fwres.pool == res->pool) {
+				iocbs_used += q->fwres.iocbs_used;
+				exch_used += q->fwres.exch_used;
 			}
 		}
 
-		if ((iores->iocb_cnt + iocbs_used) < qp->fwres.iocbs_limit) {
-			qp->fwres.iocbs_used += iores->iocb_cnt;
+		if ((iores->iocb_cnt + iocbs_used) < res->iocbs_limit &&
+		    (!res->exch_limit || exch_used < res->exch_limit)) {
+			res->iocbs_used += iores->iocb_cnt;
+			res->exch_used++;
 			return 0;
 		} else {
+			res->busy++;
 			iores->res_type = RESOURCE_NONE;
 			return ENOSPC;
 		}
@@ -417,6 +628,8 @@ qla_put_iocbs(struct qla_qpair *qp, struct iocb_resource *iores)
 			// should not happen
 			qp->fwres.iocbs_used = 0;
 		}
+		if (qp->fwres.exch_used)
+			qp->fwres.exch_used--;
 		break;
 	}
 	iores->res_type = RESOURCE_NONE;
@@ -468,6 +681,27 @@ bool qla_pci_disconnected(struct scsi_qla_host *vha,
 	return ret;
 }
 
+static inline bool
+qla_fcport_attr_valid(fc_port_t *fcport, u8 attr)
+{
+	return (fcport->attr_valid & attr) &&
+	    fcport->attr_gen == fcport->rscn_gen &&
+	    fcport->attr_d_id.b24 == fcport->d_id.b24;
+}
+
+/* @gen is the rscn_gen the query was issued under. */
+static inline void
+qla_fcport_attr_set(fc_port_t *fcport, u8 attr, u32 gen)
+{
+	if (fcport->attr_gen != gen ||
+	    fcport->attr_d_id.b24 != fcport->d_id.b24) {
+		fcport->attr_valid = 0;
+		fcport->attr_gen = gen;
+		fcport->attr_d_id = fcport->d_id;
+	}
+	fcport->attr_valid |= attr;
+}
+
 static inline bool
 fcport_is_smaller(fc_port_t *fcport)
 {
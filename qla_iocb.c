@@ -504,7 +504,7 @@ qla2x00_start_iocbs(struct scsi_qla_host *vha, struct req_que *req)
  *
  * Returns non-zero if a failure occurred, else zero.
  */
-static int
+int
 __qla2x00_marker(struct scsi_qla_host *vha, struct qla_qpair *qpair,
     uint16_t loop_id, uint64_t lun, uint8_t type)
 {
@@ -586,8 +586,6 @@ qla24xx_build_scsi_type_6_iocbs(srb_t *sp, struct cmd_type_6 *cmd_pkt,
 	uint16_t tot_dsds)
 {
 	struct dsd64 *cur_dsd = NULL, *next_dsd;
-	scsi_qla_host_t	*vha;
-	struct qla_hw_data *ha;
 	struct scsi_cmnd *cmd;
 	struct	scatterlist *cur_seg;
 	uint8_t avail_dsds;
@@ -608,9 +606,6 @@ qla24xx_build_scsi_type_6_iocbs(srb_t *sp, struct cmd_type_6 *cmd_pkt,
 		return 0;
 	}
 
-	vha = sp->vha;
-	ha = vha->hw;
-
 	/* Set transfer direction */
 	if (cmd->sc_data_direction == DMA_TO_DEVICE) {
 		cmd_pkt->control_flags = cpu_to_le16(CF_WRITE_DATA);
@@ -631,14 +626,12 @@ qla24xx_build_scsi_type_6_iocbs(srb_t *sp, struct cmd_type_6 *cmd_pkt,
 		tot_dsds -= avail_dsds;
 		dsd_list_len = (avail_dsds + 1) * QLA_DSD_SIZE;
 
-		dsd_ptr = list_first_entry(&ha->gbl_dsd_list,
-		    struct dsd_dma, list);
+		dsd_ptr = qla_dsd_get(qpair);
+		if (!dsd_ptr)
+			return 1;
 		next_dsd = dsd_ptr->dsd_addr;
-		list_del(&dsd_ptr->list);
-		ha->gbl_dsd_avail--;
 		list_add_tail(&dsd_ptr->list, &ctx->dsd_list);
 		ctx->dsd_use_cnt++;
-		ha->gbl_dsd_inuse++;
 
 		if (first_iocb) {
 			first_iocb = 0;
@@ -936,24 +929,11 @@ alloc_and_fill:
 			dsd_list_len = (avail_dsds + 1) * 12;
 			used_dsds -= avail_dsds;
 
-			/* allocate tracking DS */
-			dsd_ptr = kzalloc(sizeof(struct dsd_dma), GFP_ATOMIC);
+			/* take a pre-mapped list from the qpair cache */
+			dsd_ptr = qla_dsd_get(sp ? sp->qpair : tc->qpair);
 			if (!dsd_ptr)
 				return 1;
-
-			/* allocate new list */
-			dsd_ptr->dsd_addr = next_dsd =
-			    dma_pool_alloc(ha->dl_dma_pool, GFP_ATOMIC,
-				&dsd_ptr->dsd_list_dma);
-
-			if (!next_dsd) {
-				/*
-				 * Need to cleanup only this dsd_ptr, rest
-				 * will be done by sp_free_dma()
-				 */
-				kfree(dsd_ptr);
-				return 1;
-			}
+			next_dsd = dsd_ptr->dsd_addr;
 
 			if (sp) {
 				list_add_tail(&dsd_ptr->list,
@@ -1033,24 +1013,11 @@ qla24xx_walk_and_build_sglist(struct qla_hw_data *ha, srb_t *sp,
 			dsd_list_len = (avail_dsds + 1) * 12;
 			used_dsds -= avail_dsds;
 
-			/* allocate tracking DS */
-			dsd_ptr = kzalloc(sizeof(struct dsd_dma), GFP_ATOMIC);
+			/* take a pre-mapped list from the qpair cache */
+			dsd_ptr = qla_dsd_get(sp ? sp->qpair : tc->qpair);
 			if (!dsd_ptr)
 				return 1;
-
-			/* allocate new list */
-			dsd_ptr->dsd_addr = next_dsd =
-			    dma_pool_alloc(ha->dl_dma_pool, GFP_ATOMIC,
-				&dsd_ptr->dsd_list_dma);
-
-			if (!next_dsd) {
-				/*
-				 * Need to cleanup only this dsd_ptr, rest
-				 * will be done by sp_free_dma()
-				 */
-				kfree(dsd_ptr);
-				return 1;
-			}
+			next_dsd = dsd_ptr->dsd_addr;
 
 			if (sp) {
 				list_add_tail(&dsd_ptr->list,
@@ -1263,34 +1230,16 @@ qla24xx_walk_and_build_prot_sglist(struct qla_hw_data *ha, srb_t *sp,
 				dsd_list_len = (avail_dsds + 1) * 12;
 				used_dsds -= avail_dsds;
 
-				/* allocate tracking DS */
-				dsd_ptr = kzalloc(sizeof(*dsd_ptr), GFP_ATOMIC);
+				/* take a pre-mapped list from the qpair cache */
+				dsd_ptr = qla_dsd_get(sp ? sp->qpair :
+				    tc->qpair);
 				if (!dsd_ptr) {
 					ql_dbg(ql_dbg_tgt, vha, 0xe026,
 					    "%s: failed alloc dsd_ptr\n",
 					    __func__);
 					return 1;
 				}
-				ha->dif_bundle_kallocs++;
-
 				difctx->no_ldif_dsd++;
-				/* allocate new list */
-				dsd_ptr->dsd_addr =
-				    dma_pool_alloc(ha->dl_dma_pool, GFP_ATOMIC,
-					&dsd_ptr->dsd_list_dma);
-				if (!dsd_ptr->dsd_addr) {
-					ql_dbg(ql_dbg_tgt, vha, 0xe026,
-					    "%s: failed alloc ->dsd_addr\n",
-					    __func__);
-					/*
-					 * need to cleanup only this dsd_ptr
-					 *  rest will be done by sp_free_dma()
-					 */
-					kfree(dsd_ptr);
-					ha->dif_bundle_kallocs--;
-					return 1;
-				}
-				ha->dif_bundle_dma_allocs++;
 
 				if (sp) {
 					list_add_tail(&dsd_ptr->list,
@@ -1299,7 +1248,7 @@ qla24xx_walk_and_build_prot_sglist(struct qla_hw_data *ha, srb_t *sp,
 				} else {
 					list_add_tail(&dsd_ptr->list,
 					    &difctx->ldif_dsd_list);
-					tc->ctx_dsd_alloced = 1;
+					*tc->ctx_dsd_alloced = 1;
 				}
 
 				/* add new list to cmd iocb or last list */
@@ -1329,8 +1278,9 @@ qla24xx_walk_and_build_prot_sglist(struct qla_hw_data *ha, srb_t *sp,
 				dsd_list_len = (avail_dsds + 1) * 12;
 				used_dsds -= avail_dsds;
 
-				/* allocate tracking DS */
-				dsd_ptr = kzalloc(sizeof(*dsd_ptr), GFP_ATOMIC);
+				/* take a pre-mapped list from the qpair cache */
+				dsd_ptr = qla_dsd_get(sp ? sp->qpair :
+				    tc->qpair);
 				if (!dsd_ptr) {
 					ql_dbg(ql_dbg_tgt + ql_dbg_verbose,
 					    vha, 0xe027,
@@ -1339,17 +1289,6 @@ qla24xx_walk_and_build_prot_sglist(struct qla_hw_data *ha, srb_t *sp,
 					return 1;
 				}
 
-				/* allocate new list */
-				dsd_ptr->dsd_addr =
-				    dma_pool_alloc(ha->dl_dma_pool, GFP_ATOMIC,
-					&dsd_ptr->dsd_list_dma);
-				if (!dsd_ptr->dsd_addr) {
-					/* need to cleanup only this dsd_ptr */
-					/* rest will be done by sp_free_dma() */
-					kfree(dsd_ptr);
-					return 1;
-				}
-
 				if (sp) {
 					list_add_tail(&dsd_ptr->list,
 					    &difctx->dsd_list);
@@ -1357,7 +1296,7 @@ qla24xx_walk_and_build_prot_sglist(struct qla_hw_data *ha, srb_t *sp,
 				} else {
 					list_add_tail(&dsd_ptr->list,
 					    &difctx->dsd_list);
-					tc->ctx_dsd_alloced = 1;
+					*tc->ctx_dsd_alloced = 1;
 				}
 
 				/* add new list to cmd iocb or last list */
@@ -1441,14 +1380,13 @@ qla24xx_build_scsi_crc_2_iocbs(srb_t *sp, struct cmd_type_crc_2 *cmd_pkt,
 	    (scsi_get_prot_op(cmd) == SCSI_PROT_WRITE_INSERT))
 		bundling = 0;
 
-	/* Allocate CRC context from global pool */
-	crc_ctx_pkt = sp->u.scmd.crc_ctx =
-	    dma_pool_zalloc(ha->dl_dma_pool, GFP_ATOMIC, &crc_ctx_dma);
+	/* Take a pre-mapped CRC context from the qpair cache */
+	crc_ctx_pkt = sp->u.scmd.crc_ctx = qla_crc_ctx_get(sp->qpair);
 
 	if (!crc_ctx_pkt)
 		goto crc_queuing_error;
 
-	crc_ctx_pkt->crc_ctx_dma = crc_ctx_dma;
+	crc_ctx_dma = crc_ctx_pkt->crc_ctx_dma;
 
 	sp->flags |= SRB_CRC_CTX_DMA_VALID;
 
@@ -2630,8 +2568,8 @@ qla24xx_tm_iocb(srb_t *sp, struct tsk_mgmt_entry *tsk)
 
 void qla2x00_init_timer(srb_t *sp, unsigned long tmo)
 {
-	qla_timer_setup(&sp->u.iocb_cmd.timer, qla2x00_sp_timeout, 0, sp);
-	sp->u.iocb_cmd.timer.expires = jiffies + tmo * HZ;
+	INIT_LIST_HEAD(&sp->u.iocb_cmd.tmo_node);
+	sp->u.iocb_cmd.tmo_expires = jiffies + tmo * HZ;
 	sp->free = qla2x00_sp_free;
 	if (IS_QLAFX00(sp->vha->hw) && sp->type == SRB_FXIOCB_DCMD)
 		init_completion(&sp->u.iocb_cmd.u.fxiocb.fxiocb_comp);
@@ -2649,7 +2587,7 @@ static void qla2x00_els_dcmd_sp_free(srb_t *sp)
 		    elsio->u.els_logo.els_logo_pyld,
 		    elsio->u.els_logo.els_logo_pyld_dma);
 
-	del_timer(&elsio->timer);
+	qla_tmo_wheel_del(sp);
 	qla2x00_rel_sp(sp);
 }
 
@@ -2910,7 +2848,7 @@ static void qla2x00_els_dcmd2_sp_done(srb_t *sp, int res)
 	    sp->name, res, sp->handle, fcport->d_id.b24, fcport->port_name);
 
 	fcport->flags &= ~(FCF_ASYNC_SENT|FCF_ASYNC_ACTIVE);
-	del_timer(&sp->u.iocb_cmd.timer);
+	qla_tmo_wheel_del(sp);
 
 	if (sp->flags & SRB_WAKEUP_ON_COMP)
 		complete(&lio->u.els_plogi.comp);
@@ -3428,46 +3366,17 @@ qla82xx_start_scsi(srb_t *sp)
 	if (tot_dsds > ql2xshiftctondsd) {
 		struct cmd_type_6 *cmd_pkt;
 		uint16_t more_dsd_lists = 0;
-		struct dsd_dma *dsd_ptr;
-		uint16_t i;
 
 		more_dsd_lists = qla24xx_calc_dsd_lists(tot_dsds);
-		if ((more_dsd_lists + ha->gbl_dsd_inuse) >= NUM_DSD_CHAIN) {
+		if ((more_dsd_lists + atomic_read(&sp->qpair->dsd_inuse)) >=
+		    NUM_DSD_CHAIN) {
 			ql_dbg(ql_dbg_io, vha, 0x300d,
 			    "Num of DSD list %d is than %d for cmd=%px.\n",
-			    more_dsd_lists + ha->gbl_dsd_inuse, NUM_DSD_CHAIN,
-			    cmd);
+			    more_dsd_lists + atomic_read(&sp->qpair->dsd_inuse),
+			    NUM_DSD_CHAIN, cmd);
 			goto queuing_error;
 		}
 
-		if (more_dsd_lists <= ha->gbl_dsd_avail)
-			goto sufficient_dsds;
-		else
-			more_dsd_lists -= ha->gbl_dsd_avail;
-
-		for (i = 0; i < more_dsd_lists; i++) {
-			dsd_ptr = kzalloc(sizeof(struct dsd_dma), GFP_ATOMIC);
-			if (!dsd_ptr) {
-				ql_log(ql_log_fatal, vha, 0x300e,
-				    "Failed to allocate memory for dsd_dma "
-				    "for cmd=%px.\n", cmd);
-				goto queuing_error;
-			}
-
-			dsd_ptr->dsd_addr = dma_pool_alloc(ha->dl_dma_pool,
-				GFP_ATOMIC, &dsd_ptr->dsd_list_dma);
-			if (!dsd_ptr->dsd_addr) {
-				kfree(dsd_ptr);
-				ql_log(ql_log_fatal, vha, 0x300f,
-				    "Failed to allocate memory for dsd_addr "
-				    "for cmd=%px.\n", cmd);
-				goto queuing_error;
-			}
-			list_add_tail(&dsd_ptr->list, &ha->gbl_dsd_list);
-			ha->gbl_dsd_avail++;
-		}
-
-sufficient_dsds:
 		req_cnt = 1;
 
 		if (req->cnt < (req_cnt + 2)) {
@@ -3482,27 +3391,13 @@ sufficient_dsds:
 				goto queuing_error;
 		}
 
-		ctx = sp->u.scmd.ct6_ctx =
-		    mempool_alloc(ha->ctx_mempool, GFP_ATOMIC);
+		ctx = sp->u.scmd.ct6_ctx = qla_ct6_ctx_get(sp->qpair);
 		if (!ctx) {
 			ql_log(ql_log_fatal, vha, 0x3010,
 			    "Failed to allocate ctx for cmd=%px.\n", cmd);
 			goto queuing_error;
 		}
 
-		memset(ctx, 0, sizeof(struct ct6_dsd));
-		ctx->fcp_cmnd = dma_pool_zalloc(ha->fcp_cmnd_dma_pool,
-			GFP_ATOMIC, &ctx->fcp_cmnd_dma);
-		if (!ctx->fcp_cmnd) {
-			ql_log(ql_log_fatal, vha, 0x3011,
-			    "Failed to allocate fcp_cmnd for cmd=%px.\n", cmd);
-			goto queuing_error;
-		}
-
-		/* Initialize the DSD list and dma handle */
-		INIT_LIST_HEAD(&ctx->dsd_list);
-		ctx->dsd_use_cnt = 0;
-
 		if (cmd->cmd_len > 16) {
 			additional_cdb_len = cmd->cmd_len - 16;
 			if ((cmd->cmd_len % 4) != 0) {
@@ -3537,8 +3432,12 @@ sufficient_dsds:
 		cmd_pkt->vp_index = sp->vha->vp_idx;
 
 		/* Build IOCB segments */
-		if (qla24xx_build_scsi_type_6_iocbs(sp, cmd_pkt, tot_dsds))
+		if (qla24xx_build_scsi_type_6_iocbs(sp, cmd_pkt, tot_dsds)) {
+			ql_log(ql_log_fatal, vha, 0x300e,
+			    "Failed to allocate DSD list for cmd=%px.\n", cmd);
+			qla_dsd_put_list(sp->qpair, &ctx->dsd_list);
 			goto queuing_error_fcp_cmnd;
+		}
 
 		int_to_scsilun(cmd->device->lun, &cmd_pkt->lun);
 		host_to_fcp_swap((uint8_t *)&cmd_pkt->lun, sizeof(cmd_pkt->lun));
@@ -3673,7 +3572,8 @@ sufficient_dsds:
 	return QLA_SUCCESS;
 
 queuing_error_fcp_cmnd:
-	dma_pool_free(ha->fcp_cmnd_dma_pool, ctx->fcp_cmnd, ctx->fcp_cmnd_dma);
+	qla_ct6_ctx_put(sp->qpair, ctx);
+	sp->u.scmd.ct6_ctx = NULL;
 queuing_error:
 	if (tot_dsds)
 		scsi_dma_unmap(cmd);
@@ -3849,27 +3749,10 @@ qla24xx_prlo_iocb(srb_t *sp, struct logio_entry_24xx *logio)
 	logio->vp_index = sp->fcport->vha->vp_idx;
 }
 
-int
-qla2x00_start_sp(srb_t *sp)
+static void
+qla2x00_build_sp_iocb(srb_t *sp, void *pkt)
 {
-	int rval = QLA_SUCCESS;
-	scsi_qla_host_t *vha = sp->vha;
-	struct qla_hw_data *ha = vha->hw;
-	struct qla_qpair *qp = sp->qpair;
-	void *pkt;
-	unsigned long flags;
-
-	if (vha->hw->flags.eeh_busy)
-		return -EIO;
-
-	spin_lock_irqsave(qp->qp_lock_ptr, flags);
-	pkt = __qla2x00_alloc_iocbs(sp->qpair, sp);
-	if (!pkt) {
-		rval = EAGAIN;
-		ql_log(ql_log_warn, vha, 0x700c,
-		    "qla2x00_alloc_iocbs failed.\n");
-		goto done;
-	}
+	struct qla_hw_data *ha = sp->vha->hw;
 
 	switch (sp->type) {
 	case SRB_LOGIN_CMD:
@@ -3951,12 +3834,49 @@ qla2x00_start_sp(srb_t *sp)
 		qla_els_pt_iocb(sp->vha, pkt,  &sp->u.iocb_cmd.u.drv_els.els_pt_arg);
 		((struct els_entry_24xx *)pkt)->handle = sp->handle;
 		break;
+	case SRB_NVMET_LS:
+		qla_nvmet_ls_iocb(sp, pkt);
+		break;
+	case SRB_NVMET_FCP:
+		qla_nvmet_ctio_iocb(sp, pkt);
+		break;
 	default:
 		break;
 	}
+}
+
+int
+qla2x00_start_sp(srb_t *sp)
+{
+	int rval = QLA_SUCCESS;
+	scsi_qla_host_t *vha = sp->vha;
+	struct qla_qpair *qp = sp->qpair;
+	void *pkt;
+	unsigned long flags;
+
+	if (vha->hw->flags.eeh_busy)
+		return -EIO;
+
+	spin_lock_irqsave(qp->qp_lock_ptr, flags);
+	if (sp->start_timer && qla_tmo_wheel_add(sp)) {
+		rval = QLA_FUNCTION_FAILED;
+		ql_dbg(ql_dbg_async, vha, 0x7047,
+		    "%s: host is going away, not starting %s.\n",
+		    __func__, sp->name);
+		goto done;
+	}
+
+	pkt = __qla2x00_alloc_iocbs(sp->qpair, sp);
+	if (!pkt) {
+		rval = EAGAIN;
+		ql_log(ql_log_warn, vha, 0x700c,
+		    "qla2x00_alloc_iocbs failed.\n");
+		if (sp->start_timer)
+			qla_tmo_wheel_del(sp);
+		goto done;
+	}
 
-	if (sp->start_timer)
-		add_timer(&sp->u.iocb_cmd.timer);
+	qla2x00_build_sp_iocb(sp, pkt);
 
 	wmb();
 	qla2x00_start_iocbs(vha, qp->req);
@@ -3965,6 +3885,67 @@ done:
 	return rval;
 }
 
+/*
+ * Queue @cnt SRBs that share a qpair with a single request queue doorbell.
+ * @skip and @queued, when set, run under the qpair lock: @skip before an
+ * SRB's IOCB is built, and an SRB it returns true for is not started and
+ * its slot in @sps is set to NULL; @queued right after the IOCB is built.
+ * Returns the number of entries consumed, started or skipped; the caller
+ * owns the rest and may try again once the firmware has consumed some of
+ * the ring.
+ */
+int
+qla2x00_start_sp_batch_hook(srb_t **sps, int cnt, bool (*skip)(srb_t *),
+    void (*queued)(srb_t *))
+{
+	scsi_qla_host_t *vha = sps[0]->vha;
+	struct qla_qpair *qp = sps[0]->qpair;
+	void *pkt;
+	unsigned long flags;
+	int i, started = 0;
+
+	if (vha->hw->flags.eeh_busy)
+		return 0;
+
+	spin_lock_irqsave(qp->qp_lock_ptr, flags);
+	for (i = 0; i < cnt; i++) {
+		if (skip && skip(sps[i])) {
+			sps[i] = NULL;
+			continue;
+		}
+
+		if (sps[i]->start_timer && qla_tmo_wheel_add(sps[i]))
+			break;
+
+		pkt = __qla2x00_alloc_iocbs(qp, sps[i]);
+		if (!pkt) {
+			if (sps[i]->start_timer)
+				qla_tmo_wheel_del(sps[i]);
+			break;
+		}
+
+		qla2x00_build_sp_iocb(sps[i], pkt);
+		started++;
+		if (queued)
+			queued(sps[i]);
+	}
+
+	if (started) {
+		wmb();
+		qla2x00_start_iocbs(vha, qp->req);
+	}
+	spin_unlock_irqrestore(qp->qp_lock_ptr, flags);
+
+	return i;
+}
+
+/* Returns the number of SRBs queued, the first that many of @sps. */
+int
+qla2x00_start_sp_batch(srb_t **sps, int cnt)
+{
+	return qla2x00_start_sp_batch_hook(sps, cnt, NULL, NULL);
+}
+
 static void
 qla25xx_build_bidir_iocb(srb_t *sp, struct scsi_qla_host *vha,
 				struct cmd_bidir *cmd_pkt, uint32_t tot_dsds)
@@ -9,6 +9,7 @@
 #include "qla_gbl.h"
 
 #include <linux/delay.h>
+#include <linux/hash.h>
 #include <linux/slab.h>
 #include <linux/cpu.h>
 #include <scsi/scsi_tcq.h>
@@ -679,9 +680,22 @@ qla83xx_handle_8200_aen(scsi_qla_host_t *vha, uint16_t *mb)
 struct purex_item *
 qla24xx_alloc_purex_item(scsi_qla_host_t *vha, uint16_t size)
 {
+	struct purex_pool *pool = &vha->purex_pool;
 	struct purex_item *item = NULL;
 	uint8_t item_hdr_size = sizeof(*item);
 	uint8_t default_usable = 0;
+	unsigned long flags;
+
+	if (pool->size && size <= QLA_PUREX_POOL_PAYLOAD) {
+		spin_lock_irqsave(&pool->lock, flags);
+		item = list_first_entry_or_null(&pool->free,
+		    struct purex_item, list);
+		if (item)
+			list_del(&item->list);
+		spin_unlock_irqrestore(&pool->lock, flags);
+		if (item)
+			goto initialize_purex_header;
+	}
 
 	if (size > QLA_DEFAULT_PAYLOAD_SIZE) {
 		item = kzalloc(item_hdr_size +
@@ -692,7 +706,7 @@ qla24xx_alloc_purex_item(scsi_qla_host_t *vha, uint16_t size)
 	}
 	if (!item) {
 		if (default_usable &&
-		    (atomic_inc_return(&vha->default_item.in_use) == 1)) {
+		    !atomic_cmpxchg(&vha->default_item.in_use, 0, 1)) {
 			item = &vha->default_item;
 			goto initialize_purex_header;
 		}
@@ -705,6 +719,7 @@ qla24xx_alloc_purex_item(scsi_qla_host_t *vha, uint16_t size)
 initialize_purex_header:
 	item->vha = vha;
 	item->size = size;
+	atomic_set(&item->in_use, 1);
 	return item;
 }
 
@@ -1256,6 +1271,7 @@ skip_rio:
 		}
 
 		vha->flags.management_server_logged_in = 0;
+		vha->login_sched.linkup_jif = jiffies;
 		qla2x00_post_aen_work(vha, FCH_EVT_LINKUP, ha->link_data_rate);
 
 		if (vha->link_down_time < vha->hw->port_down_retry_count) {
@@ -3246,9 +3262,8 @@ qla2x00_status_entry(scsi_qla_host_t *vha, struct rsp_que *rsp, void *pkt)
 		/* Valid values of the retry delay timer are 0x1-0xffef */
 		if (sts24->retry_delay > 0 && sts24->retry_delay < 0xfff1) {
 			retry_delay = sts24->retry_delay & 0x3fff;
-			ql_dbg(ql_dbg_io, sp->vha, 0x3033,
-			    "%s: scope=%#x retry_delay=%#x\n", __func__,
-			    sts24->retry_delay >> 14, retry_delay);
+			ql_trc(ql_dbg_io, sp->vha, 0x3033, sp->handle,
+			    sts24->retry_delay >> 14, retry_delay, 0);
 		}
 	} else {
 		if (scsi_status & SS_SENSE_LEN_VALID)
@@ -3308,9 +3323,8 @@ qla2x00_status_entry(scsi_qla_host_t *vha, struct rsp_que *rsp, void *pkt)
 			if (!lscsi_status &&
 			    ((unsigned)(scsi_bufflen(cp) - resid) <
 			     cp->underflow)) {
-				ql_dbg(ql_dbg_io, fcport->vha, 0x301a,
-				    "Mid-layer underflow detected (0x%x of 0x%x bytes).\n",
-				    resid, scsi_bufflen(cp));
+				ql_trc(ql_dbg_io, fcport->vha, 0x301a,
+				    sp->handle, resid, scsi_bufflen(cp), 0);
 
 				res = DID_ERROR << 16;
 				break;
@@ -3319,8 +3333,8 @@ qla2x00_status_entry(scsi_qla_host_t *vha, struct rsp_que *rsp, void *pkt)
 		res = DID_OK << 16 | lscsi_status;
 
 		if (lscsi_status == SAM_STAT_TASK_SET_FULL) {
-			ql_dbg(ql_dbg_io, fcport->vha, 0x301b,
-			    "QUEUE FULL detected.\n");
+			ql_trc(ql_dbg_io, fcport->vha, 0x301b, sp->handle,
+			    fcport->d_id.b24, 0, 0);
 			break;
 		}
 		logit = 0;
@@ -3354,9 +3368,8 @@ qla2x00_status_entry(scsi_qla_host_t *vha, struct rsp_que *rsp, void *pkt)
 			if (!lscsi_status &&
 			    ((unsigned)(scsi_bufflen(cp) - resid) <
 			    cp->underflow)) {
-				ql_dbg(ql_dbg_io, fcport->vha, 0x301e,
-				    "Mid-layer underflow detected (0x%x of 0x%x bytes).\n",
-				    resid, scsi_bufflen(cp));
+				ql_trc(ql_dbg_io, fcport->vha, 0x301e,
+				    sp->handle, resid, scsi_bufflen(cp), 0);
 
 				res = DID_ERROR << 16;
 				break;
@@ -3377,9 +3390,8 @@ qla2x00_status_entry(scsi_qla_host_t *vha, struct rsp_que *rsp, void *pkt)
 			res = DID_ERROR << 16 | lscsi_status;
 			goto check_scsi_status;
 		} else {
-			ql_dbg(ql_dbg_io, fcport->vha, 0x3030,
-			    "scsi_status: 0x%x, lscsi_status: 0x%x\n",
-			    scsi_status, lscsi_status);
+			ql_trc(ql_dbg_io, fcport->vha, 0x3030, sp->handle,
+			    scsi_status, lscsi_status, 0);
 		}
 
 		res = DID_OK << 16 | lscsi_status;
@@ -3392,8 +3404,8 @@ check_scsi_status:
 		 */
 		if (lscsi_status != 0) {
 			if (lscsi_status == SAM_STAT_TASK_SET_FULL) {
-				ql_dbg(ql_dbg_io, fcport->vha, 0x3020,
-				    "QUEUE FULL detected.\n");
+				ql_trc(ql_dbg_io, fcport->vha, 0x3020,
+				    sp->handle, fcport->d_id.b24, 0, 0);
 				logit = 1;
 				break;
 			}
@@ -3793,136 +3805,271 @@ void qla24xx_nvme_ls4_iocb(struct scsi_qla_host *vha,
 	sp->done(sp, comp_status);
 }
 
+/*
+ * FPINs are handled a batch at a time: every FPIN queued since the DPC
+ * thread last ran is parsed against one WWPN index of vp_fcports, the
+ * events are summed into per-target and per-host deltas, and those are
+ * folded into fcport->scm / ha->scm and the SCMR throttle state once at
+ * the end of the batch.
+ */
+struct qla_fpin_acc {
+	struct list_head		list;
+	fc_port_t			*fcport;
+	u32				events;
+	struct qla_scm_target_combined	scm;	/* this batch only */
+	struct fpin_descriptor		*peer_congn;	/* last one seen */
+};
+
+struct qla_fpin_wwpn {
+	struct hlist_node	hnode;
+	fc_port_t		*fcport;
+	struct qla_fpin_acc	*acc;
+};
+
+struct qla_fpin_batch {
+	struct scsi_qla_host	*vha;
+	/* WWPN index, NULL if it could not be allocated */
+	struct hlist_head	*wwpn;
+	struct qla_fpin_wwpn	*ent;
+	u32			bits;
+	struct list_head	acc;
+	u32			fpins;
+
+	struct qla_scm_port_combined host;	/* this batch only */
+	u32			host_events;
+	/* ha->sfc congestion signal, replayed here and published once */
+	int			sig;
+	unsigned long		sig_expires;
+	bool			sig_changed;
+	u64			now;
+};
+
+static void
+qla_fpin_batch_init(struct scsi_qla_host *vha, struct qla_fpin_batch *b)
+{
+	fc_port_t *fcport;
+	u32 n = 0, i;
+
+	memset(b, 0, sizeof(*b));
+	b->vha = vha;
+	INIT_LIST_HEAD(&b->acc);
+	b->sig = qla_scmr_get_sig(&vha->hw->sfc);
+	b->now = qla_get_real_seconds();
+
+	list_for_each_entry(fcport, &vha->vp_fcports, list)
+		n++;
+	if (!n)
+		return;
+
+	b->bits = ilog2(roundup_pow_of_two(n));
+	if (!b->bits)
+		b->bits = 1;
+	b->wwpn = kcalloc(1 << b->bits, sizeof(*b->wwpn), GFP_KERNEL);
+	b->ent = kcalloc(n, sizeof(*b->ent), GFP_KERNEL);
+	if (!b->wwpn || !b->ent) {
+		kfree(b->wwpn);
+		kfree(b->ent);
+		b->wwpn = NULL;
+		b->ent = NULL;
+		return;
+	}
+
+	for (i = 0; i < (1 << b->bits); i++)
+		INIT_HLIST_HEAD(&b->wwpn[i]);
+
+	i = 0;
+	list_for_each_entry(fcport, &vha->vp_fcports, list) {
+		if (fcport->deleted || i == n)
+			continue;
+		b->ent[i].fcport = fcport;
+		hlist_add_head(&b->ent[i].hnode,
+		    &b->wwpn[hash_64(wwn_to_u64(fcport->port_name), b->bits)]);
+		i++;
+	}
+}
+
+static struct qla_fpin_acc *
+qla_fpin_acc_new(struct qla_fpin_batch *b, fc_port_t *fcport)
+{
+	struct qla_fpin_acc *acc;
+
+	acc = kzalloc(sizeof(*acc), GFP_KERNEL);
+	if (!acc)
+		return NULL;
+
+	acc->fcport = fcport;
+	list_add_tail(&acc->list, &b->acc);
+	return acc;
+}
+
+/*
+ * Map a WWPN from an FPIN descriptor to the accumulator of its session,
+ * creating the accumulator on first use.  Falls back to walking
+ * vp_fcports when the index is missing.
+ */
+static struct qla_fpin_acc *
+qla_fpin_acc_find(struct qla_fpin_batch *b, u8 *wwpn)
+{
+	struct qla_fpin_wwpn *ent;
+	struct qla_fpin_acc *acc;
+	fc_port_t *fcport;
+
+	if (b->wwpn) {
+		hlist_for_each_entry(ent,
+		    &b->wwpn[hash_64(wwn_to_u64(wwpn), b->bits)], hnode) {
+			if (memcmp(ent->fcport->port_name, wwpn, WWN_SIZE))
+				continue;
+			if (!ent->acc)
+				ent->acc = qla_fpin_acc_new(b, ent->fcport);
+			return ent->acc;
+		}
+		return NULL;
+	}
+
+	fcport = qla2x00_find_fcport_by_wwpn(b->vha, wwpn, 0);
+	if (!fcport)
+		return NULL;
+
+	list_for_each_entry(acc, &b->acc, list)
+		if (acc->fcport == fcport)
+			return acc;
+
+	return qla_fpin_acc_new(b, fcport);
+}
+
+static void
+qla_scm_stats_add(struct qla_scm_stats *dst, struct qla_scm_stats *src)
+{
+	u8 *d = (u8 *)dst, *s = (u8 *)src;
+	int i;
+
+	for (i = 0; i < sizeof(*dst); i += sizeof(u64))
+		put_unaligned(get_unaligned((u64 *)(d + i)) +
+		    get_unaligned((u64 *)(s + i)), (u64 *)(d + i));
+}
+
 DECLARE_ENUM2STR_LOOKUP(qla_get_li_event_type, ql_fpin_li_event_types,
 			QL_FPIN_LI_EVT_TYPES_INIT);
 static void
 qla_link_integrity_tgt_stats_update(struct fpin_descriptor *fpin_desc,
-				    fc_port_t *fcport)
+				    struct qla_fpin_acc *acc)
 {
+	struct qla_scm_target_combined *scm = &acc->scm;
 	uint16_t event;
 	uint32_t event_count;
-	const char * li_type;
 
 	event = be16_to_cpu(fpin_desc->link_integrity.event_type);
 	event_count = be32_to_cpu(fpin_desc->link_integrity.event_count);
-	li_type = qla_get_li_event_type(event);
-	ql_log(ql_log_info, fcport->vha, 0x502d,
-	       "Link Integrity Event Type: %s(%x) for Port %8phN\n",
-		li_type, event, fcport->port_name);
+	acc->events++;
 
-	fcport->scm.link_integrity.event_type = event;
-	fcport->scm.link_integrity.event_modifier =
+	scm->link_integrity.event_type = event;
+	scm->link_integrity.event_modifier =
 	    be16_to_cpu(fpin_desc->link_integrity.event_modifier);
-	fcport->scm.link_integrity.event_threshold =
+	scm->link_integrity.event_threshold =
 	    be32_to_cpu(fpin_desc->link_integrity.event_threshold);
-	fcport->scm.link_integrity.event_count = event_count;
-	fcport->scm.last_event_timestamp = qla_get_real_seconds();
+	scm->link_integrity.event_count = event_count;
 
-	fcport->scm.current_events |= SCM_EVENT_LINK_INTEGRITY;
+	scm->current_events |= SCM_EVENT_LINK_INTEGRITY;
 	switch (event) {
 	case QL_FPIN_LI_UNKNOWN:
-		fcport->scm.stats.li_failure_unknown += event_count;
+		scm->stats.li_failure_unknown += event_count;
 		break;
 	case QL_FPIN_LI_LINK_FAILURE:
-		fcport->scm.stats.li_link_failure_count += event_count;
+		scm->stats.li_link_failure_count += event_count;
 		break;
 	case QL_FPIN_LI_LOSS_OF_SYNC:
-		fcport->scm.stats.li_loss_of_sync_count += event_count;
+		scm->stats.li_loss_of_sync_count += event_count;
 		break;
 	case QL_FPIN_LI_LOSS_OF_SIG:
-		fcport->scm.stats.li_loss_of_signals_count += event_count;
+		scm->stats.li_loss_of_signals_count += event_count;
 		break;
 	case QL_FPIN_LI_PRIM_SEQ_ERR:
-		fcport->scm.stats.li_prim_seq_err_count += event_count;
+		scm->stats.li_prim_seq_err_count += event_count;
 		break;
 	case QL_FPIN_LI_INVALID_TX_WD:
-		fcport->scm.stats.li_invalid_tx_word_count += event_count;
+		scm->stats.li_invalid_tx_word_count += event_count;
 		break;
 	case QL_FPIN_LI_INVALID_CRC:
-		fcport->scm.stats.li_invalid_crc_count += event_count;
+		scm->stats.li_invalid_crc_count += event_count;
 		break;
 	case QL_FPIN_LI_DEVICE_SPEC:
-		fcport->scm.stats.li_device_specific += event_count;
+		scm->stats.li_device_specific += event_count;
 		break;
 	}
 }
 
 static void
 qla_link_integrity_host_stats_update(struct fpin_descriptor *fpin_desc,
-				    struct qla_hw_data *ha)
+				    struct qla_fpin_batch *b)
 {
+	struct qla_scm_port_combined *scm = &b->host;
 	uint16_t event;
 	uint32_t event_count;
-	const char *li_type;
 
 	event = be16_to_cpu(fpin_desc->link_integrity.event_type);
 	event_count = be32_to_cpu(fpin_desc->link_integrity.event_count);
-	li_type = qla_get_li_event_type(event);
+	b->host_events++;
 
-	ha->scm.link_integrity.event_type = event;
-	ha->scm.link_integrity.event_modifier =
+	scm->link_integrity.event_type = event;
+	scm->link_integrity.event_modifier =
 	    be16_to_cpu(fpin_desc->link_integrity.event_modifier);
-	ha->scm.link_integrity.event_threshold =
+	scm->link_integrity.event_threshold =
 	    be32_to_cpu(fpin_desc->link_integrity.event_threshold);
-	ha->scm.link_integrity.event_count = event_count;
-	ha->scm.last_event_timestamp = qla_get_real_seconds();
+	scm->link_integrity.event_count = event_count;
 
-	ha->scm.current_events |= SCM_EVENT_LINK_INTEGRITY;
+	scm->current_events |= SCM_EVENT_LINK_INTEGRITY;
 	switch (event) {
 	case QL_FPIN_LI_UNKNOWN:
-		ha->scm.stats.li_failure_unknown += event_count;
+		scm->stats.li_failure_unknown += event_count;
 		break;
 	case QL_FPIN_LI_LINK_FAILURE:
-		ha->scm.stats.li_link_failure_count += event_count;
+		scm->stats.li_link_failure_count += event_count;
 		break;
 	case QL_FPIN_LI_LOSS_OF_SYNC:
-		ha->scm.stats.li_loss_of_sync_count += event_count;
+		scm->stats.li_loss_of_sync_count += event_count;
 		break;
 	case QL_FPIN_LI_LOSS_OF_SIG:
-		ha->scm.stats.li_loss_of_signals_count += event_count;
+		scm->stats.li_loss_of_signals_count += event_count;
 		break;
 	case QL_FPIN_LI_PRIM_SEQ_ERR:
-		ha->scm.stats.li_prim_seq_err_count += event_count;
+		scm->stats.li_prim_seq_err_count += event_count;
 		break;
 	case QL_FPIN_LI_INVALID_TX_WD:
-		ha->scm.stats.li_invalid_tx_word_count += event_count;
+		scm->stats.li_invalid_tx_word_count += event_count;
 		break;
 	case QL_FPIN_LI_INVALID_CRC:
-		ha->scm.stats.li_invalid_crc_count += event_count;
+		scm->stats.li_invalid_crc_count += event_count;
 		break;
 	case QL_FPIN_LI_DEVICE_SPEC:
-		ha->scm.stats.li_device_specific += event_count;
+		scm->stats.li_device_specific += event_count;
 		break;
 	}
 }
 
 
 static void
-qla_scm_process_link_integrity_d(struct scsi_qla_host *vha,
+qla_scm_process_link_integrity_d(struct qla_fpin_batch *b,
 				 struct fpin_descriptor *fpin_desc,
 				 int length)
 {
 	int i;
 	uint16_t event;
 	const char * li_type;
-	fc_port_t *fcport =  NULL;
-	struct qla_hw_data *ha = vha->hw;
-	fc_port_t *d_fcport = NULL, *a_fcport = NULL;
+	struct scsi_qla_host *vha = b->vha;
+	struct qla_fpin_acc *acc, *d_acc = NULL, *a_acc = NULL;
 
-	fcport = qla2x00_find_fcport_by_wwpn(vha,
-				fpin_desc->link_integrity.detecting_port_name,
-				0);
-	if (fcport) {
-		d_fcport = fcport;
-		qla_link_integrity_tgt_stats_update(fpin_desc, fcport);
+	acc = qla_fpin_acc_find(b,
+				fpin_desc->link_integrity.detecting_port_name);
+	if (acc) {
+		d_acc = acc;
+		qla_link_integrity_tgt_stats_update(fpin_desc, acc);
 	}
 
-	fcport = qla2x00_find_fcport_by_wwpn(vha,
-				fpin_desc->link_integrity.attached_port_name,
-				0);
-	if (fcport) {
-		a_fcport = fcport;
-		qla_link_integrity_tgt_stats_update(fpin_desc, fcport);
+	acc = qla_fpin_acc_find(b,
+				fpin_desc->link_integrity.attached_port_name);
+	if (acc) {
+		a_acc = acc;
+		qla_link_integrity_tgt_stats_update(fpin_desc, acc);
 	}
 
 	if (be32_to_cpu(fpin_desc->link_integrity.port_name_count) > 0) {
@@ -3932,19 +4079,17 @@ qla_scm_process_link_integrity_d(struct scsi_qla_host *vha,
 			if (offsetof(struct fpin_descriptor,
 			    link_integrity.port_name_list[i]) >
 			    length - 8) {
-				ql_log(ql_log_warn, fcport->vha, 0x5098,
+				ql_log(ql_log_warn, vha, 0x5098,
 				    "SCM: Port list[%d] exceeds payload size, len %d\n",
 				    i, length);
 				break;
 			}
 
-			fcport = qla2x00_find_fcport_by_wwpn(vha,
-				fpin_desc->link_integrity.port_name_list[i],
-				0);
-			if (fcport && (fcport != d_fcport) &&
-			    (fcport != a_fcport)) {
+			acc = qla_fpin_acc_find(b,
+				fpin_desc->link_integrity.port_name_list[i]);
+			if (acc && (acc != d_acc) && (acc != a_acc)) {
 				qla_link_integrity_tgt_stats_update(fpin_desc,
-								    fcport);
+								    acc);
 			}
 		}
 	}
@@ -3957,7 +4102,7 @@ qla_scm_process_link_integrity_d(struct scsi_qla_host *vha,
 		       "Link Integrity Event Type: %s(%x) for HBA WWN %8phN\n",
 		       li_type, event, vha->port_name);
 
-		qla_link_integrity_host_stats_update(fpin_desc, ha);
+		qla_link_integrity_host_stats_update(fpin_desc, b);
 	}
 }
 
@@ -3965,88 +4110,79 @@ DECLARE_ENUM2STR_LOOKUP_DELI_EVENT
 
 static void
 qla_delivery_tgt_stats_update(struct fpin_descriptor *fpin_desc,
-			      fc_port_t *fcport)
+			      struct qla_fpin_acc *acc)
 {
+	struct qla_scm_target_combined *scm = &acc->scm;
 	uint32_t event;
-	const char * deli_type;
 
 	event = be32_to_cpu(fpin_desc->delivery.delivery_reason_code);
-	deli_type =  qla_get_dn_event_type(event);
-	ql_log(ql_log_info, fcport->vha, 0x5095,
-	       "Delivery Notification Reason Code: %s(%x) for Port %8phN\n",
-	       deli_type, event, fcport->port_name);
-
-	fcport->scm.current_events |= SCM_EVENT_DELIVERY;
-	fcport->scm.delivery.delivery_reason =
-		    be32_to_cpu(fpin_desc->delivery.delivery_reason_code);
+	acc->events++;
+
+	scm->current_events |= SCM_EVENT_DELIVERY;
+	scm->delivery.delivery_reason = event;
 	switch (event) {
 	case FPIN_DELI_UNKNOWN:
-		fcport->scm.stats.dn_unknown++;
+		scm->stats.dn_unknown++;
 		break;
 	case FPIN_DELI_TIMEOUT:
-		fcport->scm.stats.dn_timeout++;
+		scm->stats.dn_timeout++;
 		break;
 	case FPIN_DELI_UNABLE_TO_ROUTE:
-		fcport->scm.stats.dn_unable_to_route++;
+		scm->stats.dn_unable_to_route++;
 		break;
 	case FPIN_DELI_DEVICE_SPEC:
-		fcport->scm.stats.dn_device_specific++;
+		scm->stats.dn_device_specific++;
 		break;
 	}
-	fcport->scm.last_event_timestamp = qla_get_real_seconds();
 }
 
 static void
 qla_delivery_host_stats_update(struct fpin_descriptor *fpin_desc,
-			      struct qla_hw_data *ha)
+			      struct qla_fpin_batch *b)
 {
+	struct qla_scm_port_combined *scm = &b->host;
 	uint32_t event;
-	const char *deli_type;
 
 	event = be32_to_cpu(fpin_desc->delivery.delivery_reason_code);
-	deli_type =  qla_get_dn_event_type(event);
+	b->host_events++;
 
-	ha->scm.current_events |= SCM_EVENT_DELIVERY;
-	ha->scm.delivery.delivery_reason =
-		    be32_to_cpu(fpin_desc->delivery.delivery_reason_code);
+	scm->current_events |= SCM_EVENT_DELIVERY;
+	scm->delivery.delivery_reason = event;
 	switch (event) {
 	case FPIN_DELI_UNKNOWN:
-		ha->scm.stats.dn_unknown++;
+		scm->stats.dn_unknown++;
 		break;
 	case FPIN_DELI_TIMEOUT:
-		ha->scm.stats.dn_timeout++;
+		scm->stats.dn_timeout++;
 		break;
 	case FPIN_DELI_UNABLE_TO_ROUTE:
-		ha->scm.stats.dn_unable_to_route++;
+		scm->stats.dn_unable_to_route++;
 		break;
 	case FPIN_DELI_DEVICE_SPEC:
-		ha->scm.stats.dn_device_specific++;
+		scm->stats.dn_device_specific++;
 		break;
 	}
-	ha->scm.last_event_timestamp = qla_get_real_seconds();
 }
 
 /*
  * Process Delivery Notification Descriptor
  */
 static void
-qla_scm_process_delivery_notification_d(struct scsi_qla_host *vha,
+qla_scm_process_delivery_notification_d(struct qla_fpin_batch *b,
 					struct fpin_descriptor *fpin_desc)
 {
 	uint32_t event;
 	const char * deli_type;
-	fc_port_t *fcport =  NULL;
-	struct qla_hw_data *ha = vha->hw;
+	struct scsi_qla_host *vha = b->vha;
+	struct qla_fpin_acc *acc;
 
-	fcport = qla2x00_find_fcport_by_wwpn(vha,
-				fpin_desc->delivery.detecting_port_name, 0);
-	if (fcport)
-		qla_delivery_tgt_stats_update(fpin_desc, fcport);
+	acc = qla_fpin_acc_find(b, fpin_desc->delivery.detecting_port_name);
+	if (acc)
+		qla_delivery_tgt_stats_update(fpin_desc, acc);
 
-	fcport = qla2x00_find_fcport_by_wwpn(vha,
-				fpin_desc->delivery.attached_port_name, 0);
-	if (fcport)
-		qla_delivery_tgt_stats_update(fpin_desc, fcport);
+	acc = qla_fpin_acc_find(b, fpin_desc->delivery.attached_port_name);
+	if (acc)
+		qla_delivery_tgt_stats_update(fpin_desc, acc);
 
 	if (memcmp(vha->port_name, fpin_desc->delivery.attached_port_name,
 		   WWN_SIZE) == 0) {
@@ -4055,7 +4191,7 @@ qla_scm_process_delivery_notification_d(struct scsi_qla_host *vha,
 		ql_log(ql_log_info, vha, 0x5096,
 		       "Delivery Notification Reason Code: %s(%x) for HBA WWN %8phN\n",
 		       deli_type, event, vha->port_name);
-		qla_delivery_host_stats_update(fpin_desc, ha);
+		qla_delivery_host_stats_update(fpin_desc, b);
 	}
 }
 
@@ -4101,79 +4237,65 @@ DECLARE_ENUM2STR_LOOKUP_CONGN_EVENT
 
 static void
 qla_peer_congestion_tgt_stats_update(struct fpin_descriptor *fpin_desc,
-				     fc_port_t *fcport)
+				     struct qla_fpin_acc *acc)
 {
+	struct qla_scm_target_combined *scm = &acc->scm;
 	uint16_t event;
-	uint32_t event_period_secs = 0;
-	const char * congn_type;
 
 	event = be16_to_cpu(fpin_desc->peer_congestion.event_type);
-	congn_type = qla_get_congn_event_type(event);
-	ql_log(ql_log_info, fcport->vha, 0x5098,
-	       "Peer Congestion Event Type: %s(%x) for Port %8phN\n",
-	       congn_type, event, fcport->port_name);
+	acc->events++;
 
-	fcport->scm.last_event_timestamp = qla_get_real_seconds();
-	fcport->scm.peer_congestion.event_type = event;
-	fcport->scm.peer_congestion.event_modifier =
+	scm->peer_congestion.event_type = event;
+	scm->peer_congestion.event_modifier =
 	    be16_to_cpu(fpin_desc->peer_congestion.event_modifier);
-	fcport->scm.peer_congestion.event_period =
+	scm->peer_congestion.event_period =
 	    be32_to_cpu(fpin_desc->peer_congestion.event_period);
-	event_period_secs =
-	    be32_to_cpu(fpin_desc->peer_congestion.event_period) / 1000;
-	if (event_period_secs)
-		fcport->sfc.event_period = event_period_secs;
-	else
-		fcport->sfc.event_period = 1;
 
-	fcport->sfc.event_period_buffer = QLA_SCMR_BUFFER;
-
-	// What is the API to get system time ?
-	fcport->scm.current_events |= SCM_EVENT_PEER_CONGESTION;
+	scm->current_events |= SCM_EVENT_PEER_CONGESTION;
 	switch (event) {
 	case FPIN_CONGN_CLEAR:
-		fcport->scm.stats.cn_clear++;
+		scm->stats.cn_clear++;
 		break;
 	case FPIN_CONGN_LOST_CREDIT:
-		fcport->scm.stats.cn_lost_credit++;
+		scm->stats.cn_lost_credit++;
 		break;
 	case FPIN_CONGN_CREDIT_STALL:
-		fcport->scm.stats.cn_credit_stall++;
+		scm->stats.cn_credit_stall++;
 		break;
 	case FPIN_CONGN_OVERSUBSCRIPTION:
-		fcport->scm.stats.cn_oversubscription++;
+		scm->stats.cn_oversubscription++;
 		break;
 	case FPIN_CONGN_DEVICE_SPEC:
-		fcport->scm.stats.cn_device_specific++;
+		scm->stats.cn_device_specific++;
 		break;
 	}
-	qla_scm_set_target_device_state(fcport, fpin_desc);
+	/* only the latest state reaches the throttle, at batch end */
+	acc->peer_congn = fpin_desc;
 }
 
 /*
  * Process Peer-Congestion Notification Descriptor
  */
 static void
-qla_scm_process_peer_congestion_notification_d(struct scsi_qla_host *vha,
+qla_scm_process_peer_congestion_notification_d(struct qla_fpin_batch *b,
 					struct fpin_descriptor *fpin_desc,
 					int length)
 {
 	int i;
-	fc_port_t *fcport =  NULL;
-	fc_port_t *d_fcport = NULL, *a_fcport = NULL;
+	struct qla_fpin_acc *acc, *d_acc = NULL, *a_acc = NULL;
 
-	fcport = qla2x00_find_fcport_by_wwpn(vha,
-			fpin_desc->peer_congestion.detecting_port_name, 0);
-	if (fcport) {
-		d_fcport = fcport;
-		qla_peer_congestion_tgt_stats_update(fpin_desc, fcport);
+	acc = qla_fpin_acc_find(b,
+			fpin_desc->peer_congestion.detecting_port_name);
+	if (acc) {
+		d_acc = acc;
+		qla_peer_congestion_tgt_stats_update(fpin_desc, acc);
 	}
 
-	fcport = qla2x00_find_fcport_by_wwpn(vha,
-			fpin_desc->peer_congestion.attached_port_name, 0);
-	if (fcport) {
-		a_fcport = fcport;
-		qla_peer_congestion_tgt_stats_update(fpin_desc, fcport);
+	acc = qla_fpin_acc_find(b,
+			fpin_desc->peer_congestion.attached_port_name);
+	if (acc) {
+		a_acc = acc;
+		qla_peer_congestion_tgt_stats_update(fpin_desc, acc);
 	}
 
 	if (be32_to_cpu(fpin_desc->peer_congestion.port_name_count) > 0) {
@@ -4183,17 +4305,16 @@ qla_scm_process_peer_congestion_notification_d(struct scsi_qla_host *vha,
 			if (offsetof(struct fpin_descriptor,
 			    peer_congestion.port_name_list[i]) >
 			    length - 8) {
-				ql_log(ql_log_warn, fcport->vha, 0x5098,
+				ql_log(ql_log_warn, b->vha, 0x5098,
 				    "SCM: Port list[%d] exceeds payload size, len %d\n",
 				    i, length);
 				break;
 			}
-			fcport = qla2x00_find_fcport_by_wwpn(vha,
-			fpin_desc->peer_congestion.port_name_list[i], 0);
-			if (fcport && fcport != d_fcport &&
-			    fcport != a_fcport) {
+			acc = qla_fpin_acc_find(b,
+			fpin_desc->peer_congestion.port_name_list[i]);
+			if (acc && acc != d_acc && acc != a_acc) {
 				qla_peer_congestion_tgt_stats_update(fpin_desc,
-								fcport);
+								acc);
 			}
 		}
 	}
@@ -4202,30 +4323,32 @@ qla_scm_process_peer_congestion_notification_d(struct scsi_qla_host *vha,
 /*
  * qla_scm_process_congestion_notification_d() - Process
  * Process Congestion Notification Descriptor
- * @rsp: response queue
- * @pkt: Entry pointer
+ * @b: FPIN batch
+ * @fpin_desc: congestion descriptor
  */
 static void
-qla_scm_process_congestion_notification_d(struct scsi_qla_host *vha,
+qla_scm_process_congestion_notification_d(struct qla_fpin_batch *b,
 					  struct fpin_descriptor *fpin_desc)
 {
 	u64 delta;
 	uint16_t event;
 	uint32_t event_period_secs = 0;
 	const char * congn_type;
-	struct qla_hw_data *ha = vha->hw;
-	struct qla_scmr_flow_control *sfc = &ha->sfc;
+	struct scsi_qla_host *vha = b->vha;
+	struct qla_scm_port_combined *scm = &b->host;
+	struct qla_scmr_flow_control *sfc = &vha->hw->sfc;
 
 
 	event = be16_to_cpu(fpin_desc->congestion.event_type);
 	congn_type = qla_get_congn_event_type(event);
 	ql_log(ql_log_info, vha, 0x5099,
 	       "Congestion Event Type: %s(%x)\n", congn_type, event);
+	b->host_events++;
 
-	ha->scm.congestion.event_type = event;
-	ha->scm.congestion.event_modifier =
+	scm->congestion.event_type = event;
+	scm->congestion.event_modifier =
 	    be16_to_cpu(fpin_desc->congestion.event_modifier);
-	ha->scm.congestion.event_period =
+	scm->congestion.event_period =
 	    be32_to_cpu(fpin_desc->congestion.event_period);
 	event_period_secs =
 	    be32_to_cpu(fpin_desc->congestion.event_period) / 1000;
@@ -4233,9 +4356,8 @@ qla_scm_process_congestion_notification_d(struct scsi_qla_host *vha,
 		sfc->event_period = event_period_secs;
 	else
 		sfc->event_period = 1;
-	ha->scm.last_event_timestamp = qla_get_real_seconds();
 
-	ha->scm.congestion.severity =
+	scm->congestion.severity =
 	    fpin_desc->congestion.severity;
 
 	sfc->throttle_period = sfc->event_period_buffer + sfc->event_period;
@@ -4243,27 +4365,28 @@ qla_scm_process_congestion_notification_d(struct scsi_qla_host *vha,
 	if (delta < HZ)
 		delta = HZ;
 
-	ha->scm.current_events |= SCM_EVENT_CONGESTION;
-	switch (be16_to_cpu(fpin_desc->congestion.event_type)) {
+	scm->current_events |= SCM_EVENT_CONGESTION;
+	switch (event) {
 	case FPIN_CONGN_CLEAR:
-		atomic_set(&sfc->scmr_congn_signal, QLA_SIG_CLEAR);
-		ha->scm.stats.cn_clear++;
+		b->sig = QLA_SIG_CLEAR;
+		b->sig_changed = true;
+		scm->stats.cn_clear++;
 		break;
 	case FPIN_CONGN_CREDIT_STALL:
-		if (qla_scmr_get_sig(sfc) == QLA_SIG_NONE) {
-			atomic_set(&sfc->scmr_congn_signal,
-			    QLA_SIG_CREDIT_STALL);
-			sfc->expiration_jiffies = jiffies + delta;
+		if (b->sig == QLA_SIG_NONE) {
+			b->sig = QLA_SIG_CREDIT_STALL;
+			b->sig_expires = jiffies + delta;
+			b->sig_changed = true;
 		}
-		ha->scm.stats.cn_credit_stall++;
+		scm->stats.cn_credit_stall++;
 		break;
 	case FPIN_CONGN_OVERSUBSCRIPTION:
-		if (qla_scmr_get_sig(sfc) == QLA_SIG_NONE) {
-			atomic_set(&sfc->scmr_congn_signal,
-			    QLA_SIG_OVERSUBSCRIPTION);
-			sfc->expiration_jiffies = jiffies + delta;
+		if (b->sig == QLA_SIG_NONE) {
+			b->sig = QLA_SIG_OVERSUBSCRIPTION;
+			b->sig_expires = jiffies + delta;
+			b->sig_changed = true;
 		}
-		ha->scm.stats.cn_oversubscription++;
+		scm->stats.cn_oversubscription++;
 		break;
 	default:
 		break;
@@ -4272,11 +4395,11 @@ qla_scm_process_congestion_notification_d(struct scsi_qla_host *vha,
 	if (fpin_desc->congestion.severity ==
 	    SCM_CONGESTION_SEVERITY_WARNING) {
 		sfc->level = QLA_CONG_LOW;
-		ha->scm.sev.cn_warning++;
+		scm->sev.cn_warning++;
 	} else if (fpin_desc->congestion.severity ==
 	    SCM_CONGESTION_SEVERITY_ERROR) {
 		sfc->level = QLA_CONG_HIGH;
-		ha->scm.sev.cn_alarm++;
+		scm->sev.cn_alarm++;
 	}
 }
 
@@ -4293,8 +4416,86 @@ qla_scm_clear_pervious_event(struct scsi_qla_host *vha)
 }
 
 static void
-qla27xx_process_purex_fpin(struct scsi_qla_host *vha, struct purex_item *item)
+qla_fpin_tgt_flush(struct qla_fpin_batch *b, struct qla_fpin_acc *acc)
+{
+	fc_port_t *fcport = acc->fcport;
+	struct qla_scm_target_combined *scm = &fcport->scm;
+	uint32_t event_period_secs;
+
+	qla_scm_stats_add(&scm->stats, &acc->scm.stats);
+	if (acc->scm.current_events & SCM_EVENT_LINK_INTEGRITY)
+		scm->link_integrity = acc->scm.link_integrity;
+	if (acc->scm.current_events & SCM_EVENT_DELIVERY)
+		scm->delivery.delivery_reason =
+		    acc->scm.delivery.delivery_reason;
+	if (acc->scm.current_events & SCM_EVENT_PEER_CONGESTION)
+		scm->peer_congestion = acc->scm.peer_congestion;
+	scm->current_events = acc->scm.current_events;
+	scm->last_event_timestamp = b->now;
+
+	ql_log(ql_log_info, b->vha, 0x502d,
+	       "SCM: %u FPIN events (mask 0x%x) for Port %8phN\n",
+	       acc->events, acc->scm.current_events, fcport->port_name);
+
+	if (!acc->peer_congn)
+		return;
+
+	event_period_secs = acc->scm.peer_congestion.event_period / 1000;
+	fcport->sfc.event_period = event_period_secs ? event_period_secs : 1;
+	fcport->sfc.event_period_buffer = QLA_SCMR_BUFFER;
+	qla_scm_set_target_device_state(fcport, acc->peer_congn);
+}
+
+static void
+qla_fpin_batch_flush(struct qla_fpin_batch *b)
 {
+	struct qla_hw_data *ha = b->vha->hw;
+	struct qla_scm_port_combined *scm = &ha->scm;
+	struct qla_fpin_acc *acc, *tacc;
+	u32 ntgt = 0;
+
+	qla_scm_clear_pervious_event(b->vha);
+
+	list_for_each_entry_safe(acc, tacc, &b->acc, list) {
+		qla_fpin_tgt_flush(b, acc);
+		list_del(&acc->list);
+		kfree(acc);
+		ntgt++;
+	}
+
+	if (b->host_events) {
+		qla_scm_stats_add(&scm->stats, &b->host.stats);
+		scm->sev.cn_alarm += b->host.sev.cn_alarm;
+		scm->sev.cn_warning += b->host.sev.cn_warning;
+		if (b->host.current_events & SCM_EVENT_LINK_INTEGRITY)
+			scm->link_integrity = b->host.link_integrity;
+		if (b->host.current_events & SCM_EVENT_DELIVERY)
+			scm->delivery.delivery_reason =
+			    b->host.delivery.delivery_reason;
+		if (b->host.current_events & SCM_EVENT_CONGESTION)
+			scm->congestion = b->host.congestion;
+		scm->current_events = b->host.current_events;
+		scm->last_event_timestamp = b->now;
+	}
+
+	if (b->sig_changed) {
+		if (b->sig != QLA_SIG_CLEAR)
+			ha->sfc.expiration_jiffies = b->sig_expires;
+		atomic_set(&ha->sfc.scmr_congn_signal, b->sig);
+	}
+
+	ql_dbg(ql_dbg_async, b->vha, 0x509b,
+	    "SCM: FPIN batch of %u, %u targets, %u host events%s\n",
+	    b->fpins, ntgt, b->host_events, b->wwpn ? "" : " (no index)");
+
+	kfree(b->wwpn);
+	kfree(b->ent);
+}
+
+static void
+qla27xx_parse_purex_fpin(struct qla_fpin_batch *b, struct purex_item *item)
+{
+	struct scsi_qla_host *vha = b->vha;
 	struct fpin_descriptor *fpin_desc;
 	uint16_t fpin_desc_len;
 	uint32_t fpin_offset = 0;
@@ -4312,7 +4513,7 @@ qla27xx_process_purex_fpin(struct scsi_qla_host *vha, struct purex_item *item)
 	fpin_desc = (struct fpin_descriptor *)((uint8_t *)pkt +
 	    FPIN_ELS_DESCRIPTOR_LIST_OFFSET);
 
-	qla_scm_clear_pervious_event(vha);
+	b->fpins++;
 	fpin_desc_len = pkt_size - FPIN_ELS_DESCRIPTOR_LIST_OFFSET;
 	if (fpin_desc_len != be32_to_cpu(fpin_desc->descriptor_length) + 8) {
 		ql_log(ql_log_warn, vha, 0x5099,
@@ -4329,20 +4530,20 @@ qla27xx_process_purex_fpin(struct scsi_qla_host *vha, struct purex_item *item)
 
 		switch (be32_to_cpu(fpin_desc->descriptor_tag)) {
 		case SCM_NOTIFICATION_TYPE_LINK_INTEGRITY:
-			qla_scm_process_link_integrity_d(vha,
+			qla_scm_process_link_integrity_d(b,
 							 fpin_desc,
 							 fpin_desc_len);
 			break;
 		case SCM_NOTIFICATION_TYPE_DELIVERY:
-			qla_scm_process_delivery_notification_d(vha, fpin_desc);
+			qla_scm_process_delivery_notification_d(b, fpin_desc);
 			break;
 		case SCM_NOTIFICATION_TYPE_PEER_CONGESTION:
-			qla_scm_process_peer_congestion_notification_d(vha,
+			qla_scm_process_peer_congestion_notification_d(b,
 								fpin_desc,
 								fpin_desc_len);
 			break;
 		case SCM_NOTIFICATION_TYPE_CONGESTION:
-			qla_scm_process_congestion_notification_d(vha,
+			qla_scm_process_congestion_notification_d(b,
 								fpin_desc);
 			break;
 		}
@@ -4352,6 +4553,41 @@ qla27xx_process_purex_fpin(struct scsi_qla_host *vha, struct purex_item *item)
 	fc_host_fpin_rcv(vha->host, pkt_size, (char *)pkt);
 }
 
+/**
+ * qla27xx_process_fpin_list() - Process a batch of queued FPINs
+ * @vha: SCSI driver HA context
+ * @head: purex items flagged PUREX_ITEM_FPIN; they are released here
+ */
+void
+qla27xx_process_fpin_list(struct scsi_qla_host *vha, struct list_head *head)
+{
+	struct qla_fpin_batch b;
+	struct purex_item *item, *next;
+
+	qla_fpin_batch_init(vha, &b);
+
+	/* descriptors stay referenced by the batch until it is flushed */
+	list_for_each_entry(item, head, list)
+		qla27xx_parse_purex_fpin(&b, item);
+
+	qla_fpin_batch_flush(&b);
+
+	list_for_each_entry_safe(item, next, head, list) {
+		list_del(&item->list);
+		qla24xx_free_purex_item(item);
+	}
+}
+
+static void
+qla27xx_process_purex_fpin(struct scsi_qla_host *vha, struct purex_item *item)
+{
+	struct qla_fpin_batch b;
+
+	qla_fpin_batch_init(vha, &b);
+	qla27xx_parse_purex_fpin(&b, item);
+	qla_fpin_batch_flush(&b);
+}
+
 static void
 qla24xx_process_abts(struct scsi_qla_host *vha, struct purex_item *pkt)
 {
@@ -5084,6 +5320,26 @@ process_err:
 			qla24xx_nvme_ls4_iocb(vha, (struct pt_ls4_request *)pkt,
 			    rsp->req);
 			break;
+		case CTIO_NVME:
+			qla_nvmet_ctio_done(vha, rsp->req, pkt);
+			break;
+		case PT_LS4_UNSOL:
+			if (qla_chk_cont_iocb_avail(vha, rsp, (response_t *)pkt)) {
+				/*
+				 * Not all continuation entries have been
+				 * posted.  Step back to this entry and pick
+				 * it up again on the next interrupt.
+				 */
+				ql_dbg(ql_dbg_async, vha, 0x2136,
+				    "Defer processing NVMe LS, entry count %d\n",
+				    pkt->entry_count);
+				rsp->ring_ptr = (response_t *)pkt;
+				rsp->ring_index = rsp->ring_index ?
+				    rsp->ring_index - 1 : rsp->length - 1;
+				return;
+			}
+			qla_nvme_unsol_ls(vha, (void **)&pkt, &rsp);
+			break;
 		case NOTIFY_ACK_TYPE:
 			if (pkt->handle == QLA_TGT_SKIP_HANDLE)
 				qlt_response_pkt_all_vps(vha, rsp,
@@ -5131,6 +5387,7 @@ process_err:
 								rsp, rsp_in);
 				if (!pure_item)
 					break;
+				pure_item->flags |= PUREX_ITEM_FPIN;
 				qla24xx_queue_purex_item(vha, pure_item,
 						 qla27xx_process_purex_fpin);
 				break;
@@ -5525,6 +5782,29 @@ static const struct qla_init_msix_entry qla82xx_msix_entries[] = {
 	{ "qla2xxx (rsp_q)", qla82xx_msix_rsp_q },
 };
 
+#ifdef IRQ_AFFINITY_SETS
+/*
+ * With ql2xnvme_qpairs set, the last qpairs serve NVMe only.  Give them an
+ * affinity set of their own so that each protocol's vectors are spread
+ * over all CPUs and both blk-mq maps stay CPU-local.  The SCSI set keeps
+ * at least two vectors (one for the SCM slow queue).
+ */
+static void qla24xx_calc_irq_sets(struct irq_affinity *affd,
+    unsigned int nvecs)
+{
+	struct qla_hw_data *ha = affd->priv;
+	unsigned int nvme = 0;
+
+	if (ql2xnvmeenable && ql2xnvme_qpairs > 0 && nvecs > 2)
+		nvme = min_t(unsigned int, ql2xnvme_qpairs, nvecs - 2);
+
+	ha->nvme_qpairs = nvme;
+	affd->nr_sets = nvme ? 2 : 1;
+	affd->set_size[0] = nvecs - nvme;
+	affd->set_size[1] = nvme;
+}
+#endif
+
 static int
 qla24xx_enable_msix(struct qla_hw_data *ha, struct rsp_que *rsp)
 {
@@ -5534,6 +5814,10 @@ qla24xx_enable_msix(struct qla_hw_data *ha, struct rsp_que *rsp)
 	int min_vecs = QLA_BASE_VECTORS;
 	struct irq_affinity desc = {
 		.pre_vectors = QLA_BASE_VECTORS,
+#ifdef IRQ_AFFINITY_SETS
+		.calc_sets = qla24xx_calc_irq_sets,
+		.priv = ha,
+#endif
 	};
 
 	if (QLA_TGT_MODE_ENABLED() && (ql2xenablemsix != 0) &&
@@ -5542,6 +5826,7 @@ qla24xx_enable_msix(struct qla_hw_data *ha, struct rsp_que *rsp)
 		min_vecs++;
 	}
 
+	ha->nvme_qpairs = 0;
 	if (USER_CTRL_IRQ(ha) || !ha->mqiobase) {
 		/* user wants to control IRQ setting for target mode */
 		ret = pci_alloc_irq_vectors(ha->pdev, min_vecs,
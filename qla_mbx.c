@@ -9,6 +9,7 @@
 
 #include <linux/delay.h>
 #include <linux/gfp.h>
+#include <linux/log2.h>
 
 #ifdef CONFIG_PPC
 #define IS_PPCARCH      true
@@ -87,6 +88,182 @@ static int is_rom_cmd(uint16_t cmd)
 	return 0;
 }
 
+/*
+ * Recovery-critical commands.  When one of these is waiting for the
+ * mailbox, other commands step aside so that login, reset and loop
+ * recovery are not stuck behind management queries.
+ */
+static uint16_t mb_hipri_cmds[] = {
+	MBC_ABORT_COMMAND,
+	MBC_ABORT_TARGET,
+	MBC_INITIALIZE_FIRMWARE,
+	MBC_TARGET_RESET,
+	MBC_GET_FIRMWARE_STATE,
+	MBC_LOGIN_FABRIC_PORT,
+	MBC_SEND_CHANGE_REQUEST,
+	MBC_LOGOUT_FABRIC_PORT,
+	MBC_LIP_FULL_LOGIN,
+	MBC_LOGIN_LOOP_PORT,
+	MBC_LUN_RESET,
+	MBC_GET_ADAPTER_LOOP_ID,
+	MBC_MID_INITIALIZE_FIRMWARE,
+};
+
+static bool is_hipri_cmd(uint16_t cmd)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(mb_hipri_cmds); i++)
+		if (mb_hipri_cmds[i] == cmd)
+			return true;
+
+	return false;
+}
+
+/*
+ * High-frequency queries that the driver already issues as mailbox IOCBs
+ * elsewhere (qla24xx_gpdb_wait(), qla24xx_gidlist_wait()), so firmware
+ * is known to take them that way.  Issued as IOCBs they run concurrently
+ * with, and are not serialized behind, commands using the mailbox
+ * registers.
+ */
+static int __qla24xx_send_mb_cmd(struct scsi_qla_host *, mbx_cmd_t *, u32);
+
+static uint16_t mb_iocb_cmds[] = {
+	MBC_GET_PORT_DATABASE,
+	MBC_GET_ID_LIST,
+};
+
+static bool
+qla2x00_mbx_use_iocb(scsi_qla_host_t *vha, mbx_cmd_t *mcp)
+{
+	struct qla_hw_data *ha = vha->hw;
+	scsi_qla_host_t *base_vha = pci_get_drvdata(ha->pdev);
+	int i;
+
+	if (!ql2xmbx_iocb || !IS_FWI2_CAPABLE(ha) || IS_P3P_TYPE(ha) ||
+	    IS_QLAFX00(ha))
+		return false;
+
+	/* Only the first MAX_IOCB_MB_REG registers fit in the IOCB. */
+	if ((mcp->out_mb | mcp->in_mb) & GENMASK(31, MAX_IOCB_MB_REG))
+		return false;
+
+	/* The DPC thread keeps the register mailbox, as it always had. */
+	if (current == ha->dpc_thread)
+		return false;
+
+	if (!ha->flags.fw_started || !base_vha->flags.init_done ||
+	    test_bit(ABORT_ISP_ACTIVE, &base_vha->dpc_flags) ||
+	    test_bit(ISP_ABORT_NEEDED, &base_vha->dpc_flags) ||
+	    test_bit(UNLOADING, &base_vha->dpc_flags))
+		return false;
+
+	for (i = 0; i < ARRAY_SIZE(mb_iocb_cmds); i++)
+		if (mb_iocb_cmds[i] == mcp->mb[0])
+			return true;
+
+	return false;
+}
+
+/*
+ * Issue a register-style mailbox command as a mailbox IOCB.  Only the
+ * registers named in out_mb are sent and only those named in in_mb are
+ * copied back, and the caller's tov is kept, matching the register path.
+ */
+static int
+qla24xx_mbx_via_iocb(scsi_qla_host_t *vha, mbx_cmd_t *mcp)
+{
+	mbx_cmd_t mc;
+	uint32_t mboxes;
+	int i, rval;
+
+	memset(&mc, 0, sizeof(mc));
+	mboxes = mcp->out_mb;
+	for (i = 0; i < MAX_IOCB_MB_REG; i++, mboxes >>= 1)
+		if (mboxes & BIT_0)
+			mc.mb[i] = mcp->mb[i];
+
+	rval = __qla24xx_send_mb_cmd(vha, &mc,
+	    mcp->tov ? mcp->tov : MBX_TOV_SECONDS);
+
+	mboxes = mcp->in_mb;
+	for (i = 0; i < MAX_IOCB_MB_REG; i++, mboxes >>= 1)
+		if (mboxes & BIT_0)
+			mcp->mb[i] = mc.mb[i];
+
+	return rval;
+}
+
+static void
+qla2x00_mbx_lat_update(struct qla_hw_data *ha, uint16_t cmd, u64 ns,
+    bool iocb)
+{
+	struct qla_mbx_stats *st = ha->mbx_stats;
+	struct qla_mbx_lat *lat;
+	unsigned long flags;
+	u32 us, ms;
+	int b;
+
+	if (!st)
+		return;
+
+	us = min_t(u64, div_u64(ns, NSEC_PER_USEC), U32_MAX);
+	ms = us / USEC_PER_MSEC;
+	b = ms ? min(ilog2(ms) + 1, QLA_MBX_LAT_BUCKETS - 1) : 0;
+	lat = &st->op[min_t(uint16_t, cmd, QLA_MBX_LAT_OPCODES)];
+
+	spin_lock_irqsave(&st->lock, flags);
+	lat->count++;
+	if (iocb)
+		lat->iocb_count++;
+	lat->total_us += us;
+	if (us > lat->max_us)
+		lat->max_us = us;
+	lat->hist[b]++;
+	spin_unlock_irqrestore(&st->lock, flags);
+}
+
+/*
+ * Wait for the mailbox to become free.  Normal commands hand the mailbox
+ * back and wait while a recovery-critical command is pending.
+ */
+static bool
+qla2x00_mbx_acquire(struct qla_hw_data *ha, mbx_cmd_t *mcp, bool hipri)
+{
+	unsigned long deadline = jiffies + mcp->tov * HZ;
+	long left;
+
+	for (;;) {
+		left = (long)(deadline - jiffies);
+		if (left <= 0)
+			break;
+
+		if (!wait_for_completion_timeout(&ha->mbx_cmd_comp, left))
+			break;
+
+		if (hipri) {
+			if (atomic_dec_and_test(&ha->num_pend_mbx_hipri))
+				wake_up_all(&ha->mbx_hipri_wq);
+			return true;
+		}
+
+		if (!atomic_read(&ha->num_pend_mbx_hipri))
+			return true;
+
+		complete(&ha->mbx_cmd_comp);
+		left = (long)(deadline - jiffies);
+		if (left > 0)
+			wait_event_timeout(ha->mbx_hipri_wq,
+			    !atomic_read(&ha->num_pend_mbx_hipri), left);
+	}
+
+	if (hipri && atomic_dec_and_test(&ha->num_pend_mbx_hipri))
+		wake_up_all(&ha->mbx_hipri_wq);
+
+	return false;
+}
+
 /*
  * qla2x00_mailbox_command
  *	Issue mailbox command and waits for completion.
@@ -107,7 +284,7 @@ static int is_rom_cmd(uint16_t cmd)
  *	Kernel context.
  */
 static int
-qla2x00_mailbox_command(scsi_qla_host_t *vha, mbx_cmd_t *mcp)
+__qla2x00_mailbox_command(scsi_qla_host_t *vha, mbx_cmd_t *mcp)
 {
 	int		rval, i;
 	unsigned long    flags = 0;
@@ -123,6 +300,7 @@ qla2x00_mailbox_command(scsi_qla_host_t *vha, mbx_cmd_t *mcp)
 	struct qla_hw_data *ha = vha->hw;
 	scsi_qla_host_t *base_vha = pci_get_drvdata(ha->pdev);
 	u32 chip_reset;
+	bool hipri;
 
 
 	ql_dbg(ql_dbg_mbx, vha, 0x1000, "Entered %s.\n", __func__);
@@ -180,13 +358,17 @@ qla2x00_mailbox_command(scsi_qla_host_t *vha, mbx_cmd_t *mcp)
 		return QLA_FUNCTION_TIMEOUT;
 	}
 
+	hipri = is_hipri_cmd(mcp->mb[0]);
+	if (hipri)
+		atomic_inc(&ha->num_pend_mbx_hipri);
+
 	atomic_inc(&ha->num_pend_mbx_stage1);
 	/*
 	 * Wait for active mailbox commands to finish by waiting at most tov
 	 * seconds. This is to serialize actual issuing of mailbox cmds during
 	 * non ISP abort time.
 	 */
-	if (!wait_for_completion_timeout(&ha->mbx_cmd_comp, mcp->tov * HZ)) {
+	if (!qla2x00_mbx_acquire(ha, mcp, hipri)) {
 		/* Timeout occurred. Return error. */
 		ql_log(ql_log_warn, vha, 0xd035,
 		    "Cmd access timeout, cmd=0x%x, Exiting.\n",
@@ -627,6 +809,25 @@ mbx_done:
 	return rval;
 }
 
+static int
+qla2x00_mailbox_command(scsi_qla_host_t *vha, mbx_cmd_t *mcp)
+{
+	uint16_t command = mcp->mb[0];
+	u64 start = ktime_get_ns();
+	bool iocb;
+	int rval;
+
+	iocb = qla2x00_mbx_use_iocb(vha, mcp);
+	if (iocb)
+		rval = qla24xx_mbx_via_iocb(vha, mcp);
+	else
+		rval = __qla2x00_mailbox_command(vha, mcp);
+
+	qla2x00_mbx_lat_update(vha->hw, command, ktime_get_ns() - start, iocb);
+
+	return rval;
+}
+
 int
 qla2x00_load_ram(scsi_qla_host_t *vha, dma_addr_t req_dma, uint32_t risc_addr,
     uint32_t risc_code_size)
@@ -6591,7 +6792,8 @@ static void qla2x00_async_mb_sp_done(srb_t *sp, int res)
  * This allows non-critial (non chip setup) command to go
  * out in parrallel.
  */
-int qla24xx_send_mb_cmd(struct scsi_qla_host *vha, mbx_cmd_t *mcp)
+static int
+__qla24xx_send_mb_cmd(struct scsi_qla_host *vha, mbx_cmd_t *mcp, u32 tov)
 {
 	int rval = QLA_FUNCTION_FAILED;
 	srb_t *sp;
@@ -6612,7 +6814,7 @@ int qla24xx_send_mb_cmd(struct scsi_qla_host *vha, mbx_cmd_t *mcp)
 	c->timeout = qla2x00_async_iocb_timeout;
 	init_completion(&c->u.mbx.comp);
 
-	qla2x00_init_timer(sp, qla2x00_get_async_timeout(vha) + 2);
+	qla2x00_init_timer(sp, tov);
 
 	memcpy(sp->u.iocb_cmd.u.mbx.out_mb, mcp->mb, SIZEOF_IOCB_MB_REG);
 
@@ -6654,6 +6856,12 @@ done:
 	return rval;
 }
 
+int qla24xx_send_mb_cmd(struct scsi_qla_host *vha, mbx_cmd_t *mcp)
+{
+	return __qla24xx_send_mb_cmd(vha, mcp,
+	    qla2x00_get_async_timeout(vha) + 2);
+}
+
 /*
  * qla24xx_gpdb_wait
  * NOTE: Do not call this routine from DPC thread
@@ -9,6 +9,7 @@
 #include <linux/delay.h>
 #include <linux/nvme.h>
 #include <linux/nvme-fc.h>
+#include <linux/blk-mq.h>
 
 static struct nvme_fc_port_template qla_nvme_fc_transport;
 
@@ -84,6 +85,21 @@ int qla_nvme_register_remote(struct scsi_qla_host *vha, struct fc_port *fcport)
 	return 0;
 }
 
+/*
+ * NVMe I/O queue @qidx (1 based; 0 is the admin queue) runs on NVMe qpair
+ * (qidx - 1) modulo the NVMe queue count, so hctx i and that qpair share
+ * the MSI-X vector qla_nvme_map_queues() steers its CPUs to.  NVMe qpairs
+ * start at nvme_qpair_base when they are kept apart from SCSI, at 0 when
+ * shared.
+ */
+static inline unsigned int qla_nvme_qpair_idx(struct qla_hw_data *ha,
+    unsigned int qidx)
+{
+	unsigned int base = ha->nvme_qpairs ? ha->nvme_qpair_base : 0;
+
+	return base + (qidx ? (qidx - 1) % ha->nvme_hwqs : 0);
+}
+
 /* Allocate a queue for NVMe traffic */
 static int qla_nvme_alloc_queue(struct nvme_fc_local_port *lport,
     unsigned int qidx, u16 qsize, void **handle)
@@ -91,9 +107,7 @@ static int qla_nvme_alloc_queue(struct nvme_fc_local_port *lport,
 	struct scsi_qla_host *vha;
 	struct qla_hw_data *ha;
 	struct qla_qpair *qpair;
-
-	if (!qidx)
-		qidx++;
+	unsigned int idx;
 
 	vha = (struct scsi_qla_host *)lport->private;
 	ha = vha->hw;
@@ -113,8 +127,9 @@ static int qla_nvme_alloc_queue(struct nvme_fc_local_port *lport,
 	if (!ha->max_qpairs) {
 		qpair = ha->base_qpair;
 	} else {
-		if (ha->queue_pair_map[qidx]) {
-			*handle = ha->queue_pair_map[qidx];
+		idx = qla_nvme_qpair_idx(ha, qidx);
+		if (ha->queue_pair_map[idx]) {
+			*handle = ha->queue_pair_map[idx];
 			ql_log(ql_log_info, vha, 0x2121,
 			    "Returning existing qpair of %px for idx=%x\n",
 			    *handle, qidx);
@@ -133,6 +148,114 @@ static int qla_nvme_alloc_queue(struct nvme_fc_local_port *lport,
 	return 0;
 }
 
+#ifdef NVME_FC_MAP_QUEUES
+/*
+ * Send each CPU to the hctx whose qpair takes its completions on a vector
+ * affine to that CPU.  CPUs no NVMe qpair vector covers keep the default
+ * spread.
+ */
+static void qla_nvme_map_queues(struct nvme_fc_local_port *lport,
+    struct blk_mq_queue_map *map)
+{
+	struct scsi_qla_host *vha = lport->private;
+	struct qla_hw_data *ha = vha->hw;
+	const struct cpumask *mask;
+	struct qla_qpair *qpair;
+	unsigned int i, cpu;
+
+	blk_mq_map_queues(map);
+
+	if (USER_CTRL_IRQ(ha) || !ha->mqiobase || !ha->max_qpairs)
+		return;
+
+	for (i = 0; i < map->nr_queues && i < ha->nvme_hwqs; i++) {
+		qpair = ha->queue_pair_map[qla_nvme_qpair_idx(ha, i + 1)];
+		if (!qpair || !qpair->msix)
+			continue;
+		mask = pci_irq_get_affinity(ha->pdev, qpair->msix->entry);
+		if (!mask)
+			continue;
+		for_each_cpu(cpu, mask)
+			map->mq_map[cpu] = map->queue_offset + i;
+	}
+}
+#endif
+
+/*
+ * Terminate the exchange of unsolicited LS @p so its sender does not wait
+ * out its LS timeout.  Called with @qp's lock held.
+ */
+void qla_nvme_ls_term(struct scsi_qla_host *vha, struct qla_qpair *qp,
+    struct pt_ls4_rx_unsol *p)
+{
+	struct pt_ls4_request *iocb;
+
+	iocb = __qla2x00_alloc_iocbs(qp, NULL);
+	if (!iocb) {
+		ql_log(ql_log_warn, vha, 0x2132,
+		    "No room to terminate NVMe LS exchange %x.\n",
+		    le32_to_cpu(p->exchange_address));
+		return;
+	}
+
+	iocb->entry_type = PT_LS4_REQUEST;
+	iocb->entry_count = 1;
+	iocb->handle = QLA_SKIP_HANDLE;
+	iocb->nport_handle = p->nport_handle;
+	iocb->vp_index = p->vp_index;
+	iocb->exchange_address = p->exchange_address;
+	iocb->ox_id = p->ox_id;
+	iocb->control_flags =
+	    cpu_to_le16(CF_LS4_RESPONDER_TERM << CF_LS4_SHIFT);
+	wmb();
+	qla2x00_start_iocbs(vha, qp->req);
+}
+
+/*
+ * Unsolicited FC-NVMe LS requests (PT_LS4_UNSOL) go to nvmet-fc when the
+ * receiving port is a registered NVMe target.  Otherwise there is no
+ * consumer, the host NVMe stack takes no LS from us: terminate the exchange
+ * right away and drop the frame's continuation entries.  The caller defers
+ * the entry until all of them have been posted.  Called from response
+ * queue processing with the qpair lock held.
+ */
+void qla_nvme_unsol_ls(struct scsi_qla_host *vha, void **pkt,
+    struct rsp_que **rsp)
+{
+	struct pt_ls4_rx_unsol *p = *pkt;
+	struct rsp_que *rsp_q = *rsp;
+	response_t *cont;
+	u16 remaining = p->entry_count ? p->entry_count - 1 : 0;
+
+	if (qla_nvmet_unsol_ls(vha, pkt, rsp))
+		return;
+
+	ql_dbg(ql_dbg_async, vha, 0x2131,
+	    "Unsolicited NVMe LS cmd %02x from %06x xchg %x, terminating.\n",
+	    ((u8 *)p->payload)[0], be_to_port_id(p->s_id).b24,
+	    le32_to_cpu(p->exchange_address));
+
+	qla_nvme_ls_term(vha, rsp_q->qpair, p);
+
+	while (remaining && rsp_q->ring_ptr->signature != RESPONSE_PROCESSED &&
+	    rsp_q->ring_ptr->entry_type == STATUS_CONT_TYPE) {
+		cont = rsp_q->ring_ptr;
+		*pkt = cont;
+
+		rsp_q->ring_index++;
+		if (rsp_q->ring_index == rsp_q->length) {
+			rsp_q->ring_index = 0;
+			rsp_q->ring_ptr = rsp_q->ring;
+		} else {
+			rsp_q->ring_ptr++;
+		}
+
+		cont->signature = RESPONSE_PROCESSED;
+		wmb();
+		remaining--;
+	}
+}
+
 static void qla_nvme_release_fcp_cmd_kref(struct kref *kref)
 {
 	struct srb *sp = container_of(kref, struct srb, cmd_kref);
@@ -198,14 +321,6 @@ out:
 	qla2x00_rel_sp(sp);
 }
 
-static void qla_nvme_ls_complete(struct work_struct *work)
-{
-	struct nvme_private *priv =
-		container_of(work, struct nvme_private, ls_work);
-
-	kref_put(&priv->sp->cmd_kref, qla_nvme_release_ls_cmd_kref);
-}
-
 static void qla_nvme_sp_ls_done(srb_t *sp, int res)
 {
 	struct nvme_private *priv = sp->priv;
@@ -216,9 +331,12 @@ static void qla_nvme_sp_ls_done(srb_t *sp, int res)
 	if (res)
 		res = -EINVAL;
 
+	/*
+	 * Nothing on the release path sleeps, so complete the LS in place
+	 * rather than bouncing it through the system workqueue.
+	 */
 	priv->comp_status = res;
-	INIT_WORK(&priv->ls_work, qla_nvme_ls_complete);
-	schedule_work(&priv->ls_work);
+	kref_put(&sp->cmd_kref, qla_nvme_release_ls_cmd_kref);
 }
 
 /* it assumed that QPair lock is held. */
@@ -283,11 +401,264 @@ out:
 	kref_put(&sp->cmd_kref, sp->put_fn);
 }
 
+/*
+ * Direct abort path.  With async TMF the ABTS IOCB needs no process
+ * context, so the transport's abort callback builds the abort SRB itself
+ * and queues it on the remote port.  Whichever caller finds the port idle
+ * drains the queue, ringing each qpair's doorbell once per run of up to
+ * QLA_NVME_ABT_BATCH aborts; concurrent callers only append.  The
+ * reference the callback took on the command is held until the ABTS
+ * completes only when ql2xabts_wait_nvme and the firmware allow it, as
+ * on the work item path; otherwise it is dropped once the ABTS is queued.
+ */
+#define QLA_NVME_ABT_BATCH	32
+
+static void qla_nvme_abt_lat_update(struct qla_hw_data *ha, u64 ns)
+{
+	struct qla_nvme_abt_stats *st = ha->nvme_abt_stats;
+	unsigned long flags;
+	u32 us, ms;
+	int b;
+
+	if (!st)
+		return;
+
+	us = min_t(u64, div_u64(ns, NSEC_PER_USEC), U32_MAX);
+	ms = us / USEC_PER_MSEC;
+	b = ms ? min(ilog2(ms) + 1, QLA_MBX_LAT_BUCKETS - 1) : 0;
+
+	spin_lock_irqsave(&st->lock, flags);
+	st->cnt.count++;
+	st->cnt.total_us += us;
+	if (us > st->cnt.max_us)
+		st->cnt.max_us = us;
+	st->cnt.hist[b]++;
+	spin_unlock_irqrestore(&st->lock, flags);
+}
+
+static void qla_nvme_abt_cnt_add(struct qla_hw_data *ha,
+    struct qla_nvme_abt_cnt *c)
+{
+	struct qla_nvme_abt_stats *st = ha->nvme_abt_stats;
+	unsigned long flags;
+
+	if (!st)
+		return;
+
+	spin_lock_irqsave(&st->lock, flags);
+	st->cnt.direct += c->direct;
+	st->cnt.deferred += c->deferred;
+	st->cnt.not_found += c->not_found;
+	st->cnt.ring_full += c->ring_full;
+	st->cnt.doorbells += c->doorbells;
+	if (c->max_batch > st->cnt.max_batch)
+		st->cnt.max_batch = c->max_batch;
+	spin_unlock_irqrestore(&st->lock, flags);
+}
+
+static void qla_nvme_abort_sp_done(srb_t *sp, int res)
+{
+	struct srb_iocb *abt = &sp->u.iocb_cmd;
+	srb_t *orig_sp = sp->cmd_sp;
+
+	qla_nvme_abt_lat_update(sp->vha->hw,
+	    ktime_get_ns() - abt->u.abt.start_ns);
+
+	/* NULL when qla_nvme_abort_queued() already let the command go */
+	if (orig_sp)
+		kref_put(&orig_sp->cmd_kref, orig_sp->put_fn);
+	qla_tmo_wheel_del(sp);
+	sp->free(sp);
+}
+
+/* ABTS never reached the ring: release it and the command reference. */
+static void qla_nvme_abort_drop(srb_t *sp)
+{
+	srb_t *orig_sp = sp->cmd_sp;
+
+	sp->free(sp);
+	kref_put(&orig_sp->cmd_kref, orig_sp->put_fn);
+}
+
+/*
+ * No room on the request ring, which is likely in the middle of an abort
+ * storm.  Hand the command, and the reference held on it, to the work
+ * item so it is still aborted.
+ */
+static void qla_nvme_abort_defer(srb_t *sp)
+{
+	srb_t *orig_sp = sp->cmd_sp;
+	struct nvme_private *priv = orig_sp->priv;
+
+	sp->free(sp);
+	if (!priv) {
+		kref_put(&orig_sp->cmd_kref, orig_sp->put_fn);
+		return;
+	}
+
+	INIT_WORK(&priv->abort_work, qla_nvme_abort_work);
+	schedule_work(&priv->abort_work);
+}
+
+/*
+ * Under the qpair lock, right before the ABTS is built: a command that
+ * completed while its abort was queued needs no ABTS, and its handle may
+ * already belong to another I/O.
+ */
+static bool qla_nvme_abort_stale(srb_t *sp)
+{
+	srb_t *orig_sp = sp->cmd_sp;
+	struct req_que *req = orig_sp->qpair->req;
+
+	return orig_sp->handle >= req->num_outstanding_cmds ||
+	    req->outstanding_cmds[orig_sp->handle] != orig_sp;
+}
+
+/*
+ * Under the qpair lock, right after the ABTS is built, so its completion
+ * cannot run yet.  Unless ql2xabts_wait_nvme holds the I/O until the ABTS
+ * is answered, let the command complete now, as qla_nvme_abort_work()
+ * does.
+ */
+static void qla_nvme_abort_queued(srb_t *sp)
+{
+	srb_t *orig_sp = sp->cmd_sp;
+
+	if (ql2xabts_wait_nvme && QLA_ABTS_WAIT_ENABLED(orig_sp))
+		return;
+
+	sp->cmd_sp = NULL;
+	kref_put(&orig_sp->cmd_kref, orig_sp->put_fn);
+}
+
+/* @sps all belong to @qpair. */
+static void qla_nvme_abort_submit(struct qla_qpair *qpair, srb_t **sps,
+    int cnt, struct qla_nvme_abt_cnt *c)
+{
+	srb_t *abt[QLA_NVME_ABT_BATCH];
+	int i, done, started = 0;
+
+	/* skipped slots come back NULL; keep the SRBs to release them */
+	memcpy(abt, sps, cnt * sizeof(*sps));
+	done = qla2x00_start_sp_batch_hook(sps, cnt, qla_nvme_abort_stale,
+	    qla_nvme_abort_queued);
+
+	for (i = 0; i < done; i++) {
+		if (sps[i]) {
+			started++;
+			continue;
+		}
+		qla_nvme_abort_drop(abt[i]);
+		c->not_found++;
+	}
+	for (i = done; i < cnt; i++)
+		qla_nvme_abort_defer(abt[i]);
+
+	c->direct += started;
+	c->ring_full += cnt - done;
+	if (started) {
+		c->doorbells++;
+		if (started > c->max_batch)
+			c->max_batch = started;
+	}
+}
+
+static void qla_nvme_abort_flush(fc_port_t *fcport)
+{
+	struct qla_nvme_abt_cnt c = {};
+	srb_t *sps[QLA_NVME_ABT_BATCH];
+	struct qla_qpair *qpair;
+	LIST_HEAD(head);
+	unsigned long flags;
+	srb_t *sp, *tsp;
+	int cnt;
+
+	spin_lock_irqsave(&fcport->nvme_abt_lock, flags);
+	while (!list_empty(&fcport->nvme_abt_list)) {
+		list_splice_init(&fcport->nvme_abt_list, &head);
+		spin_unlock_irqrestore(&fcport->nvme_abt_lock, flags);
+
+		while (!list_empty(&head)) {
+			qpair = list_first_entry(&head, srb_t, elem)->qpair;
+			cnt = 0;
+			list_for_each_entry_safe(sp, tsp, &head, elem) {
+				if (sp->qpair != qpair)
+					continue;
+				list_del_init(&sp->elem);
+				sps[cnt++] = sp;
+				if (cnt == QLA_NVME_ABT_BATCH)
+					break;
+			}
+			qla_nvme_abort_submit(qpair, sps, cnt, &c);
+		}
+
+		spin_lock_irqsave(&fcport->nvme_abt_lock, flags);
+	}
+	fcport->nvme_abt_busy = false;
+	spin_unlock_irqrestore(&fcport->nvme_abt_lock, flags);
+
+	if (c.ring_full)
+		ql_dbg(ql_dbg_io, fcport->vha, 0x2135,
+		    "Port %8phC: %llu NVMe aborts deferred, request ring full.\n",
+		    fcport->port_name, c.ring_full);
+
+	qla_nvme_abt_cnt_add(fcport->vha->hw, &c);
+}
+
+/* Returns false if the abort must go through qla_nvme_abort_work(). */
+static bool qla_nvme_abort_direct(srb_t *orig_sp)
+{
+	fc_port_t *fcport = orig_sp->fcport;
+	struct qla_hw_data *ha = fcport->vha->hw;
+	unsigned long flags;
+	bool flush;
+	srb_t *sp;
+
+	if (!ql2xnvme_abt_direct || !ql2xasynctmfenable || IS_QLAFX00(ha))
+		return false;
+
+	/* Teardown cases stay with the work item. */
+	if (!ha->flags.fw_started || fcport->deleted == QLA_SESS_DELETED ||
+	    ha->flags.host_shutting_down)
+		return false;
+
+	sp = qla24xx_prep_abort_sp(orig_sp, false);
+	if (!sp)
+		return false;
+	sp->done = qla_nvme_abort_sp_done;
+	sp->u.iocb_cmd.u.abt.start_ns = ktime_get_ns();
+
+	spin_lock_irqsave(&fcport->nvme_abt_lock, flags);
+	list_add_tail(&sp->elem, &fcport->nvme_abt_list);
+	flush = !fcport->nvme_abt_busy;
+	fcport->nvme_abt_busy = true;
+	spin_unlock_irqrestore(&fcport->nvme_abt_lock, flags);
+
+	if (flush)
+		qla_nvme_abort_flush(fcport);
+
+	return true;
+}
+
+/* Caller holds a cmd_kref on @sp for the abort. */
+static void qla_nvme_abort_start(struct nvme_private *priv, srb_t *sp)
+{
+	struct qla_nvme_abt_cnt c = { .deferred = 1 };
+
+	if (qla_nvme_abort_direct(sp))
+		return;
+
+	qla_nvme_abt_cnt_add(sp->vha->hw, &c);
+	INIT_WORK(&priv->abort_work, qla_nvme_abort_work);
+	schedule_work(&priv->abort_work);
+}
+
 static void qla_nvme_ls_abort(struct nvme_fc_local_port *lport,
     struct nvme_fc_remote_port *rport, struct nvmefc_ls_req *fd)
 {
 	struct nvme_private *priv = fd->private;
 	unsigned long flags;
+	srb_t *sp;
 
 	spin_lock_irqsave(&priv->cmd_lock, flags);
 	if (!priv->sp) {
@@ -299,10 +670,10 @@ static void qla_nvme_ls_abort(struct nvme_fc_local_port *lport,
 		spin_unlock_irqrestore(&priv->cmd_lock, flags);
 		return;
 	}
+	sp = priv->sp;
 	spin_unlock_irqrestore(&priv->cmd_lock, flags);
 
-	INIT_WORK(&priv->abort_work, qla_nvme_abort_work);
-	schedule_work(&priv->abort_work);
+	qla_nvme_abort_start(priv, sp);
 }
 
 static int qla_nvme_ls_req(struct nvme_fc_local_port *lport,
@@ -373,6 +744,7 @@ static void qla_nvme_fcp_abort(struct nvme_fc_local_port *lport,
 {
 	struct nvme_private *priv = fd->private;
 	unsigned long flags;
+	srb_t *sp;
 
 	spin_lock_irqsave(&priv->cmd_lock, flags);
 	if (!priv->sp) {
@@ -383,10 +755,10 @@ static void qla_nvme_fcp_abort(struct nvme_fc_local_port *lport,
 		spin_unlock_irqrestore(&priv->cmd_lock, flags);
 		return;
 	}
+	sp = priv->sp;
 	spin_unlock_irqrestore(&priv->cmd_lock, flags);
 
-	INIT_WORK(&priv->abort_work, qla_nvme_abort_work);
-	schedule_work(&priv->abort_work);
+	qla_nvme_abort_start(priv, sp);
 }
 
 static inline int qla2x00_start_nvme_mq(srb_t *sp)
@@ -444,6 +816,13 @@ static inline int qla2x00_start_nvme_mq(srb_t *sp)
 		}
 	}
 
+	sp->iores.res_type = RESOURCE_INI;
+	sp->iores.iocb_cnt = req_cnt;
+	if (qla_get_iocbs(qpair, &sp->iores)) {
+		rval = -EBUSY;
+		goto queuing_error;
+	}
+
 	if (unlikely(!fd->sqid)) {
 		if (cmd->sqe.common.opcode == nvme_admin_async_event) {
 			nvme->u.nvme.aen_op = 1;
@@ -715,7 +1094,10 @@ static struct nvme_fc_port_template qla_nvme_fc_transport = {
 	.ls_abort	= qla_nvme_ls_abort,
 	.fcp_io		= qla_nvme_post_cmd,
 	.fcp_abort	= qla_nvme_fcp_abort,
-	.max_hw_queues  = 8,
+#ifdef NVME_FC_MAP_QUEUES
+	.map_queues	= qla_nvme_map_queues,
+#endif
+	.max_hw_queues  = 1,
 	.max_sgl_segments = 1024,
 	.max_dif_sgl_segments = 64,
 	.dma_boundary = 0xFFFFFFFF,
@@ -769,6 +1151,40 @@ void qla_nvme_delete(struct scsi_qla_host *vha)
 	}
 }
 
+/*
+ * One NVMe hw queue per NVMe qpair, or per blk-mq qpair when SCSI and NVMe
+ * share them (the SCM slow queue is not one), but no more than there are
+ * CPUs or ql2xnvme_queues asks for.  The port
+ * template is shared by all HBAs, so it advertises the largest count and
+ * a smaller HBA wraps the extra queues onto its qpairs.
+ */
+static void qla_nvme_size_queues(struct scsi_qla_host *vha)
+{
+	struct qla_hw_data *ha = vha->hw;
+	struct scsi_qla_host *base_vha = pci_get_drvdata(ha->pdev);
+	unsigned int nq = 1;
+
+	if (ha->max_qpairs) {
+		if (ha->nvme_qpairs)
+			nq = ha->nvme_qpairs;
+		else
+			nq = base_vha->host->nr_hw_queues ?
+			    base_vha->host->nr_hw_queues : ha->max_qpairs;
+		nq = min(nq, num_possible_cpus());
+		if (ql2xnvme_queues > 0)
+			nq = min_t(unsigned int, nq, ql2xnvme_queues);
+		nq = max(nq, 1U);
+	}
+	ha->nvme_hwqs = nq;
+
+	if (qla_nvme_fc_transport.max_hw_queues < nq)
+		qla_nvme_fc_transport.max_hw_queues = nq;
+
+	ql_dbg(ql_dbg_multiq, vha, 0x2130,
+	    "NVMe hw queues %u of %u qpairs, template max %u.\n",
+	    nq, ha->max_qpairs, qla_nvme_fc_transport.max_hw_queues);
+}
+
 int qla_nvme_register_hba(struct scsi_qla_host *vha)
 {
 	struct nvme_fc_port_template *tmpl;
@@ -784,9 +1200,7 @@ int qla_nvme_register_hba(struct scsi_qla_host *vha)
 
 	WARN_ON(vha->nvme_local_port);
 
-	qla_nvme_fc_transport.max_hw_queues =
-	    min((uint8_t)(qla_nvme_fc_transport.max_hw_queues),
-		(uint8_t)(ha->max_qpairs ? ha->max_qpairs : 1));
+	qla_nvme_size_queues(vha);
 
 	pinfo.node_name = wwn_to_u64(vha->node_name);
 	pinfo.port_name = wwn_to_u64(vha->port_name);
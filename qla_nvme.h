@@ -23,12 +23,13 @@
 struct scsi_qla_host;
 struct qla_hw_data;
 struct req_que;
+struct rsp_que;
+struct qla_qpair;
 struct srb;
 
 struct nvme_private {
 	struct srb	*sp;
 	struct nvmefc_ls_req *fd;
-	struct work_struct ls_work;
 	struct work_struct abort_work;
 	int comp_status;
 	spinlock_t cmd_lock;
@@ -96,7 +97,8 @@ struct pt_ls4_request {
 	uint16_t rx_dseg_count;
 	uint16_t rsvd2;
 	uint32_t exchange_address;
-	uint32_t rsvd3;
+	uint16_t rsvd3;
+	uint16_t ox_id;			/* responder: the LS's OX_ID */
 	uint32_t rx_byte_count;
 	uint32_t tx_byte_count;
 	struct dsd64 dsd[2];
@@ -143,4 +145,7 @@ void qla_nvme_delete(struct scsi_qla_host *);
 void qla24xx_nvme_ls4_iocb(struct scsi_qla_host *, struct pt_ls4_request *,
     struct req_que *);
 void qla24xx_async_gffid_sp_done(struct srb *sp, int);
+void qla_nvme_unsol_ls(struct scsi_qla_host *, void **, struct rsp_que **);
+void qla_nvme_ls_term(struct scsi_qla_host *, struct qla_qpair *,
+    struct pt_ls4_rx_unsol *);
 #endif
@@ -0,0 +1,782 @@
+/*
+ * QLogic Fibre Channel HBA Driver
+ * Copyright (c)  2003-2017 QLogic Corporation
+ *
+ * See LICENSE.qla2xxx for copyright and licensing details.
+ */
+#include "qla_def.h"
+
+#include <linux/scatterlist.h>
+#include <linux/workqueue.h>
+
+/*
+ * Terminate the FC-NVMe exchange of @atio.  Called from ATIO queue
+ * processing, with the hardware lock held when @ha_locked.
+ */
+void qla_nvmet_term_atio(struct scsi_qla_host *vha,
+    struct atio_from_isp *atio, uint8_t ha_locked)
+{
+	struct qla_qpair *qpair = vha->hw->base_qpair;
+	struct ctio_nvme_to_27xx *ctio;
+	unsigned long flags = 0;
+
+	ql_dbg(ql_dbg_tgt, vha, 0x2137,
+	    "Terminating NVMe cmd from %06x xchg %x ox_id %04x.\n",
+	    be_to_port_id(atio->u.isp24.fcp_hdr.s_id).b24,
+	    le32_to_cpu(atio->u.isp24.exchange_addr),
+	    be16_to_cpu(atio->u.isp24.fcp_hdr.ox_id));
+
+	if (!ha_locked)
+		spin_lock_irqsave(qpair->qp_lock_ptr, flags);
+
+	ctio = __qla2x00_alloc_iocbs(qpair, NULL);
+	if (!ctio) {
+		ql_log(ql_log_warn, vha, 0x2138,
+		    "No room to terminate NVMe exchange %x.\n",
+		    le32_to_cpu(atio->u.isp24.exchange_addr));
+		goto done;
+	}
+
+	ctio->entry_type = CTIO_NVME;
+	ctio->entry_count = 1;
+	ctio->handle = QLA_SKIP_HANDLE;
+	ctio->nport_handle = cpu_to_le16(CTIO7_NHANDLE_UNRECOGNIZED);
+	ctio->timeout = cpu_to_le16(QLA_TGT_TIMEOUT);
+	ctio->vp_index = vha->vp_idx;
+	ctio->initiator_id = be_id_to_le(atio->u.isp24.fcp_hdr.s_id);
+	ctio->exchange_addr = atio->u.isp24.exchange_addr;
+	ctio->ox_id = cpu_to_le16(be16_to_cpu(atio->u.isp24.fcp_hdr.ox_id));
+	ctio->flags = cpu_to_le16(NVMET_CTIO_TERMINATE | NVMET_CTIO_STS_MODE1);
+	wmb();
+	qla2x00_start_iocbs(vha, qpair->req);
+done:
+	if (!ha_locked)
+		spin_unlock_irqrestore(qpair->qp_lock_ptr, flags);
+}
+
+#if IS_ENABLED(CONFIG_NVME_TARGET_FC) && defined(NVMET_FC_LS_RSP)
+
+/*
+ * One FC-NVMe command exchange, from its ATIO until nvmet-fc releases it.
+ * Lives on the receiving vha's nvmet_cmd_list so an ABTS can find it.
+ */
+struct qla_nvmet_cmd {
+	struct nvmefc_tgt_fcp_req req;
+	struct scsi_qla_host	*vha;
+	struct qla_qpair	*qpair;
+	struct list_head	list;
+	struct work_struct	rcv_work;
+	struct work_struct	done_work;
+	struct delayed_work	retry_work;
+	uint32_t		exchange_addr;
+	be_id_t			s_id;
+	__be16			ox_id;
+	u16			loop_id;
+	u16			cpuid;
+	u8			queued;		/* owned by nvmet-fc */
+	u8			aborted;
+	u32			iu_len;
+	u8			iu[sizeof(struct nvme_fc_cmd_iu)];
+};
+
+/* An unsolicited FC-NVMe LS, from PT_LS4_UNSOL until its response is sent. */
+struct qla_nvmet_ls {
+	struct nvmefc_ls_rsp	rsp;
+	struct scsi_qla_host	*vha;
+	struct fc_port		*fcport;
+	struct pt_ls4_rx_unsol	hdr;
+	u32			len;
+	u8			buf[];
+};
+
+static struct nvmet_fc_target_template qla_nvmet_fc_transport;
+static struct kmem_cache *qla_nvmet_cmd_cachep;
+static struct workqueue_struct *qla_nvmet_wq;
+
+/* nvmet-fc keeps the queue id in the low 16 bits of the connection id. */
+#define QLA_NVMET_QID(iu)	(be64_to_cpu((iu)->connection_id) & 0xffff)
+
+/* Called with @cmd's qpair lock held. */
+static void __qla_nvmet_term_cmd(struct qla_nvmet_cmd *cmd)
+{
+	struct scsi_qla_host *vha = cmd->vha;
+	struct ctio_nvme_to_27xx *ctio;
+
+	ctio = __qla2x00_alloc_iocbs(cmd->qpair, NULL);
+	if (!ctio) {
+		ql_log(ql_log_warn, vha, 0x2139,
+		    "No room to terminate NVMe exchange %x.\n",
+		    le32_to_cpu(cmd->exchange_addr));
+		return;
+	}
+
+	ctio->entry_type = CTIO_NVME;
+	ctio->entry_count = 1;
+	ctio->handle = QLA_SKIP_HANDLE;
+	ctio->nport_handle = cpu_to_le16(cmd->loop_id);
+	ctio->timeout = cpu_to_le16(QLA_TGT_TIMEOUT);
+	ctio->vp_index = vha->vp_idx;
+	ctio->initiator_id = be_id_to_le(cmd->s_id);
+	ctio->exchange_addr = cmd->exchange_addr;
+	ctio->ox_id = cpu_to_le16(be16_to_cpu(cmd->ox_id));
+	ctio->flags = cpu_to_le16(NVMET_CTIO_TERMINATE | NVMET_CTIO_STS_MODE1);
+	wmb();
+	qla2x00_start_iocbs(vha, cmd->qpair->req);
+}
+
+static void qla_nvmet_term_cmd(struct qla_nvmet_cmd *cmd)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(cmd->qpair->qp_lock_ptr, flags);
+	__qla_nvmet_term_cmd(cmd);
+	spin_unlock_irqrestore(cmd->qpair->qp_lock_ptr, flags);
+}
+
+static void qla_nvmet_free_cmd(struct qla_nvmet_cmd *cmd)
+{
+	struct scsi_qla_host *vha = cmd->vha;
+	unsigned long flags;
+
+	spin_lock_irqsave(&vha->nvmet_cmd_lock, flags);
+	list_del(&cmd->list);
+	spin_unlock_irqrestore(&vha->nvmet_cmd_lock, flags);
+
+	kmem_cache_free(qla_nvmet_cmd_cachep, cmd);
+}
+
+/*
+ * Pass a new command to nvmet-fc from the CPU of the qpair it was steered
+ * to.  -EOVERFLOW means nvmet-fc had no free context and queued it; the IU
+ * stays in @cmd until the command is released either way.
+ */
+static void qla_nvmet_rcv_work(struct work_struct *work)
+{
+	struct qla_nvmet_cmd *cmd =
+	    container_of(work, struct qla_nvmet_cmd, rcv_work);
+	struct scsi_qla_host *vha = cmd->vha;
+	struct nvmet_fc_target_port *tgtport;
+	unsigned long flags;
+	int rc;
+
+	spin_lock_irqsave(&vha->nvmet_cmd_lock, flags);
+	tgtport = vha->nvmet_tgtport;
+	if (!cmd->aborted && tgtport)
+		cmd->queued = 1;
+	spin_unlock_irqrestore(&vha->nvmet_cmd_lock, flags);
+
+	if (!cmd->queued) {
+		rc = -ECANCELED;
+		goto term;
+	}
+
+	rc = nvmet_fc_rcv_fcp_req(tgtport, &cmd->req, cmd->iu, cmd->iu_len);
+	if (!rc || rc == -EOVERFLOW)
+		return;
+
+term:
+	ql_dbg(ql_dbg_io, vha, 0x213a,
+	    "NVMe cmd xchg %x from %06x not taken, rc %d.\n",
+	    le32_to_cpu(cmd->exchange_addr), be_to_port_id(cmd->s_id).b24,
+	    rc);
+	qla_nvmet_term_cmd(cmd);
+	qla_nvmet_free_cmd(cmd);
+}
+
+/* nvmet-fc may start the next operation, or the backend I/O, from done. */
+static void qla_nvmet_done_work(struct work_struct *work)
+{
+	struct qla_nvmet_cmd *cmd =
+	    container_of(work, struct qla_nvmet_cmd, done_work);
+
+	cmd->req.done(&cmd->req);
+}
+
+static void qla_nvmet_fcp_sp_done(srb_t *sp, int res)
+{
+	struct qla_nvmet_cmd *cmd = sp->priv;
+	struct nvmefc_tgt_fcp_req *req = &cmd->req;
+
+	if (res == CTIO_SUCCESS) {
+		req->transferred_length =
+		    req->op == NVMET_FCOP_RSP ? 0 : req->transfer_length;
+		req->fcp_error = 0;
+	} else {
+		ql_dbg(ql_dbg_io, cmd->vha, 0x213b,
+		    "NVMe op %d xchg %x failed, status %x.\n", req->op,
+		    le32_to_cpu(cmd->exchange_addr), res);
+		req->transferred_length = 0;
+		req->fcp_error = NVME_SC_DATA_XFER_ERROR;
+	}
+
+	qla2xxx_rel_qpair_sp(sp->qpair, sp);
+	queue_work_on(cmd->cpuid, qla_nvmet_wq, &cmd->done_work);
+}
+
+/*
+ * Queue the CTIO for the operation nvmet-fc set up in @cmd->req.  A full
+ * request ring is retried from the command's CPU rather than failed, the
+ * way the SCSI target path has tcm retry on -EAGAIN.
+ */
+static int qla_nvmet_send_op(struct qla_nvmet_cmd *cmd)
+{
+	struct nvmefc_tgt_fcp_req *req = &cmd->req;
+	srb_t *sp;
+	int rval;
+
+	if (READ_ONCE(cmd->aborted))
+		return -ECANCELED;
+
+	sp = qla2xxx_get_qpair_sp(cmd->vha, cmd->qpair, NULL, GFP_ATOMIC);
+	if (!sp)
+		return -EBUSY;
+
+	sp->type = SRB_NVMET_FCP;
+	sp->name = "nvmet_fcp";
+	sp->priv = cmd;
+	sp->done = qla_nvmet_fcp_sp_done;
+	if (req->op != NVMET_FCOP_RSP && req->sg_cnt > 1)
+		sp->iocbs += DIV_ROUND_UP(req->sg_cnt - 1,
+		    ARRAY_SIZE(((cont_a64_entry_t *)NULL)->dsd));
+
+	rval = qla2x00_start_sp(sp);
+	if (rval == QLA_SUCCESS)
+		return 0;
+
+	qla2xxx_rel_qpair_sp(sp->qpair, sp);
+	if (rval != EAGAIN)
+		return -EIO;
+
+	queue_delayed_work_on(cmd->cpuid, qla_nvmet_wq, &cmd->retry_work, 1);
+	return 0;
+}
+
+static void qla_nvmet_retry_work(struct work_struct *work)
+{
+	struct qla_nvmet_cmd *cmd =
+	    container_of(to_delayed_work(work), struct qla_nvmet_cmd,
+		retry_work);
+
+	if (!qla_nvmet_send_op(cmd))
+		return;
+
+	cmd->req.transferred_length = 0;
+	cmd->req.fcp_error = NVME_SC_DATA_XFER_ERROR;
+	cmd->req.done(&cmd->req);
+}
+
+/*
+ * Build the CTIO_NVME of an SRB_NVMET_FCP srb: data in mode 0 with the
+ * scatterlist nvmet-fc mapped, the response IU in mode 2.  Called from
+ * qla2x00_start_sp() with the qpair lock held.
+ */
+void qla_nvmet_ctio_iocb(srb_t *sp, struct ctio_nvme_to_27xx *ctio)
+{
+	struct qla_nvmet_cmd *cmd = sp->priv;
+	struct nvmefc_tgt_fcp_req *req = &cmd->req;
+	struct scsi_qla_host *vha = cmd->vha;
+	struct scatterlist *sg;
+	cont_a64_entry_t *cont;
+	struct dsd64 *cur_dsd;
+	int avail, i;
+	u16 flags;
+
+	ctio->entry_type = CTIO_NVME;
+	ctio->nport_handle = cpu_to_le16(cmd->loop_id);
+	ctio->timeout = cpu_to_le16(req->timeout);
+	ctio->vp_index = vha->vp_idx;
+	ctio->initiator_id = be_id_to_le(cmd->s_id);
+	ctio->exchange_addr = cmd->exchange_addr;
+	ctio->ox_id = cpu_to_le16(be16_to_cpu(cmd->ox_id));
+
+	if (req->op == NVMET_FCOP_RSP) {
+		flags = NVMET_CTIO_SEND_STATUS | NVMET_CTIO_STS_MODE2;
+		ctio->u.mode2.transfer_len = cpu_to_le32(req->rsplen);
+		put_unaligned_le64(req->rspdma, &ctio->u.mode2.rsp_dsd.address);
+		ctio->u.mode2.rsp_dsd.length = cpu_to_le32(req->rsplen);
+		ctio->flags = cpu_to_le16(flags);
+		return;
+	}
+
+	flags = NVMET_CTIO_STS_MODE0;
+	flags |= req->op == NVMET_FCOP_WRITEDATA ? NVMET_CTIO_DATA_OUT :
+	    NVMET_CTIO_DATA_IN;
+	ctio->flags = cpu_to_le16(flags);
+	ctio->dseg_count = cpu_to_le16(req->sg_cnt);
+	ctio->u.mode0.relative_offset = cpu_to_le32(req->offset);
+	ctio->u.mode0.transfer_len = cpu_to_le32(req->transfer_length);
+
+	cur_dsd = &ctio->u.mode0.dsd;
+	avail = 1;
+	for_each_sg(req->sg, sg, req->sg_cnt, i) {
+		if (!avail) {
+			cont = qla2x00_prep_cont_type1_iocb(vha,
+			    sp->qpair->req);
+			cur_dsd = cont->dsd;
+			avail = ARRAY_SIZE(cont->dsd);
+		}
+		append_dsd64(&cur_dsd, sg);
+		avail--;
+	}
+}
+
+void qla_nvmet_ctio_done(struct scsi_qla_host *vha, struct req_que *req,
+    void *pkt)
+{
+	struct ctio7_from_24xx *ctio = pkt;
+	const char func[] = "CTIO_NVME";
+	srb_t *sp;
+
+	sp = qla2x00_get_sp_from_handle(vha, func, req, pkt);
+	if (!sp)
+		return;
+
+	sp->done(sp, le16_to_cpu(ctio->status));
+}
+
+/*
+ * An FC-NVMe CMD IU arrived as an ATIO_TYPE7: the first entry holds its
+ * first NVME_FIRST_PACKET_CMDLEN bytes, the rest follows in raw
+ * continuation entries that qlt_24xx_process_atio_queue() has waited for.
+ * The command is handed to nvmet-fc on the CPU of the qpair its NVMe queue
+ * maps to, and its CTIOs go out on that qpair.  Called from ATIO queue
+ * processing, with the hardware lock held when @ha_locked.
+ */
+void qla_nvmet_handle_atio(struct scsi_qla_host *vha,
+    struct atio_from_isp *atio, uint8_t ha_locked)
+{
+	struct qla_hw_data *ha = vha->hw;
+	struct scsi_qla_host *host;
+	struct qla_nvmet_cmd *cmd;
+	struct qla_qpair_hint *h;
+	struct fc_port *fcport;
+	port_id_t id;
+	u32 len, off, n, idx;
+	unsigned long flags;
+	u16 qid, i;
+
+	host = qla_find_host_by_d_id(vha, atio->u.isp24.fcp_hdr.d_id);
+	len = le16_to_cpu(atio->u.raw.attr_n_length) & FCP_CMD_LENGTH_MASK;
+	if (!host || !READ_ONCE(host->nvmet_tgtport) ||
+	    len > sizeof(cmd->iu))
+		goto term;
+
+	id = be_to_port_id(atio->u.isp24.fcp_hdr.s_id);
+	fcport = qla2x00_find_fcport_by_nportid(host, &id, 0);
+	if (!fcport || fcport->loop_id == FC_NO_LOOP_ID)
+		goto term;
+
+	cmd = kmem_cache_zalloc(qla_nvmet_cmd_cachep, GFP_ATOMIC);
+	if (!cmd)
+		goto term;
+
+	n = min_t(u32, len, NVME_FIRST_PACKET_CMDLEN);
+	memcpy(cmd->iu, (u8 *)atio + NVME_ATIO_CMD_OFF, n);
+	idx = ha->tgt.atio_ring_index;
+	for (off = n, i = 1; off < len && i < atio->u.raw.entry_count; i++) {
+		if (++idx == ha->tgt.atio_q_length)
+			idx = 0;
+		n = min_t(u32, len - off, sizeof(struct atio));
+		memcpy(cmd->iu + off, &ha->tgt.atio_ring[idx], n);
+		off += n;
+	}
+	if (off < len) {
+		kmem_cache_free(qla_nvmet_cmd_cachep, cmd);
+		goto term;
+	}
+
+	qid = QLA_NVMET_QID((struct nvme_fc_cmd_iu *)cmd->iu);
+	i = qid && ha->max_qpairs ? 1 + (qid - 1) % ha->max_qpairs : 0;
+	h = &host->vha_tgt.qla_tgt->qphints[i];
+	if (!h->qpair)
+		h = &host->vha_tgt.qla_tgt->qphints[0];
+
+	cmd->vha = host;
+	cmd->qpair = h->qpair;
+	cmd->cpuid = h->cpuid;
+	cmd->loop_id = fcport->loop_id;
+	cmd->exchange_addr = atio->u.isp24.exchange_addr;
+	cmd->s_id = atio->u.isp24.fcp_hdr.s_id;
+	cmd->ox_id = atio->u.isp24.fcp_hdr.ox_id;
+	cmd->iu_len = len;
+	cmd->req.hwqid = h - host->vha_tgt.qla_tgt->qphints;
+	INIT_WORK(&cmd->rcv_work, qla_nvmet_rcv_work);
+	INIT_WORK(&cmd->done_work, qla_nvmet_done_work);
+	INIT_DELAYED_WORK(&cmd->retry_work, qla_nvmet_retry_work);
+
+	spin_lock_irqsave(&host->nvmet_cmd_lock, flags);
+	list_add_tail(&cmd->list, &host->nvmet_cmd_list);
+	spin_unlock_irqrestore(&host->nvmet_cmd_lock, flags);
+
+	queue_work_on(cmd->cpuid, qla_nvmet_wq, &cmd->rcv_work);
+	return;
+
+term:
+	qla_nvmet_term_atio(vha, atio, ha_locked);
+}
+
+/*
+ * An ABTS for an exchange that is an FC-NVMe command of @vha.  nvmet-fc
+ * aborts it through ->fcp_abort; one it has not been handed yet is
+ * terminated by its receive work.  Returns false for any other exchange.
+ * Called with the hardware lock held; the caller sends the BA_ACC.
+ */
+bool qla_nvmet_handle_abts(struct scsi_qla_host *vha,
+    struct abts_recv_from_24xx *abts)
+{
+	struct qla_nvmet_cmd *cmd;
+	unsigned long flags;
+	bool found = false;
+
+	spin_lock_irqsave(&vha->nvmet_cmd_lock, flags);
+	list_for_each_entry(cmd, &vha->nvmet_cmd_list, list) {
+		if (cmd->exchange_addr != abts->exchange_addr_to_abort)
+			continue;
+
+		ql_dbg(ql_dbg_tgt_mgt, vha, 0x213c,
+		    "ABTS for NVMe cmd xchg %x ox_id %04x.\n",
+		    le32_to_cpu(cmd->exchange_addr),
+		    be16_to_cpu(cmd->ox_id));
+		cmd->aborted = 1;
+		if (cmd->queued && vha->nvmet_tgtport)
+			nvmet_fc_rcv_fcp_abort(vha->nvmet_tgtport, &cmd->req);
+		found = true;
+		break;
+	}
+	spin_unlock_irqrestore(&vha->nvmet_cmd_lock, flags);
+
+	return found;
+}
+
+static void qla_nvmet_ls_sp_done(srb_t *sp, int res)
+{
+	struct qla_nvmet_ls *ls = sp->priv;
+
+	if (res)
+		ql_dbg(ql_dbg_disc, sp->vha, 0x213d,
+		    "NVMe LS response xchg %x failed, status %x.\n",
+		    le32_to_cpu(ls->hdr.exchange_address), res);
+
+	ls->rsp.done(&ls->rsp);
+	qla2x00_rel_sp(sp);
+	kfree(ls);
+}
+
+/* Build the PT_LS4_REQUEST answering an SRB_NVMET_LS srb's LS. */
+void qla_nvmet_ls_iocb(srb_t *sp, struct pt_ls4_request *iocb)
+{
+	struct qla_nvmet_ls *ls = sp->priv;
+	struct qla_hw_data *ha = sp->vha->hw;
+
+	iocb->entry_type = PT_LS4_REQUEST;
+	iocb->control_flags = cpu_to_le16(CF_LS4_RESPONDER << CF_LS4_SHIFT);
+	iocb->nport_handle = ls->hdr.nport_handle;
+	iocb->vp_index = ls->hdr.vp_index;
+	iocb->timeout = cpu_to_le16(2 * (ha->r_a_tov / 10));
+	iocb->exchange_address = ls->hdr.exchange_address;
+	iocb->ox_id = ls->hdr.ox_id;
+
+	iocb->tx_dseg_count = cpu_to_le16(1);
+	iocb->tx_byte_count = cpu_to_le32(ls->rsp.rsplen);
+	iocb->dsd[0].length = cpu_to_le32(ls->rsp.rsplen);
+	put_unaligned_le64(ls->rsp.rspdma, &iocb->dsd[0].address);
+}
+
+/*
+ * Hand an unsolicited FC-NVMe LS to nvmet-fc.  Returns false, with the ring
+ * untouched, when the receiving port is not a registered NVMe target or the
+ * sender is not logged in; otherwise the LS and its continuation entries
+ * are consumed.  Called from response queue processing with the qpair lock
+ * held.
+ */
+bool qla_nvmet_unsol_ls(struct scsi_qla_host *vha, void **pkt,
+    struct rsp_que **rsp)
+{
+	struct pt_ls4_rx_unsol *p = *pkt;
+	struct qla_hw_data *ha = vha->hw;
+	struct scsi_qla_host *host = NULL;
+	struct qla_nvmet_ls *ls;
+	struct fc_port *fcport;
+	unsigned long flags;
+	u32 len;
+	int rc = -ENODEV;
+
+	if (p->vp_index == vha->vp_idx)
+		host = vha;
+	else if (ha->tgt.tgt_vp_map && test_bit(p->vp_index, ha->vp_idx_map))
+		host = ha->tgt.tgt_vp_map[p->vp_index].vha;
+	if (!host || !READ_ONCE(host->nvmet_tgtport))
+		return false;
+
+	fcport = qla2x00_find_fcport_by_loopid(host,
+	    le16_to_cpu(p->nport_handle));
+	len = le16_to_cpu(p->frame_size) & 0x0fff;
+	if (!fcport || len <= PURX_ELS_HEADER_SIZE)
+		return false;
+	len -= PURX_ELS_HEADER_SIZE;
+
+	ls = kzalloc(struct_size(ls, buf, roundup(len, 4)), GFP_ATOMIC);
+	if (!ls)
+		return false;
+
+	ls->vha = host;
+	ls->fcport = fcport;
+	ls->hdr = *p;
+	ls->len = len;
+
+	if (__qla_copy_purex_to_buffer(vha, pkt, rsp, ls->buf,
+	    roundup(len, 4)))
+		goto term;
+
+	spin_lock_irqsave(&host->nvmet_cmd_lock, flags);
+	if (host->nvmet_tgtport) {
+		fcport->nvme_flag |= NVME_FLAG_NVMET_HOST;
+		rc = nvmet_fc_rcv_ls_req(host->nvmet_tgtport, fcport,
+		    &ls->rsp, ls->buf, len);
+	}
+	spin_unlock_irqrestore(&host->nvmet_cmd_lock, flags);
+	if (!rc)
+		return true;
+
+term:
+	ql_dbg(ql_dbg_async, host, 0x213e,
+	    "NVMe LS cmd %02x from %06x not taken, rc %d.\n", ls->buf[0],
+	    be_to_port_id(ls->hdr.s_id).b24, rc);
+	qla_nvme_ls_term(vha, (*rsp)->qpair, &ls->hdr);
+	kfree(ls);
+	return true;
+}
+
+static int qla_nvmet_xmt_ls_rsp(struct nvmet_fc_target_port *tgtport,
+    struct nvmefc_ls_rsp *rsp)
+{
+	struct qla_nvmet_ls *ls = container_of(rsp, struct qla_nvmet_ls, rsp);
+	struct scsi_qla_host *vha = ls->vha;
+	struct qla_qpair *qpair = vha->hw->base_qpair;
+	unsigned long flags;
+	srb_t *sp;
+	int rval = QLA_FUNCTION_FAILED;
+
+	sp = qla2x00_get_sp(vha, ls->fcport, GFP_ATOMIC);
+	if (sp) {
+		sp->type = SRB_NVMET_LS;
+		sp->name = "nvmet_ls";
+		sp->priv = ls;
+		sp->done = qla_nvmet_ls_sp_done;
+		rval = qla2x00_start_sp(sp);
+		if (rval != QLA_SUCCESS)
+			qla2x00_rel_sp(sp);
+	}
+	if (rval == QLA_SUCCESS)
+		return 0;
+
+	/*
+	 * nvmet-fc would complete the LS itself on an error return; the
+	 * exchange still has to be terminated, so finish it here instead.
+	 */
+	ql_log(ql_log_warn, vha, 0x213f,
+	    "Failed to send NVMe LS response xchg %x, rval %x.\n",
+	    le32_to_cpu(ls->hdr.exchange_address), rval);
+	spin_lock_irqsave(qpair->qp_lock_ptr, flags);
+	qla_nvme_ls_term(vha, qpair, &ls->hdr);
+	spin_unlock_irqrestore(qpair->qp_lock_ptr, flags);
+	rsp->done(rsp);
+	kfree(ls);
+	return 0;
+}
+
+static int qla_nvmet_fcp_op(struct nvmet_fc_target_port *tgtport,
+    struct nvmefc_tgt_fcp_req *req)
+{
+	struct qla_nvmet_cmd *cmd =
+	    container_of(req, struct qla_nvmet_cmd, req);
+
+	switch (req->op) {
+	case NVMET_FCOP_READDATA:
+	case NVMET_FCOP_WRITEDATA:
+	case NVMET_FCOP_RSP:
+		return qla_nvmet_send_op(cmd);
+	default:
+		/* READDATA_RSP is not advertised in target_features. */
+		return -EINVAL;
+	}
+}
+
+/*
+ * The firmware returns a CTIO still outstanding on the exchange once it is
+ * terminated, and a retry still pending sees cmd->aborted; either way the
+ * operation completes with an error before nvmet-fc releases the command.
+ */
+static void qla_nvmet_fcp_abort(struct nvmet_fc_target_port *tgtport,
+    struct nvmefc_tgt_fcp_req *req)
+{
+	struct qla_nvmet_cmd *cmd =
+	    container_of(req, struct qla_nvmet_cmd, req);
+	unsigned long flags;
+
+	ql_dbg(ql_dbg_io, cmd->vha, 0x2140,
+	    "Aborting NVMe cmd xchg %x ox_id %04x.\n",
+	    le32_to_cpu(cmd->exchange_addr), be16_to_cpu(cmd->ox_id));
+
+	spin_lock_irqsave(&cmd->vha->nvmet_cmd_lock, flags);
+	cmd->aborted = 1;
+	spin_unlock_irqrestore(&cmd->vha->nvmet_cmd_lock, flags);
+
+	qla_nvmet_term_cmd(cmd);
+}
+
+static void qla_nvmet_fcp_req_release(struct nvmet_fc_target_port *tgtport,
+    struct nvmefc_tgt_fcp_req *req)
+{
+	qla_nvmet_free_cmd(container_of(req, struct qla_nvmet_cmd, req));
+}
+
+static void qla_nvmet_targetport_delete(struct nvmet_fc_target_port *tgtport)
+{
+	struct scsi_qla_host *vha = tgtport->private;
+
+	ql_log(ql_log_info, vha, 0x2141,
+	    "NVMe targetport %px deleted.\n", tgtport);
+	complete(&vha->nvmet_del_done);
+}
+
+static struct nvmet_fc_target_template qla_nvmet_fc_transport = {
+	.targetport_delete	= qla_nvmet_targetport_delete,
+	.xmt_ls_rsp		= qla_nvmet_xmt_ls_rsp,
+	.fcp_op			= qla_nvmet_fcp_op,
+	.fcp_abort		= qla_nvmet_fcp_abort,
+	.fcp_req_release	= qla_nvmet_fcp_req_release,
+	.max_hw_queues		= 1,
+	.max_sgl_segments	= 128,
+	.max_dif_sgl_segments	= 64,
+	.dma_boundary		= 0xFFFFFFFF,
+	.target_features	= 0,
+};
+
+/*
+ * Register @vha as an nvmet-fc target port once its loop is up.  Only a
+ * port already in target or dual mode, with a tcm_qla2xxx TPG enabled or
+ * qlini_mode set, takes FC-NVMe commands; this does not change its mode.
+ * One hw queue per target qpair hint; the template is shared, so it
+ * advertises the largest count of all HBAs.
+ */
+void qla_nvmet_register(struct scsi_qla_host *vha)
+{
+	struct qla_tgt *tgt = vha->vha_tgt.qla_tgt;
+	struct nvmet_fc_target_port *tgtport;
+	struct nvmet_fc_port_info pinfo;
+	unsigned long flags;
+	int ret;
+
+	if (!ql2xnvmetenable || vha->nvmet_tgtport ||
+	    !vha->flags.nvme_enabled || !tgt || tgt->tgt_stop ||
+	    tgt->tgt_stopped ||
+	    !(qla_tgt_mode_enabled(vha) || qla_dual_mode_enabled(vha)))
+		return;
+
+	if (vha->hw->max_qpairs + 1 > qla_nvmet_fc_transport.max_hw_queues)
+		qla_nvmet_fc_transport.max_hw_queues = vha->hw->max_qpairs + 1;
+	qla_nvmet_fc_transport.dma_boundary = vha->host->dma_boundary;
+
+	memset(&pinfo, 0, sizeof(pinfo));
+	pinfo.node_name = wwn_to_u64(vha->node_name);
+	pinfo.port_name = wwn_to_u64(vha->port_name);
+	pinfo.port_id = vha->d_id.b24;
+
+	ret = nvmet_fc_register_targetport(&pinfo, &qla_nvmet_fc_transport,
+	    &vha->hw->pdev->dev, &tgtport);
+	if (ret) {
+		ql_log(ql_log_warn, vha, 0x2142,
+		    "register_targetport failed: ret=%d\n", ret);
+		return;
+	}
+	tgtport->private = vha;
+
+	spin_lock_irqsave(&vha->nvmet_cmd_lock, flags);
+	vha->nvmet_tgtport = tgtport;
+	spin_unlock_irqrestore(&vha->nvmet_cmd_lock, flags);
+
+	ql_log(ql_log_info, vha, 0x2143,
+	    "register_targetport: traddr=nn-0x%llx:pn-0x%llx on portID:%x\n",
+	    pinfo.node_name, pinfo.port_name, pinfo.port_id);
+}
+
+void qla_nvmet_delete(struct scsi_qla_host *vha)
+{
+	struct nvmet_fc_target_port *tgtport;
+	unsigned long flags;
+	int ret;
+
+	spin_lock_irqsave(&vha->nvmet_cmd_lock, flags);
+	tgtport = vha->nvmet_tgtport;
+	vha->nvmet_tgtport = NULL;
+	spin_unlock_irqrestore(&vha->nvmet_cmd_lock, flags);
+
+	if (!tgtport)
+		return;
+
+	/* Commands not yet handed over see the port gone and terminate. */
+	flush_workqueue(qla_nvmet_wq);
+
+	init_completion(&vha->nvmet_del_done);
+	ql_log(ql_log_info, vha, 0x2144,
+	    "unregister targetport=%px\n", tgtport);
+	ret = nvmet_fc_unregister_targetport(tgtport);
+	if (ret)
+		ql_log(ql_log_info, vha, 0x2145,
+		    "Unregister of targetport failed: ret=%d\n", ret);
+	else
+		wait_for_completion(&vha->nvmet_del_done);
+}
+
+/* The host logged out: drop its associations. */
+void qla_nvmet_invalidate_host(struct scsi_qla_host *vha,
+    struct fc_port *fcport)
+{
+	unsigned long flags;
+
+	if (!(fcport->nvme_flag & NVME_FLAG_NVMET_HOST))
+		return;
+
+	spin_lock_irqsave(&vha->nvmet_cmd_lock, flags);
+	fcport->nvme_flag &= ~NVME_FLAG_NVMET_HOST;
+	if (vha->nvmet_tgtport)
+		nvmet_fc_invalidate_host(vha->nvmet_tgtport, fcport);
+	spin_unlock_irqrestore(&vha->nvmet_cmd_lock, flags);
+}
+
+int qla_nvmet_init(void)
+{
+	if (!ql2xnvmetenable)
+		return 0;
+
+	qla_nvmet_cmd_cachep = kmem_cache_create("qla_nvmet_cmd_cachep",
+	    sizeof(struct qla_nvmet_cmd), __alignof__(struct qla_nvmet_cmd),
+	    0, NULL);
+	if (!qla_nvmet_cmd_cachep) {
+		ql_log(ql_log_fatal, NULL, 0x2146,
+		    "kmem_cache_create for qla_nvmet_cmd_cachep failed\n");
+		return -ENOMEM;
+	}
+
+	qla_nvmet_wq = alloc_workqueue("qla_nvmet_wq", 0, 0);
+	if (!qla_nvmet_wq) {
+		ql_log(ql_log_fatal, NULL, 0x2147,
+		    "alloc_workqueue for qla_nvmet_wq failed\n");
+		kmem_cache_destroy(qla_nvmet_cmd_cachep);
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+void qla_nvmet_exit(void)
+{
+	if (!ql2xnvmetenable)
+		return;
+
+	destroy_workqueue(qla_nvmet_wq);
+	kmem_cache_destroy(qla_nvmet_cmd_cachep);
+}
+
+#endif
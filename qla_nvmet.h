@@ -0,0 +1,141 @@
+/*
+ * QLogic Fibre Channel HBA Driver
+ * Copyright (c)  2003-2017 QLogic Corporation
+ *
+ * See LICENSE.qla2xxx for copyright and licensing details.
+ */
+#ifndef __QLA_NVMET_H
+#define __QLA_NVMET_H
+
+#include <linux/nvme.h>
+#include <linux/nvme-fc.h>
+#include <linux/nvme-fc-driver.h>
+
+/*
+ * ISP queue - CTIO FC-NVMe from the target driver to the ISP, moving data
+ * for, sending the response of, or terminating an FC-NVMe exchange that
+ * arrived as an ATIO_TYPE7 with an FC_TYPE_NVME header.  Completions come
+ * back in the CTIO7 layout (struct ctio7_from_24xx).
+ */
+#define CTIO_NVME	0x82		/* CTIO FC-NVMe IOCB */
+struct ctio_nvme_to_27xx {
+	uint8_t	 entry_type;		/* Entry type. */
+	uint8_t	 entry_count;		/* Entry count. */
+	uint8_t	 sys_define;		/* System defined. */
+	uint8_t	 entry_status;		/* Entry Status. */
+	uint32_t handle;		/* System defined handle */
+	__le16	 nport_handle;
+	__le16	 timeout;
+	__le16	 dseg_count;		/* Data segment count. */
+	uint8_t	 vp_index;
+	uint8_t	 add_flags;
+	le_id_t	 initiator_id;
+	uint8_t	 reserved;
+	uint32_t exchange_addr;
+	__le16	 ox_id;
+	__le16	 flags;
+#define NVMET_CTIO_SEND_STATUS		BIT_15
+#define NVMET_CTIO_TERMINATE		BIT_14
+#define NVMET_CTIO_STS_MODE0		0
+#define NVMET_CTIO_STS_MODE1		BIT_6
+#define NVMET_CTIO_STS_MODE2		BIT_7
+#define NVMET_CTIO_DATA_IN		BIT_1	/* to the initiator */
+#define NVMET_CTIO_DATA_OUT		BIT_0	/* from the initiator */
+	union {
+		struct {
+			uint8_t	 reserved1[8];
+			__le32	 relative_offset;
+			uint8_t	 reserved2[4];
+			__le32	 transfer_len;
+			uint8_t	 reserved3[4];
+			struct dsd64 dsd;
+		} mode0;
+		struct {
+			uint8_t	 reserved1[16];
+			__le32	 transfer_len;
+			struct dsd64 rsp_dsd;
+			uint8_t	 reserved2[4];
+		} mode2;
+	} u;
+} __packed;
+
+struct pt_ls4_request;
+
+void qla_nvmet_term_atio(struct scsi_qla_host *, struct atio_from_isp *,
+    uint8_t);
+
+#if IS_ENABLED(CONFIG_NVME_TARGET_FC) && defined(NVMET_FC_LS_RSP)
+
+int qla_nvmet_init(void);
+void qla_nvmet_exit(void);
+void qla_nvmet_register(struct scsi_qla_host *);
+void qla_nvmet_delete(struct scsi_qla_host *);
+void qla_nvmet_invalidate_host(struct scsi_qla_host *, struct fc_port *);
+void qla_nvmet_handle_atio(struct scsi_qla_host *, struct atio_from_isp *,
+    uint8_t);
+bool qla_nvmet_handle_abts(struct scsi_qla_host *,
+    struct abts_recv_from_24xx *);
+bool qla_nvmet_unsol_ls(struct scsi_qla_host *, void **, struct rsp_que **);
+void qla_nvmet_ctio_iocb(srb_t *, struct ctio_nvme_to_27xx *);
+void qla_nvmet_ls_iocb(srb_t *, struct pt_ls4_request *);
+void qla_nvmet_ctio_done(struct scsi_qla_host *, struct req_que *, void *);
+
+#else
+
+static inline int qla_nvmet_init(void)
+{
+	return 0;
+}
+
+static inline void qla_nvmet_exit(void)
+{
+}
+
+static inline void qla_nvmet_register(struct scsi_qla_host *vha)
+{
+}
+
+static inline void qla_nvmet_delete(struct scsi_qla_host *vha)
+{
+}
+
+static inline void qla_nvmet_invalidate_host(struct scsi_qla_host *vha,
+    struct fc_port *fcport)
+{
+}
+
+/* Without nvmet-fc an FC-NVMe command is only terminated. */
+static inline void qla_nvmet_handle_atio(struct scsi_qla_host *vha,
+    struct atio_from_isp *atio, uint8_t ha_locked)
+{
+	qla_nvmet_term_atio(vha, atio, ha_locked);
+}
+
+static inline bool qla_nvmet_handle_abts(struct scsi_qla_host *vha,
+    struct abts_recv_from_24xx *abts)
+{
+	return false;
+}
+
+static inline bool qla_nvmet_unsol_ls(struct scsi_qla_host *vha, void **pkt,
+    struct rsp_que **rsp)
+{
+	return false;
+}
+
+static inline void qla_nvmet_ctio_iocb(srb_t *sp,
+    struct ctio_nvme_to_27xx *ctio)
+{
+}
+
+static inline void qla_nvmet_ls_iocb(srb_t *sp, struct pt_ls4_request *iocb)
+{
+}
+
+static inline void qla_nvmet_ctio_done(struct scsi_qla_host *vha,
+    struct req_que *req, void *pkt)
+{
+}
+
+#endif
+#endif
@@ -859,6 +859,7 @@ struct fcp_cmnd {
 
 struct dsd_dma {
 	struct list_head list;
+	struct llist_node cache_node;	/* qpair->dsd_cache */
 	dma_addr_t dsd_list_dma;
 	void *dsd_addr;
 };
@@ -871,6 +872,7 @@ struct ct6_dsd {
 	struct fcp_cmnd *fcp_cmnd;
 	int dsd_use_cnt;
 	struct list_head dsd_list;
+	struct llist_node cache_node;	/* qpair->ct6_cache */
 };
 
 #define MBC_TOGGLE_INTERRUPT	0x10
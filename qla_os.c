@@ -52,6 +52,18 @@ MODULE_PARM_DESC(ql2xsecenable,
 		"0 (Default) - Security disabled. "
 		"1 - Security enabled.");
 
+int ql2xedif_db_depth = 512;
+module_param(ql2xedif_db_depth, int, 0444);
+MODULE_PARM_DESC(ql2xedif_db_depth,
+		"Number of edif doorbell event nodes preallocated per port "
+		"when the authentication application starts. (default: 512)");
+
+int ql2xedif_db_batch = 256;
+module_param(ql2xedif_db_batch, int, 0644);
+MODULE_PARM_DESC(ql2xedif_db_batch,
+		"Bytes of edif doorbell events returned per read of "
+		"edif_doorbell, 256 to PAGE_SIZE. (default: 256)");
+
 static int ql2xenableclass2;
 module_param(ql2xenableclass2, int, S_IRUGO|S_IRUSR);
 MODULE_PARM_DESC(ql2xenableclass2,
@@ -149,6 +161,30 @@ MODULE_PARM_DESC(ql2xnvmeenable,
     "Enables NVME support. "
     "0 - no NVMe.  Default is Y");
 
+int ql2xnvme_queues;
+module_param(ql2xnvme_queues, int, 0444);
+MODULE_PARM_DESC(ql2xnvme_queues,
+	"Maximum number of NVMe/FC I/O queues per HBA. Each is served by "
+	"its own queue pair, whose interrupt is affine to the CPUs the "
+	"queue is mapped to. 0 - one per queue pair, up to the number of "
+	"CPUs. (default: 0)");
+
+int ql2xnvme_qpairs;
+module_param(ql2xnvme_qpairs, int, 0444);
+MODULE_PARM_DESC(ql2xnvme_qpairs,
+	"Number of queue pairs reserved for NVMe/FC, on interrupt vectors "
+	"of their own, so SCSI and NVMe I/O do not share rings or locks. "
+	"Needs kernel support for interrupt affinity sets. "
+	"0 - SCSI and NVMe share all queue pairs. (default: 0)");
+
+int ql2xnvme_qpair_weight;
+module_param(ql2xnvme_qpair_weight, int, 0644);
+MODULE_PARM_DESC(ql2xnvme_qpair_weight,
+	"With ql2xnvme_qpairs set, percentage (5-95) of the firmware IOCB "
+	"and exchange budget given to the NVMe queue pairs. Applied on the "
+	"next chip reset. 0 - in proportion to the queue pair split. "
+	"(default: 0)");
+
 int ql2xenablehba_err_chk = 2;
 module_param(ql2xenablehba_err_chk, int, S_IRUGO|S_IWUSR);
 MODULE_PARM_DESC(ql2xenablehba_err_chk,
@@ -399,6 +435,19 @@ module_param(ql2xabts_wait_nvme, int, 0444);
 MODULE_PARM_DESC(ql2xabts_wait_nvme,
 	"To wait for ABTS response on I/O timeouts for NVMe. (default: 1)");
 
+int ql2xnvmetenable;
+module_param(ql2xnvmetenable, int, 0444);
+MODULE_PARM_DESC(ql2xnvmetenable,
+	"Serve FC-NVMe through nvmet-fc on ports in target or dual mode. "
+	"1 - enabled. (default: 0)");
+
+int ql2xnvme_abt_direct = 1;
+module_param(ql2xnvme_abt_direct, int, 0644);
+MODULE_PARM_DESC(ql2xnvme_abt_direct,
+	"Send NVMe aborts from the transport callback, batched per "
+	"remote port, when ql2xasynctmfenable is set. "
+	"0 - queue every abort to a work item. (default: 1)");
+
 int ql2xrspq_follow_inptr = 1;
 module_param(ql2xrspq_follow_inptr, int, 0644);
 MODULE_PARM_DESC(ql2xrspq_follow_inptr,
@@ -416,6 +465,91 @@ MODULE_PARM_DESC(ql2xcontrol_edc_rdf,
 	"0 - Firmware implements EDC and RDF"
 	"1 - Driver controls EDC and RDF - default");
 
+int ql2xtrace_entries = 512;
+module_param(ql2xtrace_entries, int, 0444);
+MODULE_PARM_DESC(ql2xtrace_entries,
+	"Number of records in the per-CPU binary trace ring used by the "
+	"I/O path debug sites. Rounded up to a power of 2. "
+	"0 - disable the trace ring. (default: 512)");
+
+int ql2xmbx_iocb = 1;
+module_param(ql2xmbx_iocb, int, 0644);
+MODULE_PARM_DESC(ql2xmbx_iocb,
+	"Issue port database and ID list queries from outside the DPC "
+	"thread through the request queue so they do not serialize behind "
+	"other mailbox commands. "
+	"0 - always use the mailbox registers. "
+	"1 - use the mailbox IOCB when possible (default).");
+
+int ql2xstats_interval = 5;
+module_param(ql2xstats_interval, int, 0644);
+MODULE_PARM_DESC(ql2xstats_interval,
+	"Seconds a cached firmware statistics snapshot is served to "
+	"fc_host/BSG/sysfs readers before it is refreshed. The snapshot is "
+	"refreshed in the background while readers keep polling. "
+	"0 - query the firmware on every read. (default: 5)");
+
+int ql2xdsd_cache_depth = 64;
+module_param(ql2xdsd_cache_depth, int, 0644);
+MODULE_PARM_DESC(ql2xdsd_cache_depth,
+	"Number of pre-mapped continuation DSD lists, CRC_2 and Command "
+	"Type 6 contexts kept per queue pair for large scatter-gather, "
+	"DIF and eDIF commands. "
+	"0 - allocate from the DMA pool for every command. (default: 64)");
+
+int ql2xrscn_coalesce_ms = 50;
+module_param(ql2xrscn_coalesce_ms, int, 0644);
+MODULE_PARM_DESC(ql2xrscn_coalesce_ms,
+	"Milliseconds to gather RSCNs before acting on them. Port-scoped "
+	"RSCNs are then resolved with per-port GPN_ID queries and only "
+	"area, domain or fabric-scoped ones trigger a full fabric scan. "
+	"0 - every RSCN triggers a full fabric scan. (default: 50)");
+
+int ql2xlogin_window = 32;
+module_param(ql2xlogin_window, int, 0644);
+MODULE_PARM_DESC(ql2xlogin_window,
+	"Maximum number of fabric login exchanges (GNL, PLOGI, PRLI, GPDB) "
+	"a host keeps in flight. Ports with a registered rport and the NVRAM "
+	"boot target may use the whole window, other ports three quarters "
+	"of it. 0 - unlimited. (default: 32)");
+
+int ql2xwork_pool = 256;
+module_param(ql2xwork_pool, int, 0444);
+MODULE_PARM_DESC(ql2xwork_pool,
+	"Number of pre-allocated work events per host. Events beyond this "
+	"are allocated with GFP_ATOMIC. (default: 256)");
+
+int ql2xparallel_drain = 1;
+module_param(ql2xparallel_drain, int, 0644);
+MODULE_PARM_DESC(ql2xparallel_drain,
+	"Abort outstanding commands of all queue pairs in parallel, each on "
+	"the CPU its queue is affine to, when the HBA is reset. "
+	"0 - one queue after the other, 1 - in parallel. (default: 1)");
+
+int ql2xwarm_resume = 1;
+module_param(ql2xwarm_resume, int, 0644);
+MODULE_PARM_DESC(ql2xwarm_resume,
+	"After an ISP abort, log fabric sessions that were up before the "
+	"reset back in as soon as the fabric login completes with an "
+	"unchanged N_Port ID, ahead of the fabric scan. "
+	"0 - disabled, 1 - enabled. (default: 1)");
+
+int ql2xdisc_cache = 256;
+module_param(ql2xdisc_cache, int, 0444);
+MODULE_PARM_DESC(ql2xdisc_cache,
+	"Number of remote ports per host whose FC-4 types and speed are "
+	"remembered, by WWPN, after their session is freed. While the "
+	"fabric name does not change they are reused instead of asking the "
+	"name server, and FC-4 registration is skipped if GFT_ID shows it "
+	"is still in place. 0 - disabled. (default: 256)");
+
+int ql2xpurex_pool = 32;
+module_param(ql2xpurex_pool, int, 0444);
+MODULE_PARM_DESC(ql2xpurex_pool,
+	"Number of unsolicited ELS (PUREX) items preallocated per host, each "
+	"large enough for a full FC frame, so RDP/FPIN/ABTS bursts do not "
+	"allocate from interrupt context. 0 - disabled. (default: 32)");
+
 u64 ql2xdebug;
 module_param(ql2xdebug, ullong, 0644);
 MODULE_PARM_DESC(ql2xdebug,
@@ -820,26 +954,20 @@ void qla2x00_sp_free_dma(srb_t *sp)
 
 	if (sp->flags & SRB_CRC_CTX_DSD_VALID) {
 		/* List assured to be having elements */
-		qla2x00_clean_dsd_pool(ha, sp->u.scmd.crc_ctx);
+		qla2x00_clean_dsd_pool(sp->qpair, sp->u.scmd.crc_ctx);
 		sp->flags &= ~SRB_CRC_CTX_DSD_VALID;
 	}
 
 	if (sp->flags & SRB_CRC_CTX_DMA_VALID) {
-		struct crc_context *ctx0 = sp->u.scmd.crc_ctx;
-
-		dma_pool_free(ha->dl_dma_pool, ctx0, ctx0->crc_ctx_dma);
+		qla_crc_ctx_put(sp->qpair, sp->u.scmd.crc_ctx);
 		sp->flags &= ~SRB_CRC_CTX_DMA_VALID;
 	}
 
 	if (sp->flags & SRB_FCP_CMND_DMA_VALID) {
 		struct ct6_dsd *ctx1 = sp->u.scmd.ct6_ctx;
 
-		dma_pool_free(ha->fcp_cmnd_dma_pool, ctx1->fcp_cmnd,
-		    ctx1->fcp_cmnd_dma);
-		list_splice(&ctx1->dsd_list, &ha->gbl_dsd_list);
-		ha->gbl_dsd_inuse -= ctx1->dsd_use_cnt;
-		ha->gbl_dsd_avail += ctx1->dsd_use_cnt;
-		mempool_free(ctx1, ha->ctx_mempool);
+		qla_dsd_put_list(sp->qpair, &ctx1->dsd_list);
+		qla_ct6_ctx_put(sp->qpair, ctx1);
 	}
 }
 
@@ -855,6 +983,7 @@ void qla2x00_sp_compl(srb_t *sp, int res)
 	}
 #endif
 	qla2xxx_scmr_manage_qdepth(sp->fcport, false);
+	qla_fcport_cmd_done(sp);
 	sp->free(sp);
 	cmd->result = res;
 	sp->done_jiffies = jiffies;
@@ -882,7 +1011,7 @@ void qla2xxx_qpair_sp_free_dma(srb_t *sp)
 
 	if (sp->flags & SRB_CRC_CTX_DSD_VALID) {
 		/* List assured to be having elements */
-		qla2x00_clean_dsd_pool(ha, sp->u.scmd.crc_ctx);
+		qla2x00_clean_dsd_pool(sp->qpair, sp->u.scmd.crc_ctx);
 		sp->flags &= ~SRB_CRC_CTX_DSD_VALID;
 	}
 
@@ -902,9 +1031,7 @@ void qla2xxx_qpair_sp_free_dma(srb_t *sp)
 		list_for_each_entry_safe(dif_dsd, nxt_dsd,
 		    &difctx->ldif_dsd_list, list) {
 			list_del(&dif_dsd->list);
-			dma_pool_free(ha->dl_dma_pool, dif_dsd->dsd_addr,
-			    dif_dsd->dsd_list_dma);
-			kfree(dif_dsd);
+			qla_dsd_put(sp->qpair, dif_dsd);
 			difctx->no_ldif_dsd--;
 		}
 
@@ -925,19 +1052,13 @@ void qla2xxx_qpair_sp_free_dma(srb_t *sp)
 	if (sp->flags & SRB_FCP_CMND_DMA_VALID) {
 		struct ct6_dsd *ctx1 = sp->u.scmd.ct6_ctx;
 
-		dma_pool_free(ha->fcp_cmnd_dma_pool, ctx1->fcp_cmnd,
-		    ctx1->fcp_cmnd_dma);
-		list_splice(&ctx1->dsd_list, &ha->gbl_dsd_list);
-		ha->gbl_dsd_inuse -= ctx1->dsd_use_cnt;
-		ha->gbl_dsd_avail += ctx1->dsd_use_cnt;
-		mempool_free(ctx1, ha->ctx_mempool);
+		qla_dsd_put_list(sp->qpair, &ctx1->dsd_list);
+		qla_ct6_ctx_put(sp->qpair, ctx1);
 		sp->flags &= ~SRB_FCP_CMND_DMA_VALID;
 	}
 
 	if (sp->flags & SRB_CRC_CTX_DMA_VALID) {
-		struct crc_context *ctx0 = sp->u.scmd.crc_ctx;
-
-		dma_pool_free(ha->dl_dma_pool, ctx0, ctx0->crc_ctx_dma);
+		qla_crc_ctx_put(sp->qpair, sp->u.scmd.crc_ctx);
 		sp->flags &= ~SRB_CRC_CTX_DMA_VALID;
 	}
 }
@@ -954,6 +1075,7 @@ void qla2xxx_qpair_sp_compl(srb_t *sp, int res)
 	}
 #endif
 	qla2xxx_scmr_manage_qdepth(sp->fcport, false);
+	qla_fcport_cmd_done(sp);
 	sp->free(sp);
 	cmd->result = res;
 	sp->done_jiffies = jiffies;
@@ -1017,9 +1139,7 @@ qla2xxx_queuecommand(struct Scsi_Host *host, struct scsi_cmnd *cmd)
 	rval = fc_remote_port_chkready(rport);
 	if (rval) {
 		cmd->result = rval;
-		ql_dbg(ql_dbg_io + ql_dbg_verbose, vha, 0x3003,
-		    "fc_remote_port_chkready failed for cmd=%px, rval=0x%x.\n",
-		    cmd, rval);
+		ql_trc(ql_dbg_io + ql_dbg_verbose, vha, 0x3003, 0, rval, 0, 0);
 		goto qc24_fail_command;
 	}
 
@@ -1040,10 +1160,9 @@ qla2xxx_queuecommand(struct Scsi_Host *host, struct scsi_cmnd *cmd)
 	if (atomic_read(&fcport->state) != FCS_ONLINE) {
 		if (atomic_read(&fcport->state) == FCS_DEVICE_DEAD ||
 			atomic_read(&base_vha->loop_state) == LOOP_DEAD) {
-			ql_dbg(ql_dbg_io, vha, 0x3005,
-			    "Returning DNC, fcport_state=%d loop_state=%d.\n",
+			ql_trc(ql_dbg_io, vha, 0x3005, 0,
 			    atomic_read(&fcport->state),
-			    atomic_read(&base_vha->loop_state));
+			    atomic_read(&base_vha->loop_state), 0);
 			cmd->result = DID_NO_CONNECT << 16;
 			goto qc24_fail_command;
 		}
@@ -1083,16 +1202,17 @@ qla2xxx_queuecommand(struct Scsi_Host *host, struct scsi_cmnd *cmd)
 	ktime_get_real_ts64(&sp->q_cmd);
 #endif
 
+	qla_fcport_cmd_start(sp);
 	rval = ha->isp_ops->start_scsi(sp);
 	if (rval != QLA_SUCCESS) {
-		ql_dbg(ql_dbg_io + ql_dbg_verbose, vha, 0x3013,
-		    "Start scsi failed rval=%d for cmd=%px.\n", rval, cmd);
+		ql_trc(ql_dbg_io + ql_dbg_verbose, vha, 0x3013, 0, rval, 0, 0);
 		goto qc24_host_busy_free_sp;
 	}
 
 	return 0;
 
 qc24_host_busy_free_sp:
+	qla_fcport_cmd_done(sp);
 	qla2xxx_scmr_cleanup(vha, cmd);
 	sp->free(sp);
 
@@ -1122,15 +1242,13 @@ qla2xxx_mqueuecommand(struct Scsi_Host *host, struct scsi_cmnd *cmd,
 	rval = rport ? fc_remote_port_chkready(rport) : FC_PORTSTATE_OFFLINE;
 	if (rval) {
 		cmd->result = rval;
-		ql_dbg(ql_dbg_io + ql_dbg_verbose, vha, 0x3076,
-		    "fc_remote_port_chkready failed for cmd=%px, rval=0x%x.\n",
-		    cmd, rval);
+		ql_trc(ql_dbg_io + ql_dbg_verbose, vha, 0x3076, 0, rval, 0, 0);
 		goto qc24_fail_command;
 	}
 
 	if (!qpair->online) {
-		ql_dbg(ql_dbg_io, vha, 0x3077,
-		    "qpair not online. eeh_busy=%d.\n", ha->flags.eeh_busy);
+		ql_trc(ql_dbg_io, vha, 0x3077, 0, qpair->id,
+		    ha->flags.eeh_busy, 0);
 		cmd->result = DID_NO_CONNECT << 16;
 		goto qc24_fail_command;
 	}
@@ -1143,10 +1261,9 @@ qla2xxx_mqueuecommand(struct Scsi_Host *host, struct scsi_cmnd *cmd,
 	if (atomic_read(&fcport->state) != FCS_ONLINE) {
 		if (atomic_read(&fcport->state) == FCS_DEVICE_DEAD ||
 			atomic_read(&base_vha->loop_state) == LOOP_DEAD) {
-			ql_dbg(ql_dbg_io, vha, 0x3077,
-			    "Returning DNC, fcport_state=%d loop_state=%d.\n",
+			ql_trc(ql_dbg_io, vha, 0x3077, 0,
 			    atomic_read(&fcport->state),
-			    atomic_read(&base_vha->loop_state));
+			    atomic_read(&base_vha->loop_state), 0);
 			cmd->result = DID_NO_CONNECT << 16;
 			goto qc24_fail_command;
 		}
@@ -1185,16 +1302,18 @@ qla2xxx_mqueuecommand(struct Scsi_Host *host, struct scsi_cmnd *cmd,
 	ktime_get_real_ts64(&sp->q_cmd);
 #endif
 
+	qla_fcport_cmd_start(sp);
 	rval = ha->isp_ops->start_scsi_mq(sp);
 	if (rval != QLA_SUCCESS) {
-		ql_dbg(ql_dbg_io + ql_dbg_verbose, vha, 0x3078,
-		    "Start scsi failed rval=%d for cmd=%px.\n", rval, cmd);
+		ql_trc(ql_dbg_io + ql_dbg_verbose, vha, 0x3078, 0, rval,
+		    qpair->id, 0);
 		goto qc24_host_busy_free_sp;
 	}
 
 	return 0;
 
 qc24_host_busy_free_sp:
+	qla_fcport_cmd_done(sp);
 	qla2xxx_scmr_cleanup(vha, cmd);
 	sp->free(sp);
 
@@ -1555,6 +1674,35 @@ qla2x00_eh_wait_for_pending_commands(scsi_qla_host_t *vha, unsigned int t,
 	return status;
 }
 
+/*
+ * Device-scoped variant of qla2x00_eh_wait_for_pending_commands(): an
+ * idle port returns at once, and a target wait polls the port's own
+ * counter (which covers every qpair) instead of sweeping the handle
+ * array.  LUN waits still need the sweep to tell LUNs apart.
+ */
+static int
+qla2x00_eh_wait_for_fcport_commands(scsi_qla_host_t *vha, fc_port_t *fcport,
+    unsigned int t, uint64_t l, enum nexus_wait_type type)
+{
+	unsigned long wait_iter = ABORT_WAIT_ITER;
+	struct qla_hw_data *ha = vha->hw;
+
+	if (!atomic_read(&fcport->active_cmds))
+		return QLA_SUCCESS;
+
+	if (type != WAIT_TARGET)
+		return qla2x00_eh_wait_for_pending_commands(vha, t, l, type);
+
+	if (unlikely(pci_channel_offline(ha->pdev)) || ha->flags.eeh_busy)
+		return QLA_SUCCESS;
+
+	while (atomic_read(&fcport->active_cmds) && wait_iter--)
+		msleep(ABORT_POLLING_PERIOD);
+
+	return atomic_read(&fcport->active_cmds) ?
+	    QLA_FUNCTION_FAILED : QLA_SUCCESS;
+}
+
 static char *reset_errors[] = {
 	"HBA not online",
 	"HBA not ready",
@@ -1599,7 +1747,7 @@ __qla2xxx_eh_generic_reset(char *name, enum nexus_wait_type type,
 		goto eh_reset_failed;
 	}
 	err = 3;
-	if (qla2x00_eh_wait_for_pending_commands(vha, cmd->device->id,
+	if (qla2x00_eh_wait_for_fcport_commands(vha, fcport, cmd->device->id,
 	    cmd->device->lun, type) != QLA_SUCCESS) {
 		ql_log(ql_log_warn, vha, 0x800d,
 		    "wait for pending cmds failed for cmd=%px.\n", cmd);
@@ -1990,25 +2138,93 @@ __qla2x00_abort_all_cmds(struct qla_qpair *qp, int res)
 	spin_unlock_irqrestore(qp->qp_lock_ptr, flags);
 }
 
+static void qla2x00_drain_qpair(struct qla_qpair *qp, int res)
+{
+	ktime_t start = ktime_get();
+	u32 us;
+
+	__qla2x00_abort_all_cmds(qp, res);
+
+	us = ktime_us_delta(ktime_get(), start);
+	qp->drain_last_us = us;
+	if (us > qp->drain_max_us)
+		qp->drain_max_us = us;
+	qp->drains++;
+}
+
+static void qla2x00_drain_work_fn(struct work_struct *work)
+{
+	struct qla_qpair *qp = container_of(work, struct qla_qpair,
+	    drain_work);
+	struct qla_hw_data *ha = qp->hw;
+
+	qla2x00_drain_qpair(qp, ha->drain_res);
+	if (atomic_dec_and_test(&ha->drain_pending))
+		complete(&ha->drain_done);
+}
+
+/*
+ * Abort every outstanding command on every qpair.  With multiple queues,
+ * each qpair is drained by a work item on its own CPU while the caller
+ * drains the base qpair, and the caller waits for all of them.  Context:
+ * process; may sleep.
+ */
 void
 qla2x00_abort_all_cmds(scsi_qla_host_t *vha, int res)
 {
 	int que;
 	struct qla_hw_data *ha = vha->hw;
+	struct qla_qpair *qp;
+	ktime_t start;
+	u32 us;
 
 	/* Continue only if initialization complete. */
 	if (!ha->base_qpair)
 		return;
-	__qla2x00_abort_all_cmds(ha->base_qpair, res);
 
-	if (!ha->queue_pair_map)
+	if (!ha->queue_pair_map || !ha->wq || !ql2xparallel_drain) {
+		qla2x00_drain_qpair(ha->base_qpair, res);
+		if (!ha->queue_pair_map)
+			return;
+		for (que = 0; que < ha->max_qpairs; que++) {
+			if (!ha->queue_pair_map[que])
+				continue;
+
+			qla2x00_drain_qpair(ha->queue_pair_map[que], res);
+		}
 		return;
+	}
+
+	mutex_lock(&ha->drain_mutex);
+	start = ktime_get();
+	ha->drain_res = res;
+	/* the caller's reference, dropped after the base qpair */
+	atomic_set(&ha->drain_pending, 1);
+	reinit_completion(&ha->drain_done);
+
 	for (que = 0; que < ha->max_qpairs; que++) {
-		if (!ha->queue_pair_map[que])
+		qp = ha->queue_pair_map[que];
+		if (!qp)
 			continue;
 
-		__qla2x00_abort_all_cmds(ha->queue_pair_map[que], res);
+		INIT_WORK(&qp->drain_work, qla2x00_drain_work_fn);
+		atomic_inc(&ha->drain_pending);
+		queue_work_on(cpu_online(qp->cpuid) ? qp->cpuid :
+		    WORK_CPU_UNBOUND, ha->wq, &qp->drain_work);
 	}
+
+	qla2x00_drain_qpair(ha->base_qpair, res);
+	if (!atomic_dec_and_test(&ha->drain_pending))
+		wait_for_completion(&ha->drain_done);
+
+	us = ktime_us_delta(ktime_get(), start);
+	ha->drain_last_us = us;
+	if (us > ha->drain_max_us)
+		ha->drain_max_us = us;
+	mutex_unlock(&ha->drain_mutex);
+
+	ql_dbg(ql_dbg_taskm, vha, 0x8046,
+	    "Drained all qpairs in %u us.\n", us);
 }
 
 static int
@@ -2926,6 +3142,11 @@ qla2xxx_scan_finished(struct Scsi_Host *shost, unsigned long time)
 	return atomic_read(&vha->loop_state) == LOOP_READY;
 }
 
+static inline bool qla2x00_work_pending(struct scsi_qla_host *vha)
+{
+	return !llist_empty(&vha->work_q) || !list_empty(&vha->work_list);
+}
+
 static void qla2x00_iocb_work_fn(struct work_struct *work)
 {
 	struct scsi_qla_host *vha = container_of(work,
@@ -2933,19 +3154,24 @@ static void qla2x00_iocb_work_fn(struct work_struct *work)
 	struct qla_hw_data *ha = vha->hw;
 	struct scsi_qla_host *base_vha = pci_get_drvdata(ha->pdev);
 	int i = 2;
-	unsigned long flags;
 
 	if (test_bit(UNLOADING, &base_vha->dpc_flags))
 		return;
 
-	while (!list_empty(&vha->work_list) && i > 0) {
+	while (qla2x00_work_pending(vha) && i > 0) {
 		qla2x00_do_work(vha);
 		i--;
 	}
 
-	spin_lock_irqsave(&vha->work_lock, flags);
+	/*
+	 * A post racing with the clear found the bit still set and did not
+	 * queue us; pick its event up here rather than at the next timer tick.
+	 */
 	clear_bit(IOCB_WORK_ACTIVE, &vha->dpc_flags);
-	spin_unlock_irqrestore(&vha->work_lock, flags);
+	smp_mb__after_atomic();
+	if (!llist_empty(&vha->work_q) &&
+	    !test_and_set_bit(IOCB_WORK_ACTIVE, &vha->dpc_flags))
+		queue_work(ha->wq, &vha->iocb_work);
 }
 
 /*
@@ -3029,8 +3255,6 @@ qla2x00_probe_one(struct pci_dev *pdev, const struct pci_device_id *id)
 
 	// edif sadb
 	spin_lock_init(&ha->sadb_lock);
-	INIT_LIST_HEAD(&ha->sadb_tx_index_list);
-	INIT_LIST_HEAD(&ha->sadb_rx_index_list);
 
 	// edif sa_index free pool
 	spin_lock_init(&ha->sadb_fp_lock);
@@ -3278,8 +3502,11 @@ qla2x00_probe_one(struct pci_dev *pdev, const struct pci_device_id *id)
 	    pdev->device, pdev->irq, ha->iobase);
 	mutex_init(&ha->vport_lock);
 	mutex_init(&ha->mq_lock);
+	mutex_init(&ha->drain_mutex);
+	init_completion(&ha->drain_done);
 	init_completion(&ha->mbx_cmd_comp);
 	complete(&ha->mbx_cmd_comp);
+	init_waitqueue_head(&ha->mbx_hipri_wq);
 	init_completion(&ha->mbx_intr_comp);
 	init_completion(&ha->dcbx_comp);
 	init_completion(&ha->lb_portup_comp);
@@ -3399,18 +3626,27 @@ qla2x00_probe_one(struct pci_dev *pdev, const struct pci_device_id *id)
 		goto probe_failed;
 	}
 
+	qla_dsd_cache_fill(ha->base_qpair);
+
 	if (ha->mqenable) {
+		/* NVMe-only queue pairs, if any, follow the SCSI ones */
+		if (ha->max_qpairs < ha->nvme_qpairs + 2)
+			ha->nvme_qpairs = 0;
+		ha->nvme_qpair_base = ha->max_qpairs - ha->nvme_qpairs;
+
 		/* number of hardware queues supported by blk/scsi-mq*/
 		if (IS_QLA27XX(ha) || IS_QLA28XX(ha)) {
 			/* The last queue pair is reserved for slow queue */
-			host->nr_hw_queues = ha->max_qpairs - 1;
+			host->nr_hw_queues = ha->nvme_qpair_base - 1;
 		} else {
-			host->nr_hw_queues = ha->max_qpairs;
+			host->nr_hw_queues = ha->nvme_qpair_base;
 		}
 
 		ql_dbg(ql_dbg_init, base_vha, 0x0192,
-			"blk/scsi-mq enabled, HW queues = %d.\n", host->nr_hw_queues);
+			"blk/scsi-mq enabled, HW queues = %d, NVMe queue pairs = %d.\n",
+			host->nr_hw_queues, ha->nvme_qpairs);
 	} else {
+		ha->nvme_qpairs = 0;
 		if (ql2xnvmeenable) {
 			host->nr_hw_queues = ha->max_qpairs;
 			ql_dbg(ql_dbg_init, base_vha, 0x0194,
@@ -3523,6 +3759,7 @@ qla2x00_probe_one(struct pci_dev *pdev, const struct pci_device_id *id)
 	/* Check if FW supports MQ or not for ISP25xx*/
 	if (IS_QLA25XX(ha) &&  !(ha->fw_attributes & BIT_6)) {
                 ha->mqenable = 0;
+                ha->nvme_qpairs = 0;
         }
 
 	if (ha->mqenable) {
@@ -3536,16 +3773,19 @@ qla2x00_probe_one(struct pci_dev *pdev, const struct pci_device_id *id)
 
 		/* Create start of day qpairs for Block MQ */
 		if (IS_SCM_CAPABLE(ha) && ha->flags.scm_supported_f) {
-			for (i = 0; i < (ha->max_qpairs - 1); i++)
+			for (i = 0; i < (ha->nvme_qpair_base - 1); i++)
 				qla2xxx_create_qpair(base_vha, 5, 0, startit);
 			/* Create a Slow queue */
 			ql_log(ql_log_info, base_vha, 0x00ed,
 			    "SCMR: Creating Slow queue\n");
 			qla2xxx_create_qpair(base_vha, 1, 0, startit);
 		} else {
-			for (i = 0; i < ha->max_qpairs; i++)
+			for (i = 0; i < ha->nvme_qpair_base; i++)
 				qla2xxx_create_qpair(base_vha, 5, 0, startit);
 		}
+		/* NVMe queue pairs, on vectors of their own affinity set */
+		for (i = 0; i < ha->nvme_qpairs; i++)
+			qla2xxx_create_qpair(base_vha, 5, 0, startit);
 	}
 	qla_init_iocb_limit(base_vha);
 
@@ -3707,6 +3947,8 @@ probe_failed:
 				base_vha->gnl.l, base_vha->gnl.ldma);
 		base_vha->gnl.l = NULL;
 	}
+	qla24xx_free_gnl_index(base_vha);
+	qla_tmo_wheel_stop(base_vha);
 
 	if (base_vha->timer_active)
 		qla2x00_stop_timer(base_vha);
@@ -3722,6 +3964,9 @@ probe_failed:
 	}
 
 	qla2x00_free_device(base_vha);
+	qla2x00_free_work_pool(base_vha);
+	qla2x00_free_disc_cache(base_vha);
+	qla24xx_free_purex_pool(base_vha);
 	scsi_host_put(base_vha->host);
 	/*
 	 * Need to NULL out local req/rsp after
@@ -3869,6 +4114,7 @@ qla2x00_delete_all_vps(struct qla_hw_data *ha, scsi_qla_host_t *base_vha)
 		spin_unlock_irqrestore(&ha->vport_slock, flags);
 		mutex_unlock(&ha->vport_lock);
 
+		qla_nvmet_delete(vha);
 		qla_nvme_delete(vha);
 
 		fc_vport_terminate(vha->fc_vport);
@@ -3970,6 +4216,11 @@ qla2x00_remove_one(struct pci_dev *pdev)
 		dma_free_coherent(&ha->pdev->dev, base_vha->gnl.size,
 		    base_vha->gnl.l, base_vha->gnl.ldma);
 		base_vha->gnl.l = NULL;
+		qla24xx_free_gnl_index(base_vha);
+		qla_tmo_wheel_stop(base_vha);
+		qla2x00_free_work_pool(base_vha);
+		qla2x00_free_disc_cache(base_vha);
+		qla24xx_free_purex_pool(base_vha);
 		scsi_host_put(base_vha->host);
 		kfree(ha);
 		pci_set_drvdata(pdev, NULL);
@@ -4004,12 +4255,14 @@ qla2x00_remove_one(struct pci_dev *pdev)
 
 	set_bit(UNLOADING, &base_vha->dpc_flags);
 
+	qla_nvmet_delete(base_vha);
 	qla_nvme_delete(base_vha);
 
 	dma_free_coherent(&ha->pdev->dev,
 		base_vha->gnl.size, base_vha->gnl.l, base_vha->gnl.ldma);
 
 	base_vha->gnl.l = NULL;
+	qla24xx_free_gnl_index(base_vha);
 	qla_enode_stop(base_vha);
 	qla_edb_stop(base_vha);
 
@@ -4029,6 +4282,7 @@ qla2x00_remove_one(struct pci_dev *pdev)
 		qla2x00_stop_timer(base_vha);
 	if (base_vha->perf_timer_active)
 		qla2x00_stop_perf_timer(base_vha);
+	qla_tmo_wheel_stop(base_vha);
 
 	base_vha->flags.online = 0;
 
@@ -4050,10 +4304,15 @@ qla2x00_remove_one(struct pci_dev *pdev)
 
 	scsi_remove_host(base_vha->host);
 
+	qla2x00_stats_cache_free(base_vha);
+
 	qla2x00_free_device(base_vha);
 
 	qla2x00_clear_drv_active(ha);
 
+	qla2x00_free_work_pool(base_vha);
+	qla2x00_free_disc_cache(base_vha);
+	qla24xx_free_purex_pool(base_vha);
 	scsi_host_put(base_vha->host);
 
 	qla2x00_unmap_iobases(ha);
@@ -4069,13 +4328,13 @@ qla2x00_remove_one(struct pci_dev *pdev)
 static inline void
 qla24xx_free_purex_list(struct purex_list *list)
 {
-	struct list_head *item, *next;
+	struct purex_item *item, *next;
 	ulong flags;
 
 	spin_lock_irqsave(&list->lock, flags);
-	list_for_each_safe(item, next, &list->head) {
-		list_del(item);
-		kfree(list_entry(item, struct purex_item, list));
+	list_for_each_entry_safe(item, next, &list->head, list) {
+		list_del(&item->list);
+		qla24xx_free_purex_item(item);
 	}
 	spin_unlock_irqrestore(&list->lock, flags);
 }
@@ -4520,8 +4779,6 @@ qla2x00_mem_alloc(struct qla_hw_data *ha, uint16_t req_len, uint16_t rsp_len,
 			   "sf_init_cb=%px.\n", ha->sf_init_cb);
 	}
 
-	INIT_LIST_HEAD(&ha->gbl_dsd_list);
-
 	/* Get consistent memory allocated for Async Port-Database. */
 	if (!IS_FWI2_CAPABLE(ha)) {
 		ha->async_pd = dma_pool_alloc(ha->s_dma_pool, GFP_KERNEL,
@@ -4587,6 +4844,14 @@ qla2x00_mem_alloc(struct qla_hw_data *ha, uint16_t req_len, uint16_t rsp_len,
 	ha->elsrej.c->er_cmd = ELS_LS_RJT;
 	ha->elsrej.c->er_reason = ELS_RJT_LOGIC;
 	ha->elsrej.c->er_explan = ELS_EXPL_UNAB_DATA;
+
+	/* Latency accounting is optional, mailbox works without it. */
+	ha->mbx_stats = kzalloc(sizeof(*ha->mbx_stats), GFP_KERNEL);
+	if (ha->mbx_stats)
+		spin_lock_init(&ha->mbx_stats->lock);
+	ha->nvme_abt_stats = kzalloc(sizeof(*ha->nvme_abt_stats), GFP_KERNEL);
+	if (ha->nvme_abt_stats)
+		spin_lock_init(&ha->nvme_abt_stats->lock);
 	return 0;
 
 fail_elsrej:
@@ -4983,6 +5248,11 @@ qla2x00_mem_free(struct qla_hw_data *ha)
 {
 	qla2x00_free_fw_dump(ha);
 
+	kfree(ha->mbx_stats);
+	ha->mbx_stats = NULL;
+	kfree(ha->nvme_abt_stats);
+	ha->nvme_abt_stats = NULL;
+
 	if (ha->mctp_dump)
 		dma_free_coherent(&ha->pdev->dev, MCTP_DUMP_SIZE, ha->mctp_dump,
 		    ha->mctp_dump_dma);
@@ -5056,20 +5326,8 @@ qla2x00_mem_free(struct qla_hw_data *ha)
 	ha->gid_list = NULL;
 	ha->gid_list_dma = 0;
 
-	if (IS_QLA82XX(ha)) {
-		if (!list_empty(&ha->gbl_dsd_list)) {
-			struct dsd_dma *dsd_ptr, *tdsd_ptr;
-
-			/* clean up allocated prev pool */
-			list_for_each_entry_safe(dsd_ptr,
-				tdsd_ptr, &ha->gbl_dsd_list, list) {
-				dma_pool_free(ha->dl_dma_pool,
-				dsd_ptr->dsd_addr, dsd_ptr->dsd_list_dma);
-				list_del(&dsd_ptr->list);
-				kfree(dsd_ptr);
-			}
-		}
-	}
+	if (ha->base_qpair)
+		qla_dsd_cache_drain(ha->base_qpair);
 
 	dma_pool_destroy(ha->dl_dma_pool);
 	ha->dl_dma_pool = NULL;
@@ -5168,6 +5426,7 @@ struct scsi_qla_host *qla2x00_create_host(struct scsi_host_template *sht,
 
 	INIT_LIST_HEAD(&vha->vp_fcports);
 	INIT_LIST_HEAD(&vha->work_list);
+	init_llist_head(&vha->work_q);
 	INIT_LIST_HEAD(&vha->list);
 	INIT_LIST_HEAD(&vha->qla_cmd_list);
 	INIT_LIST_HEAD(&vha->qla_sess_op_cmd_list);
@@ -5177,9 +5436,14 @@ struct scsi_qla_host *qla2x00_create_host(struct scsi_host_template *sht,
 	INIT_LIST_HEAD(&vha->gnl.fcports);
 	INIT_LIST_HEAD(&vha->gpnid_list);
 	INIT_WORK(&vha->iocb_work, qla2x00_iocb_work_fn);
+	qla2x00_stats_cache_init(vha);
+	spin_lock_init(&vha->login_sched.lock);
+	qla_tmo_wheel_init(vha);
 
 	INIT_LIST_HEAD(&vha->purex_list.head);
 	spin_lock_init(&vha->purex_list.lock);
+	INIT_LIST_HEAD(&vha->nvmet_cmd_list);
+	spin_lock_init(&vha->nvmet_cmd_lock);
 
 	spin_lock_init(&vha->work_lock);
 	spin_lock_init(&vha->cmd_list_lock);
@@ -5200,6 +5464,16 @@ struct scsi_qla_host *qla2x00_create_host(struct scsi_host_template *sht,
 		return NULL;
 	}
 
+	if (qla24xx_alloc_gnl_index(vha)) {
+		ql_log(ql_log_fatal, vha, 0xd04a,
+		    "Alloc failed for name list index.\n");
+		dma_free_coherent(&ha->pdev->dev, vha->gnl.size,
+		    vha->gnl.l, vha->gnl.ldma);
+		vha->gnl.l = NULL;
+		scsi_host_put(vha->host);
+		return NULL;
+	}
+
 	/* todo: what about ext login? */
 	vha->scan.size = ha->max_fibre_devices * sizeof(struct fab_scan_rp);
 	vha->scan.l = vmalloc(vha->scan.size);
@@ -5209,11 +5483,24 @@ struct scsi_qla_host *qla2x00_create_host(struct scsi_host_template *sht,
 		dma_free_coherent(&ha->pdev->dev, vha->gnl.size,
 		    vha->gnl.l, vha->gnl.ldma);
 		vha->gnl.l = NULL;
+		qla24xx_free_gnl_index(vha);
 		scsi_host_put(vha->host);
 		return NULL;
 	}
 	INIT_DELAYED_WORK(&vha->scan.scan_work, qla_scan_work_fn);
 
+	if (qla2x00_alloc_work_pool(vha))
+		ql_log(ql_log_warn, vha, 0xd050,
+		    "Alloc failed for work event pool, using GFP_ATOMIC.\n");
+
+	if (qla2x00_alloc_disc_cache(vha))
+		ql_log(ql_log_warn, vha, 0xd051,
+		    "Alloc failed for discovery cache, disabled.\n");
+
+	if (qla24xx_alloc_purex_pool(vha))
+		ql_log(ql_log_warn, vha, 0xd052,
+		    "Alloc failed for purex item pool, using GFP_ATOMIC.\n");
+
 	sprintf(vha->host_str, "%s_%ld", QLA2XXX_DRIVER_NAME, vha->host_no);
 	ql_dbg(ql_dbg_init, vha, 0x0041,
 	    "Allocated the host=%px hw=%px vha=%px dev_name=%s",
@@ -5223,17 +5510,162 @@ struct scsi_qla_host *qla2x00_create_host(struct scsi_host_template *sht,
 	return vha;
 }
 
+int qla2x00_alloc_work_pool(struct scsi_qla_host *vha)
+{
+	struct qla_work_pool *wp = &vha->work_pool;
+
+	if (ql2xwork_pool <= 0)
+		return 0;
+
+	wp->evt = kcalloc(ql2xwork_pool, sizeof(*wp->evt), GFP_KERNEL);
+	wp->map = kcalloc(BITS_TO_LONGS(ql2xwork_pool), sizeof(long),
+	    GFP_KERNEL);
+	if (!wp->evt || !wp->map) {
+		qla2x00_free_work_pool(vha);
+		return -ENOMEM;
+	}
+	wp->size = ql2xwork_pool;
+
+	return 0;
+}
+
+void qla2x00_free_work_pool(struct scsi_qla_host *vha)
+{
+	struct qla_work_pool *wp = &vha->work_pool;
+
+	wp->size = 0;
+	kfree(wp->map);
+	wp->map = NULL;
+	kfree(wp->evt);
+	wp->evt = NULL;
+}
+
+int qla24xx_alloc_purex_pool(struct scsi_qla_host *vha)
+{
+	struct purex_pool *pool = &vha->purex_pool;
+	struct purex_item *item;
+	u32 i;
+
+	spin_lock_init(&pool->lock);
+	INIT_LIST_HEAD(&pool->free);
+
+	if (ql2xpurex_pool <= 0)
+		return 0;
+
+	for (i = 0; i < ql2xpurex_pool; i++) {
+		item = kzalloc(sizeof(*item) - QLA_DEFAULT_PAYLOAD_SIZE +
+		    QLA_PUREX_POOL_PAYLOAD, GFP_KERNEL);
+		if (!item) {
+			qla24xx_free_purex_pool(vha);
+			return -ENOMEM;
+		}
+		item->flags = PUREX_ITEM_POOLED;
+		list_add_tail(&item->list, &pool->free);
+	}
+	pool->size = ql2xpurex_pool;
+
+	return 0;
+}
+
+void qla24xx_free_purex_pool(struct scsi_qla_host *vha)
+{
+	struct purex_pool *pool = &vha->purex_pool;
+	struct purex_item *item, *next;
+
+	/* return anything still queued before tearing the pool down */
+	qla24xx_free_purex_list(&vha->purex_list);
+
+	pool->size = 0;
+	list_for_each_entry_safe(item, next, &pool->free, list) {
+		list_del(&item->list);
+		kfree(item);
+	}
+}
+
+int qla2x00_alloc_disc_cache(struct scsi_qla_host *vha)
+{
+	struct qla_disc_cache *dc = &vha->disc_cache;
+	u32 i;
+
+	spin_lock_init(&dc->lock);
+	INIT_LIST_HEAD(&dc->lru);
+	hash_init(dc->hash);
+
+	if (ql2xdisc_cache <= 0)
+		return 0;
+
+	dc->ent = kcalloc(ql2xdisc_cache, sizeof(*dc->ent), GFP_KERNEL);
+	if (!dc->ent)
+		return -ENOMEM;
+
+	for (i = 0; i < ql2xdisc_cache; i++)
+		list_add_tail(&dc->ent[i].lru, &dc->lru);
+	dc->size = ql2xdisc_cache;
+
+	return 0;
+}
+
+void qla2x00_free_disc_cache(struct scsi_qla_host *vha)
+{
+	struct qla_disc_cache *dc = &vha->disc_cache;
+	struct qla_disc_ent *ent;
+	unsigned long flags;
+
+	spin_lock_irqsave(&dc->lock, flags);
+	ent = dc->ent;
+	dc->ent = NULL;
+	dc->size = 0;
+	INIT_LIST_HEAD(&dc->lru);
+	hash_init(dc->hash);
+	spin_unlock_irqrestore(&dc->lock, flags);
+
+	kfree(ent);
+}
+
+static struct qla_work_evt *qla2x00_work_pool_get(struct qla_work_pool *wp)
+{
+	unsigned int i;
+
+	do {
+		i = find_first_zero_bit(wp->map, wp->size);
+		if (i >= wp->size)
+			return NULL;
+	} while (test_and_set_bit_lock(i, wp->map));
+
+	return &wp->evt[i];
+}
+
+static void qla2x00_free_work(struct scsi_qla_host *vha,
+	struct qla_work_evt *e)
+{
+	struct qla_work_pool *wp = &vha->work_pool;
+
+	if (e->flags & QLA_EVT_FLAG_POOL)
+		clear_bit_unlock(e - wp->evt, wp->map);
+	else if (e->flags & QLA_EVT_FLAG_FREE)
+		kfree(e);
+}
+
 struct qla_work_evt *
 qla2x00_alloc_work(struct scsi_qla_host *vha, enum qla_work_type type)
 {
+	struct qla_work_pool *wp = &vha->work_pool;
 	struct qla_work_evt *e;
 	uint8_t bail;
+	u32 flags = QLA_EVT_FLAG_POOL;
 
 	QLA_VHA_MARK_BUSY(vha, bail);
 	if (bail)
 		return NULL;
 
-	e = kzalloc(sizeof(struct qla_work_evt), GFP_ATOMIC);
+	e = wp->size ? qla2x00_work_pool_get(wp) : NULL;
+	if (e) {
+		memset(e, 0, sizeof(*e));
+	} else {
+		atomic64_inc(&wp->overflow);
+		e = kzalloc(sizeof(struct qla_work_evt), GFP_ATOMIC);
+		flags = QLA_EVT_FLAG_FREE;
+	}
 	if (!e) {
 		QLA_VHA_MARK_NOT_BUSY(vha);
 		return NULL;
@@ -5241,25 +5673,54 @@ qla2x00_alloc_work(struct scsi_qla_host *vha, enum qla_work_type type)
 
 	INIT_LIST_HEAD(&e->list);
 	e->type = type;
-	e->flags = QLA_EVT_FLAG_FREE;
+	e->flags = flags;
 	return e;
 }
 
+/*
+ * Events that carry nothing but their fc_port are idempotent: while one
+ * is queued, another of the same type for the same port adds nothing.
+ * Returns the bitmap tracking queued events of e's kind, or NULL.
+ */
+static unsigned long *
+qla2x00_work_pend_map(struct scsi_qla_host *vha, struct qla_work_evt *e)
+{
+	switch (e->type) {
+	case QLA_EVT_GPDB:
+		if (e->u.fcport.opt)
+			return NULL;
+		/* fall through */
+	case QLA_EVT_PRLI:
+	case QLA_EVT_GPSC:
+	case QLA_EVT_GNL:
+	case QLA_EVT_GNNID:
+	case QLA_EVT_GFPNID:
+	case QLA_EVT_ELS_PLOGI:
+		return &e->u.fcport.fcport->work_pend;
+	case QLA_EVT_RELOGIN:
+	case QLA_EVT_IIDMA:
+		return &vha->work_pend;
+	default:
+		return NULL;
+	}
+}
+
 int
 qla2x00_post_work(struct scsi_qla_host *vha, struct qla_work_evt *e)
 {
-	unsigned long flags;
-	bool q = false;
-
-	spin_lock_irqsave(&vha->work_lock, flags);
-	list_add_tail(&e->list, &vha->work_list);
+	unsigned long *pend = qla2x00_work_pend_map(vha, e);
 
-	if (!test_and_set_bit(IOCB_WORK_ACTIVE, &vha->dpc_flags))
-		q = true;
+	if (pend && test_and_set_bit(e->type, pend)) {
+		atomic64_inc(&vha->work_pool.deduped);
+		qla2x00_free_work(vha, e);
+		QLA_VHA_MARK_NOT_BUSY(vha);
+		return QLA_SUCCESS;
+	}
 
-	spin_unlock_irqrestore(&vha->work_lock, flags);
+	atomic64_inc(&vha->work_pool.posted);
+	llist_add(&e->lnode, &vha->work_q);
 
-	if (q)
+	if (!test_and_set_bit(IOCB_WORK_ACTIVE, &vha->dpc_flags))
 		queue_work(vha->hw->wq, &vha->iocb_work);
 
 	return QLA_SUCCESS;
@@ -5435,6 +5896,8 @@ void qla24xx_create_new_sess(struct scsi_qla_host *vha, struct qla_work_evt *e)
 				fcport->n2n_flag = 1;
 				if (vha->flags.nvme_enabled)
 					fcport->fc4_type |= FS_FC4TYPE_NVME;
+			} else {
+				qla_disc_cache_seed(vha, fcport);
 			}
 
 		} else {
@@ -5546,6 +6009,11 @@ void qla24xx_create_new_sess(struct scsi_qla_host *vha, struct qla_work_evt *e)
 				fcport->fw_login_state = 0;
 
 				schedule_delayed_work(&vha->scan.scan_work, 5);
+			} else if (!fcport->fc4_type && vha->flags.nvme_enabled) {
+				/* GFF_ID picks FCP vs NVMe PRLI, then posts GNL */
+				if (qla24xx_async_gffid(vha, fcport))
+					qla24xx_fcport_handle_login(vha,
+					    fcport);
 			} else {
 				qla24xx_fcport_handle_login(vha, fcport);
 			}
@@ -5575,20 +6043,29 @@ static void qla_sp_retry(struct scsi_qla_host *vha, struct qla_work_evt *e)
 	}
 }
 
+/*
+ * Single consumer: only qla2x00_iocb_work_fn() gets here, so vha->work_list
+ * (events deferred with EAGAIN) needs no lock.
+ */
 void
 qla2x00_do_work(struct scsi_qla_host *vha)
 {
 	struct qla_work_evt *e, *tmp;
-	unsigned long flags;
+	struct llist_node *node;
+	unsigned long *pend;
 	LIST_HEAD(work);
 	int rc;
 
-	spin_lock_irqsave(&vha->work_lock, flags);
 	list_splice_init(&vha->work_list, &work);
-	spin_unlock_irqrestore(&vha->work_lock, flags);
+	node = llist_reverse_order(llist_del_all(&vha->work_q));
+	llist_for_each_entry_safe(e, tmp, node, lnode)
+		list_add_tail(&e->list, &work);
 
 	list_for_each_entry_safe(e, tmp, &work, list) {
 		rc = QLA_SUCCESS;
+		pend = qla2x00_work_pend_map(vha, e);
+		if (pend)
+			clear_bit(e->type, pend);
 		switch (e->type) {
 		case QLA_EVT_AEN:
 			fc_host_post_event(vha->host, fc_get_event_number(),
@@ -5669,7 +6146,7 @@ qla2x00_do_work(struct scsi_qla_host *vha)
 			qla_sp_retry(vha, e);
 			break;
 		case QLA_EVT_IIDMA:
-			qla_do_iidma_work(vha, e->u.fcport.fcport);
+			qla_do_iidma_work(vha);
 			break;
 		case QLA_EVT_ELS_PLOGI:
 			qla24xx_els_dcmd2_iocb(vha, ELS_DCMD_PLOGI,
@@ -5682,14 +6159,11 @@ qla2x00_do_work(struct scsi_qla_host *vha)
 
 		if (rc == EAGAIN) {
 			/* put 'work' at head of 'vha->work_list' */
-			spin_lock_irqsave(&vha->work_lock, flags);
 			list_splice(&work, &vha->work_list);
-			spin_unlock_irqrestore(&vha->work_lock, flags);
 			break;
 		}
 		list_del_init(&e->list);
-		if (e->flags & QLA_EVT_FLAG_FREE)
-			kfree(e);
+		qla2x00_free_work(vha, e);
 
 		/* For each work completed decrement vha ref count */
 		QLA_VHA_MARK_NOT_BUSY(vha);
@@ -5718,8 +6192,16 @@ void qla2x00_relogin(struct scsi_qla_host *vha)
 	fc_port_t       *fcport;
 	int status, relogin_needed = 0;
 	struct event_arg ea;
+	bool prio = true;
 
+	/*
+	 * Two passes: ports something is waiting on (see
+	 * qla_login_priority()) claim login window slots first.
+	 */
+again:
 	list_for_each_entry(fcport, &vha->vp_fcports, list) {
+		if (ql2xlogin_window > 0 && qla_login_priority(fcport) != prio)
+			continue;
 		/*
 		 * If the port is not ONLINE then try to login
 		 * to it if we haven't run out of retries.
@@ -5772,9 +6254,14 @@ void qla2x00_relogin(struct scsi_qla_host *vha)
 			}
 		}
 		if (test_bit(LOOP_RESYNC_NEEDED, &vha->dpc_flags))
-			break;
+			goto out;
 	}
 
+	if (ql2xlogin_window > 0 && prio) {
+		prio = false;
+		goto again;
+	}
+out:
 	if (relogin_needed)
 		set_bit(RELOGIN_NEEDED, &vha->dpc_flags);
 
@@ -6113,15 +6600,29 @@ retry_lock:
 void
 qla24xx_free_purex_item(struct purex_item *item)
 {
-	if (item == &item->vha->default_item)
+	struct purex_pool *pool = &item->vha->purex_pool;
+	unsigned long flags;
+
+	if (!atomic_dec_and_test(&item->in_use))
+		return;
+
+	if (item == &item->vha->default_item) {
 		memset(&item->vha->default_item, 0, sizeof(struct purex_item));
-	else
+	} else if (item->flags & PUREX_ITEM_POOLED) {
+		item->flags = PUREX_ITEM_POOLED;
+		spin_lock_irqsave(&pool->lock, flags);
+		list_add(&item->list, &pool->free);
+		spin_unlock_irqrestore(&pool->lock, flags);
+	} else {
 		kfree(item);
+	}
 }
 
 void qla24xx_process_purex_list(struct purex_list *list)
 {
 	struct list_head head = LIST_HEAD_INIT(head);
+	struct list_head fpin = LIST_HEAD_INIT(fpin);
+	struct scsi_qla_host *fpin_vha = NULL;
 	struct purex_item *item, *next;
 	ulong flags;
 
@@ -6131,9 +6632,18 @@ void qla24xx_process_purex_list(struct purex_list *list)
 
 	list_for_each_entry_safe(item, next, &head, list) {
 		list_del(&item->list);
+		/* FPINs are aggregated and handled once, below */
+		if (item->flags & PUREX_ITEM_FPIN) {
+			fpin_vha = item->vha;
+			list_add_tail(&item->list, &fpin);
+			continue;
+		}
 		item->process_item(item->vha, item);
 		qla24xx_free_purex_item(item);
 	}
+
+	if (fpin_vha)
+		qla27xx_process_fpin_list(fpin_vha, &fpin);
 }
 
 void
@@ -7031,13 +7541,10 @@ void
 qla2x00_timer(qla_timer_arg_t t)
 {
 	scsi_qla_host_t *vha = qla_from_timer(vha, t, timer);
-	unsigned long	cpu_flags = 0;
 	int		start_dpc = 0;
 	int		index;
-	srb_t		*sp;
 	uint16_t        w;
 	struct qla_hw_data *ha = vha->hw;
-	struct req_que *req;
 	unsigned long flags;
 	fc_port_t *fcport = NULL;
 
@@ -7104,37 +7611,15 @@ qla2x00_timer(qla_timer_arg_t t)
 			 * Schedule an ISP abort to return any FCP2-device
 			 * commands.
 			 */
-			/* NPIV - scan physical port only */
-			if (!vha->vp_idx) {
-				spin_lock_irqsave(&ha->hardware_lock,
-				    cpu_flags);
-				req = ha->req_q_map[0];
-				for (index = 1;
-				    index < req->num_outstanding_cmds;
-				    index++) {
-					fc_port_t *sfcp;
-
-					sp = req->outstanding_cmds[index];
-					if (!sp)
-						continue;
-					if (sp->cmd_type != TYPE_SRB)
-						continue;
-					if (sp->type != SRB_SCSI_CMD)
-						continue;
-					sfcp = sp->fcport;
-					if (!(sfcp->flags & FCF_FCP2_DEVICE))
-						continue;
-
-					if (IS_QLA82XX(ha))
-						set_bit(FCOE_CTX_RESET_NEEDED,
-							&vha->dpc_flags);
-					else
-						set_bit(ISP_ABORT_NEEDED,
-							&vha->dpc_flags);
-					break;
-				}
-				spin_unlock_irqrestore(&ha->hardware_lock,
-								cpu_flags);
+			/* NPIV - physical port only */
+			if (!vha->vp_idx &&
+			    atomic_read(&ha->fcp2_active_cmds)) {
+				if (IS_QLA82XX(ha))
+					set_bit(FCOE_CTX_RESET_NEEDED,
+						&vha->dpc_flags);
+				else
+					set_bit(ISP_ABORT_NEEDED,
+						&vha->dpc_flags);
 			}
 			start_dpc++;
 		}
@@ -7171,17 +7656,9 @@ qla2x00_timer(qla_timer_arg_t t)
 		qla_edif_timer(vha);
 
 	/* Process any deferred work. */
-	if (!list_empty(&vha->work_list)) {
-		unsigned long flags;
-		bool q = false;
-
-		spin_lock_irqsave(&vha->work_lock, flags);
-		if (!test_and_set_bit(IOCB_WORK_ACTIVE, &vha->dpc_flags))
-			q = true;
-		spin_unlock_irqrestore(&vha->work_lock, flags);
-		if (q)
-			queue_work(vha->hw->wq, &vha->iocb_work);
-	}
+	if (qla2x00_work_pending(vha) &&
+	    !test_and_set_bit(IOCB_WORK_ACTIVE, &vha->dpc_flags))
+		queue_work(vha->hw->wq, &vha->iocb_work);
 
 	/*
 	 * FC-NVME
@@ -7752,6 +8229,7 @@ qla2x00_module_init(void)
 	BUILD_BUG_ON(sizeof(struct cmd_type_7_fx00) != 64);
 	BUILD_BUG_ON(sizeof(struct cmd_type_crc_2) != 64);
 	BUILD_BUG_ON(sizeof(struct ct_entry_24xx) != 64);
+	BUILD_BUG_ON(sizeof(struct ctio_nvme_to_27xx) != 64);
 	BUILD_BUG_ON(sizeof(struct ctio_crc2_to_fw) != 64);
 	BUILD_BUG_ON(sizeof(struct els_entry_24xx) != 64);
 	BUILD_BUG_ON(sizeof(struct fxdisc_entry_fx00) != 64);
@@ -7762,6 +8240,27 @@ qla2x00_module_init(void)
 	BUILD_BUG_ON(sizeof(struct verify_chip_entry_84xx) != 64);
 	BUILD_BUG_ON(sizeof(struct vf_evfp_entry_24xx) != 56);
 
+	/* CRC_2 IOCB and the context firmware fetches through it */
+	BUILD_BUG_ON(offsetof(struct cmd_type_crc_2, fcp_cmnd_dseg_address) != 28);
+	BUILD_BUG_ON(offsetof(struct cmd_type_crc_2, byte_count) != 44);
+	BUILD_BUG_ON(offsetof(struct cmd_type_crc_2, crc_context_address) != 52);
+	BUILD_BUG_ON(offsetof(struct cmd_type_crc_2, crc_context_len) != 60);
+	BUILD_BUG_ON(offsetof(struct crc_context, ref_tag) != 4);
+	BUILD_BUG_ON(offsetof(struct crc_context, prot_opts) != 18);
+	BUILD_BUG_ON(offsetof(struct crc_context, blk_size) != 20);
+	BUILD_BUG_ON(offsetof(struct crc_context, byte_count) != 24);
+	BUILD_BUG_ON(offsetof(struct crc_context, u.bundling.dseg_count) != 34);
+	BUILD_BUG_ON(offsetof(struct crc_context, u.bundling.data_dsd) != 40);
+	BUILD_BUG_ON(offsetof(struct crc_context, u.bundling.dif_dsd) != 52);
+	BUILD_BUG_ON(offsetof(struct crc_context, u.nobundling.data_dsd) != 40);
+	BUILD_BUG_ON(CRC_CONTEXT_LEN_FW != 64);
+
+	/* FC-NVMe target IOCBs */
+	BUILD_BUG_ON(offsetof(struct ctio_nvme_to_27xx, flags) != 26);
+	BUILD_BUG_ON(offsetof(struct ctio_nvme_to_27xx, u.mode0.dsd) != 52);
+	BUILD_BUG_ON(offsetof(struct ctio_nvme_to_27xx, u.mode2.rsp_dsd) != 48);
+	BUILD_BUG_ON(offsetof(struct pt_ls4_request, ox_id) != 30);
+
 	/* Allocate cache for SRBs. */
 	srb_cachep = kmem_cache_create("qla2xxx_srbs", sizeof(srb_t), 0,
 	    SLAB_HWCACHE_ALIGN, NULL);
@@ -7785,6 +8284,10 @@ qla2x00_module_init(void)
 		qla2xxx_transport_vport_functions.disable_target_scan = 1;
 	}
 
+	ret = qla_nvmet_init();
+	if (ret)
+		goto tgt_exit;
+
 	/* Derive version string. */
 	strcpy(qla2x00_version_str, QLA2XXX_VERSION);
 	if (ql2xextended_error_logging)
@@ -7792,6 +8295,9 @@ qla2x00_module_init(void)
 	if (ql2xextended_error_logging == 1)
 		ql2xextended_error_logging = QL_DBG_DEFAULT1_MASK;
 
+	/* Failure only disables tracing, don't fail the load. */
+	qla2x00_trc_init();
+
 	if (ql2x_ini_mode == QLA2XXX_INI_MODE_DUAL)
 		qla_insert_tgt_attrs();
 
@@ -7839,6 +8345,10 @@ unreg_chrdev:
 	fc_release_transport(qla2xxx_transport_template);
 
 qlt_exit:
+	qla2x00_trc_free();
+	qla_nvmet_exit();
+
+tgt_exit:
 	qlt_exit();
 
 destroy_cache:
@@ -7859,6 +8369,8 @@ qla2x00_module_exit(void)
 	if (apidev_major >= 0)
 		unregister_chrdev(apidev_major, QLA2XXX_APIDEV);
 	fc_release_transport(qla2xxx_transport_template);
+	qla2x00_trc_free();
+	qla_nvmet_exit();
 	qlt_exit();
 	kmem_cache_destroy(srb_cachep);
 }
@@ -351,8 +351,14 @@ static bool qlt_24xx_atio_pkt_all_vps(struct scsi_qla_host *vha,
 	switch (atio->u.raw.entry_type) {
 	case ATIO_TYPE7:
 	{
-		struct scsi_qla_host *host = qla_find_host_by_d_id(vha,
-		    atio->u.isp24.fcp_hdr.d_id);
+		struct scsi_qla_host *host;
+
+		if (atio->u.isp24.fcp_hdr.type == FC_TYPE_NVME) {
+			qla_nvmet_handle_atio(vha, atio, ha_locked);
+			break;
+		}
+
+		host = qla_find_host_by_d_id(vha, atio->u.isp24.fcp_hdr.d_id);
 		if (unlikely(NULL == host)) {
 			ql_dbg(ql_dbg_tgt, vha, 0xe03e,
 			    "qla_target(%d): Received ATIO_TYPE7 "
@@ -1066,6 +1072,8 @@ void qlt_free_session_done(struct work_struct *work)
 			sess->nvme_flag |= NVME_FLAG_DELETING;
 			qla_nvme_unregister_remote_port(sess);
 		}
+
+		qla_nvmet_invalidate_host(vha, sess);
 	}
 
 	/*
@@ -1556,6 +1564,9 @@ int qlt_stop_phase1(struct qla_tgt *tgt)
 	struct qla_hw_data *ha = tgt->ha;
 	unsigned long flags;
 
+	/* No FC-NVMe without target mode; nvmet-fc drains its commands. */
+	qla_nvmet_delete(vha);
+
 	mutex_lock(&ha->optrom_mutex);
 	mutex_lock(&qla_tgt_mutex);
 
@@ -2237,6 +2248,12 @@ static void qlt_24xx_handle_abts(struct scsi_qla_host *vha,
 	    abts->fcp_hdr_le.s_id.area, abts->fcp_hdr_le.s_id.al_pa, tag,
 	    le32_to_cpu(abts->fcp_hdr_le.parameter));
 
+	if (qla_nvmet_handle_abts(vha, abts)) {
+		qlt_24xx_send_abts_resp(ha->base_qpair, abts, FCP_TMF_CMPL,
+		    false);
+		return;
+	}
+
 	s_id = le_id_to_be(abts->fcp_hdr_le.s_id);
 
 	spin_lock_irqsave(&ha->tgt.sess_lock, flags);
@@ -2526,7 +2543,6 @@ out_err:
 
 static void qlt_unmap_sg(struct scsi_qla_host *vha, struct qla_tgt_cmd *cmd)
 {
-	struct qla_hw_data *ha;
 	struct qla_qpair *qpair;
 
 	if (!cmd->sg_mapped)
@@ -2544,11 +2560,10 @@ static void qlt_unmap_sg(struct scsi_qla_host *vha, struct qla_tgt_cmd *cmd)
 
 	if (!cmd->ctx)
 		return;
-	ha = vha->hw;
 	if (cmd->ctx_dsd_alloced)
-		qla2x00_clean_dsd_pool(ha, cmd->ctx);
+		qla2x00_clean_dsd_pool(cmd->qpair, cmd->ctx);
 
-	dma_pool_free(ha->dl_dma_pool, cmd->ctx, cmd->ctx->crc_ctx_dma);
+	qla_crc_ctx_put(cmd->qpair, cmd->ctx);
 }
 
 static int qlt_check_reserve_free_req(struct qla_qpair *qpair,
@@ -3219,14 +3234,13 @@ qlt_build_ctio_crc2_pkt(struct qla_qpair *qpair, struct qla_tgt_prm *prm)
 
 	/* ----- CRC context -------- */
 
-	/* Allocate CRC context from global pool */
-	crc_ctx_pkt = cmd->ctx =
-	    dma_pool_zalloc(ha->dl_dma_pool, GFP_ATOMIC, &crc_ctx_dma);
+	/* Take a pre-mapped CRC context from the qpair cache */
+	crc_ctx_pkt = cmd->ctx = qla_crc_ctx_get(qpair);
 
 	if (!crc_ctx_pkt)
 		goto crc_queuing_error;
 
-	crc_ctx_pkt->crc_ctx_dma = crc_ctx_dma;
+	crc_ctx_dma = crc_ctx_pkt->crc_ctx_dma;
 	INIT_LIST_HEAD(&crc_ctx_pkt->dsd_list);
 
 	/* Set handle */
@@ -3265,6 +3279,7 @@ qlt_build_ctio_crc2_pkt(struct qla_qpair *qpair, struct qla_tgt_prm *prm)
 	tc.prot_sg = cmd->prot_sg;
 	tc.ctx = crc_ctx_pkt;
 	tc.ctx_dsd_alloced = &cmd->ctx_dsd_alloced;
+	tc.qpair = qpair;
 
 	/* Walks data segments */
 	pkt->flags |= cpu_to_le16(CTIO7_FLAGS_DSD_PTR);
@@ -3317,11 +3332,8 @@ int qlt_xmit_response(struct qla_tgt_cmd *cmd, int xmit_type,
 		goto free;
 	}
 
-	ql_dbg_qp(ql_dbg_tgt, qpair, 0xe018,
-	    "is_send_status=%d, cmd->bufflen=%d, cmd->sg_cnt=%d, cmd->dma_data_direction=%d se_cmd[%px] qp %d\n",
-	    (xmit_type & QLA_TGT_XMIT_STATUS) ?
-	    1 : 0, cmd->bufflen, cmd->sg_cnt, cmd->dma_data_direction,
-	    &cmd->se_cmd, qpair->id);
+	ql_trc(ql_dbg_tgt, vha, 0xe018, cmd->atio.u.isp24.exchange_addr,
+	    xmit_type, cmd->bufflen, cmd->sg_cnt);
 
 	res = qlt_pre_xmit_response(cmd, &prm, xmit_type, scsi_status,
 	    &full_req_cnt);
@@ -6949,6 +6961,14 @@ qlt_init_atio_q_entries(struct scsi_qla_host *vha)
 
 }
 
+/* Has the firmware posted the entry @n past the ATIO queue's out pointer? */
+static inline bool qlt_atio_entry_posted(struct qla_hw_data *ha, int n)
+{
+	u32 idx = (ha->tgt.atio_ring_index + n) % ha->tgt.atio_q_length;
+
+	return ha->tgt.atio_ring[idx].signature != ATIO_PROCESSED;
+}
+
 /*
  * qlt_24xx_process_atio_queue() - Process ATIO queue entries.
  * @ha: SCSI driver HA context
@@ -6968,6 +6988,14 @@ qlt_24xx_process_atio_queue(struct scsi_qla_host *vha, uint8_t ha_locked)
 		pkt = (struct atio_from_isp *)ha->tgt.atio_ring_ptr;
 		cnt = pkt->u.raw.entry_count;
 
+		/*
+		 * The firmware writes the entries of an ATIO in order: take
+		 * a multi-entry one (an FC-NVMe CMD IU, a long CDB) only once
+		 * its last entry has been posted.
+		 */
+		if (unlikely(cnt > 1) && !qlt_atio_entry_posted(ha, cnt - 1))
+			break;
+
 		if (unlikely(fcpcmd_is_corrupted(ha->tgt.atio_ring_ptr))) {
 			/*
 			 * This packet is corrupted. The header + payload